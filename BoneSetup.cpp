@@ -0,0 +1,479 @@
+//--------------------------------------------------------------------------------------
+// File: BoneSetup.cpp
+//
+// Skeleton and skinning helpers for studio models.
+//
+//--------------------------------------------------------------------------------------
+#include "DXUT.h"
+#include "BoneSetup.h"
+
+
+//--------------------------------------------------------------------------------------
+// Parents always come before their children in the bone table, so one forward pass
+// resolves the hierarchy.
+//--------------------------------------------------------------------------------------
+void Studio_BuildBindPose( const studiohdr_t* pStudioHdr, matrix3x4_t* pBoneToWorld )
+{
+	for( int i=0; i < pStudioHdr->numbones; i++ )
+	{
+		const mstudiobone_t* pBone = pStudioHdr->pBone( i );
+
+		matrix3x4_t boneToParent;
+		QuaternionMatrix( pBone->quat, pBone->pos, boneToParent );
+
+		if( pBone->parent == -1 )
+			pBoneToWorld[i] = boneToParent;
+		else
+			ConcatTransforms( pBoneToWorld[pBone->parent], boneToParent, pBoneToWorld[i] );
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+void Studio_BuildMatrices( const studiohdr_t* pStudioHdr, const Vector pos[], const Quaternion q[], matrix3x4_t* pBoneToWorld )
+{
+	for( int i=0; i < pStudioHdr->numbones; i++ )
+	{
+		int iParent = pStudioHdr->pBone( i )->parent;
+
+		matrix3x4_t boneToParent;
+		QuaternionMatrix( q[i], pos[i], boneToParent );
+
+		if( iParent == -1 )
+			pBoneToWorld[i] = boneToParent;
+		else
+			ConcatTransforms( pBoneToWorld[iParent], boneToParent, pBoneToWorld[i] );
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+void Studio_BuildSkinningMatrices( const studiohdr_t* pStudioHdr, const matrix3x4_t* pBoneToWorld, matrix3x4_t* pSkinning )
+{
+	for( int i=0; i < pStudioHdr->numbones; i++ )
+	{
+		ConcatTransforms( pBoneToWorld[i], pStudioHdr->pBone( i )->poseToBone, pSkinning[i] );
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+void Studio_SkinVertices( const mstudiovertex_t* pVertices, const int* pRemap, int numVertices,
+						  const matrix3x4_t* pSkinning, Vector* pPositions, Vector* pNormals )
+{
+	for( int i=0; i < numVertices; i++ )
+	{
+		const mstudiovertex_t& vert = pVertices[pRemap ? pRemap[i] : i];
+		const mstudioboneweight_t& weights = vert.m_BoneWeights;
+
+		// Most vertices follow a single bone
+		if( weights.numbones == 1 )
+		{
+			const matrix3x4_t& skin = pSkinning[weights.bone[0]];
+			VectorTransform( vert.m_vecPosition, skin, pPositions[i] );
+			if( pNormals )
+				VectorRotate( vert.m_vecNormal, skin, pNormals[i] );
+			continue;
+		}
+
+		// Blend the matrices, then transform once
+		matrix3x4_t blend;
+		memset( blend.m_flMatVal, 0, sizeof(blend.m_flMatVal) );
+		for( int j=0; j < weights.numbones; j++ )
+		{
+			const matrix3x4_t& skin = pSkinning[weights.bone[j]];
+			float w = weights.weight[j];
+			for( int r=0; r < 3; r++ )
+			{
+				blend[r][0] += skin[r][0] * w;
+				blend[r][1] += skin[r][1] * w;
+				blend[r][2] += skin[r][2] * w;
+				blend[r][3] += skin[r][3] * w;
+			}
+		}
+
+		VectorTransform( vert.m_vecPosition, blend, pPositions[i] );
+		if( pNormals )
+		{
+			VectorRotate( vert.m_vecNormal, blend, pNormals[i] );
+			D3DXVec3Normalize( &pNormals[i], &pNormals[i] );
+		}
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+// Pose parameters are kept normalized, so looping ones are already wrapped when set.
+//--------------------------------------------------------------------------------------
+void Studio_LocalPoseParameter( const studiohdr_t* pStudioHdr, const float poseParameter[], const mstudioseqdesc_t& seqdesc,
+								int iSequence, int iLocalIndex, float& flSetting, int& index )
+{
+	flSetting = 0.0f;
+	index = 0;
+
+	int iPose = pStudioHdr->GetSharedPoseParameter( iSequence, seqdesc.paramindex[iLocalIndex] );
+	if( iPose < 0 || iPose >= pStudioHdr->GetNumPoseParameters() )
+		return;
+
+	const mstudioposeparamdesc_t& pose = pStudioHdr->pPoseParameter( iPose );
+	float flValue = poseParameter[iPose];
+	int nGroup = seqdesc.groupsize[iLocalIndex];
+
+	if( seqdesc.posekeyindex == 0 )
+	{
+		// Evenly spaced blend cells between the sequence's start and end values
+		float flLocalStart = ( seqdesc.paramstart[iLocalIndex] - pose.start ) / ( pose.end - pose.start );
+		float flLocalEnd = ( seqdesc.paramend[iLocalIndex] - pose.start ) / ( pose.end - pose.start );
+		flSetting = ( flValue - flLocalStart ) / ( flLocalEnd - flLocalStart );
+		if( !( flSetting > 0.0f ) )
+			flSetting = 0.0f;
+		if( flSetting > 1.0f )
+			flSetting = 1.0f;
+
+		if( nGroup > 2 )
+		{
+			index = (int)( flSetting * ( nGroup - 1 ) );
+			if( index == nGroup - 1 )
+				index = nGroup - 2;
+			flSetting = flSetting * ( nGroup - 1 ) - index;
+		}
+	}
+	else
+	{
+		// Explicit key values per cell
+		flValue = flValue * ( pose.end - pose.start ) + pose.start;
+		for( ;; )
+		{
+			flSetting = ( flValue - seqdesc.poseKey( iLocalIndex, index ) ) /
+						( seqdesc.poseKey( iLocalIndex, index + 1 ) - seqdesc.poseKey( iLocalIndex, index ) );
+			if( index < nGroup - 2 && flSetting > 1.0f )
+			{
+				index++;
+				continue;
+			}
+			break;
+		}
+		if( flSetting < 0.0f )
+			flSetting = 0.0f;
+		if( flSetting > 1.0f )
+			flSetting = 1.0f;
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+void Studio_SeqAnims( const studiohdr_t* pStudioHdr, const mstudioseqdesc_t& seqdesc, int iSequence,
+					  const float poseParameter[], int iAnim[4], float flWeight[4] )
+{
+	int i0 = 0;
+	int i1 = 0;
+	float s0 = 0.0f;
+	float s1 = 0.0f;
+
+	Studio_LocalPoseParameter( pStudioHdr, poseParameter, seqdesc, iSequence, 0, s0, i0 );
+	Studio_LocalPoseParameter( pStudioHdr, poseParameter, seqdesc, iSequence, 1, s1, i1 );
+
+	iAnim[0] = pStudioHdr->iRelativeAnim( iSequence, seqdesc.anim( i0    , i1     ) );
+	iAnim[1] = pStudioHdr->iRelativeAnim( iSequence, seqdesc.anim( i0 + 1, i1     ) );
+	iAnim[2] = pStudioHdr->iRelativeAnim( iSequence, seqdesc.anim( i0    , i1 + 1 ) );
+	iAnim[3] = pStudioHdr->iRelativeAnim( iSequence, seqdesc.anim( i0 + 1, i1 + 1 ) );
+
+	flWeight[0] = ( 1.0f - s0 ) * ( 1.0f - s1 );
+	flWeight[1] = s0 * ( 1.0f - s1 );
+	flWeight[2] = ( 1.0f - s0 ) * s1;
+	flWeight[3] = s0 * s1;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Values of a run-length encoded channel at frame and frame + 1
+//--------------------------------------------------------------------------------------
+static void ExtractAnimValue( int frame, const mstudioanimvalue_t* panimvalue, float scale, float& v1, float& v2 )
+{
+	if( !panimvalue )
+	{
+		v1 = v2 = 0.0f;
+		return;
+	}
+
+	// A constant channel
+	if( panimvalue->num.total == 1 && panimvalue->num.valid == 1 )
+	{
+		v1 = v2 = panimvalue[1].value * scale;
+		return;
+	}
+
+	// Find the run holding the frame
+	int k = frame;
+	while( panimvalue->num.total <= k )
+	{
+		k -= panimvalue->num.total;
+		panimvalue += panimvalue->num.valid + 1;
+		if( panimvalue->num.total == 0 )
+		{
+			// Ran off the end of the stream
+			v1 = v2 = 0.0f;
+			return;
+		}
+	}
+
+	if( panimvalue->num.valid > k )
+	{
+		v1 = panimvalue[k + 1].value * scale;
+		if( panimvalue->num.valid > k + 1 )
+			v2 = panimvalue[k + 2].value * scale;
+		else if( panimvalue->num.total > k + 1 )
+			v2 = v1;    // the last value repeats
+		else
+			v2 = panimvalue[panimvalue->num.valid + 2].value * scale;   // first value of the next run
+	}
+	else
+	{
+		v1 = panimvalue[panimvalue->num.valid].value * scale;
+		if( panimvalue->num.total > k + 1 )
+			v2 = v1;
+		else
+			v2 = panimvalue[panimvalue->num.valid + 2].value * scale;
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+static void ExtractAnimValue( int frame, const mstudioanimvalue_t* panimvalue, float scale, float& v1 )
+{
+	if( !panimvalue )
+	{
+		v1 = 0.0f;
+		return;
+	}
+
+	int k = frame;
+	while( panimvalue->num.total <= k )
+	{
+		k -= panimvalue->num.total;
+		panimvalue += panimvalue->num.valid + 1;
+		if( panimvalue->num.total == 0 )
+		{
+			v1 = 0.0f;
+			return;
+		}
+	}
+
+	if( panimvalue->num.valid > k )
+		v1 = panimvalue[k + 1].value * scale;
+	else
+		v1 = panimvalue[panimvalue->num.valid].value * scale;
+}
+
+
+//--------------------------------------------------------------------------------------
+static void CalcBoneQuaternion( int frame, float s, const mstudiobone_t* pBone, const mstudioanim_t* panim, Quaternion& q )
+{
+	if( panim->flags & STUDIO_ANIM_RAWROT )
+	{
+		q = *panim->pQuat();
+		return;
+	}
+
+	if( !( panim->flags & STUDIO_ANIM_ANIMROT ) )
+	{
+		if( panim->flags & STUDIO_ANIM_DELTA )
+			q = Quaternion( 0.0f, 0.0f, 0.0f, 1.0f );
+		else
+			q = pBone->quat;
+		return;
+	}
+
+	const mstudioanim_valueptr_t* pRotV = panim->pRotV();
+	if( s > 0.001f )
+	{
+		RadianEuler angle1, angle2;
+		ExtractAnimValue( frame, pRotV->pAnimvalue( 0 ), pBone->rotscale.x, angle1.x, angle2.x );
+		ExtractAnimValue( frame, pRotV->pAnimvalue( 1 ), pBone->rotscale.y, angle1.y, angle2.y );
+		ExtractAnimValue( frame, pRotV->pAnimvalue( 2 ), pBone->rotscale.z, angle1.z, angle2.z );
+
+		if( !( panim->flags & STUDIO_ANIM_DELTA ) )
+		{
+			angle1 += pBone->rot;
+			angle2 += pBone->rot;
+		}
+
+		if( angle1 != angle2 )
+		{
+			Quaternion q1, q2;
+			AngleQuaternion( angle1, q1 );
+			AngleQuaternion( angle2, q2 );
+			QuaternionBlend( q1, q2, s, q );
+		}
+		else
+		{
+			AngleQuaternion( angle1, q );
+		}
+	}
+	else
+	{
+		RadianEuler angle;
+		ExtractAnimValue( frame, pRotV->pAnimvalue( 0 ), pBone->rotscale.x, angle.x );
+		ExtractAnimValue( frame, pRotV->pAnimvalue( 1 ), pBone->rotscale.y, angle.y );
+		ExtractAnimValue( frame, pRotV->pAnimvalue( 2 ), pBone->rotscale.z, angle.z );
+
+		if( !( panim->flags & STUDIO_ANIM_DELTA ) )
+			angle += pBone->rot;
+
+		AngleQuaternion( angle, q );
+	}
+
+	// Keep fixed alignment bones on the same side as their reference rotation
+	if( !( panim->flags & STUDIO_ANIM_DELTA ) && ( pBone->flags & BONE_FIXED_ALIGNMENT ) )
+		QuaternionAlign( pBone->qAlignment, q, q );
+}
+
+
+//--------------------------------------------------------------------------------------
+static void CalcBonePosition( int frame, float s, const mstudiobone_t* pBone, const mstudioanim_t* panim, Vector& pos )
+{
+	if( panim->flags & STUDIO_ANIM_RAWPOS )
+	{
+		pos = *panim->pPos();
+		return;
+	}
+
+	if( !( panim->flags & STUDIO_ANIM_ANIMPOS ) )
+	{
+		if( panim->flags & STUDIO_ANIM_DELTA )
+			pos = Vector( 0.0f, 0.0f, 0.0f );
+		else
+			pos = pBone->pos;
+		return;
+	}
+
+	const mstudioanim_valueptr_t* pPosV = panim->pPosV();
+	if( s > 0.001f )
+	{
+		for( int j=0; j < 3; j++ )
+		{
+			float v1, v2;
+			ExtractAnimValue( frame, pPosV->pAnimvalue( j ), pBone->posscale[j], v1, v2 );
+			pos[j] = v1 * ( 1.0f - s ) + v2 * s;
+		}
+	}
+	else
+	{
+		for( int j=0; j < 3; j++ )
+			ExtractAnimValue( frame, pPosV->pAnimvalue( j ), pBone->posscale[j], pos[j] );
+	}
+
+	if( !( panim->flags & STUDIO_ANIM_DELTA ) )
+		pos += pBone->pos;
+}
+
+
+//--------------------------------------------------------------------------------------
+// The bone entries of an animation are sorted by bone index and only list animated
+// bones, the rest keep their reference pose.
+//--------------------------------------------------------------------------------------
+void Studio_CalcAnimation( const studiohdr_t* pStudioHdr, int iAnim, float flCycle,
+						   Vector pos[], Quaternion q[], int boneMask )
+{
+	const mstudioanimdesc_t& animdesc = pStudioHdr->pAnimdesc( iAnim );
+
+	float fFrame = flCycle * ( animdesc.numframes - 1 );
+	int iFrame = (int)fFrame;
+	float s = fFrame - iFrame;
+
+	const mstudioanim_t* panim = animdesc.pAnim();
+	for( int i=0; i < pStudioHdr->numbones; i++ )
+	{
+		const mstudiobone_t* pBone = pStudioHdr->pBone( i );
+		bool bUsed = ( pBone->flags & boneMask ) != 0;
+
+		if( panim && panim->bone == i )
+		{
+			if( bUsed )
+			{
+				CalcBoneQuaternion( iFrame, s, pBone, panim, q[i] );
+				CalcBonePosition( iFrame, s, pBone, panim, pos[i] );
+			}
+			panim = panim->pNext();
+		}
+		else if( bUsed )
+		{
+			if( animdesc.flags & STUDIO_DELTA )
+			{
+				q[i] = Quaternion( 0.0f, 0.0f, 0.0f, 1.0f );
+				pos[i] = Vector( 0.0f, 0.0f, 0.0f );
+			}
+			else
+			{
+				q[i] = pBone->quat;
+				pos[i] = pBone->pos;
+			}
+		}
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+void Studio_BlendPoses( const studiohdr_t* pStudioHdr, int nPoses, const Vector* const* ppPos, const Quaternion* const* ppQ,
+						const float* pflWeight, Vector pos[], Quaternion q[], int boneMask )
+{
+	for( int i=0; i < pStudioHdr->numbones; i++ )
+	{
+		if( !( pStudioHdr->pBone( i )->flags & boneMask ) )
+			continue;
+
+		const Quaternion& q0 = ppQ[0][i];
+		Vector p( 0.0f, 0.0f, 0.0f );
+		Quaternion r( 0.0f, 0.0f, 0.0f, 0.0f );
+		for( int n=0; n < nPoses; n++ )
+		{
+			float w = pflWeight[n];
+			Quaternion qn;
+			QuaternionAlign( q0, ppQ[n][i], qn );
+			p += w * ppPos[n][i];
+			r += w * qn;
+		}
+		QuaternionNormalize( r );
+		pos[i] = p;
+		q[i] = r;
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+void Studio_CalcPose( const studiohdr_t* pStudioHdr, int iSequence, float flCycle, const float poseParameter[],
+					  Vector pos[], Quaternion q[], int boneMask )
+{
+	int iAnim[4];
+	float flWeight[4];
+	Studio_SeqAnims( pStudioHdr, pStudioHdr->pSeqdesc( iSequence ), iSequence, poseParameter, iAnim, flWeight );
+
+	// Most sequences don't blend, or sit exactly on a blend cell
+	int nPoses = 0;
+	for( int i=0; i < 4; i++ )
+	{
+		if( flWeight[i] > 0.001f )
+		{
+			iAnim[nPoses] = iAnim[i];
+			flWeight[nPoses] = flWeight[i];
+			nPoses++;
+		}
+	}
+	if( nPoses <= 1 )
+	{
+		Studio_CalcAnimation( pStudioHdr, iAnim[0], flCycle, pos, q, boneMask );
+		return;
+	}
+
+	Vector blendPos[4][MAXSTUDIOBONES];
+	Quaternion blendQ[4][MAXSTUDIOBONES];
+	const Vector* ppPos[4];
+	const Quaternion* ppQ[4];
+	for( int i=0; i < nPoses; i++ )
+	{
+		Studio_CalcAnimation( pStudioHdr, iAnim[i], flCycle, blendPos[i], blendQ[i], boneMask );
+		ppPos[i] = blendPos[i];
+		ppQ[i] = blendQ[i];
+	}
+	Studio_BlendPoses( pStudioHdr, nPoses, ppPos, ppQ, flWeight, pos, q, boneMask );
+}
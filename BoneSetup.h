@@ -0,0 +1,49 @@
+//--------------------------------------------------------------------------------------
+// File: BoneSetup.h
+//
+// Skeleton and skinning helpers for studio models: building bone-to-world transforms,
+// turning them into skinning matrices and skinning mstudiovertex_t data on the CPU.
+//
+//--------------------------------------------------------------------------------------
+#pragma once
+#include "studio.h"
+#include "mathlib.h"
+
+// Bone-to-world transforms of the reference pose, from each bone's default pos/quat
+void Studio_BuildBindPose( const studiohdr_t* pStudioHdr, matrix3x4_t* pBoneToWorld );
+
+// Bone-to-world transforms from parent-relative positions and rotations, in bone order.
+// Procedural bones are left as plain children of their parent, see CStudioProceduralBones.
+void Studio_BuildMatrices( const studiohdr_t* pStudioHdr, const Vector pos[], const Quaternion q[], matrix3x4_t* pBoneToWorld );
+
+// Skinning matrices take bind pose vertices straight to the posed model space
+void Studio_BuildSkinningMatrices( const studiohdr_t* pStudioHdr, const matrix3x4_t* pBoneToWorld, matrix3x4_t* pSkinning );
+
+// Skins numVertices vertices. pRemap, if given, selects the source vertex for each output
+// vertex. pNormals may be NULL when only positions are needed.
+void Studio_SkinVertices( const mstudiovertex_t* pVertices, const int* pRemap, int numVertices,
+						  const matrix3x4_t* pSkinning, Vector* pPositions, Vector* pNormals );
+
+// Position of a normalized (0..1) pose parameter within the sequence's blend axis
+// iLocalIndex: the blend cell index and the weight towards the next cell
+void Studio_LocalPoseParameter( const studiohdr_t* pStudioHdr, const float poseParameter[], const mstudioseqdesc_t& seqdesc,
+								int iSequence, int iLocalIndex, float& flSetting, int& index );
+
+// The up to four animations of the blend grid cell the pose parameters fall in, with
+// their bilinear weights. Returns animation indices for studiohdr_t::pAnimdesc.
+void Studio_SeqAnims( const studiohdr_t* pStudioHdr, const mstudioseqdesc_t& seqdesc, int iSequence,
+					  const float poseParameter[], int iAnim[4], float flWeight[4] );
+
+// Parent-relative positions and rotations of one animation at a cycle (0..1), decoded
+// from the run-length encoded mstudioanim_t streams. Only bones with a flag in
+// boneMask are written.
+void Studio_CalcAnimation( const studiohdr_t* pStudioHdr, int iAnim, float flCycle,
+						   Vector pos[], Quaternion q[], int boneMask = BONE_USED_BY_ANYTHING );
+
+// Weighted sum of nPoses poses, rotations aligned to the first pose and renormalized
+void Studio_BlendPoses( const studiohdr_t* pStudioHdr, int nPoses, const Vector* const* ppPos, const Quaternion* const* ppQ,
+						const float* pflWeight, Vector pos[], Quaternion q[], int boneMask = BONE_USED_BY_ANYTHING );
+
+// Pose of a sequence at a cycle, blended across its animations by the pose parameters
+void Studio_CalcPose( const studiohdr_t* pStudioHdr, int iSequence, float flCycle, const float poseParameter[],
+					  Vector pos[], Quaternion q[], int boneMask = BONE_USED_BY_ANYTHING );
@@ -0,0 +1,880 @@
+//--------------------------------------------------------------------------------------
+// File: MeshBVH.cpp
+//
+// Bounding volume hierarchy over the triangles of a loaded mesh. The tree is built top
+// down with a binned surface area heuristic into 32 byte binary nodes, and can be
+// collapsed into 4-wide nodes whose children are tested together with SSE.
+//
+//--------------------------------------------------------------------------------------
+#include "DXUT.h"
+#include "MeshBVH.h"
+#include <xmmintrin.h>
+
+
+struct BVHBuildEntry
+{
+	int iNode;
+	int iFirst;
+	int nCount;
+	int nDepth;
+};
+
+struct BVHStackEntry
+{
+	int   iNode;
+	float fDist;
+};
+
+
+//--------------------------------------------------------------------------------------
+static inline float SurfaceArea( const D3DXVECTOR3& vMin, const D3DXVECTOR3& vMax )
+{
+	D3DXVECTOR3 d = vMax - vMin;
+	return 2.0f * ( d.x * d.y + d.y * d.z + d.z * d.x );
+}
+
+
+//--------------------------------------------------------------------------------------
+static inline void GrowBounds( D3DXVECTOR3* pMin, D3DXVECTOR3* pMax, const D3DXVECTOR3& vMin, const D3DXVECTOR3& vMax )
+{
+	D3DXVec3Minimize( pMin, pMin, &vMin );
+	D3DXVec3Maximize( pMax, pMax, &vMax );
+}
+
+
+//--------------------------------------------------------------------------------------
+static inline void TriangleBounds( const BVHTriangle& tri, D3DXVECTOR3* pMin, D3DXVECTOR3* pMax )
+{
+	D3DXVECTOR3 v1 = tri.v0 + tri.vEdge1;
+	D3DXVECTOR3 v2 = tri.v0 + tri.vEdge2;
+	D3DXVec3Minimize( pMin, &tri.v0, &v1 );
+	D3DXVec3Minimize( pMin, pMin, &v2 );
+	D3DXVec3Maximize( pMax, &tri.v0, &v1 );
+	D3DXVec3Maximize( pMax, pMax, &v2 );
+}
+
+
+//--------------------------------------------------------------------------------------
+// Avoid infinities and NaNs in the slab test for axis aligned rays
+//--------------------------------------------------------------------------------------
+static inline D3DXVECTOR3 SafeInverse( const D3DXVECTOR3& vDir )
+{
+	const float fTiny = 1e-20f;
+	D3DXVECTOR3 vInv;
+	vInv.x = 1.0f / ( fabsf( vDir.x ) > fTiny ? vDir.x : ( vDir.x < 0.0f ? -fTiny : fTiny ) );
+	vInv.y = 1.0f / ( fabsf( vDir.y ) > fTiny ? vDir.y : ( vDir.y < 0.0f ? -fTiny : fTiny ) );
+	vInv.z = 1.0f / ( fabsf( vDir.z ) > fTiny ? vDir.z : ( vDir.z < 0.0f ? -fTiny : fTiny ) );
+	return vInv;
+}
+
+
+//--------------------------------------------------------------------------------------
+static inline bool IntersectBox( const D3DXVECTOR3& vMin, const D3DXVECTOR3& vMax, const D3DXVECTOR3& vOrigin,
+								 const D3DXVECTOR3& vInvDir, float fMaxDist, float* pDist )
+{
+	float tx0 = ( vMin.x - vOrigin.x ) * vInvDir.x;
+	float tx1 = ( vMax.x - vOrigin.x ) * vInvDir.x;
+	float ty0 = ( vMin.y - vOrigin.y ) * vInvDir.y;
+	float ty1 = ( vMax.y - vOrigin.y ) * vInvDir.y;
+	float tz0 = ( vMin.z - vOrigin.z ) * vInvDir.z;
+	float tz1 = ( vMax.z - vOrigin.z ) * vInvDir.z;
+
+	float tmin = __max( __max( __min( tx0, tx1 ), __min( ty0, ty1 ) ), __max( __min( tz0, tz1 ), 0.0f ) );
+	float tmax = __min( __min( __max( tx0, tx1 ), __max( ty0, ty1 ) ), __min( __max( tz0, tz1 ), fMaxDist ) );
+	*pDist = tmin;
+	return tmin <= tmax;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Two sided Moller-Trumbore test
+//--------------------------------------------------------------------------------------
+static inline bool IntersectTriangle( const BVHTriangle& tri, const D3DXVECTOR3& vOrigin, const D3DXVECTOR3& vDir,
+									  float fMaxDist, float* pDist, float* pU, float* pV )
+{
+	D3DXVECTOR3 p;
+	D3DXVec3Cross( &p, &vDir, &tri.vEdge2 );
+	float det = D3DXVec3Dot( &tri.vEdge1, &p );
+	if( det == 0.0f )
+		return false;
+	float invDet = 1.0f / det;
+
+	D3DXVECTOR3 s = vOrigin - tri.v0;
+	float u = D3DXVec3Dot( &s, &p ) * invDet;
+	if( u < 0.0f || u > 1.0f )
+		return false;
+
+	D3DXVECTOR3 q;
+	D3DXVec3Cross( &q, &s, &tri.vEdge1 );
+	float v = D3DXVec3Dot( &vDir, &q ) * invDet;
+	if( v < 0.0f || u + v > 1.0f )
+		return false;
+
+	float t = D3DXVec3Dot( &tri.vEdge2, &q ) * invDet;
+	if( t < 0.0f || t > fMaxDist )
+		return false;
+
+	*pDist = t;
+	*pU = u;
+	*pV = v;
+	return true;
+}
+
+
+//--------------------------------------------------------------------------------------
+CMeshBVH::CMeshBVH()
+{
+	m_pNodes = NULL;
+	m_nNodes = 0;
+	m_pNodes4 = NULL;
+	m_nNodes4 = 0;
+	m_pTriangles = NULL;
+	m_nTriangles = 0;
+	m_pTriangleVerts = NULL;
+	m_nVertices = 0;
+	m_dwBuildFlags = 0;
+	m_fBuildSAHCost = 0.0f;
+	ZeroMemory( &m_Stats, sizeof(m_Stats) );
+}
+
+
+//--------------------------------------------------------------------------------------
+CMeshBVH::~CMeshBVH()
+{
+	Destroy();
+}
+
+
+//--------------------------------------------------------------------------------------
+void CMeshBVH::Destroy()
+{
+	SAFE_DELETE_ARRAY( m_pNodes );
+	SAFE_DELETE_ARRAY( m_pNodes4 );
+	SAFE_DELETE_ARRAY( m_pTriangles );
+	SAFE_DELETE_ARRAY( m_pTriangleVerts );
+	m_nNodes = 0;
+	m_nNodes4 = 0;
+	m_nTriangles = 0;
+	m_nVertices = 0;
+	m_dwBuildFlags = 0;
+	m_fBuildSAHCost = 0.0f;
+	ZeroMemory( &m_Stats, sizeof(m_Stats) );
+}
+
+
+//--------------------------------------------------------------------------------------
+// Copies the triangles out of an indexed triangle list and builds the hierarchy.
+// pPositions is read with uStride bytes between vertices, so it can point straight
+// into an interleaved vertex array.
+//--------------------------------------------------------------------------------------
+HRESULT CMeshBVH::Build( const D3DXVECTOR3* pPositions, UINT uStride, int numVertices,
+						 const unsigned short* pIndices, int numIndices, const DWORD* pAttributes, DWORD dwFlags )
+{
+	Destroy();
+
+	if( pPositions == NULL || pIndices == NULL || numIndices < 3 )
+		return E_INVALIDARG;
+
+	m_nTriangles = numIndices / 3;
+	m_nVertices = numVertices;
+	m_pTriangles = new BVHTriangle[m_nTriangles];
+	m_pTriangleVerts = new int[m_nTriangles * 3];
+	if( m_pTriangles == NULL || m_pTriangleVerts == NULL )
+	{
+		Destroy();
+		return E_OUTOFMEMORY;
+	}
+
+	const BYTE* pBase = (const BYTE*)pPositions;
+	for( int i=0; i < m_nTriangles; i++ )
+	{
+		int i0 = pIndices[i*3];
+		int i1 = pIndices[i*3+1];
+		int i2 = pIndices[i*3+2];
+		if( i0 >= numVertices || i1 >= numVertices || i2 >= numVertices )
+		{
+			Destroy();
+			return E_INVALIDARG;
+		}
+
+		const D3DXVECTOR3& p0 = *(const D3DXVECTOR3*)( pBase + i0 * uStride );
+		const D3DXVECTOR3& p1 = *(const D3DXVECTOR3*)( pBase + i1 * uStride );
+		const D3DXVECTOR3& p2 = *(const D3DXVECTOR3*)( pBase + i2 * uStride );
+
+		BVHTriangle& tri = m_pTriangles[i];
+		tri.v0 = p0;
+		tri.vEdge1 = p1 - p0;
+		tri.vEdge2 = p2 - p0;
+		tri.iTriangle = i;
+		tri.iSubset = pAttributes ? pAttributes[i] : 0;
+		tri.dwPad = 0;
+
+		m_pTriangleVerts[i*3]   = i0;
+		m_pTriangleVerts[i*3+1] = i1;
+		m_pTriangleVerts[i*3+2] = i2;
+	}
+
+	return Rebuild( dwFlags );
+}
+
+
+//--------------------------------------------------------------------------------------
+// Builds the hierarchy again over the triangles currently held by the tree
+//--------------------------------------------------------------------------------------
+HRESULT CMeshBVH::Rebuild( DWORD dwFlags )
+{
+	if( m_pTriangles == NULL )
+		return E_FAIL;
+
+	LARGE_INTEGER qwStart, qwEnd, qwFreq;
+	QueryPerformanceFrequency( &qwFreq );
+	QueryPerformanceCounter( &qwStart );
+
+	SAFE_DELETE_ARRAY( m_pNodes );
+	SAFE_DELETE_ARRAY( m_pNodes4 );
+	m_nNodes = 0;
+	m_nNodes4 = 0;
+
+	int nMaxDepth = BuildNodes();
+	if( nMaxDepth < 0 )
+		return E_OUTOFMEMORY;
+
+	if( dwFlags & BVH_BUILD_WIDE )
+	{
+		m_pNodes4 = new BVHNode4[m_nNodes];
+		if( m_pNodes4 == NULL )
+			return E_OUTOFMEMORY;
+		CollapseNode( 0 );
+	}
+
+	QueryPerformanceCounter( &qwEnd );
+
+	m_dwBuildFlags = dwFlags;
+	m_fBuildSAHCost = ComputeSAHCost( &m_Stats.nLeaves );
+
+	m_Stats.nNodes = m_pNodes4 ? m_nNodes4 : m_nNodes;
+	m_Stats.nMaxDepth = nMaxDepth;
+	m_Stats.fSAHCost = m_fBuildSAHCost;
+	m_Stats.fBuildTime = (double)( qwEnd.QuadPart - qwStart.QuadPart ) / (double)qwFreq.QuadPart;
+	m_Stats.nRefits = 0;
+
+	return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Keeps the topology and only recomputes bounds, which is far cheaper than a build but
+// lets the tree degrade as triangles move away from their original neighbours.
+//--------------------------------------------------------------------------------------
+HRESULT CMeshBVH::Refit( const D3DXVECTOR3* pPositions, UINT uStride, int numVertices )
+{
+	if( m_pNodes == NULL )
+		return E_FAIL;
+	if( pPositions == NULL || numVertices != m_nVertices )
+		return E_INVALIDARG;
+
+	LARGE_INTEGER qwStart, qwEnd, qwFreq;
+	QueryPerformanceFrequency( &qwFreq );
+	QueryPerformanceCounter( &qwStart );
+
+	const BYTE* pBase = (const BYTE*)pPositions;
+	for( int i=0; i < m_nTriangles; i++ )
+	{
+		const D3DXVECTOR3& p0 = *(const D3DXVECTOR3*)( pBase + m_pTriangleVerts[i*3] * uStride );
+		const D3DXVECTOR3& p1 = *(const D3DXVECTOR3*)( pBase + m_pTriangleVerts[i*3+1] * uStride );
+		const D3DXVECTOR3& p2 = *(const D3DXVECTOR3*)( pBase + m_pTriangleVerts[i*3+2] * uStride );
+
+		BVHTriangle& tri = m_pTriangles[i];
+		tri.v0 = p0;
+		tri.vEdge1 = p1 - p0;
+		tri.vEdge2 = p2 - p0;
+	}
+
+	// Children always have higher indices than their parent, so walking the nodes
+	// backwards visits every child before its parent
+	for( int i=m_nNodes - 1; i >= 0; i-- )
+	{
+		BVHNode& node = m_pNodes[i];
+		if( node.nTriangles )
+		{
+			TriangleBounds( m_pTriangles[node.iLeftFirst], &node.vMin, &node.vMax );
+			for( int t=node.iLeftFirst + 1; t < node.iLeftFirst + node.nTriangles; t++ )
+			{
+				D3DXVECTOR3 vMin, vMax;
+				TriangleBounds( m_pTriangles[t], &vMin, &vMax );
+				GrowBounds( &node.vMin, &node.vMax, vMin, vMax );
+			}
+		}
+		else
+		{
+			const BVHNode& left = m_pNodes[node.iLeftFirst];
+			const BVHNode& right = m_pNodes[node.iLeftFirst + 1];
+			D3DXVec3Minimize( &node.vMin, &left.vMin, &right.vMin );
+			D3DXVec3Maximize( &node.vMax, &left.vMax, &right.vMax );
+		}
+	}
+
+	if( m_pNodes4 )
+	{
+		m_nNodes4 = 0;
+		CollapseNode( 0 );
+	}
+
+	float fCost = ComputeSAHCost( NULL );
+
+	QueryPerformanceCounter( &qwEnd );
+	m_Stats.fRefitTime = (double)( qwEnd.QuadPart - qwStart.QuadPart ) / (double)qwFreq.QuadPart;
+
+	if( fCost > m_fBuildSAHCost * BVH_REFIT_REBUILD_RATIO )
+	{
+		HRESULT hr = Rebuild( m_dwBuildFlags );
+		return FAILED( hr ) ? hr : S_FALSE;
+	}
+
+	m_Stats.fSAHCost = fCost;
+	m_Stats.nRefits++;
+	return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+// SAH cost of the binary tree relative to the root, counting a traversal step the same
+// as a triangle test
+//--------------------------------------------------------------------------------------
+float CMeshBVH::ComputeSAHCost( int* pnLeaves ) const
+{
+	float fInteriorArea = 0.0f;
+	float fLeafArea = 0.0f;
+	int nLeaves = 0;
+	for( int i=0; i < m_nNodes; i++ )
+	{
+		const BVHNode& node = m_pNodes[i];
+		float fArea = SurfaceArea( node.vMin, node.vMax );
+		if( node.nTriangles )
+		{
+			fLeafArea += fArea * node.nTriangles;
+			nLeaves++;
+		}
+		else
+		{
+			fInteriorArea += fArea;
+		}
+	}
+
+	if( pnLeaves )
+		*pnLeaves = nLeaves;
+
+	float fRootArea = SurfaceArea( m_pNodes[0].vMin, m_pNodes[0].vMax );
+	return fRootArea > 0.0f ? ( fInteriorArea + fLeafArea ) / fRootArea : 0.0f;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Top down binned SAH build. Returns the depth of the tree, or -1 on failure.
+//--------------------------------------------------------------------------------------
+int CMeshBVH::BuildNodes()
+{
+	int nTris = m_nTriangles;
+	D3DXVECTOR3* pTriMin = new D3DXVECTOR3[nTris];
+	D3DXVECTOR3* pTriMax = new D3DXVECTOR3[nTris];
+	D3DXVECTOR3* pCentroid = new D3DXVECTOR3[nTris];
+	int* pOrder = new int[nTris];
+	m_pNodes = new BVHNode[nTris * 2 - 1];
+	if( !pTriMin || !pTriMax || !pCentroid || !pOrder || !m_pNodes )
+	{
+		SAFE_DELETE_ARRAY( pTriMin );
+		SAFE_DELETE_ARRAY( pTriMax );
+		SAFE_DELETE_ARRAY( pCentroid );
+		SAFE_DELETE_ARRAY( pOrder );
+		SAFE_DELETE_ARRAY( m_pNodes );
+		return -1;
+	}
+
+	for( int i=0; i < nTris; i++ )
+	{
+		TriangleBounds( m_pTriangles[i], &pTriMin[i], &pTriMax[i] );
+		pCentroid[i] = ( pTriMin[i] + pTriMax[i] ) * 0.5f;
+		pOrder[i] = i;
+	}
+
+	BVHBuildEntry stack[BVH_MAX_DEPTH + 1];
+	int nStack = 0;
+	int nMaxDepth = 0;
+
+	m_nNodes = 1;
+	stack[nStack].iNode = 0;
+	stack[nStack].iFirst = 0;
+	stack[nStack].nCount = nTris;
+	stack[nStack].nDepth = 1;
+	nStack++;
+
+	while( nStack > 0 )
+	{
+		BVHBuildEntry entry = stack[--nStack];
+		BVHNode& node = m_pNodes[entry.iNode];
+		nMaxDepth = __max( nMaxDepth, entry.nDepth );
+
+		D3DXVECTOR3 vCentroidMin( FLT_MAX, FLT_MAX, FLT_MAX );
+		D3DXVECTOR3 vCentroidMax( -FLT_MAX, -FLT_MAX, -FLT_MAX );
+		node.vMin = vCentroidMin;
+		node.vMax = vCentroidMax;
+		for( int i=entry.iFirst; i < entry.iFirst + entry.nCount; i++ )
+		{
+			GrowBounds( &node.vMin, &node.vMax, pTriMin[pOrder[i]], pTriMax[pOrder[i]] );
+			GrowBounds( &vCentroidMin, &vCentroidMax, pCentroid[pOrder[i]], pCentroid[pOrder[i]] );
+		}
+
+		int iMid = -1;
+		if( entry.nCount > 1 && entry.nDepth < BVH_MAX_DEPTH )
+		{
+			// Find the cheapest bin boundary over all three axes
+			float fBestCost = FLT_MAX;
+			int iBestAxis = -1;
+			int iBestBin = 0;
+			for( int iAxis=0; iAxis < 3; iAxis++ )
+			{
+				float fLo = ((const float*)vCentroidMin)[iAxis];
+				float fExtent = ((const float*)vCentroidMax)[iAxis] - fLo;
+				if( fExtent <= 0.0f )
+					continue;
+				float fScale = BVH_NUM_BINS * 0.9999f / fExtent;
+
+				int nBinCount[BVH_NUM_BINS];
+				D3DXVECTOR3 vBinMin[BVH_NUM_BINS];
+				D3DXVECTOR3 vBinMax[BVH_NUM_BINS];
+				for( int b=0; b < BVH_NUM_BINS; b++ )
+				{
+					nBinCount[b] = 0;
+					vBinMin[b] = D3DXVECTOR3( FLT_MAX, FLT_MAX, FLT_MAX );
+					vBinMax[b] = D3DXVECTOR3( -FLT_MAX, -FLT_MAX, -FLT_MAX );
+				}
+				for( int i=entry.iFirst; i < entry.iFirst + entry.nCount; i++ )
+				{
+					int b = (int)( ( ((const float*)pCentroid[pOrder[i]])[iAxis] - fLo ) * fScale );
+					b = __min( __max( b, 0 ), BVH_NUM_BINS - 1 );
+					nBinCount[b]++;
+					GrowBounds( &vBinMin[b], &vBinMax[b], pTriMin[pOrder[i]], pTriMax[pOrder[i]] );
+				}
+
+				// Sweep from the right to get the cost of everything above each boundary
+				float fRightCost[BVH_NUM_BINS];
+				D3DXVECTOR3 vMin( FLT_MAX, FLT_MAX, FLT_MAX );
+				D3DXVECTOR3 vMax( -FLT_MAX, -FLT_MAX, -FLT_MAX );
+				int nRight = 0;
+				for( int b=BVH_NUM_BINS - 1; b > 0; b-- )
+				{
+					nRight += nBinCount[b];
+					if( nBinCount[b] )
+						GrowBounds( &vMin, &vMax, vBinMin[b], vBinMax[b] );
+					fRightCost[b] = nRight ? SurfaceArea( vMin, vMax ) * nRight : 0.0f;
+				}
+
+				vMin = D3DXVECTOR3( FLT_MAX, FLT_MAX, FLT_MAX );
+				vMax = D3DXVECTOR3( -FLT_MAX, -FLT_MAX, -FLT_MAX );
+				int nLeft = 0;
+				for( int b=0; b < BVH_NUM_BINS - 1; b++ )
+				{
+					nLeft += nBinCount[b];
+					if( nBinCount[b] )
+						GrowBounds( &vMin, &vMax, vBinMin[b], vBinMax[b] );
+					if( nLeft == 0 || nLeft == entry.nCount )
+						continue;
+					float fCost = SurfaceArea( vMin, vMax ) * nLeft + fRightCost[b+1];
+					if( fCost < fBestCost )
+					{
+						fBestCost = fCost;
+						iBestAxis = iAxis;
+						iBestBin = b;
+					}
+				}
+			}
+
+			// Traversal step costs as much as one triangle test
+			float fParentArea = SurfaceArea( node.vMin, node.vMax );
+			bool bSplit = entry.nCount > BVH_MAX_LEAF_TRIANGLES;
+			if( iBestAxis >= 0 && fParentArea > 0.0f )
+				bSplit = bSplit || ( 1.0f + fBestCost / fParentArea < (float)entry.nCount );
+
+			if( bSplit && iBestAxis >= 0 )
+			{
+				float fLo = ((const float*)vCentroidMin)[iBestAxis];
+				float fScale = BVH_NUM_BINS * 0.9999f / ( ((const float*)vCentroidMax)[iBestAxis] - fLo );
+				int i = entry.iFirst;
+				int j = entry.iFirst + entry.nCount - 1;
+				while( i <= j )
+				{
+					int b = (int)( ( ((const float*)pCentroid[pOrder[i]])[iBestAxis] - fLo ) * fScale );
+					b = __min( __max( b, 0 ), BVH_NUM_BINS - 1 );
+					if( b <= iBestBin )
+					{
+						i++;
+					}
+					else
+					{
+						int t = pOrder[i];
+						pOrder[i] = pOrder[j];
+						pOrder[j--] = t;
+					}
+				}
+				iMid = i;
+			}
+			else if( bSplit )
+			{
+				// All centroids coincide, any split is as good as another
+				iMid = entry.iFirst + entry.nCount / 2;
+			}
+
+			if( iMid == entry.iFirst || iMid == entry.iFirst + entry.nCount )
+				iMid = entry.iFirst + entry.nCount / 2;
+		}
+
+		if( iMid < 0 )
+		{
+			node.iLeftFirst = entry.iFirst;
+			node.nTriangles = entry.nCount;
+			continue;
+		}
+
+		int iLeft = m_nNodes;
+		m_nNodes += 2;
+		node.iLeftFirst = iLeft;
+		node.nTriangles = 0;
+
+		stack[nStack].iNode = iLeft + 1;
+		stack[nStack].iFirst = iMid;
+		stack[nStack].nCount = entry.iFirst + entry.nCount - iMid;
+		stack[nStack].nDepth = entry.nDepth + 1;
+		nStack++;
+
+		stack[nStack].iNode = iLeft;
+		stack[nStack].iFirst = entry.iFirst;
+		stack[nStack].nCount = iMid - entry.iFirst;
+		stack[nStack].nDepth = entry.nDepth + 1;
+		nStack++;
+	}
+
+	// Put the triangles in leaf order
+	BVHTriangle* pTriangles = new BVHTriangle[nTris];
+	int* pTriangleVerts = new int[nTris * 3];
+	if( pTriangles && pTriangleVerts )
+	{
+		for( int i=0; i < nTris; i++ )
+		{
+			pTriangles[i] = m_pTriangles[pOrder[i]];
+			pTriangleVerts[i*3]   = m_pTriangleVerts[pOrder[i]*3];
+			pTriangleVerts[i*3+1] = m_pTriangleVerts[pOrder[i]*3+1];
+			pTriangleVerts[i*3+2] = m_pTriangleVerts[pOrder[i]*3+2];
+		}
+		delete[] m_pTriangles;
+		delete[] m_pTriangleVerts;
+		m_pTriangles = pTriangles;
+		m_pTriangleVerts = pTriangleVerts;
+	}
+	else
+	{
+		SAFE_DELETE_ARRAY( pTriangles );
+		SAFE_DELETE_ARRAY( pTriangleVerts );
+		SAFE_DELETE_ARRAY( m_pNodes );
+		nMaxDepth = -1;
+	}
+
+	delete[] pTriMin;
+	delete[] pTriMax;
+	delete[] pCentroid;
+	delete[] pOrder;
+
+	return nMaxDepth;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Turns a binary node and up to two levels below it into one 4-wide node, opening the
+// interior child with the largest surface area until four slots are used.
+//--------------------------------------------------------------------------------------
+int CMeshBVH::CollapseNode( int iNode )
+{
+	int iNode4 = m_nNodes4++;
+
+	int aChild[4];
+	int nChild = 0;
+	if( m_pNodes[iNode].nTriangles )
+	{
+		aChild[nChild++] = iNode;
+	}
+	else
+	{
+		aChild[nChild++] = m_pNodes[iNode].iLeftFirst;
+		aChild[nChild++] = m_pNodes[iNode].iLeftFirst + 1;
+	}
+
+	while( nChild < 4 )
+	{
+		int iBest = -1;
+		float fBestArea = -1.0f;
+		for( int c=0; c < nChild; c++ )
+		{
+			const BVHNode& child = m_pNodes[aChild[c]];
+			if( child.nTriangles )
+				continue;
+			float fArea = SurfaceArea( child.vMin, child.vMax );
+			if( fArea > fBestArea )
+			{
+				fBestArea = fArea;
+				iBest = c;
+			}
+		}
+		if( iBest < 0 )
+			break;
+
+		int iOpen = aChild[iBest];
+		aChild[iBest] = m_pNodes[iOpen].iLeftFirst;
+		aChild[nChild++] = m_pNodes[iOpen].iLeftFirst + 1;
+	}
+
+	for( int c=0; c < 4; c++ )
+	{
+		BVHNode4& node4 = m_pNodes4[iNode4];
+		if( c >= nChild )
+		{
+			// Empty slot, the slab test always misses a box at FLT_MAX
+			node4.bbMinX[c] = node4.bbMinY[c] = node4.bbMinZ[c] = FLT_MAX;
+			node4.bbMaxX[c] = node4.bbMaxY[c] = node4.bbMaxZ[c] = FLT_MAX;
+			node4.iChild[c] = -1;
+			node4.nTriangles[c] = 0;
+			continue;
+		}
+
+		const BVHNode& child = m_pNodes[aChild[c]];
+		node4.bbMinX[c] = child.vMin.x;
+		node4.bbMinY[c] = child.vMin.y;
+		node4.bbMinZ[c] = child.vMin.z;
+		node4.bbMaxX[c] = child.vMax.x;
+		node4.bbMaxY[c] = child.vMax.y;
+		node4.bbMaxZ[c] = child.vMax.z;
+		node4.nTriangles[c] = child.nTriangles;
+		if( child.nTriangles )
+		{
+			node4.iChild[c] = child.iLeftFirst;
+		}
+		else
+		{
+			int iChild4 = CollapseNode( aChild[c] );
+			m_pNodes4[iNode4].iChild[c] = iChild4;
+		}
+	}
+
+	return iNode4;
+}
+
+
+//--------------------------------------------------------------------------------------
+void CMeshBVH::GetBounds( D3DXVECTOR3* pMin, D3DXVECTOR3* pMax ) const
+{
+	if( m_pNodes == NULL )
+	{
+		*pMin = D3DXVECTOR3( 0, 0, 0 );
+		*pMax = D3DXVECTOR3( 0, 0, 0 );
+		return;
+	}
+	*pMin = m_pNodes[0].vMin;
+	*pMax = m_pNodes[0].vMax;
+}
+
+
+//--------------------------------------------------------------------------------------
+bool CMeshBVH::IntersectRay( const D3DXVECTOR3& vOrigin, const D3DXVECTOR3& vDir, float fMaxDist, BVHRayHit* pHit ) const
+{
+	if( m_pNodes == NULL )
+		return false;
+	if( m_pNodes4 )
+		return IntersectRayWide( vOrigin, vDir, fMaxDist, pHit, false );
+	return IntersectRayBinary( vOrigin, vDir, fMaxDist, pHit, false );
+}
+
+
+//--------------------------------------------------------------------------------------
+bool CMeshBVH::IntersectRayAny( const D3DXVECTOR3& vOrigin, const D3DXVECTOR3& vDir, float fMaxDist ) const
+{
+	if( m_pNodes == NULL )
+		return false;
+	if( m_pNodes4 )
+		return IntersectRayWide( vOrigin, vDir, fMaxDist, NULL, true );
+	return IntersectRayBinary( vOrigin, vDir, fMaxDist, NULL, true );
+}
+
+
+//--------------------------------------------------------------------------------------
+bool CMeshBVH::IntersectRayBinary( const D3DXVECTOR3& vOrigin, const D3DXVECTOR3& vDir, float fMaxDist,
+								   BVHRayHit* pHit, bool bAny ) const
+{
+	D3DXVECTOR3 vInvDir = SafeInverse( vDir );
+	float fClosest = fMaxDist;
+	bool bHit = false;
+
+	float fDist;
+	if( !IntersectBox( m_pNodes[0].vMin, m_pNodes[0].vMax, vOrigin, vInvDir, fClosest, &fDist ) )
+		return false;
+
+	BVHStackEntry stack[BVH_MAX_DEPTH];
+	int nStack = 0;
+	int iNode = 0;
+	for( ;; )
+	{
+		const BVHNode& node = m_pNodes[iNode];
+		if( node.nTriangles )
+		{
+			for( int i=node.iLeftFirst; i < node.iLeftFirst + node.nTriangles; i++ )
+			{
+				float t, u, v;
+				if( IntersectTriangle( m_pTriangles[i], vOrigin, vDir, fClosest, &t, &u, &v ) )
+				{
+					bHit = true;
+					if( bAny )
+						return true;
+					fClosest = t;
+					pHit->fDist = t;
+					pHit->fBaryU = u;
+					pHit->fBaryV = v;
+					pHit->iTriangle = m_pTriangles[i].iTriangle;
+					pHit->iSubset = m_pTriangles[i].iSubset;
+				}
+			}
+		}
+		else
+		{
+			int iLeft = node.iLeftFirst;
+			float fDist0, fDist1;
+			bool bHit0 = IntersectBox( m_pNodes[iLeft].vMin, m_pNodes[iLeft].vMax, vOrigin, vInvDir, fClosest, &fDist0 );
+			bool bHit1 = IntersectBox( m_pNodes[iLeft+1].vMin, m_pNodes[iLeft+1].vMax, vOrigin, vInvDir, fClosest, &fDist1 );
+			if( bHit0 && bHit1 )
+			{
+				// Visit the nearer child first, the farther one may be culled later
+				assert( nStack < BVH_MAX_DEPTH );
+				bool bSwap = fDist1 < fDist0;
+				stack[nStack].iNode = bSwap ? iLeft : iLeft + 1;
+				stack[nStack].fDist = bSwap ? fDist0 : fDist1;
+				nStack++;
+				iNode = bSwap ? iLeft + 1 : iLeft;
+				continue;
+			}
+			if( bHit0 || bHit1 )
+			{
+				iNode = bHit0 ? iLeft : iLeft + 1;
+				continue;
+			}
+		}
+
+		bool bFound = false;
+		while( nStack > 0 )
+		{
+			nStack--;
+			if( stack[nStack].fDist <= fClosest )
+			{
+				iNode = stack[nStack].iNode;
+				bFound = true;
+				break;
+			}
+		}
+		if( !bFound )
+			break;
+	}
+
+	return bHit;
+}
+
+
+//--------------------------------------------------------------------------------------
+bool CMeshBVH::IntersectRayWide( const D3DXVECTOR3& vOrigin, const D3DXVECTOR3& vDir, float fMaxDist,
+								 BVHRayHit* pHit, bool bAny ) const
+{
+	D3DXVECTOR3 vInvDir = SafeInverse( vDir );
+	float fClosest = fMaxDist;
+	bool bHit = false;
+
+	const __m128 ox = _mm_set1_ps( vOrigin.x );
+	const __m128 oy = _mm_set1_ps( vOrigin.y );
+	const __m128 oz = _mm_set1_ps( vOrigin.z );
+	const __m128 ix = _mm_set1_ps( vInvDir.x );
+	const __m128 iy = _mm_set1_ps( vInvDir.y );
+	const __m128 iz = _mm_set1_ps( vInvDir.z );
+	const __m128 zero = _mm_setzero_ps();
+
+	BVHStackEntry stack[BVH_MAX_DEPTH * 4];
+	int nStack = 0;
+	stack[nStack].iNode = 0;
+	stack[nStack].fDist = 0.0f;
+	nStack++;
+
+	while( nStack > 0 )
+	{
+		nStack--;
+		if( stack[nStack].fDist > fClosest )
+			continue;
+		const BVHNode4& node = m_pNodes4[stack[nStack].iNode];
+
+		__m128 tx0 = _mm_mul_ps( _mm_sub_ps( _mm_loadu_ps( node.bbMinX ), ox ), ix );
+		__m128 tx1 = _mm_mul_ps( _mm_sub_ps( _mm_loadu_ps( node.bbMaxX ), ox ), ix );
+		__m128 ty0 = _mm_mul_ps( _mm_sub_ps( _mm_loadu_ps( node.bbMinY ), oy ), iy );
+		__m128 ty1 = _mm_mul_ps( _mm_sub_ps( _mm_loadu_ps( node.bbMaxY ), oy ), iy );
+		__m128 tz0 = _mm_mul_ps( _mm_sub_ps( _mm_loadu_ps( node.bbMinZ ), oz ), iz );
+		__m128 tz1 = _mm_mul_ps( _mm_sub_ps( _mm_loadu_ps( node.bbMaxZ ), oz ), iz );
+
+		__m128 tmin = _mm_max_ps( _mm_max_ps( _mm_min_ps( tx0, tx1 ), _mm_min_ps( ty0, ty1 ) ),
+								  _mm_max_ps( _mm_min_ps( tz0, tz1 ), zero ) );
+		__m128 tmax = _mm_min_ps( _mm_min_ps( _mm_max_ps( tx0, tx1 ), _mm_max_ps( ty0, ty1 ) ),
+								  _mm_min_ps( _mm_max_ps( tz0, tz1 ), _mm_set1_ps( fClosest ) ) );
+		int mask = _mm_movemask_ps( _mm_cmple_ps( tmin, tmax ) );
+		if( mask == 0 )
+			continue;
+
+		float afDist[4];
+		_mm_storeu_ps( afDist, tmin );
+
+		// Test leaves right away, queue interior children far to near
+		int aPush[4];
+		int nPush = 0;
+		for( int c=0; c < 4; c++ )
+		{
+			if( !( mask & ( 1 << c ) ) )
+				continue;
+			if( node.nTriangles[c] == 0 )
+			{
+				int k = nPush++;
+				while( k > 0 && afDist[aPush[k-1]] < afDist[c] )
+				{
+					aPush[k] = aPush[k-1];
+					k--;
+				}
+				aPush[k] = c;
+				continue;
+			}
+
+			for( int i=node.iChild[c]; i < node.iChild[c] + node.nTriangles[c]; i++ )
+			{
+				float t, u, v;
+				if( IntersectTriangle( m_pTriangles[i], vOrigin, vDir, fClosest, &t, &u, &v ) )
+				{
+					bHit = true;
+					if( bAny )
+						return true;
+					fClosest = t;
+					pHit->fDist = t;
+					pHit->fBaryU = u;
+					pHit->fBaryV = v;
+					pHit->iTriangle = m_pTriangles[i].iTriangle;
+					pHit->iSubset = m_pTriangles[i].iSubset;
+				}
+			}
+		}
+
+		for( int k=0; k < nPush; k++ )
+		{
+			assert( nStack < BVH_MAX_DEPTH * 4 );
+			stack[nStack].iNode = node.iChild[aPush[k]];
+			stack[nStack].fDist = afDist[aPush[k]];
+			nStack++;
+		}
+	}
+
+	return bHit;
+}
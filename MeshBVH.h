@@ -0,0 +1,116 @@
+//--------------------------------------------------------------------------------------
+// File: MeshBVH.h
+//
+// Bounding volume hierarchy over the triangles of a loaded mesh. Used for exact ray
+// picking and line-of-sight tests without brute-forcing every triangle.
+//
+//--------------------------------------------------------------------------------------
+#pragma once
+#include <float.h>
+
+#define BVH_MAX_LEAF_TRIANGLES	8
+#define BVH_MAX_DEPTH			64
+#define BVH_NUM_BINS			16
+#define BVH_REFIT_REBUILD_RATIO	1.5f	// rebuild once refitting has grown the SAH cost by this factor
+
+// Build flags
+#define BVH_BUILD_WIDE			0x01	// collapse the binary tree into 4-wide nodes for SSE traversal
+
+// 32 byte binary node. Children of an interior node are stored next to each other,
+// so only the index of the left child is kept.
+struct BVHNode
+{
+	D3DXVECTOR3 vMin;
+	int         iLeftFirst;     // interior: index of left child, leaf: first triangle
+	D3DXVECTOR3 vMax;
+	int         nTriangles;     // 0 for interior nodes
+};
+
+// 4-wide node, bounds stored per axis so all four children are tested at once
+struct BVHNode4
+{
+	float bbMinX[4];
+	float bbMinY[4];
+	float bbMinZ[4];
+	float bbMaxX[4];
+	float bbMaxY[4];
+	float bbMaxZ[4];
+	int   iChild[4];            // interior: BVHNode4 index, leaf: first triangle, -1: empty slot
+	int   nTriangles[4];        // 0 for interior children
+};
+
+// Triangle in leaf order, pre-transformed for Moller-Trumbore
+struct BVHTriangle
+{
+	D3DXVECTOR3 v0;
+	D3DXVECTOR3 vEdge1;
+	D3DXVECTOR3 vEdge2;
+	DWORD       iTriangle;      // face index in the mesh index buffer
+	DWORD       iSubset;        // attribute of the face
+	DWORD       dwPad;
+};
+
+struct BVHRayHit
+{
+	float fDist;                // distance along the ray, in units of the direction length
+	float fBaryU;               // weight of the second vertex
+	float fBaryV;               // weight of the third vertex, first vertex is 1 - u - v
+	DWORD iTriangle;
+	DWORD iSubset;
+};
+
+struct BVHStats
+{
+	int    nNodes;
+	int    nLeaves;
+	int    nMaxDepth;
+	float  fSAHCost;
+	double fBuildTime;          // seconds spent in the last build
+	double fRefitTime;          // seconds spent in the last refit
+	int    nRefits;             // refits since the last build
+};
+
+class CMeshBVH
+{
+public:
+	CMeshBVH();
+	~CMeshBVH();
+
+	HRESULT Build( const D3DXVECTOR3* pPositions, UINT uStride, int numVertices,
+				   const unsigned short* pIndices, int numIndices, const DWORD* pAttributes, DWORD dwFlags = 0 );
+	HRESULT Rebuild( DWORD dwFlags );
+	// Moves the triangles to new vertex positions, in the same order as passed to Build,
+	// and recomputes the node bounds. Returns S_FALSE if the tree had degraded enough to
+	// be rebuilt instead.
+	HRESULT Refit( const D3DXVECTOR3* pPositions, UINT uStride, int numVertices );
+	void    Destroy();
+
+	// Closest hit along the ray within [0, fMaxDist]
+	bool    IntersectRay( const D3DXVECTOR3& vOrigin, const D3DXVECTOR3& vDir, float fMaxDist, BVHRayHit* pHit ) const;
+	// Any hit within [0, fMaxDist], for line of sight
+	bool    IntersectRayAny( const D3DXVECTOR3& vOrigin, const D3DXVECTOR3& vDir, float fMaxDist ) const;
+
+	bool    IsWide() const { return m_pNodes4 != NULL; }
+	int     GetNumTriangles() const { return m_nTriangles; }
+	void    GetBounds( D3DXVECTOR3* pMin, D3DXVECTOR3* pMax ) const;
+	const BVHStats& GetStats() const { return m_Stats; }
+
+private:
+	int     BuildNodes();
+	float   ComputeSAHCost( int* pnLeaves ) const;
+	int     CollapseNode( int iNode );
+	bool    IntersectRayBinary( const D3DXVECTOR3& vOrigin, const D3DXVECTOR3& vDir, float fMaxDist, BVHRayHit* pHit, bool bAny ) const;
+	bool    IntersectRayWide( const D3DXVECTOR3& vOrigin, const D3DXVECTOR3& vDir, float fMaxDist, BVHRayHit* pHit, bool bAny ) const;
+
+	BVHNode*        m_pNodes;
+	int             m_nNodes;
+	BVHNode4*       m_pNodes4;
+	int             m_nNodes4;
+	BVHTriangle*    m_pTriangles;
+	int             m_nTriangles;
+	int*            m_pTriangleVerts;   // three vertex indices per triangle, in leaf order
+	int             m_nVertices;
+	DWORD           m_dwBuildFlags;
+	float           m_fBuildSAHCost;    // cost right after the last build, refits are compared to it
+	BVHStats        m_Stats;
+};
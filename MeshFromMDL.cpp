@@ -37,8 +37,13 @@ CDXUTDialog                  g_HUD;                   // dialog for standard con
 CDXUTDialog                  g_SampleUI;              // dialog for sample specific controls
 
 CMeshLoader                  g_MeshLoader;            // Loads a mesh from an .obj file
+int                          g_iSkin = 0;             // Skin family the mesh is drawn with
 
 WCHAR                        g_strFileSaveMessage[MAX_PATH] = {0}; // Text indicating file write success/failure
+WCHAR                        g_strPickMessage[MAX_PATH] = {0};     // Result of the last middle button pick
+WCHAR                        g_strBVHMessage[1024] = {0};          // Result of the last BVH benchmark
+
+#define FLEX_AMPLITUDE          0.5f    // model units the flexed vertices move along their normals
 
 
 //--------------------------------------------------------------------------------------
@@ -67,6 +72,8 @@ D3DXHANDLE g_hWorldViewProjection = NULL;
 #define IDC_CHANGEDEVICE        4
 #define IDC_SUBSET              5
 #define IDC_SAVETOX             6
+#define IDC_BENCHMARKBVH        7
+#define IDC_SKIN                8
 
 
 
@@ -88,7 +95,11 @@ void    CALLBACK OnDestroyDevice( void* pUserContext );
 void    InitApp();
 void    RenderText();
 void    RenderSubset( UINT iSubset );
+void    UpdateTechniques();
 void    SaveMeshToXFile();
+void    PickMesh( int x, int y );
+void    BenchmarkBVH();
+void    UpdateFlex( double fTime );
 
 //--------------------------------------------------------------------------------------
 // Entry point to the program. Initializes everything and goes into a message processing 
@@ -173,7 +184,10 @@ void InitApp()
 
     g_SampleUI.AddStatic( IDC_STATIC, L"(S)ubset", 20, 0, 105, 25 );
     g_SampleUI.AddComboBox( IDC_SUBSET, 20, 25, 140, 24, 'S' );
-    g_SampleUI.AddButton(IDC_SAVETOX, L"Save Mesh To X file",  20, 50,  140, 24, 'X');
+    g_SampleUI.AddStatic( IDC_STATIC, L"S(k)in", 20, 50, 105, 25 );
+    g_SampleUI.AddComboBox( IDC_SKIN, 20, 75, 140, 24, 'K' );
+    g_SampleUI.AddButton(IDC_SAVETOX, L"Save Mesh To X file",  20, 100,  140, 24, 'X');
+    g_SampleUI.AddButton(IDC_BENCHMARKBVH, L"(B)enchmark BVH",  20, 125,  140, 24, 'B');
     
 }
 
@@ -297,11 +311,21 @@ HRESULT CALLBACK OnCreateDevice( IDirect3DDevice9* pd3dDevice, const D3DSURFACE_
     pComboBox->RemoveAllItems();
     pComboBox->AddItem( L"All", (void*)(INT_PTR) -1 );
     
-    for( UINT i=0; i < g_MeshLoader.GetNumMaterials(); i++ )
+    for( UINT i=0; i < g_MeshLoader.GetNumSubsets(); i++ )
     {
-        Material* pMaterial = g_MeshLoader.GetMaterial( i );
+        Material* pMaterial = g_MeshLoader.GetSubsetMaterial( i );
         pComboBox->AddItem( pMaterial->strName, (void*)(INT_PTR) i );
     }
+
+    // Add the skin families, all of them draw the same mesh
+    g_iSkin = 0;
+    pComboBox = g_SampleUI.GetComboBox( IDC_SKIN );
+    pComboBox->RemoveAllItems();
+    for( int i=0; i < g_MeshLoader.GetNumSkins(); i++ )
+    {
+        StringCchPrintf( str, MAX_PATH, L"Skin %d", i );
+        pComboBox->AddItem( str, (void*)(INT_PTR) i );
+    }
     
     // Define DEBUG_VS and/or DEBUG_PS to debug vertex and/or pixel shaders with the 
     // shader debugger. Debugging vertex shaders requires either REF or software vertex 
@@ -384,25 +408,10 @@ HRESULT CALLBACK OnResetDevice( IDirect3DDevice9* pd3dDevice,
         V_RETURN( g_pFont->OnResetDevice() );
     if( g_pEffect )
         V_RETURN( g_pEffect->OnResetDevice() );
+    V_RETURN( g_MeshLoader.OnResetDevice() );
 
     // Store the correct technique handles for each material
-    for( UINT i=0; i < g_MeshLoader.GetNumMaterials(); i++ )
-    {
-        Material* pMaterial = g_MeshLoader.GetMaterial( i );
-        
-        const char* strTechnique;
-
-        if( pMaterial->pTexture && pMaterial->bSpecular )
-            strTechnique = "TexturedSpecular";
-        else if( pMaterial->pTexture && !pMaterial->bSpecular )
-            strTechnique = "TexturedNoSpecular";
-        else if( !pMaterial->pTexture && pMaterial->bSpecular )
-            strTechnique = "Specular";
-        else if( !pMaterial->pTexture && !pMaterial->bSpecular )
-            strTechnique = "NoSpecular";
-
-        pMaterial->hTechnique = g_pEffect->GetTechniqueByName( strTechnique );
-    }
+    UpdateTechniques();
     
     // Create a sprite to help batch calls when drawing many lines of text
     V_RETURN( D3DXCreateSprite( pd3dDevice, &g_pTextSprite ) );
@@ -435,6 +444,34 @@ void CALLBACK OnFrameMove( double fTime, float fElapsedTime, void* pUserContext
 {
     // Update the camera's position based on user input 
     g_Camera.FrameMove( fElapsedTime );
+
+    UpdateFlex( fTime );
+}
+
+
+//--------------------------------------------------------------------------------------
+// Stand-in for evaluating the flex controllers: the flexed vertices swell and relax
+// along their normals, which rewrites the dynamic stream every frame as a talking face
+// would. Models without flexed strip groups have nothing to update.
+//--------------------------------------------------------------------------------------
+void UpdateFlex( double fTime )
+{
+    HRESULT hr;
+
+    CStudioFlexStream* pFlex = g_MeshLoader.GetFlexStream();
+    if( pFlex->GetNumVertices() == 0 )
+        return;
+
+    pFlex->BeginFrame();
+    float fWeight = FLEX_AMPLITUDE * ( 0.5f + 0.5f * sinf( (float)fTime * 2.0f ) );
+    const StudioFlexVertex* pRest = pFlex->GetRestVertices();
+    StudioFlexVertex* pDynamic = pFlex->GetDynamicVertices();
+    for( int i=0; i < pFlex->GetNumVertices(); i++ )
+    {
+        pDynamic[i].vecPosition = pRest[i].vecPosition + pRest[i].vecNormal * fWeight;
+        pDynamic[i].vecNormal = pRest[i].vecNormal;
+    }
+    V( g_MeshLoader.UpdateFlexedVertices() );
 }
 
 
@@ -486,7 +523,7 @@ void CALLBACK OnFrameRender( IDirect3DDevice9* pd3dDevice, double fTime, float f
         if( iCurSubset == -1 )
         {
             // Iterate through subsets, changing material properties for each
-            for( UINT iSubset = 0; iSubset < g_MeshLoader.GetNumMaterials(); iSubset++ )
+            for( UINT iSubset = 0; iSubset < g_MeshLoader.GetNumSubsets(); iSubset++ )
             {
                 RenderSubset( iSubset );
             }
@@ -511,9 +548,8 @@ void RenderSubset( UINT iSubset )
     HRESULT hr;
     UINT iPass, cPasses;
    
-    // Retrieve the ID3DXMesh pointer and current material from the MeshLoader helper
-    ID3DXMesh* pMesh = g_MeshLoader.GetMesh();
-    Material* pMaterial = g_MeshLoader.GetMaterial( iSubset );
+    // Retrieve the current material from the MeshLoader helper
+    Material* pMaterial = g_MeshLoader.GetSubsetMaterial( iSubset, g_iSkin );
     // Set the lighting variables and texture for the current material
     V( g_pEffect->SetValue( g_hAmbient, pMaterial->vAmbient, sizeof(D3DXVECTOR3) ) );
     V( g_pEffect->SetValue( g_hDiffuse, pMaterial->vDiffuse, sizeof(D3DXVECTOR3) ) );
@@ -534,14 +570,40 @@ void RenderSubset( UINT iSubset )
         // you are not setting any parameters between the BeginPass and EndPass.
         // V( g_pEffect->CommitChanges() );
 
-        // Render the mesh with the applied technique
-        V( pMesh->DrawSubset( iSubset ) );
+        // Render the mesh with the applied technique, flexed subsets from their stream
+        V( g_MeshLoader.DrawSubset( iSubset ) );
 
         V( g_pEffect->EndPass() );
     }
     V( g_pEffect->End() );
 }
 
+
+//--------------------------------------------------------------------------------------
+// Picks the technique of every material from whether its texture is loaded. Called
+// again after a skin family loads its textures.
+//--------------------------------------------------------------------------------------
+void UpdateTechniques()
+{
+    for( UINT i=0; i < g_MeshLoader.GetNumMaterials(); i++ )
+    {
+        Material* pMaterial = g_MeshLoader.GetMaterial( i );
+        
+        const char* strTechnique;
+
+        if( pMaterial->pTexture && pMaterial->bSpecular )
+            strTechnique = "TexturedSpecular";
+        else if( pMaterial->pTexture && !pMaterial->bSpecular )
+            strTechnique = "TexturedNoSpecular";
+        else if( !pMaterial->pTexture && pMaterial->bSpecular )
+            strTechnique = "Specular";
+        else if( !pMaterial->pTexture && !pMaterial->bSpecular )
+            strTechnique = "NoSpecular";
+
+        pMaterial->hTechnique = g_pEffect->GetTechniqueByName( strTechnique );
+    }
+}
+
 //--------------------------------------------------------------------------------------
 // Render the help and statistics text. This function uses the ID3DXFont interface for 
 // efficient text rendering.
@@ -563,21 +625,31 @@ void RenderText()
 
     txtHelper.SetForegroundColor( D3DXCOLOR( 1.0f, 1.0f, 1.0f, 1.0f ) );
     txtHelper.DrawTextLine( g_strFileSaveMessage );
+    txtHelper.DrawTextLine( g_strPickMessage );
+    txtHelper.DrawTextLine( g_strBVHMessage );
+
+    CStudioFlexStream* pFlex = g_MeshLoader.GetFlexStream();
+    if( pFlex->GetNumVertices() > 0 )
+    {
+        txtHelper.DrawFormattedTextLine( L"Flex: %d bytes rewritten this frame, the whole mesh is %d",
+                                         pFlex->GetStats().nBytesWritten, pFlex->GetStaticBytes() );
+    }
     
     // Draw help
     if( g_bShowHelp )
     {
         const D3DSURFACE_DESC* pd3dsdBackBuffer = DXUTGetD3D9BackBufferSurfaceDesc();
-        txtHelper.SetInsertionPos( 10, pd3dsdBackBuffer->Height-15*5 );
+        txtHelper.SetInsertionPos( 10, pd3dsdBackBuffer->Height-15*6 );
         txtHelper.SetForegroundColor( D3DCOLOR_ARGB( 200, 50, 50, 50 ) );
         txtHelper.DrawTextLine( L"Controls (F1 to hide):" );
 
-        txtHelper.SetInsertionPos( 20, pd3dsdBackBuffer->Height-15*4 );
+        txtHelper.SetInsertionPos( 20, pd3dsdBackBuffer->Height-15*5 );
         txtHelper.DrawTextLine( L"Rotate model: Left mouse button\n"
                                 L"Rotate camera: Right mouse button\n"
-                                L"Zoom camera: Mouse wheel scroll\n" );
+                                L"Zoom camera: Mouse wheel scroll\n"
+                                L"Pick triangle: Middle mouse button\n" );
 
-        txtHelper.SetInsertionPos( 250, pd3dsdBackBuffer->Height-15*4 );
+        txtHelper.SetInsertionPos( 250, pd3dsdBackBuffer->Height-15*5 );
         txtHelper.DrawTextLine( L"Hide help: F1\n"); 
         txtHelper.DrawTextLine( L"Quit: ESC\n" );
     }
@@ -618,6 +690,10 @@ LRESULT CALLBACK MsgProc( HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam, bo
     if( *pbNoFurtherProcessing )
         return 0;
 
+    // The camera ignores the middle button, use it for picking
+    if( uMsg == WM_MBUTTONDOWN )
+        PickMesh( (short)LOWORD( lParam ), (short)HIWORD( lParam ) );
+
     // Pass all remaining windows messages to camera so it can respond to user input
     g_Camera.HandleMessages( hWnd, uMsg, wParam, lParam );
 
@@ -654,6 +730,25 @@ void CALLBACK OnGUIEvent( UINT nEvent, int nControlID, CDXUTControl* pControl, v
         case IDC_TOGGLEREF:        DXUTToggleREF(); break;
         case IDC_CHANGEDEVICE:     g_SettingsDlg.SetActive( !g_SettingsDlg.IsActive() ); break;
         case IDC_SAVETOX:          SaveMeshToXFile(); break;    
+        case IDC_BENCHMARKBVH:     BenchmarkBVH(); break;
+        case IDC_SKIN:
+        {
+            // The first use of a family loads its textures, after that switching is free.
+            // A family that fails to load leaves the combo on the one still drawn.
+            CDXUTComboBox* pComboBox = (CDXUTComboBox*)pControl;
+            int iSkin = (int)(INT_PTR) pComboBox->GetSelectedData();
+            if( !g_MeshLoader.IsSkinLoaded( iSkin ) )
+            {
+                if( FAILED( g_MeshLoader.LoadSkin( iSkin ) ) )
+                {
+                    pComboBox->SetSelectedByData( (void*)(INT_PTR) g_iSkin );
+                    break;
+                }
+                UpdateTechniques();
+            }
+            g_iSkin = iSkin;
+            break;
+        }
     }
 }
 
@@ -673,6 +768,7 @@ void CALLBACK OnLostDevice( void* pUserContext )
         g_pFont->OnLostDevice();
     if( g_pEffect )
         g_pEffect->OnLostDevice();
+    g_MeshLoader.OnLostDevice();
 
     SAFE_RELEASE(g_pTextSprite);
 }
@@ -701,15 +797,15 @@ void SaveMeshToXFile()
 {
     HRESULT hr;
 
-    // Fill out D3DXMATERIAL structures
-    UINT numMaterials = g_MeshLoader.GetNumMaterials();
+    // Fill out D3DXMATERIAL structures, one per subset in the current skin
+    UINT numMaterials = g_MeshLoader.GetNumSubsets();
     D3DXMATERIAL *pMaterials = new D3DXMATERIAL[numMaterials];
     char *pStrTexture = new char[MAX_PATH * numMaterials];
     if ((pMaterials != NULL) && (pStrTexture != NULL))
     {
-        for( UINT i=0; i < g_MeshLoader.GetNumMaterials(); i++ )
+        for( UINT i=0; i < numMaterials; i++ )
         {
-            Material* pMat = g_MeshLoader.GetMaterial( i );
+            Material* pMat = g_MeshLoader.GetSubsetMaterial( i, g_iSkin );
             if (pMat != NULL)
             {
                 pMaterials[i].MatD3D.Ambient.r = pMat->vAmbient.x;
@@ -764,3 +860,151 @@ void SaveMeshToXFile()
 
 
 
+//--------------------------------------------------------------------------------------
+// Casts a ray from the cursor into the mesh and reports the closest triangle
+//--------------------------------------------------------------------------------------
+void PickMesh( int x, int y )
+{
+    const D3DXMATRIX* pmatProj = g_Camera.GetProjMatrix();
+    const D3DSURFACE_DESC* pd3dsdBackBuffer = DXUTGetD3D9BackBufferSurfaceDesc();
+
+    // Compute the vector of the pick ray in screen space
+    D3DXVECTOR3 v;
+    v.x = ( ( ( 2.0f * x ) / pd3dsdBackBuffer->Width ) - 1 ) / pmatProj->_11;
+    v.y = -( ( ( 2.0f * y ) / pd3dsdBackBuffer->Height ) - 1 ) / pmatProj->_22;
+    v.z = 1.0f;
+
+    // Get the inverse of the composite world and view matrix
+    D3DXMATRIX mWorldView = *g_Camera.GetWorldMatrix() * *g_Camera.GetViewMatrix();
+    D3DXMATRIX m;
+    D3DXMatrixInverse( &m, NULL, &mWorldView );
+
+    // Transform the screen space pick ray into model space
+    D3DXVECTOR3 vPickRayDir;
+    vPickRayDir.x = v.x * m._11 + v.y * m._21 + v.z * m._31;
+    vPickRayDir.y = v.x * m._12 + v.y * m._22 + v.z * m._32;
+    vPickRayDir.z = v.x * m._13 + v.y * m._23 + v.z * m._33;
+    D3DXVec3Normalize( &vPickRayDir, &vPickRayDir );
+    D3DXVECTOR3 vPickRayOrig( m._41, m._42, m._43 );
+
+    BVHRayHit hit;
+    if( g_MeshLoader.GetBVH()->IntersectRay( vPickRayOrig, vPickRayDir, FLT_MAX, &hit ) )
+    {
+        StringCchPrintf( g_strPickMessage, MAX_PATH-1, L"Picked triangle %d, subset %d, distance %.2f, uv (%.2f, %.2f)",
+                         hit.iTriangle, hit.iSubset, hit.fDist, hit.fBaryU, hit.fBaryV );
+    }
+    else
+    {
+        StringCchPrintf( g_strPickMessage, MAX_PATH-1, L"Picked nothing" );
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// Times hierarchy builds and ray queries against the loaded mesh. Rays start on a sphere
+// around the model and aim at random points inside its bounds, so most of them hit.
+//--------------------------------------------------------------------------------------
+void BenchmarkBVH()
+{
+    const int numBuilds = 10;
+    const int numRays = 200000;
+
+    CMeshBVH* pBVH = g_MeshLoader.GetBVH();
+    if( pBVH->GetNumTriangles() == 0 )
+        return;
+
+    D3DXVECTOR3 vMin, vMax;
+    pBVH->GetBounds( &vMin, &vMax );
+    D3DXVECTOR3 vCenter = ( vMin + vMax ) * 0.5f;
+    D3DXVECTOR3 vExtent = vMax - vMin;
+    float fRadius = D3DXVec3Length( &vExtent );
+
+    D3DXVECTOR3* pOrigins = new D3DXVECTOR3[numRays];
+    D3DXVECTOR3* pDirs = new D3DXVECTOR3[numRays];
+    if( pOrigins == NULL || pDirs == NULL )
+    {
+        SAFE_DELETE_ARRAY( pOrigins );
+        SAFE_DELETE_ARRAY( pDirs );
+        return;
+    }
+
+    // Fixed seed so runs are comparable
+    DWORD dwSeed = 12345;
+    for( int i=0; i < numRays; i++ )
+    {
+        float r[6];
+        for( int k=0; k < 6; k++ )
+        {
+            dwSeed = dwSeed * 1664525 + 1013904223;
+            r[k] = ( dwSeed >> 8 ) * ( 1.0f / 16777216.0f );
+        }
+
+        D3DXVECTOR3 vOnSphere( r[0] * 2 - 1, r[1] * 2 - 1, r[2] * 2 - 1 );
+        D3DXVec3Normalize( &vOnSphere, &vOnSphere );
+        pOrigins[i] = vCenter + vOnSphere * fRadius;
+
+        D3DXVECTOR3 vTarget( vMin.x + r[3] * vExtent.x, vMin.y + r[4] * vExtent.y, vMin.z + r[5] * vExtent.z );
+        pDirs[i] = vTarget - pOrigins[i];
+        D3DXVec3Normalize( &pDirs[i], &pDirs[i] );
+    }
+
+    LARGE_INTEGER qwFreq, qwStart, qwEnd;
+    QueryPerformanceFrequency( &qwFreq );
+
+    double fBuildTime[2], fClosestRate[2], fAnyRate[2];
+    int nHits = 0;
+    for( int iWide=0; iWide < 2; iWide++ )
+    {
+        DWORD dwFlags = iWide ? BVH_BUILD_WIDE : 0;
+        double fTotal = 0.0;
+        for( int i=0; i < numBuilds; i++ )
+        {
+            pBVH->Rebuild( dwFlags );
+            fTotal += pBVH->GetStats().fBuildTime;
+        }
+        fBuildTime[iWide] = fTotal / numBuilds;
+
+        BVHRayHit hit;
+        nHits = 0;
+        QueryPerformanceCounter( &qwStart );
+        for( int i=0; i < numRays; i++ )
+            nHits += pBVH->IntersectRay( pOrigins[i], pDirs[i], FLT_MAX, &hit ) ? 1 : 0;
+        QueryPerformanceCounter( &qwEnd );
+        fClosestRate[iWide] = numRays / ( (double)( qwEnd.QuadPart - qwStart.QuadPart ) / qwFreq.QuadPart );
+
+        QueryPerformanceCounter( &qwStart );
+        for( int i=0; i < numRays; i++ )
+            pBVH->IntersectRayAny( pOrigins[i], pDirs[i], FLT_MAX );
+        QueryPerformanceCounter( &qwEnd );
+        fAnyRate[iWide] = numRays / ( (double)( qwEnd.QuadPart - qwStart.QuadPart ) / qwFreq.QuadPart );
+    }
+
+    // CPU skinning of the reference pose followed by a refit, as done for animated meshes
+    matrix3x4_t boneToWorld[MAXSTUDIOBONES];
+    Studio_BuildBindPose( g_MeshLoader.GetStudioHdr(), boneToWorld );
+    pBVH->Rebuild( 0 );
+    QueryPerformanceCounter( &qwStart );
+    for( int i=0; i < numBuilds; i++ )
+        g_MeshLoader.UpdateSkinnedBVH( boneToWorld );
+    QueryPerformanceCounter( &qwEnd );
+    double fSkinRefitTime = (double)( qwEnd.QuadPart - qwStart.QuadPart ) / qwFreq.QuadPart / numBuilds;
+    double fRefitTime = pBVH->GetStats().fRefitTime;
+
+    // Leave the hierarchy the way the loader built it
+    pBVH->Rebuild( 0 );
+    const BVHStats& stats = pBVH->GetStats();
+
+    StringCchPrintf( g_strBVHMessage, 1023,
+                     L"BVH: %d tris, %d nodes, depth %d, SAH %.1f, %d%% hit\n"
+                     L"Binary: build %.2f ms, closest %.2f Mrays/s, any %.2f Mrays/s\n"
+                     L"4-wide: build %.2f ms, closest %.2f Mrays/s, any %.2f Mrays/s\n"
+                     L"Skin + refit: %.2f ms, refit alone %.2f ms",
+                     pBVH->GetNumTriangles(), stats.nNodes, stats.nMaxDepth, stats.fSAHCost, nHits * 100 / numRays,
+                     fBuildTime[0] * 1000.0, fClosestRate[0] / 1e6, fAnyRate[0] / 1e6,
+                     fBuildTime[1] * 1000.0, fClosestRate[1] / 1e6, fAnyRate[1] / 1e6,
+                     fSkinRefitTime * 1000.0, fRefitTime * 1000.0 );
+
+    SAFE_DELETE_ARRAY( pOrigins );
+    SAFE_DELETE_ARRAY( pDirs );
+}
+
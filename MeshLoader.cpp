@@ -28,13 +28,40 @@ D3DVERTEXELEMENT9 VERTEX_DECL[] =
 	D3DDECL_END()
 };
 
+// Flexed subsets read position and normal from the dynamic stream
+D3DVERTEXELEMENT9 FLEX_VERTEX_DECL[] =
+{
+    { 0,  0, D3DDECLTYPE_FLOAT3, D3DDECLMETHOD_DEFAULT,  D3DDECLUSAGE_BLENDWEIGHT,  0},
+    { 0, 12, D3DDECLTYPE_UBYTE4, D3DDECLMETHOD_DEFAULT,  D3DDECLUSAGE_BLENDINDICES, 0},
+    { 1,  0, D3DDECLTYPE_FLOAT3, D3DDECLMETHOD_DEFAULT,  D3DDECLUSAGE_POSITION, 0},
+    { 1, 12, D3DDECLTYPE_FLOAT3, D3DDECLMETHOD_DEFAULT,  D3DDECLUSAGE_NORMAL,   0}, 
+    { 0, 40, D3DDECLTYPE_FLOAT2, D3DDECLMETHOD_DEFAULT,  D3DDECLUSAGE_TEXCOORD, 0},
+    { 0, 48, D3DDECLTYPE_FLOAT4, D3DDECLMETHOD_DEFAULT,  D3DDECLUSAGE_TANGENT,  0},
+	D3DDECL_END()
+};
+
 
 //--------------------------------------------------------------------------------------
 CMeshLoader::CMeshLoader()
 {
     m_pd3dDevice = NULL;  
     m_pMesh = NULL;  
+    m_pFlexVB = NULL;
+    m_pFlexDecl = NULL;
+    m_pShadowVB = NULL;
+    m_pShadowIB = NULL;
+    m_pShadowDecl = NULL;
+    m_bPackVertices = false;
+    m_bRegenerateTangents = false;
+    m_bParallelDecode = false;
+    m_pPackedVB = NULL;
+    m_pPackedDecl = NULL;
+    ZeroMemory( &m_PackStats, sizeof( m_PackStats ) );
+    ZeroMemory( &m_GeometryCounts, sizeof( m_GeometryCounts ) );
 	m_iLod = 0;
+	m_pVvdFileHeader = NULL;
+	m_pVtxFileHeader = NULL;
+	m_pMdlFileHeader = NULL;
     ZeroMemory( m_strMediaDir, sizeof(m_strMediaDir) );
 }
 
@@ -66,10 +93,34 @@ void CMeshLoader::Destroy()
     }
 
     m_Materials.RemoveAll();
-    m_Vertices.RemoveAll();
-    m_Attributes.RemoveAll();
+    m_VertexStreams.RemoveAll();
+    ZeroMemory( &m_GeometryCounts, sizeof( m_GeometryCounts ) );
+    m_SubsetSkinRef.RemoveAll();
+    m_SkinRemap.RemoveAll();
+    m_SkinLoaded.RemoveAll();
+    m_SkinnedPositions.RemoveAll();
+    m_BVH.Destroy();
+    m_Bounds.Destroy();
+    m_Lookup.Destroy();
+    m_Activities.Destroy();
+    m_Events.Destroy();
+    m_Transitions.Destroy();
+    m_Movement.Destroy();
+    m_Procedural.Destroy();
+    m_FrameCache.Destroy();
+    m_Palettes.Destroy();
+    m_FlexStream.Destroy();
+    m_ShadowStream.Destroy();
 	
     SAFE_RELEASE( m_pMesh );
+    SAFE_RELEASE( m_pFlexVB );
+    SAFE_RELEASE( m_pFlexDecl );
+    SAFE_RELEASE( m_pShadowVB );
+    SAFE_RELEASE( m_pShadowIB );
+    SAFE_RELEASE( m_pShadowDecl );
+    SAFE_RELEASE( m_pPackedVB );
+    SAFE_RELEASE( m_pPackedDecl );
+    ZeroMemory( &m_PackStats, sizeof( m_PackStats ) );
 	SAFE_DELETE( m_pVvdFileHeader );
 	SAFE_DELETE( m_pVtxFileHeader );
 	SAFE_DELETE( m_pMdlFileHeader );
@@ -79,7 +130,7 @@ void CMeshLoader::Destroy()
 
 
 //--------------------------------------------------------------------------------------
-HRESULT CMeshLoader::Create( IDirect3DDevice9* pd3dDevice, const WCHAR* strFilename )
+HRESULT CMeshLoader::Create( IDirect3DDevice9* pd3dDevice, const WCHAR* strFilename, int iLod )
 {
     HRESULT hr;
     WCHAR str[ MAX_PATH ] = {0};
@@ -89,80 +140,271 @@ HRESULT CMeshLoader::Create( IDirect3DDevice9* pd3dDevice, const WCHAR* strFilen
 
     // Store the device pointer
     m_pd3dDevice = pd3dDevice;
+    m_iLod = (unsigned short)( iLod > 0 ? iLod : 0 );
 
     // Load the vertex buffer, index buffer, and subset information from a file. In this case, 
     // an .obj file was chosen for simplicity, but it's meant to illustrate that ID3DXMesh objects
     // can be filled from any mesh file format once the necessary data is extracted from file.
     V_RETURN( LoadGeometryFromMDL( strFilename ) );
 
+    // Per-bone boxes over the root LOD vertices, for bounds of animated poses
+    V_RETURN( m_Bounds.Init( m_pMdlFileHeader, m_pVvdFileHeader->pVertex( 0 ), m_pVvdFileHeader->numLODVertexes[0] ) );
+    V_RETURN( m_Lookup.Init( m_pMdlFileHeader ) );
+    V_RETURN( m_Activities.Init( m_pMdlFileHeader ) );
+    V_RETURN( m_Events.Init( m_pMdlFileHeader ) );
+    V_RETURN( m_Transitions.Init( m_pMdlFileHeader ) );
+    V_RETURN( m_Movement.Init( m_pMdlFileHeader ) );
+    V_RETURN( m_Procedural.Init( m_pMdlFileHeader ) );
+    V_RETURN( m_FrameCache.Init( m_pMdlFileHeader ) );
+
+    // Only the textures of the default skin are loaded up front, other families load
+    // theirs the first time they are selected
+    V_RETURN( LoadSkin( 0 ) );
+
+    // Create the encapsulated mesh at the sizes of the counting pass
+    ID3DXMesh* pMesh = NULL;
+	V_RETURN( D3DXCreateMesh( m_GeometryCounts.numIndices / 3, m_GeometryCounts.numVertices, 
+                              D3DXMESH_MANAGED, VERTEX_DECL, 
+                              pd3dDevice, &pMesh ) ); 
+    m_pMesh = pMesh;
+
+    // Decode straight into the vertex streams and the locked index and attribute buffers.
+    // Every step below runs only while the ones before succeeded, so both buffers are
+    // unlocked on the way out whatever fails.
+    V_RETURN( m_VertexStreams.Resize( m_GeometryCounts.numVertices ) );
+    unsigned short * pIndex = NULL;
+    DWORD * pSubset = NULL;
+    hr = pMesh->LockIndexBuffer( 0, (void**) &pIndex );
+    if( SUCCEEDED( hr ) )
+        hr = pMesh->LockAttributeBuffer( 0, &pSubset );
+    if( SUCCEEDED( hr ) )
+    {
+        StudioGeometrySpans spans;
+        spans.pPositions = m_VertexStreams.GetPositions();
+        spans.pNormals = m_VertexStreams.GetNormals();
+        spans.pTexCoords = m_VertexStreams.GetTexCoords();
+        spans.pBoneWeights = m_VertexStreams.GetBoneWeights();
+        spans.pTangents = m_VertexStreams.GetTangents();
+        spans.pSourceVertices = m_VertexStreams.GetSourceVertices();
+        spans.pIndices = pIndex;
+        spans.pAttributes = pSubset;
+        hr = Studio_FillGeometry( m_pMdlFileHeader, m_pVvdFileHeader, m_pVtxFileHeader, m_iLod, spans,
+                                  m_bParallelDecode ? 0 : 1 );
+    }
+
+    if( SUCCEEDED( hr ) && ( m_bRegenerateTangents || m_pVvdFileHeader->tangentDataStart == 0 ) )
+        hr = Studio_GenerateTangents( m_VertexStreams.GetView(), pIndex, m_GeometryCounts.numIndices,
+                                      m_VertexStreams.GetTangents() );
+
+    // Build the picking hierarchy while the triangles are at hand
+    if( SUCCEEDED( hr ) )
+        hr = m_BVH.Build( m_VertexStreams.GetPositions(), sizeof( Vector ), m_VertexStreams.GetNumVertices(),
+                          pIndex, m_GeometryCounts.numIndices, pSubset );
+
+    if( pSubset )
+        pMesh->UnlockAttributeBuffer();
+    if( pIndex )
+        pMesh->UnlockIndexBuffer();
+    V_RETURN( hr );
+
+    // Bone palettes per strip, strips that don't resolve fall back to the .vvd bones
+    V_RETURN( m_Palettes.Init( m_pMdlFileHeader, m_pVtxFileHeader, m_iLod,
+                               m_pVvdFileHeader->pVertex( 0 ), m_VertexStreams.GetSourceVertices() ) );
+
+    // Mirror the flexed vertices into the dynamic stream, the mesh itself is never rewritten
+    V_RETURN( m_FlexStream.Init( m_pMdlFileHeader, m_pVtxFileHeader, m_iLod, m_VertexStreams.GetView(), sizeof( Vertex ) ) );
+    if( m_FlexStream.GetNumVertices() > 0 )
+    {
+        V_RETURN( pd3dDevice->CreateVertexDeclaration( FLEX_VERTEX_DECL, &m_pFlexDecl ) );
+        V_RETURN( OnResetDevice() );
+    }
+
+    // Shadow and depth passes only fetch positions, quantized to 8 bytes a vertex
+    V_RETURN( m_ShadowStream.Init( m_pMdlFileHeader, m_pVtxFileHeader, m_pVvdFileHeader, true ) );
+    V_RETURN( m_ShadowStream.CreateBuffers( pd3dDevice, &m_pShadowVB, &m_pShadowIB ) );
+    V_RETURN( pd3dDevice->CreateVertexDeclaration( m_ShadowStream.GetDecl(), &m_pShadowDecl ) );
+
+    if( m_bPackVertices )
+    {
+        V_RETURN( pd3dDevice->CreateVertexBuffer( m_VertexStreams.GetNumVertices() * sizeof( StudioPackedVertex ), D3DUSAGE_WRITEONLY,
+                                                  0, D3DPOOL_MANAGED, &m_pPackedVB, NULL ) );
+        V_RETURN( pd3dDevice->CreateVertexDeclaration( PACKED_VERTEX_DECL, &m_pPackedDecl ) );
+        StudioPackedVertex* pPacked;
+        V_RETURN( m_pPackedVB->Lock( 0, 0, (void**)&pPacked, 0 ) );
+        m_Packer.Pack( m_VertexStreams.GetView(), pPacked, &m_PackStats );
+        m_pPackedVB->Unlock();
+    }
+
+    // Interleave the vertex streams into the vertex buffer
+    Vertex* pVertex;
+    V_RETURN( pMesh->LockVertexBuffer( 0, (void**) &pVertex ) );
+    m_VertexStreams.Interleave( &pVertex->studiovertex, &pVertex->vecTangent, sizeof( Vertex ) );
+    pMesh->UnlockVertexBuffer();
+
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT CMeshLoader::LoadSkin( int iSkin )
+{
+    HRESULT hr = S_OK;
+
+    if( iSkin < 0 || iSkin >= m_SkinLoaded.GetSize() )
+        return E_INVALIDARG;
+    if( m_SkinLoaded[iSkin] )
+        return S_OK;
+
     // Set the current directory based on where the mesh was found
     WCHAR wstrOldDir[MAX_PATH] = {0};
     GetCurrentDirectory( MAX_PATH, wstrOldDir );
     SetCurrentDirectory( m_strMediaDir );
 
-    // Load material textures
-    for( int iMaterial=0; iMaterial < m_Materials.GetSize(); iMaterial++ )
+    int numSubsets = GetNumSubsets();
+    for( int iSubset=0; iSubset < numSubsets; iSubset++ )
     {
-        Material* pMaterial = m_Materials.GetAt( iMaterial );
-        if( pMaterial->strTexture[0] )
-        {   
-            // Avoid loading the same texture twice
-            bool bFound = false;
-            for( int x=0; x < iMaterial; x++ )
-            {
-                Material* pCur = m_Materials.GetAt( x );
-                if( 0 == wcscmp( pCur->strTexture, pMaterial->strTexture ) )
-                {
-                    bFound = true;
-                    pMaterial->pTexture = pCur->pTexture;
-                    break;
-                }
-            }
+        Material* pMaterial = m_Materials.GetAt( m_SkinRemap[iSkin*numSubsets + iSubset] );
+        if( pMaterial->pTexture || !pMaterial->strTexture[0] )
+            continue;
 
-            // Not found, load the texture
-            if( !bFound )
+        // Avoid loading the same texture twice, another family may already have it
+        for( int x=0; x < m_Materials.GetSize(); x++ )
+        {
+            Material* pCur = m_Materials.GetAt( x );
+            if( pCur->pTexture && 0 == wcscmp( pCur->strTexture, pMaterial->strTexture ) )
             {
-                V_RETURN( CreateTextureFromVTF( pd3dDevice, pMaterial->strTexture, &(pMaterial->pTexture) ) );
+                pMaterial->pTexture = pCur->pTexture;
+                break;
             }
         }
+
+        // Not found, load the texture
+        if( !pMaterial->pTexture )
+        {
+            hr = CreateTextureFromVTF( m_pd3dDevice, pMaterial->strTexture, &(pMaterial->pTexture) );
+            if( FAILED( hr ) )
+                break;
+        }
     }
 
     // Restore the original current directory
     SetCurrentDirectory( wstrOldDir );
 
-    // Create the encapsulated mesh
-    ID3DXMesh* pMesh = NULL;
-	//StripGroupHeader_t* pStripGroup= m_pVtxFileHeader->pBodyPart(0)->pModel(0)->pLOD(m_iLod)->pMesh(0)->pStripGroup(0);
-	V_RETURN( D3DXCreateMesh( m_Indices.GetSize() / 3,m_Vertices.GetSize(), 
-                              D3DXMESH_MANAGED, VERTEX_DECL, 
-                              pd3dDevice, &pMesh ) ); 
-    // Copy the vertex data
-    mstudiovertex_t* pVertex;
-    V_RETURN( pMesh->LockVertexBuffer( 0, (void**) &pVertex ) );
-    memcpy( pVertex, m_Vertices.GetData(), m_Vertices.GetSize() * sizeof( Vertex ) );
-    pMesh->UnlockVertexBuffer();
-    m_Vertices.RemoveAll();
-    
-    //Copy the index data
-    unsigned short * pIndex;
-    V_RETURN( pMesh->LockIndexBuffer( 0, (void**) &pIndex ) );
-	memcpy( pIndex, m_Indices.GetData(), m_Indices.GetSize() * sizeof( unsigned short ) );
-    pMesh->UnlockIndexBuffer();
-    m_Indices.RemoveAll();
-
-    // Copy the attribute data
-    DWORD * pSubset;
-    V_RETURN( pMesh->LockAttributeBuffer( 0, &pSubset ) );
-    memcpy( pSubset, m_Attributes.GetData(), m_Attributes.GetSize() * sizeof( DWORD ) );
-    pMesh->UnlockAttributeBuffer();
-    m_Attributes.RemoveAll();
-
-    m_pMesh = pMesh;
+    if( FAILED( hr ) )
+        return DXTRACE_ERR( L"CreateTextureFromVTF", hr );
 
+    m_SkinLoaded[iSkin] = true;
     return S_OK;
 }
 
 
+//--------------------------------------------------------------------------------------
+Material* CMeshLoader::GetSubsetMaterial( UINT iSubset, int iSkin )
+{
+    if( iSkin < 0 || iSkin >= m_SkinLoaded.GetSize() )
+        iSkin = 0;
+    return m_Materials.GetAt( m_SkinRemap[iSkin*GetNumSubsets() + iSubset] );
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT CMeshLoader::OnResetDevice()
+{
+    HRESULT hr;
+
+    if( m_pd3dDevice == NULL || m_pFlexVB != NULL || m_FlexStream.GetNumVertices() == 0 )
+        return S_OK;
+
+    V_RETURN( m_pd3dDevice->CreateVertexBuffer( m_FlexStream.GetDynamicBytes(), D3DUSAGE_DYNAMIC | D3DUSAGE_WRITEONLY,
+                                                0, D3DPOOL_DEFAULT, &m_pFlexVB, NULL ) );
+    return m_FlexStream.Upload( m_pFlexVB );
+}
+
+
+//--------------------------------------------------------------------------------------
+void CMeshLoader::OnLostDevice()
+{
+    SAFE_RELEASE( m_pFlexVB );
+}
+
+
+//--------------------------------------------------------------------------------------
+// A flexed subset reads the mesh vertex buffer from its first vertex on stream 0 and its
+// part of the dynamic stream on stream 1, and the negative base vertex index brings the
+// mesh indices down to both, see StudioFlexStream.h
+//--------------------------------------------------------------------------------------
+HRESULT CMeshLoader::DrawSubset( UINT iSubset )
+{
+    HRESULT hr;
+
+    const StudioFlexRange* pRange = NULL;
+    for( int i=0; i < m_FlexStream.GetNumRanges() && m_pFlexVB != NULL; i++ )
+    {
+        if( m_FlexStream.GetRange( i ).iSubset == (int)iSubset )
+            pRange = &m_FlexStream.GetRange( i );
+    }
+    if( pRange == NULL )
+        return m_pMesh->DrawSubset( iSubset );
+
+    IDirect3DVertexBuffer9* pVB = NULL;
+    IDirect3DIndexBuffer9* pIB = NULL;
+    V_RETURN( m_pMesh->GetVertexBuffer( &pVB ) );
+    hr = m_pMesh->GetIndexBuffer( &pIB );
+    if( SUCCEEDED( hr ) )
+        hr = m_pd3dDevice->SetVertexDeclaration( m_pFlexDecl );
+    if( SUCCEEDED( hr ) )
+        hr = m_pd3dDevice->SetStreamSource( 0, pVB, pRange->iFirstVertex * sizeof( Vertex ), sizeof( Vertex ) );
+    if( SUCCEEDED( hr ) )
+        hr = m_pd3dDevice->SetStreamSource( 1, m_pFlexVB, pRange->iFirstDynamic * sizeof( StudioFlexVertex ), sizeof( StudioFlexVertex ) );
+    if( SUCCEEDED( hr ) )
+        hr = m_pd3dDevice->SetIndices( pIB );
+    if( SUCCEEDED( hr ) )
+        hr = m_pd3dDevice->DrawIndexedPrimitive( D3DPT_TRIANGLELIST, -pRange->iFirstVertex, pRange->iFirstVertex,
+                                                 pRange->numVertices, pRange->iFirstIndex, pRange->numIndices / 3 );
+
+    // The mesh draws that follow only set stream 0
+    m_pd3dDevice->SetStreamSource( 1, NULL, 0, 0 );
+    SAFE_RELEASE( pIB );
+    SAFE_RELEASE( pVB );
+    return hr;
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT CMeshLoader::UpdateFlexedVertices()
+{
+    if( m_pFlexVB == NULL )
+        return S_OK;
+    return m_FlexStream.Upload( m_pFlexVB );
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT CMeshLoader::UpdateSkinnedBVH( const matrix3x4_t* pBoneToWorld )
+{
+    HRESULT hr;
+
+    if( m_pMdlFileHeader == NULL || m_VertexStreams.GetNumVertices() == 0 )
+        return E_FAIL;
+
+    int numVertices = m_VertexStreams.GetNumVertices();
+    if( m_SkinnedPositions.GetSize() != numVertices )
+    {
+        m_SkinnedPositions.RemoveAll();
+        V_RETURN( m_SkinnedPositions.SetSize( numVertices ) );
+        for( int i=0; i < numVertices; i++ )
+            m_SkinnedPositions.Add( Vector( 0, 0, 0 ) );
+    }
+
+    matrix3x4_t skinning[MAXSTUDIOBONES];
+    Studio_BuildSkinningMatrices( m_pMdlFileHeader, pBoneToWorld, skinning );
+    Studio_SkinVertices( m_pVvdFileHeader->pVertex( 0 ), m_VertexStreams.GetSourceVertices(), numVertices,
+                         skinning, m_SkinnedPositions.GetData(), NULL );
+
+    return m_BVH.Refit( m_SkinnedPositions.GetData(), sizeof( Vector ), numVertices );
+}
+
+
 //--------------------------------------------------------------------------------------
 HRESULT CMeshLoader::LoadGeometryFromMDL( const WCHAR* strFileName )
 {
@@ -232,7 +474,8 @@ HRESULT CMeshLoader::LoadGeometryFromMDL( const WCHAR* strFileName )
 	{
 		vertexFileHeader_t *	pNewVvdHdr;
 		pNewVvdHdr = new vertexFileHeader_t[vvdFileSize];
-		Studio_LoadVertexes( m_pVvdFileHeader, pNewVvdHdr, 0, true );
+		// A .vvd without a tangent block must not have one copied in from past its end
+		Studio_LoadVertexes( m_pVvdFileHeader, pNewVvdHdr, 0, m_pVvdFileHeader->tangentDataStart != 0 );
 		delete m_pVvdFileHeader;
 		m_pVvdFileHeader = pNewVvdHdr;
 	}
@@ -282,37 +525,23 @@ HRESULT CMeshLoader::LoadGeometryFromMDL( const WCHAR* strFileName )
 
 	BodyPartHeader_t* pBodyPart = m_pVtxFileHeader->pBodyPart(0);
 	ModelHeader_t*  pModel=pBodyPart->pModel(0);
+	// A dedicated shadow LOD is the last one and is never drawn as the model itself
+	int numLODs = pModel->numLODs;
+	if ((m_pMdlFileHeader->flags & STUDIOHDR_FLAGS_HASSHADOWLOD) && numLODs > 1)
+		numLODs--;
+	if (m_iLod >= numLODs)
+		m_iLod = numLODs - 1;
 	ModelLODHeader_t* pLod = pModel->pLOD(m_iLod);
 
 	mstudiobodyparts_t* pStudioBodyPart = m_pMdlFileHeader->pBodypart(0);
 	mstudiomodel_t* pStudioModel= pStudioBodyPart->pModel(0);
-	unsigned short indexOffset=0;
-	unsigned short iSubset = 0;
+	// Only the sizes are taken here, Create decodes the strip groups into the mesh
+	V_RETURN( Studio_CountGeometry( m_pMdlFileHeader, m_pVtxFileHeader, m_iLod, &m_GeometryCounts ) );
+	V_RETURN( m_SubsetSkinRef.SetSize( m_GeometryCounts.numSubsets ) );
 	for (int k=0;k<pStudioModel->nummeshes;k++)
 	{
-		MeshHeader_t* pMesh = pLod->pMesh(k);
-		mstudiomesh_t* pStudioMesh = pStudioModel->pMesh( k );
-		for (int j=0;j<pMesh->numStripGroups;j++)
-		{
-			StripGroupHeader_t* pStripGroup = pMesh->pStripGroup(j);
-			for (int i=0;i<pStripGroup->numVerts;i++)
-			{
-				Vertex vertex;
-				mstudiovertex_t studiovertex=* m_pVvdFileHeader->pVertex( pStudioMesh->vertexoffset+pStripGroup->pVertex(i)->origMeshVertID );
-				vertex.studiovertex = studiovertex;
-				vertex.vecTangent = * m_pVvdFileHeader->pTangent(pStripGroup->pVertex(i)->origMeshVertID );
-				m_Vertices.Add(vertex);
-			}
-			for (int i=0;i<pStripGroup->numIndices;i+=3)
-			{
-				m_Indices.Add(indexOffset + *pStripGroup->pIndex(i));
-				m_Indices.Add(indexOffset + *pStripGroup->pIndex(i+1));
-				m_Indices.Add(indexOffset + *pStripGroup->pIndex(i+2));
-				m_Attributes.Add( iSubset );
-			}
-			indexOffset=m_Vertices.GetSize();
-			iSubset++;
-		}
+		for (int j=0;j<pLod->pMesh(k)->numStripGroups;j++)
+			m_SubsetSkinRef.Add( pStudioModel->pMesh( k )->material );
 	}
 
 	for (int i=0;i<	m_pMdlFileHeader->numtextures;i++)
@@ -322,15 +551,60 @@ HRESULT CMeshLoader::LoadGeometryFromMDL( const WCHAR* strFileName )
 		char pTempName[MAX_PATH];
 		StringCchCopyA(pTempName,MAX_PATH,pPathName);
 		StringCchCatA(pTempName,MAX_PATH,pSkinName);
-		ShaderInfo shaderInfo;
-		GetMaterialFromVMT( pTempName, &shaderInfo );
-		Material* pMaterial = new Material();
-		InitMaterial( pMaterial );
-		WCHAR strName[MAX_PATH];
-		StringCchCopy( pMaterial->strTexture, MAX_PATH, shaderInfo.propertis.GetAt((int)ShaderPropertyName::basetexture).strValue );
-		StringCchCopy( pMaterial->strName, MAX_PATH, pMaterial->strTexture );
-		StringCchCat( pMaterial->strTexture, MAX_PATH, L".vtf" );
-		m_Materials.Add( pMaterial );
+		m_Materials.Add( CreateMaterialFromVMT( pTempName ) );
+	}
+
+	// The .vtx may swap textures for cheaper materials at this LOD. A replacement gets its
+	// own material, whose texture like any other is only loaded once a skin draws with it
+	CGrowableArray< int > lodMaterials;
+	V_RETURN( lodMaterials.SetSize( m_pMdlFileHeader->numtextures ) );
+	for (int i=0;i<m_pMdlFileHeader->numtextures;i++)
+		lodMaterials.Add( i );
+	MaterialReplacementListHeader_t* pReplacements = m_pVtxFileHeader->pMaterialReplacementList( m_iLod );
+	for (int i=0;i<pReplacements->numReplacements;i++)
+	{
+		MaterialReplacementHeader_t* pReplacement = pReplacements->pMaterialReplacement( i );
+		if (pReplacement->materialID < 0 || pReplacement->materialID >= m_pMdlFileHeader->numtextures)
+			continue;
+
+		// Several textures may share one replacement
+		int iMaterial = -1;
+		for (int x=0;x<i;x++)
+		{
+			MaterialReplacementHeader_t* pPrev = pReplacements->pMaterialReplacement( x );
+			if (pPrev->materialID >= 0 && pPrev->materialID < m_pMdlFileHeader->numtextures &&
+				0 == strcmp( pPrev->pMaterialReplacementName(), pReplacement->pMaterialReplacementName() ) &&
+				lodMaterials[pPrev->materialID] >= m_pMdlFileHeader->numtextures)
+			{
+				iMaterial = lodMaterials[pPrev->materialID];
+				break;
+			}
+		}
+		if (iMaterial < 0)
+		{
+			iMaterial = m_Materials.GetSize();
+			m_Materials.Add( CreateMaterialFromVMT( pReplacement->pMaterialReplacementName() ) );
+		}
+		lodMaterials[pReplacement->materialID] = iMaterial;
+	}
+
+	// Resolve every subset through every skin family once, so switching skins is a
+	// table lookup and the geometry is shared by all of them
+	int numSkins = m_pMdlFileHeader->numskinfamilies > 0 ? m_pMdlFileHeader->numskinfamilies : 1;
+	V_RETURN( m_SkinRemap.SetSize( numSkins * m_GeometryCounts.numSubsets ) );
+	V_RETURN( m_SkinLoaded.SetSize( numSkins ) );
+	for (int iSkin=0;iSkin<numSkins;iSkin++)
+	{
+		for (int i=0;i<m_GeometryCounts.numSubsets;i++)
+		{
+			int iTexture = m_SubsetSkinRef[i];
+			if (iTexture >= 0 && iTexture < m_pMdlFileHeader->numskinref && m_pMdlFileHeader->numskinfamilies > 0)
+				iTexture = *m_pMdlFileHeader->pSkinref( iSkin*m_pMdlFileHeader->numskinref + iTexture );
+			if (iTexture < 0 || iTexture >= m_pMdlFileHeader->numtextures)
+				iTexture = 0;
+			m_SkinRemap.Add( lodMaterials[iTexture] );
+		}
+		m_SkinLoaded.Add( false );
 	}
 
 	//WCHAR   string[25];
@@ -345,6 +619,19 @@ HRESULT CMeshLoader::LoadGeometryFromMDL( const WCHAR* strFileName )
 	return S_OK;
 }
 
+//--------------------------------------------------------------------------------------
+Material* CMeshLoader::CreateMaterialFromVMT( const char* strMaterial )
+{
+	ShaderInfo shaderInfo;
+	GetMaterialFromVMT( strMaterial, &shaderInfo );
+	Material* pMaterial = new Material();
+	InitMaterial( pMaterial );
+	StringCchCopy( pMaterial->strTexture, MAX_PATH, shaderInfo.propertis.GetAt((int)ShaderPropertyName::basetexture).strValue );
+	StringCchCopy( pMaterial->strName, MAX_PATH, pMaterial->strTexture );
+	StringCchCat( pMaterial->strTexture, MAX_PATH, L".vtf" );
+	return pMaterial;
+}
+
 //--------------------------------------------------------------------------------------
 void CMeshLoader::InitMaterial( Material* pMaterial )
 {
@@ -393,24 +680,21 @@ HRESULT CMeshLoader::CreateTextureFromVTF( IDirect3DDevice9* pd3dDevice, const W
 	//int x=(*ppTexture)->GetLevelCount();
 
 	V_RETURN( pd3dDevice->CreateTexture( pVtf->width, pVtf->height, pVtf->numMipLevels, D3DUSAGE_DYNAMIC, format, D3DPOOL_DEFAULT, ppTexture, NULL ) );
-	int ThumbnailBufferSize = GetMemRequired( pVtf->lowResImageWidth, pVtf->lowResImageHeight, pVtf->lowResImageFormat, false );
-	int ImageDataOffset = pVtf->headerSize + ThumbnailBufferSize;
-	int size=1;
-	int offset=0;
 	int memRequired=0;
-	unsigned char* pRect;
-	unsigned char* pSrc;
+	const unsigned char* pSrc;
 	D3DLOCKED_RECT rectD3D;
-	for (int i=0;i< pVtf->numMipLevels; i++)
+	// Smallest level first, the order they are stored in
+	for (int i=pVtf->numMipLevels-1;i>=0;i--)
 	{
-		V_RETURN((*ppTexture)->LockRect( pVtf->numMipLevels-1-i, &rectD3D, NULL, 0 ));
-		pRect = (unsigned char*) rectD3D.pBits; 
-		pSrc  = (unsigned char*)(((unsigned char*)pVtf) + ImageDataOffset + offset );	
-		memRequired = GetMemRequired( size, size, pVtf->imageFormat, false );
-		memcpy( pRect, pSrc, memRequired );
-		V_RETURN((*ppTexture)->UnlockRect( pVtf->numMipLevels-1-i ));
-		size*=2;
-		offset+=memRequired;
+		pSrc = GetVTFMipLevel( pVtf, fileSize, i, &memRequired );
+		if (pSrc == NULL)
+		{
+			delete pMem;
+			return DXTRACE_ERR( L"GetVTFMipLevel", E_FAIL );
+		}
+		V_RETURN((*ppTexture)->LockRect( i, &rectD3D, NULL, 0 ));
+		memcpy( rectD3D.pBits, pSrc, memRequired );
+		V_RETURN((*ppTexture)->UnlockRect( i ));
 	}
 	delete pMem;
 	inFile.close();
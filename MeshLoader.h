@@ -9,6 +9,23 @@
 #pragma once
 #include "optimize.h"//vtxfile header
 #include "vtf.h"//vtffile header
+#include "MeshBVH.h"
+#include "BoneSetup.h"
+#include "StudioBounds.h"
+#include "StudioLookup.h"
+#include "StudioActivity.h"
+#include "StudioEvents.h"
+#include "StudioTransitions.h"
+#include "StudioMovement.h"
+#include "StudioProcedural.h"
+#include "StudioFrameCache.h"
+#include "StudioPalettes.h"
+#include "StudioFlexStream.h"
+#include "StudioShadowLOD.h"
+#include "StudioPackedVertex.h"
+#include "StudioSoAMesh.h"
+#include "StudioTangents.h"
+#include "StudioGeometry.h"
 using namespace OptimizedModel;
 struct Vertex
 {
@@ -117,6 +134,31 @@ inline int GetMemRequired( int width, int height, ImageFormat imageFormat, bool
 		return memSize;
 	}
 }
+// Image data of one mip level of a single frame .vtf image, level 0 being the largest.
+// The levels follow the header and the low resolution thumbnail, smallest first.
+// Returns NULL when the level lies outside the nFileBytes of the image.
+inline const unsigned char* GetVTFMipLevel( const VTFFileHeader_t* pVtf, int nFileBytes, int iLevel, int* pnBytes )
+{
+	*pnBytes = 0;
+	if( iLevel < 0 || iLevel >= pVtf->numMipLevels )
+		return NULL;
+
+	int offset = pVtf->headerSize;
+	if( pVtf->lowResImageWidth > 0 && pVtf->lowResImageHeight > 0 )
+		offset += GetMemRequired( pVtf->lowResImageWidth, pVtf->lowResImageHeight, pVtf->lowResImageFormat, false );
+	for( int i=pVtf->numMipLevels-1; i >= iLevel; i-- )
+	{
+		int width = pVtf->width >> i;
+		int height = pVtf->height >> i;
+		*pnBytes = GetMemRequired( width > 0 ? width : 1, height > 0 ? height : 1, pVtf->imageFormat, false );
+		if( i > iLevel )
+			offset += *pnBytes;
+	}
+
+	if( offset + *pnBytes > nFileBytes )
+		return NULL;
+	return (const unsigned char*)pVtf + offset;
+}
 struct Material
 {
     WCHAR strName[MAX_PATH];
@@ -224,14 +266,82 @@ public:
     CMeshLoader();
     ~CMeshLoader();
 
-    HRESULT Create( IDirect3DDevice9* pd3dDevice, const WCHAR* strFileName );
+    HRESULT Create( IDirect3DDevice9* pd3dDevice, const WCHAR* strFileName, int iLod = 0 );
     void    Destroy();
+
+    // The dynamic flex buffer lives in the default pool and goes with the device
+    HRESULT OnResetDevice();
+    void    OnLostDevice();
+
+    // Draws through the mesh, or from the flex stream for a flexed subset
+    HRESULT DrawSubset( UINT iSubset );
     
     
     UINT GetNumMaterials() const { return m_Materials.GetSize(); }
     Material* GetMaterial( UINT iMaterial ) { return m_Materials.GetAt( iMaterial ); }
 
+    // Skin families share the mesh and only swap the material of each subset. A family's
+    // textures are loaded by LoadSkin the first time it is used, the default skin by Create.
+    UINT GetNumSubsets() const { return m_SubsetSkinRef.GetSize(); }
+    int  GetNumSkins() const { return m_SkinLoaded.GetSize(); }
+    bool IsSkinLoaded( int iSkin ) const { return iSkin >= 0 && iSkin < m_SkinLoaded.GetSize() && m_SkinLoaded[iSkin]; }
+    HRESULT LoadSkin( int iSkin );
+    Material* GetSubsetMaterial( UINT iSubset, int iSkin = 0 );
+
     ID3DXMesh* GetMesh() { return m_pMesh; }
+    int GetLOD() const { return m_iLod; }
+    CMeshBVH* GetBVH() { return &m_BVH; }
+    studiohdr_t* GetStudioHdr() { return m_pMdlFileHeader; }
+    const CStudioBounds* GetBounds() const { return &m_Bounds; }
+    const CStudioLookup* GetLookup() const { return &m_Lookup; }
+    const CStudioActivityIndex* GetActivityIndex() const { return &m_Activities; }
+    const CStudioEventIndex* GetEventIndex() const { return &m_Events; }
+    const CStudioTransitionGraph* GetTransitions() const { return &m_Transitions; }
+    const CStudioMovementCache* GetMovement() const { return &m_Movement; }
+    const CStudioProceduralBones* GetProceduralBones() const { return &m_Procedural; }
+    CStudioFrameCache* GetFrameCache() { return &m_FrameCache; }
+    const CStudioBonePalettes* GetBonePalettes() const { return &m_Palettes; }
+
+    // Flexed strip groups also live in a small dynamic stream, see StudioFlexStream.h.
+    // The vertex buffer and declaration are NULL when the LOD has no flexed groups.
+    CStudioFlexStream* GetFlexStream() { return &m_FlexStream; }
+    IDirect3DVertexBuffer9* GetFlexVertexBuffer() { return m_pFlexVB; }
+    IDirect3DVertexDeclaration9* GetFlexDecl() { return m_pFlexDecl; }
+    // Uploads GetFlexStream()->GetDynamicVertices(), call once a frame after flexing them
+    HRESULT UpdateFlexedVertices();
+
+    // Position-only stream for shadow and depth passes, drawn as one indexed triangle list
+    const CStudioShadowStream* GetShadowStream() const { return &m_ShadowStream; }
+    IDirect3DVertexBuffer9* GetShadowVertexBuffer() { return m_pShadowVB; }
+    IDirect3DIndexBuffer9* GetShadowIndexBuffer() { return m_pShadowIB; }
+    IDirect3DVertexDeclaration9* GetShadowDecl() { return m_pShadowDecl; }
+
+    // Optional 28 byte copy of the vertex buffer, see StudioPackedVertex.h. Set before
+    // Create, the buffer and declaration stay NULL otherwise.
+    void SetPackVertices( bool bPack ) { m_bPackVertices = bPack; }
+    IDirect3DVertexBuffer9* GetPackedVertexBuffer() { return m_pPackedVB; }
+    IDirect3DVertexDeclaration9* GetPackedDecl() { return m_pPackedDecl; }
+    const CStudioVertexPacker* GetVertexPacker() const { return &m_Packer; }
+    const StudioPackStats& GetPackStats() const { return m_PackStats; }
+
+    // Tangents are generated when the .vvd has none. Set before Create to replace the
+    // stored ones as well, so every model is shaded with the same tangent basis.
+    void SetRegenerateTangents( bool bRegenerate ) { m_bRegenerateTangents = bRegenerate; }
+
+    // Vertices, indices and subsets of the drawn LOD. The vertex streams are sized once
+    // from these, so GetVertexStreams()->GetNumGrows() stays 1 after Create. The subset,
+    // material and skin tables, the tangent accumulators and the BVH allocate on their own.
+    const StudioGeometryCounts& GetGeometryCounts() const { return m_GeometryCounts; }
+    // Decode the strip groups on one worker per processor, set before Create
+    void SetParallelDecode( bool bParallel ) { m_bParallelDecode = bParallel; }
+
+    // The loaded vertices as separate streams, kept for CPU side processing
+    const CStudioSoAMesh* GetVertexStreams() const { return &m_VertexStreams; }
+
+    // Skins the mesh on the CPU with the given bone-to-world transforms and refits the
+    // picking hierarchy to the skinned positions
+    HRESULT UpdateSkinnedBVH( const matrix3x4_t* pBoneToWorld );
+    const Vector* GetSkinnedPositions() { return m_SkinnedPositions.GetData(); }
     WCHAR* GetMediaDirectory() { return m_strMediaDir; }
 	HRESULT CreateTextureFromVTF( IDirect3DDevice9* pd3dDevice, const WCHAR* strFilename,  IDirect3DTexture9** ppTexture );
 	HRESULT GetMaterialFromVMT( const char* strFileName, ShaderInfo*  pShaderInfo  );
@@ -240,19 +350,47 @@ private:
     HRESULT LoadGeometryFromMDL( const WCHAR* strFileName );
 
     void    InitMaterial( Material* pMaterial );
+    Material* CreateMaterialFromVMT( const char* strMaterial );
     
     //DWORD   AddVertex( UINT hash, VERTEX* pVertex );
     //void    DeleteCache();
 
     IDirect3DDevice9* m_pd3dDevice;    // Direct3D Device object associated with this mesh
     ID3DXMesh*        m_pMesh;         // Encapsulated D3DX Mesh
+    IDirect3DVertexBuffer9* m_pFlexVB; // Dynamic positions and normals of the flexed vertices
+    IDirect3DVertexDeclaration9* m_pFlexDecl; // Mesh vertex with position and normal from stream 1
+    IDirect3DVertexBuffer9* m_pShadowVB;  // Shadow LOD positions
+    IDirect3DIndexBuffer9*  m_pShadowIB;  // Shadow LOD triangles
+    IDirect3DVertexDeclaration9* m_pShadowDecl;
+    bool              m_bPackVertices; // Build the packed vertex buffer in Create
+    bool              m_bRegenerateTangents; // Ignore the .vvd tangents in Create
+    bool              m_bParallelDecode; // Fill the geometry on several workers in Create
+    IDirect3DVertexBuffer9* m_pPackedVB;
+    IDirect3DVertexDeclaration9* m_pPackedDecl;
+    CStudioVertexPacker m_Packer;      // Box the packed positions are quantized to
+    StudioPackStats   m_PackStats;     // Size and worst errors of the packed vertices
 	unsigned short    m_iLod;
 	vertexFileHeader_t* m_pVvdFileHeader;
 	FileHeader_t*	 m_pVtxFileHeader;
 	studiohdr_t*	 m_pMdlFileHeader;
-    CGrowableArray< Vertex >      m_Vertices;      // Filled and copied to the vertex buffer
-    CGrowableArray< Material* >   m_Materials;     // Holds material properties per subset
-	CGrowableArray< DWORD >       m_Attributes;    // Filled and copied to the attribute buffer
-    CGrowableArray< unsigned short >       m_Indices;       // Filled and copied to the index buffer
+    StudioGeometryCounts          m_GeometryCounts; // Sizes of the drawn LOD from the counting pass
+    CStudioSoAMesh                m_VertexStreams; // Filled and interleaved into the vertex buffer, with the .vvd index for CPU skinning
+    CGrowableArray< Material* >   m_Materials;     // Holds material properties per .mdl texture, then per LOD replacement
+    CGrowableArray< int >         m_SubsetSkinRef; // Skin reference of the .mdl mesh each subset came from
+    CGrowableArray< int >         m_SkinRemap;     // Material of every subset for every skin family
+    CGrowableArray< bool >        m_SkinLoaded;    // Skin families whose textures have been loaded
+    CGrowableArray< Vector >      m_SkinnedPositions; // Output of the last CPU skinning
+    CMeshBVH          m_BVH;           // Triangle hierarchy for ray picking
+    CStudioBounds     m_Bounds;        // Per-bone boxes for animated bounds
+    CStudioLookup     m_Lookup;        // Hashed bone, attachment, sequence, pose parameter and flex names
+    CStudioActivityIndex m_Activities; // Sequences grouped by activity for weighted selection
+    CStudioEventIndex m_Events;        // Animation events sorted by cycle
+    CStudioTransitionGraph m_Transitions; // Next sequence for every pair of transition nodes
+    CStudioMovementCache m_Movement;   // Root motion blocks of every animation
+    CStudioProceduralBones m_Procedural; // Bone evaluation order with the procedural bone rules
+    CStudioFrameCache m_FrameCache;    // Decoded frame 0 of every animation, all frames of cached sequences
+    CStudioBonePalettes m_Palettes;    // Bones each strip references, for hardware skinning
+    CStudioFlexStream m_FlexStream;    // CPU side of the dynamic stream
+    CStudioShadowStream m_ShadowStream; // Position-only stream from the shadow or coarsest LOD
     WCHAR m_strMediaDir[ MAX_PATH ];               // Directory where the mesh was found
 };
@@ -0,0 +1,166 @@
+//--------------------------------------------------------------------------------------
+// File: StudioActivity.cpp
+//
+// Activity to sequence index for studio models.
+//
+//--------------------------------------------------------------------------------------
+#include "DXUT.h"
+#include "StudioActivity.h"
+
+
+//--------------------------------------------------------------------------------------
+// Numbers the activities, writes them back to the sequence descriptions so
+// studiohdr_t::GetSequenceActivity agrees, and groups the sequences by activity.
+//--------------------------------------------------------------------------------------
+HRESULT CStudioActivityIndex::Init( studiohdr_t* pStudioHdr )
+{
+	HRESULT hr;
+
+	Destroy();
+
+	int numSeq = pStudioHdr->GetNumSeq();
+	V_RETURN( m_Names.Init( numSeq ) );
+	V_RETURN( m_SequenceActivity.SetSize( numSeq ) );
+	V_RETURN( m_SequenceWeight.SetSize( numSeq ) );
+
+	for( int i=0; i < numSeq; i++ )
+	{
+		mstudioseqdesc_t& seqdesc = pStudioHdr->pSeqdesc( i );
+		const char* pszName = seqdesc.pszActivityName();
+
+		int iActivity = ACT_INVALID;
+		if( pszName[0] )
+		{
+			iActivity = m_Names.Find( pszName );
+			if( iActivity == -1 )
+			{
+				iActivity = m_Activities.GetSize();
+				m_Names.Insert( pszName, iActivity );
+
+				StudioActivity activity = { pszName, 0, 0, 0 };
+				V_RETURN( m_Activities.Add( activity ) );
+			}
+			m_Activities[iActivity].nCount++;
+			m_Activities[iActivity].nTotalWeight += abs( seqdesc.actweight );
+		}
+
+		m_SequenceActivity.Add( iActivity );
+		m_SequenceWeight.Add( seqdesc.actweight );
+		pStudioHdr->SetSequenceActivity( i, iActivity );
+	}
+	pStudioHdr->SetActivityListVersion( 1 );
+
+	// Lay the groups out back to back
+	int nTotal = 0;
+	for( int i=0; i < m_Activities.GetSize(); i++ )
+	{
+		m_Activities[i].iFirst = nTotal;
+		nTotal += m_Activities[i].nCount;
+	}
+
+	V_RETURN( m_Sequences.SetSize( nTotal ) );
+	V_RETURN( m_CumulativeWeights.SetSize( nTotal ) );
+	for( int i=0; i < nTotal; i++ )
+	{
+		m_Sequences.Add( -1 );
+		m_CumulativeWeights.Add( 0 );
+	}
+
+	CGrowableArray< int > fill;
+	V_RETURN( fill.SetSize( m_Activities.GetSize() ) );
+	for( int i=0; i < m_Activities.GetSize(); i++ )
+		fill.Add( 0 );
+
+	for( int i=0; i < numSeq; i++ )
+	{
+		int iActivity = m_SequenceActivity[i];
+		if( iActivity == ACT_INVALID )
+			continue;
+
+		const StudioActivity& activity = m_Activities[iActivity];
+		int iEntry = activity.iFirst + fill[iActivity]++;
+		int nPrevious = iEntry > activity.iFirst ? m_CumulativeWeights[iEntry - 1] : 0;
+		m_Sequences[iEntry] = i;
+		m_CumulativeWeights[iEntry] = nPrevious + abs( m_SequenceWeight[i] );
+	}
+
+	return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+void CStudioActivityIndex::Destroy()
+{
+	m_Names.Destroy();
+	m_Activities.RemoveAll();
+	m_Sequences.RemoveAll();
+	m_CumulativeWeights.RemoveAll();
+	m_SequenceActivity.RemoveAll();
+	m_SequenceWeight.RemoveAll();
+}
+
+
+//--------------------------------------------------------------------------------------
+const char* CStudioActivityIndex::GetActivityName( int iActivity ) const
+{
+	if( iActivity < 0 || iActivity >= m_Activities.GetSize() )
+		return NULL;
+	return m_Activities[iActivity].pszName;
+}
+
+
+//--------------------------------------------------------------------------------------
+int CStudioActivityIndex::GetSequenceActivity( int iSequence ) const
+{
+	if( iSequence < 0 || iSequence >= m_SequenceActivity.GetSize() )
+		return ACT_INVALID;
+	return m_SequenceActivity[iSequence];
+}
+
+
+//--------------------------------------------------------------------------------------
+int CStudioActivityIndex::GetNumSequences( int iActivity ) const
+{
+	if( iActivity < 0 || iActivity >= m_Activities.GetSize() )
+		return 0;
+	return m_Activities[iActivity].nCount;
+}
+
+
+//--------------------------------------------------------------------------------------
+int CStudioActivityIndex::GetSequence( int iActivity, int i ) const
+{
+	if( iActivity < 0 || iActivity >= m_Activities.GetSize() || i < 0 || i >= m_Activities[iActivity].nCount )
+		return -1;
+	return m_Sequences[m_Activities[iActivity].iFirst + i];
+}
+
+
+//--------------------------------------------------------------------------------------
+int CStudioActivityIndex::SelectWeightedSequence( int iActivity, int iCurSequence, int iRandom ) const
+{
+	if( iActivity < 0 || iActivity >= m_Activities.GetSize() )
+		return -1;
+
+	if( GetSequenceActivity( iCurSequence ) == iActivity && m_SequenceWeight[iCurSequence] < 0 )
+		return iCurSequence;
+
+	const StudioActivity& activity = m_Activities[iActivity];
+	if( activity.nTotalWeight == 0 )
+		return m_Sequences[activity.iFirst];
+
+	// First entry whose running total passes the pick
+	int iPick = (int)( (unsigned int)iRandom % (unsigned int)activity.nTotalWeight );
+	int iLow = activity.iFirst;
+	int iHigh = activity.iFirst + activity.nCount - 1;
+	while( iLow < iHigh )
+	{
+		int iMid = ( iLow + iHigh ) / 2;
+		if( m_CumulativeWeights[iMid] > iPick )
+			iHigh = iMid;
+		else
+			iLow = iMid + 1;
+	}
+
+	return m_Sequences[iLow];
+}
@@ -0,0 +1,50 @@
+//--------------------------------------------------------------------------------------
+// File: StudioActivity.h
+//
+// Activity to sequence index for studio models. Activities are numbered by name in the
+// order they first appear. Sequences of one activity are stored together with running
+// weight totals, so a weighted pick is a table lookup plus a binary search. The index
+// is built once per model and is read-only afterwards, so every instance can share it.
+//
+//--------------------------------------------------------------------------------------
+#pragma once
+#include "StudioLookup.h"
+
+#define ACT_INVALID		-1
+
+struct StudioActivity
+{
+	const char* pszName;
+	int         iFirst;         // first entry in the sequence list
+	int         nCount;
+	int         nTotalWeight;
+};
+
+class CStudioActivityIndex
+{
+public:
+	HRESULT Init( studiohdr_t* pStudioHdr );
+	void    Destroy();
+
+	int     GetNumActivities() const { return m_Activities.GetSize(); }
+	int     FindActivity( const char* pszName ) const { return m_Names.Find( pszName ); }
+	const char* GetActivityName( int iActivity ) const;
+	int     GetSequenceActivity( int iSequence ) const;
+
+	int     GetNumSequences( int iActivity ) const;
+	// i-th sequence of the activity, -1 when either index is out of range
+	int     GetSequence( int iActivity, int i ) const;
+
+	// Picks a sequence of the activity with probability proportional to its weight.
+	// iRandom is any non-negative random number. A current sequence with a negative
+	// weight is kept, as the engine does. Returns -1 if no sequence has the activity.
+	int     SelectWeightedSequence( int iActivity, int iCurSequence, int iRandom ) const;
+
+private:
+	CStudioNameTable                m_Names;
+	CGrowableArray< StudioActivity > m_Activities;
+	CGrowableArray< int >           m_Sequences;            // grouped by activity
+	CGrowableArray< int >           m_CumulativeWeights;    // running total within each group
+	CGrowableArray< int >           m_SequenceActivity;     // per sequence
+	CGrowableArray< int >           m_SequenceWeight;       // per sequence, actweight as stored
+};
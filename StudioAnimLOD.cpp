@@ -0,0 +1,240 @@
+//--------------------------------------------------------------------------------------
+// File: StudioAnimLOD.cpp
+//
+// Animation update-rate LOD for studio models.
+//
+//--------------------------------------------------------------------------------------
+#include "DXUT.h"
+#include "StudioAnimLOD.h"
+
+
+//--------------------------------------------------------------------------------------
+float Studio_ComputeLODMetric( const studiohdr_t* pStudioHdr, const Vector& vOrigin, const Vector& vEye )
+{
+	Vector vExtent = pStudioHdr->hull_max - pStudioHdr->hull_min;
+	float flRadius = 0.5f * D3DXVec3Length( &vExtent );
+	Vector vDelta = vOrigin - vEye;
+	float flDist = D3DXVec3Length( &vDelta );
+	if( flRadius < 1.0f )
+		flRadius = 1.0f;
+	return flDist / flRadius;
+}
+
+
+//--------------------------------------------------------------------------------------
+CStudioAnimScheduler::CStudioAnimScheduler()
+{
+	m_pInstances = NULL;
+	m_nInstances = 0;
+	m_iFrame = 0;
+	ZeroMemory( &m_Stats, sizeof( m_Stats ) );
+
+	// Every frame up close, then every 2nd and 4th frame with coarser skeletons
+	static const StudioAnimLODLevel s_DefaultLevels[] =
+	{
+		{ 20.0f,  1, 0 },
+		{ 60.0f,  2, 1 },
+		{ FLT_MAX, 4, 2 },
+	};
+	SetLevels( s_DefaultLevels, sizeof( s_DefaultLevels ) / sizeof( s_DefaultLevels[0] ) );
+}
+
+
+//--------------------------------------------------------------------------------------
+CStudioAnimScheduler::~CStudioAnimScheduler()
+{
+	Destroy();
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT CStudioAnimScheduler::Init( int nMaxInstances )
+{
+	Destroy();
+
+	m_pInstances = new Instance[nMaxInstances];
+	if( m_pInstances == NULL )
+		return E_OUTOFMEMORY;
+	m_nInstances = nMaxInstances;
+
+	for( int i=0; i < nMaxInstances; i++ )
+		Invalidate( i );
+
+	return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+void CStudioAnimScheduler::Destroy()
+{
+	SAFE_DELETE_ARRAY( m_pInstances );
+	m_nInstances = 0;
+	m_iFrame = 0;
+	ZeroMemory( &m_Stats, sizeof( m_Stats ) );
+}
+
+
+//--------------------------------------------------------------------------------------
+void CStudioAnimScheduler::SetLevels( const StudioAnimLODLevel* pLevels, int nLevels )
+{
+	if( nLevels > ANIMLOD_MAX_LEVELS )
+		nLevels = ANIMLOD_MAX_LEVELS;
+
+	m_nLevels = nLevels;
+	for( int i=0; i < nLevels; i++ )
+	{
+		m_Levels[i] = pLevels[i];
+		if( m_Levels[i].nInterval < 1 )
+			m_Levels[i].nInterval = 1;
+	}
+
+	for( int i=0; i < m_nInstances; i++ )
+		Invalidate( i );
+}
+
+
+//--------------------------------------------------------------------------------------
+int CStudioAnimScheduler::SelectLevel( float flMetric, int iCurrentLevel ) const
+{
+	int iLevel = m_nLevels - 1;
+	for( int i=0; i < m_nLevels - 1; i++ )
+	{
+		if( flMetric <= m_Levels[i].flMaxMetric )
+		{
+			iLevel = i;
+			break;
+		}
+	}
+	if( iCurrentLevel < 0 || iCurrentLevel >= m_nLevels || iLevel == iCurrentLevel )
+		return iLevel;
+
+	// Stay until the metric is clear of the band around either threshold of the level
+	float flLow = ( iCurrentLevel > 0 ) ? m_Levels[iCurrentLevel - 1].flMaxMetric * ( 1.0f - ANIMLOD_HYSTERESIS ) : -FLT_MAX;
+	float flHigh = ( iCurrentLevel < m_nLevels - 1 ) ? m_Levels[iCurrentLevel].flMaxMetric * ( 1.0f + ANIMLOD_HYSTERESIS ) : FLT_MAX;
+	if( flMetric > flLow && flMetric <= flHigh )
+		return iCurrentLevel;
+	return iLevel;
+}
+
+
+//--------------------------------------------------------------------------------------
+void CStudioAnimScheduler::BeginFrame()
+{
+	m_iFrame++;
+	ZeroMemory( &m_Stats, sizeof( m_Stats ) );
+}
+
+
+//--------------------------------------------------------------------------------------
+void CStudioAnimScheduler::Invalidate( int iInstance )
+{
+	if( iInstance < 0 || iInstance >= m_nInstances )
+		return;
+
+	m_pInstances[iInstance].pStudioHdr = NULL;
+	m_pInstances[iInstance].iSequence = -1;
+	m_pInstances[iInstance].iLevel = -1;
+	m_pInstances[iInstance].iLastFrame = -1;
+	m_pInstances[iInstance].nSpan = 1;
+}
+
+
+//--------------------------------------------------------------------------------------
+void CStudioAnimScheduler::Evaluate( const studiohdr_t* pStudioHdr, const CStudioFrameCache* pFrameCache, int iSequence, float flCycle,
+									 const float poseParameter[], int boneMask, Vector pos[], Quaternion q[] )
+{
+	if( pFrameCache )
+		pFrameCache->CalcPose( iSequence, flCycle, poseParameter, pos, q, boneMask );
+	else
+		Studio_CalcPose( pStudioHdr, iSequence, flCycle, poseParameter, pos, q, boneMask );
+
+	m_Stats.nEvaluations++;
+	for( int i=0; i < pStudioHdr->numbones; i++ )
+	{
+		if( pStudioHdr->pBone( i )->flags & boneMask )
+			m_Stats.nBonesEvaluated++;
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+bool CStudioAnimScheduler::Animate( int iInstance, const studiohdr_t* pStudioHdr, const CStudioFrameCache* pFrameCache,
+									int iSequence, float flCycle, float flCycleRate, const float poseParameter[],
+									float flMetric, Vector pos[], Quaternion q[] )
+{
+	m_Stats.nInstances++;
+
+	bool bSlot = iInstance >= 0 && iInstance < m_nInstances;
+	int iLevel = SelectLevel( flMetric, bSlot ? m_pInstances[iInstance].iLevel : -1 );
+	const StudioAnimLODLevel& level = m_Levels[iLevel];
+	int boneMask = Studio_BoneMaskForLOD( level.iBoneLOD );
+
+	// Without a slot, or at full rate, evaluate directly. The level is remembered for
+	// the hysteresis, the schedule restarts if the instance drops to a lower rate.
+	if( !bSlot || level.nInterval == 1 )
+	{
+		Evaluate( pStudioHdr, pFrameCache, iSequence, flCycle, poseParameter, boneMask, pos, q );
+		if( bSlot )
+		{
+			Invalidate( iInstance );
+			m_pInstances[iInstance].iLevel = iLevel;
+		}
+		return true;
+	}
+
+	Instance& inst = m_pInstances[iInstance];
+	bool bRestart = inst.iLastFrame < 0 || inst.pStudioHdr != pStudioHdr || inst.iSequence != iSequence || inst.iLevel != iLevel;
+	bool bUpdate = bRestart || m_iFrame - inst.iLastFrame >= inst.nSpan;
+
+	if( bUpdate )
+	{
+		// The pose planned for now becomes the start, or is evaluated when there isn't one
+		if( bRestart )
+			Evaluate( pStudioHdr, pFrameCache, iSequence, flCycle, poseParameter, boneMask, inst.prevPos, inst.prevQ );
+		else
+		{
+			memcpy( inst.prevPos, inst.nextPos, sizeof( Vector ) * pStudioHdr->numbones );
+			memcpy( inst.prevQ, inst.nextQ, sizeof( Quaternion ) * pStudioHdr->numbones );
+		}
+
+		// Target at the instance's next slot, wrapped for looping sequences. A restart
+		// may land between slots and gets a shorter first span.
+		int nSpan = level.nInterval - ( m_iFrame + iInstance ) % level.nInterval;
+		float flNextCycle = flCycle + flCycleRate * nSpan;
+		if( pStudioHdr->pSeqdesc( iSequence ).flags & STUDIO_LOOPING )
+			flNextCycle -= floorf( flNextCycle );
+		else if( flNextCycle > 1.0f )
+			flNextCycle = 1.0f;
+		Evaluate( pStudioHdr, pFrameCache, iSequence, flNextCycle, poseParameter, boneMask, inst.nextPos, inst.nextQ );
+
+		inst.pStudioHdr = pStudioHdr;
+		inst.iSequence = iSequence;
+		inst.iLevel = iLevel;
+		inst.iLastFrame = m_iFrame;
+		inst.nSpan = nSpan;
+	}
+	else
+	{
+		m_Stats.nInterpolated++;
+	}
+
+	float t = (float)( m_iFrame - inst.iLastFrame ) / inst.nSpan;
+	for( int i=0; i < pStudioHdr->numbones; i++ )
+	{
+		if( !( pStudioHdr->pBone( i )->flags & boneMask ) )
+			continue;
+
+		if( t > 0.0f )
+		{
+			pos[i] = inst.prevPos[i] * ( 1.0f - t ) + inst.nextPos[i] * t;
+			QuaternionBlend( inst.prevQ[i], inst.nextQ[i], t, q[i] );
+		}
+		else
+		{
+			pos[i] = inst.prevPos[i];
+			q[i] = inst.prevQ[i];
+		}
+	}
+
+	return bUpdate;
+}
@@ -0,0 +1,99 @@
+//--------------------------------------------------------------------------------------
+// File: StudioAnimLOD.h
+//
+// Animation update-rate LOD. Each instance picks a level from its LOD metric, the
+// distance to the eye in multiples of the model's hull radius. Near levels evaluate
+// bones every frame. Farther ones evaluate every Nth frame, one interval ahead, and
+// blend towards that pose in between. Updates are staggered by instance index so each
+// frame does a similar amount of work. Every level also names the vertex LOD whose
+// bones it needs, and bones only used by finer LODs are skipped.
+//
+// Switching levels restarts an instance's schedule, so an instance only leaves its
+// level once the metric is ANIMLOD_HYSTERESIS past the threshold. A model resting on
+// a threshold keeps its level instead of switching every frame.
+//
+//--------------------------------------------------------------------------------------
+#pragma once
+#include "StudioFrameCache.h"
+
+#define ANIMLOD_MAX_LEVELS	8
+#define ANIMLOD_HYSTERESIS	0.1f	// fraction of a threshold the metric must pass to switch
+
+struct StudioAnimLODLevel
+{
+	float flMaxMetric;      // used up to this distance / hull radius
+	int   nInterval;        // frames between evaluations, 1 for every frame
+	int   iBoneLOD;         // vertex LOD whose bones are evaluated
+};
+
+struct StudioAnimLODStats
+{
+	int nInstances;         // instances animated this frame
+	int nEvaluations;       // poses evaluated this frame
+	int nInterpolated;      // instances served by blending
+	int nBonesEvaluated;    // bones decoded this frame
+};
+
+// Distance from the eye to the model origin in multiples of its hull radius
+float Studio_ComputeLODMetric( const studiohdr_t* pStudioHdr, const Vector& vOrigin, const Vector& vEye );
+
+// Flags of the bones needed to draw a vertex LOD and place attachments
+inline int Studio_BoneMaskForLOD( int iBoneLOD )
+{
+	return BONE_USED_BY_VERTEX_AT_LOD( iBoneLOD ) | BONE_USED_BY_ATTACHMENT;
+}
+
+class CStudioAnimScheduler
+{
+public:
+	CStudioAnimScheduler();
+	~CStudioAnimScheduler();
+
+	HRESULT Init( int nMaxInstances );
+	void    Destroy();
+
+	// Levels sorted by flMaxMetric. The last one also covers anything farther.
+	void    SetLevels( const StudioAnimLODLevel* pLevels, int nLevels );
+	// Level for the metric, iCurrentLevel is kept while the metric is within the
+	// hysteresis band around its thresholds
+	int     SelectLevel( float flMetric, int iCurrentLevel = -1 ) const;
+
+	// Advances the frame and clears the per-frame counters
+	void    BeginFrame();
+
+	// Local pose of an instance playing iSequence at flCycle, advancing flCycleRate
+	// cycles per frame. Returns true if bones were evaluated this frame. Only the bones
+	// of the level's bone mask are written.
+	bool    Animate( int iInstance, const studiohdr_t* pStudioHdr, const CStudioFrameCache* pFrameCache,
+					 int iSequence, float flCycle, float flCycleRate, const float poseParameter[],
+					 float flMetric, Vector pos[], Quaternion q[] );
+
+	// Forces the instance to evaluate on its next Animate, e.g. after a teleport
+	void    Invalidate( int iInstance );
+
+	const StudioAnimLODStats& GetStats() const { return m_Stats; }
+
+private:
+	struct Instance
+	{
+		const studiohdr_t*  pStudioHdr;
+		int                 iSequence;
+		int                 iLevel;         // level in use, -1 if none
+		int                 iLastFrame;     // frame of the last evaluation, -1 if invalid
+		int                 nSpan;          // frames from the last evaluation to the next one
+		Vector              prevPos[MAXSTUDIOBONES];    // pose at the last evaluation frame
+		Quaternion          prevQ[MAXSTUDIOBONES];
+		Vector              nextPos[MAXSTUDIOBONES];    // pose one interval later
+		Quaternion          nextQ[MAXSTUDIOBONES];
+	};
+
+	void    Evaluate( const studiohdr_t* pStudioHdr, const CStudioFrameCache* pFrameCache, int iSequence, float flCycle,
+					  const float poseParameter[], int boneMask, Vector pos[], Quaternion q[] );
+
+	Instance*           m_pInstances;
+	int                 m_nInstances;
+	StudioAnimLODLevel  m_Levels[ANIMLOD_MAX_LEVELS];
+	int                 m_nLevels;
+	int                 m_iFrame;
+	StudioAnimLODStats  m_Stats;
+};
@@ -0,0 +1,1288 @@
+//--------------------------------------------------------------------------------------
+// File: StudioBench.cpp
+//
+// Console benchmark of the CPU side of loading a model, run on the sample model and
+// material and on synthetic models from StudioSynth.h.
+//
+// For every model:
+//   load            what Create does before it touches the device: take the three file
+//                   images, run the .vvd fixups, check the headers, count and fill LOD 0
+//                   and generate tangents when the .vvd has none
+//   vvd_fixup       Studio_LoadVertexes
+//   vtx_count       Studio_CountGeometry, the walk over the .vtx headers
+//   vtx_fill_wN     Studio_FillGeometry on N workers
+//   tangents_wN     Studio_GenerateTangents on N workers
+//   pack            CStudioVertexPacker::Pack, with -pack only, after which the packed
+//                   bytes and the worst quantization errors are printed
+// and before them it prints
+//   palettes        the strips of LOD 0, how many fall back to the full skeleton, and
+//                   the bone matrix bytes one pass uploads per strip with the palettes
+//                   and with the full skeleton, once CStudioBonePalettes::Validate has
+//                   matched every blend index against its .vvd weight
+// For the sample model, unless -crowd is 0:
+//   crowd/pose      Studio_CalcPose through the frame cache for every instance
+//   crowd/matrices  CStudioProceduralBones::BuildMatrices over the poses of the whole
+//                   crowd in one batch, after which the procedural bones are counted
+//   crowd/pose_cache
+//                   CStudioPoseCache::GetPose for every instance, after which the hit
+//                   rate over all the runs is printed
+//   crowd/anim_lod  CStudioAnimScheduler::Animate for every instance, the crowd standing
+//                   on a grid that starts 4 hull radii from the eye, after which the
+//                   instances per level and the bones evaluated per frame are printed
+// Once:
+//   vmt_parse       CMeshLoader::GetMaterialFromVMT
+//   vtf_mips        the CPU side of CreateTextureFromVTF, every mip level copied out
+//   mem_required    GetMemRequired for five formats at every size from 1 to 4096
+//
+// Every benchmark runs until it has at least -iterations samples and -time ms, then
+// reports the median and 99th percentile time, MB/s over the median and allocations
+// per run. MB/s counts the input bytes for load, fixup, vmt and vtf, and the output
+// bytes for fill, tangents and pack. Allocations are the malloc, realloc and _aligned_malloc
+// calls of the executable, operator new included, counted the same way in debug and
+// release builds.
+//
+// StudioBench [options]
+//   -model path      .mdl/.vvd/.dx90.vtx base name (Models\Combine_Soldier)
+//   -material path   .vmt and .vtf base name (Models\Combine_Soldier\combinesoldiersheet)
+//   -nosynth         skip the 10k, 100k and 1m vertex synthetic models
+//   -crowd n         instances in the crowd benchmarks, 0 skips them (256)
+//   -pack            also pack the vertices of every model to the 28 byte format
+//   -iterations n    samples at least (10)
+//   -time ms         time per benchmark at least (250)
+//   -json file       write the results
+//   -baseline file   compare with results written by -json earlier
+//   -threshold pct   median slowdown that counts as a regression (10)
+//
+// Exits with 2 when a benchmark regressed or its allocations changed against the
+// baseline, and with 1 when a model cannot be loaded, LOD 0 past 16 bit indices
+// included, or its bone palettes don't validate.
+//
+//--------------------------------------------------------------------------------------
+#include "DXUT.h"
+#pragma warning(disable: 4995)
+#include "MeshLoader.h"
+#include "StudioSynth.h"
+#include "StudioThreads.h"
+#include "StudioPoseCache.h"
+#include "StudioAnimLOD.h"
+#include <fstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <new>
+using namespace std;
+#pragma warning(default: 4995)
+
+#define BENCH_MAX_NAME	64
+#define BENCH_MAX_BODYPART_VERTICES	60000	// synthetic body parts, below GEOMETRY_MAX_VERTICES after the grid rounds up
+
+static volatile LONG g_nAllocations = 0;
+
+
+//--------------------------------------------------------------------------------------
+// Allocation counting
+//
+// Both builds use the CRT in a DLL, so every heap function this executable calls goes
+// through its import table. The entries of the allocating ones are pointed at counting
+// wrappers, which sees malloc, realloc and _aligned_malloc alike in debug and release.
+// operator new is replaced by one that calls the hooked malloc.
+//--------------------------------------------------------------------------------------
+static const char* g_strAllocCounter = "crt imports";
+
+typedef void* (__cdecl *PFNMALLOC)( size_t nBytes );
+typedef void* (__cdecl *PFNCALLOC)( size_t nCount, size_t nBytes );
+typedef void* (__cdecl *PFNREALLOC)( void* p, size_t nBytes );
+typedef void* (__cdecl *PFNALIGNEDMALLOC)( size_t nBytes, size_t nAlignment );
+typedef void* (__cdecl *PFNALIGNEDREALLOC)( void* p, size_t nBytes, size_t nAlignment );
+
+static PFNMALLOC g_pfnMalloc = NULL;
+static PFNCALLOC g_pfnCalloc = NULL;
+static PFNREALLOC g_pfnRealloc = NULL;
+static PFNALIGNEDMALLOC g_pfnAlignedMalloc = NULL;
+static PFNALIGNEDREALLOC g_pfnAlignedRealloc = NULL;
+
+static void* __cdecl CountMalloc( size_t nBytes )
+{
+	InterlockedIncrement( &g_nAllocations );
+	return g_pfnMalloc( nBytes );
+}
+
+static void* __cdecl CountCalloc( size_t nCount, size_t nBytes )
+{
+	InterlockedIncrement( &g_nAllocations );
+	return g_pfnCalloc( nCount, nBytes );
+}
+
+static void* __cdecl CountRealloc( void* p, size_t nBytes )
+{
+	InterlockedIncrement( &g_nAllocations );
+	return g_pfnRealloc( p, nBytes );
+}
+
+static void* __cdecl CountAlignedMalloc( size_t nBytes, size_t nAlignment )
+{
+	InterlockedIncrement( &g_nAllocations );
+	return g_pfnAlignedMalloc( nBytes, nAlignment );
+}
+
+static void* __cdecl CountAlignedRealloc( void* p, size_t nBytes, size_t nAlignment )
+{
+	InterlockedIncrement( &g_nAllocations );
+	return g_pfnAlignedRealloc( p, nBytes, nAlignment );
+}
+
+
+//--------------------------------------------------------------------------------------
+// Points the import of strFunction at pfnHook, the old target goes to ppfnOriginal.
+// Returns false when the executable does not import the function by name.
+//--------------------------------------------------------------------------------------
+static bool HookImport( const char* strFunction, void* pfnHook, void** ppfnOriginal )
+{
+	BYTE* pBase = (BYTE*)GetModuleHandle( NULL );
+	if( pBase == NULL || ( (IMAGE_DOS_HEADER*)pBase )->e_magic != IMAGE_DOS_SIGNATURE )
+		return false;
+	IMAGE_NT_HEADERS* pNtHeaders = (IMAGE_NT_HEADERS*)( pBase + ( (IMAGE_DOS_HEADER*)pBase )->e_lfanew );
+	if( pNtHeaders->Signature != IMAGE_NT_SIGNATURE )
+		return false;
+	const IMAGE_DATA_DIRECTORY& imports = pNtHeaders->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_IMPORT];
+	if( imports.VirtualAddress == 0 )
+		return false;
+
+	bool bHooked = false;
+	for( IMAGE_IMPORT_DESCRIPTOR* pImport = (IMAGE_IMPORT_DESCRIPTOR*)( pBase + imports.VirtualAddress ); pImport->Name; pImport++ )
+	{
+		// The names are only kept in the original thunks, the bound ones hold addresses
+		if( pImport->OriginalFirstThunk == 0 )
+			continue;
+		IMAGE_THUNK_DATA* pName = (IMAGE_THUNK_DATA*)( pBase + pImport->OriginalFirstThunk );
+		IMAGE_THUNK_DATA* pAddress = (IMAGE_THUNK_DATA*)( pBase + pImport->FirstThunk );
+		for( ; pName->u1.AddressOfData; pName++, pAddress++ )
+		{
+			if( IMAGE_SNAP_BY_ORDINAL( pName->u1.Ordinal ) )
+				continue;
+			const IMAGE_IMPORT_BY_NAME* pByName = (const IMAGE_IMPORT_BY_NAME*)( pBase + pName->u1.AddressOfData );
+			if( 0 != strcmp( (const char*)pByName->Name, strFunction ) )
+				continue;
+
+			// The import table is read only once the loader is done with it
+			DWORD dwProtect;
+			if( !VirtualProtect( &pAddress->u1.Function, sizeof( pAddress->u1.Function ), PAGE_READWRITE, &dwProtect ) )
+				return false;
+			*ppfnOriginal = (void*)(DWORD_PTR)pAddress->u1.Function;
+			pAddress->u1.Function = (DWORD_PTR)pfnHook;
+			VirtualProtect( &pAddress->u1.Function, sizeof( pAddress->u1.Function ), dwProtect, &dwProtect );
+			bHooked = true;
+		}
+	}
+	return bHooked;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Returns false when malloc is not imported, the CRT is linked statically then and
+// nothing would be counted
+//--------------------------------------------------------------------------------------
+static bool HookAllocations()
+{
+	if( !HookImport( "malloc", CountMalloc, (void**)&g_pfnMalloc ) )
+		return false;
+	HookImport( "calloc", CountCalloc, (void**)&g_pfnCalloc );
+	HookImport( "realloc", CountRealloc, (void**)&g_pfnRealloc );
+	HookImport( "_aligned_malloc", CountAlignedMalloc, (void**)&g_pfnAlignedMalloc );
+	HookImport( "_aligned_realloc", CountAlignedRealloc, (void**)&g_pfnAlignedRealloc );
+	return true;
+}
+
+
+//--------------------------------------------------------------------------------------
+void* operator new( size_t nBytes )
+{
+	void* p = malloc( nBytes ? nBytes : 1 );
+	if( p == NULL )
+		throw std::bad_alloc();
+	return p;
+}
+
+void* operator new[]( size_t nBytes )
+{
+	return operator new( nBytes );
+}
+
+void operator delete( void* p )
+{
+	free( p );
+}
+
+void operator delete[]( void* p )
+{
+	free( p );
+}
+
+
+//--------------------------------------------------------------------------------------
+// Timing
+//--------------------------------------------------------------------------------------
+typedef HRESULT (*BenchFn)( void* pContext );
+
+struct BenchResult
+{
+	char   strName[BENCH_MAX_NAME];
+	int    nIterations;
+	double flMedianUs;
+	double flP99Us;
+	double flMBps;
+	double flAllocsPerOp;
+};
+
+struct BenchSettings
+{
+	int nMinIterations;
+	int nMinTimeMs;
+};
+
+static int CompareDouble( const void* a, const void* b )
+{
+	double d = *(const double*)a - *(const double*)b;
+	return d < 0 ? -1 : ( d > 0 ? 1 : 0 );
+}
+
+
+//--------------------------------------------------------------------------------------
+static HRESULT RunBench( const BenchSettings& settings, const char* strName, BenchFn pfnBench, void* pContext,
+						 int nBytes, CGrowableArray< BenchResult >* pResults )
+{
+	HRESULT hr;
+
+	LARGE_INTEGER frequency, start, end;
+	QueryPerformanceFrequency( &frequency );
+
+	// One untimed run to warm the caches and fault in the pages
+	V_RETURN( pfnBench( pContext ) );
+
+	CGrowableArray< double > samples;
+	V_RETURN( samples.SetSize( settings.nMinIterations ) );
+	double flTotalUs = 0;
+	LONG nAllocations = 0;
+	while( samples.GetSize() < settings.nMinIterations || flTotalUs < settings.nMinTimeMs * 1000.0 )
+	{
+		LONG nAllocationsBefore = g_nAllocations;
+		QueryPerformanceCounter( &start );
+		hr = pfnBench( pContext );
+		QueryPerformanceCounter( &end );
+		nAllocations += g_nAllocations - nAllocationsBefore;
+		if( FAILED( hr ) )
+			return hr;
+
+		double flUs = (double)( end.QuadPart - start.QuadPart ) * 1000000.0 / (double)frequency.QuadPart;
+		V_RETURN( samples.Add( flUs ) );
+		flTotalUs += flUs;
+	}
+
+	int n = samples.GetSize();
+	qsort( samples.GetData(), n, sizeof( double ), CompareDouble );
+
+	BenchResult result;
+	ZeroMemory( &result, sizeof( result ) );
+	StringCchCopyA( result.strName, BENCH_MAX_NAME, strName );
+	result.nIterations = n;
+	result.flMedianUs = ( n & 1 ) ? samples[n / 2] : 0.5 * ( samples[n / 2 - 1] + samples[n / 2] );
+	int iP99 = (int)( 0.99 * ( n - 1 ) + 0.5 );
+	result.flP99Us = samples[iP99];
+	result.flMBps = result.flMedianUs > 0 ? nBytes / result.flMedianUs : 0;
+	result.flAllocsPerOp = (double)nAllocations / n;
+
+	printf( "  %-28s %10.1f %10.1f %10.1f %8.1f %8d\n", result.strName, result.flMedianUs, result.flP99Us,
+			result.flMBps, result.flAllocsPerOp, result.nIterations );
+	return pResults->Add( result );
+}
+
+
+//--------------------------------------------------------------------------------------
+// Models
+//--------------------------------------------------------------------------------------
+enum
+{
+	FILE_MDL,
+	FILE_VVD,
+	FILE_VTX,
+	NUM_FILES
+};
+
+struct BenchModel
+{
+	char   strName[BENCH_MAX_NAME];
+	char*  pFiles[NUM_FILES];       // images as read from disk
+	int    nFileBytes[NUM_FILES];
+
+	// Set up once for the single stage benchmarks
+	char*  pVvd;                    // fixed up .vvd
+	StudioGeometryCounts counts;    // LOD 0
+	CStudioSoAMesh streams;
+	unsigned short* pIndices;
+	DWORD* pAttributes;
+	Vector4D* pTangents;
+	CStudioVertexPacker packer;
+	StudioPackedVertex* pPacked;    // with -pack
+	int    nWorkers;                // of the fill or tangent run at hand
+
+	BenchModel()
+	{
+		ZeroMemory( strName, sizeof( strName ) );
+		ZeroMemory( pFiles, sizeof( pFiles ) );
+		ZeroMemory( nFileBytes, sizeof( nFileBytes ) );
+		ZeroMemory( &counts, sizeof( counts ) );
+		pVvd = NULL;
+		pIndices = NULL;
+		pAttributes = NULL;
+		pTangents = NULL;
+		pPacked = NULL;
+		nWorkers = 1;
+	}
+
+	~BenchModel()
+	{
+		for( int i=0; i < NUM_FILES; i++ )
+			SAFE_DELETE_ARRAY( pFiles[i] );
+		SAFE_DELETE_ARRAY( pVvd );
+		SAFE_DELETE_ARRAY( pIndices );
+		SAFE_DELETE_ARRAY( pAttributes );
+		SAFE_DELETE_ARRAY( pTangents );
+		SAFE_DELETE_ARRAY( pPacked );
+	}
+
+	studiohdr_t* GetStudioHdr() { return (studiohdr_t*)pFiles[FILE_MDL]; }
+	vertexFileHeader_t* GetVvd() { return (vertexFileHeader_t*)pVvd; }
+	FileHeader_t* GetVtx() { return (FileHeader_t*)pFiles[FILE_VTX]; }
+
+	StudioGeometrySpans GetSpans()
+	{
+		StudioGeometrySpans spans;
+		spans.pPositions = streams.GetPositions();
+		spans.pNormals = streams.GetNormals();
+		spans.pTexCoords = streams.GetTexCoords();
+		spans.pBoneWeights = streams.GetBoneWeights();
+		spans.pTangents = streams.GetTangents();
+		spans.pSourceVertices = streams.GetSourceVertices();
+		spans.pIndices = pIndices;
+		spans.pAttributes = pAttributes;
+		return spans;
+	}
+
+private:
+	BenchModel( const BenchModel& );
+	BenchModel& operator=( const BenchModel& );
+};
+
+
+//--------------------------------------------------------------------------------------
+static HRESULT ReadFileImage( const char* strFileName, char** ppData, int* pnBytes )
+{
+	ifstream file( strFileName, ios::binary );
+	if( !file )
+		return E_FAIL;
+	file.seekg( 0, ios::end );
+	streamoff nSize = file.tellg();
+	file.seekg( 0, ios::beg );
+	if( nSize <= 0 || nSize > INT_MAX )
+		return E_FAIL;
+	int nBytes = (int)nSize;
+
+	*ppData = new char[nBytes];
+	*pnBytes = nBytes;
+	file.read( *ppData, nBytes );
+	return file ? S_OK : E_FAIL;
+}
+
+
+//--------------------------------------------------------------------------------------
+static HRESULT ValidateModel( const studiohdr_t* pStudioHdr, const vertexFileHeader_t* pVvdHdr, const FileHeader_t* pVtxHdr )
+{
+	if( pStudioHdr->id != IDSTUDIOHEADER || pStudioHdr->version != STUDIO_VERSION )
+		return E_FAIL;
+	if( pVtxHdr->version != OPTIMIZED_MODEL_FILE_VERSION || pVtxHdr->checkSum != pStudioHdr->checksum )
+		return E_FAIL;
+	if( pVvdHdr->id != MODEL_VERTEX_FILE_ID || pVvdHdr->version != MODEL_VERTEX_FILE_VERSION ||
+		pVvdHdr->checksum != pStudioHdr->checksum )
+		return E_FAIL;
+	return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+static HRESULT PrepareModel( BenchModel* pModel )
+{
+	HRESULT hr;
+
+	const vertexFileHeader_t* pFileVvd = (const vertexFileHeader_t*)pModel->pFiles[FILE_VVD];
+	V_RETURN( ValidateModel( pModel->GetStudioHdr(), pFileVvd, pModel->GetVtx() ) );
+
+	pModel->pVvd = new char[pModel->nFileBytes[FILE_VVD]];
+	if( pFileVvd->numFixups )
+		Studio_LoadVertexes( pFileVvd, pModel->GetVvd(), 0, pFileVvd->tangentDataStart != 0 );
+	else
+		memcpy( pModel->pVvd, pFileVvd, pModel->nFileBytes[FILE_VVD] );
+
+	pModel->GetStudioHdr()->pVertexBase = pModel->pVvd;
+	pModel->GetStudioHdr()->pIndexBase = pModel->pFiles[FILE_VTX];
+
+	// Geometry the loader refuses would only time wrapped indices
+	hr = Studio_CountGeometry( pModel->GetStudioHdr(), pModel->GetVtx(), 0, &pModel->counts );
+	if( FAILED( hr ) )
+	{
+		printf( "%s: LOD 0 has more than %d vertices, the loader cannot draw it\n", pModel->strName, GEOMETRY_MAX_VERTICES );
+		return hr;
+	}
+	V_RETURN( pModel->streams.Resize( pModel->counts.numVertices ) );
+	pModel->pIndices = new unsigned short[pModel->counts.numIndices];
+	pModel->pAttributes = new DWORD[pModel->counts.numIndices / 3];
+	pModel->pTangents = new Vector4D[pModel->counts.numVertices];
+	return Studio_FillGeometry( pModel->GetStudioHdr(), pModel->GetVvd(), pModel->GetVtx(), 0, pModel->GetSpans() );
+}
+
+
+//--------------------------------------------------------------------------------------
+static HRESULT LoadModel( const char* strBaseName, BenchModel* pModel )
+{
+	static const char* s_strExtensions[NUM_FILES] = { ".mdl", ".vvd", ".dx90.vtx" };
+
+	for( int i=0; i < NUM_FILES; i++ )
+	{
+		char strFileName[MAX_PATH];
+		StringCchCopyA( strFileName, MAX_PATH, strBaseName );
+		StringCchCatA( strFileName, MAX_PATH, s_strExtensions[i] );
+		if( FAILED( ReadFileImage( strFileName, &pModel->pFiles[i], &pModel->nFileBytes[i] ) ) )
+		{
+			printf( "Could not read %s\n", strFileName );
+			return E_FAIL;
+		}
+	}
+	return PrepareModel( pModel );
+}
+
+
+//--------------------------------------------------------------------------------------
+static HRESULT SynthesizeModel( const StudioSynthParams& params, BenchModel* pModel )
+{
+	HRESULT hr;
+
+	StudioSynthModel* pSynth = new StudioSynthModel;
+	hr = Studio_SynthesizeModel( params, pSynth );
+	if( SUCCEEDED( hr ) )
+	{
+		CStudioSynthFile* pFiles[NUM_FILES] = { &pSynth->mdl, &pSynth->vvd, &pSynth->vtx };
+		for( int i=0; i < NUM_FILES; i++ )
+		{
+			pModel->nFileBytes[i] = pFiles[i]->GetSize();
+			pModel->pFiles[i] = new char[pModel->nFileBytes[i]];
+			memcpy( pModel->pFiles[i], pFiles[i]->GetData(), pModel->nFileBytes[i] );
+		}
+	}
+	SAFE_DELETE( pSynth );
+	V_RETURN( hr );
+
+	return PrepareModel( pModel );
+}
+
+
+//--------------------------------------------------------------------------------------
+// Model benchmarks
+//--------------------------------------------------------------------------------------
+static HRESULT BenchLoad( void* pContext )
+{
+	BenchModel* pModel = (BenchModel*)pContext;
+	HRESULT hr = S_OK;
+
+	// The reads of the three files
+	char* pFiles[NUM_FILES];
+	for( int i=0; i < NUM_FILES; i++ )
+	{
+		pFiles[i] = new char[pModel->nFileBytes[i]];
+		memcpy( pFiles[i], pModel->pFiles[i], pModel->nFileBytes[i] );
+	}
+
+	vertexFileHeader_t* pVvdHdr = (vertexFileHeader_t*)pFiles[FILE_VVD];
+	if( pVvdHdr->numFixups )
+	{
+		char* pNewVvd = new char[pModel->nFileBytes[FILE_VVD]];
+		Studio_LoadVertexes( pVvdHdr, (vertexFileHeader_t*)pNewVvd, 0, pVvdHdr->tangentDataStart != 0 );
+		delete[] pFiles[FILE_VVD];
+		pFiles[FILE_VVD] = pNewVvd;
+		pVvdHdr = (vertexFileHeader_t*)pNewVvd;
+	}
+
+	studiohdr_t* pStudioHdr = (studiohdr_t*)pFiles[FILE_MDL];
+	FileHeader_t* pVtxHdr = (FileHeader_t*)pFiles[FILE_VTX];
+	hr = ValidateModel( pStudioHdr, pVvdHdr, pVtxHdr );
+	if( SUCCEEDED( hr ) )
+	{
+		pStudioHdr->pVertexBase = pVvdHdr;
+		pStudioHdr->pIndexBase = pVtxHdr;
+
+		// Plain arrays stand in for the locked index and attribute buffers
+		StudioGeometryCounts counts;
+		hr = Studio_CountGeometry( pStudioHdr, pVtxHdr, 0, &counts );
+		CStudioSoAMesh streams;
+		unsigned short* pIndices = NULL;
+		DWORD* pAttributes = NULL;
+		if( SUCCEEDED( hr ) )
+		{
+			pIndices = new unsigned short[counts.numIndices];
+			pAttributes = new DWORD[counts.numIndices / 3];
+			hr = streams.Resize( counts.numVertices );
+		}
+		if( SUCCEEDED( hr ) )
+		{
+			StudioGeometrySpans spans;
+			spans.pPositions = streams.GetPositions();
+			spans.pNormals = streams.GetNormals();
+			spans.pTexCoords = streams.GetTexCoords();
+			spans.pBoneWeights = streams.GetBoneWeights();
+			spans.pTangents = streams.GetTangents();
+			spans.pSourceVertices = streams.GetSourceVertices();
+			spans.pIndices = pIndices;
+			spans.pAttributes = pAttributes;
+			hr = Studio_FillGeometry( pStudioHdr, pVvdHdr, pVtxHdr, 0, spans );
+		}
+		if( SUCCEEDED( hr ) && pVvdHdr->tangentDataStart == 0 )
+			hr = Studio_GenerateTangents( streams.GetView(), pIndices, counts.numIndices, streams.GetTangents() );
+		delete[] pIndices;
+		delete[] pAttributes;
+	}
+
+	for( int i=0; i < NUM_FILES; i++ )
+		delete[] pFiles[i];
+	return hr;
+}
+
+
+//--------------------------------------------------------------------------------------
+static HRESULT BenchVvdFixup( void* pContext )
+{
+	BenchModel* pModel = (BenchModel*)pContext;
+	const vertexFileHeader_t* pFileVvd = (const vertexFileHeader_t*)pModel->pFiles[FILE_VVD];
+	Studio_LoadVertexes( pFileVvd, pModel->GetVvd(), 0, pFileVvd->tangentDataStart != 0 );
+	return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+static HRESULT BenchVtxCount( void* pContext )
+{
+	BenchModel* pModel = (BenchModel*)pContext;
+	return Studio_CountGeometry( pModel->GetStudioHdr(), pModel->GetVtx(), 0, &pModel->counts );
+}
+
+
+//--------------------------------------------------------------------------------------
+static HRESULT BenchVtxFill( void* pContext )
+{
+	BenchModel* pModel = (BenchModel*)pContext;
+	return Studio_FillGeometry( pModel->GetStudioHdr(), pModel->GetVvd(), pModel->GetVtx(), 0, pModel->GetSpans(),
+								pModel->nWorkers );
+}
+
+
+//--------------------------------------------------------------------------------------
+static HRESULT BenchTangents( void* pContext )
+{
+	BenchModel* pModel = (BenchModel*)pContext;
+	return Studio_GenerateTangents( pModel->streams.GetView(), pModel->pIndices, pModel->counts.numIndices,
+									pModel->pTangents, pModel->nWorkers );
+}
+
+
+//--------------------------------------------------------------------------------------
+// Model reports
+//--------------------------------------------------------------------------------------
+static HRESULT ReportPalettes( BenchModel* pModel )
+{
+	HRESULT hr;
+
+	CStudioBonePalettes palettes;
+	V_RETURN( palettes.Init( pModel->GetStudioHdr(), pModel->GetVtx(), 0, pModel->GetVvd()->pVertex( 0 ),
+							 pModel->streams.GetSourceVertices() ) );
+	if( !palettes.Validate( pModel->GetVvd()->pVertex( 0 ), pModel->streams.GetSourceVertices() ) )
+	{
+		printf( "%s: a blend index does not match the bone of its .vvd weight\n", pModel->strName );
+		return E_FAIL;
+	}
+
+	int numStrips = palettes.GetNumPalettes();
+	int nUploadBytes = palettes.GetUploadBytes();
+	int nFullBytes = palettes.GetFullUploadBytes();
+	printf( "  palettes: %d strips, %d with the full skeleton, %.0f bone bytes a strip against %.0f, %.1f%%\n",
+			numStrips, palettes.GetNumFullPalettes(), numStrips ? (double)nUploadBytes / numStrips : 0.0,
+			numStrips ? (double)nFullBytes / numStrips : 0.0, nFullBytes ? 100.0 * nUploadBytes / nFullBytes : 0.0 );
+	return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+static HRESULT BenchPack( void* pContext )
+{
+	BenchModel* pModel = (BenchModel*)pContext;
+	StudioPackStats stats;
+	pModel->packer.Pack( pModel->streams.GetView(), pModel->pPacked, &stats );
+	return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Worker counts of 1, 2, 4 .. and the processor count
+//--------------------------------------------------------------------------------------
+static int NextWorkerCount( int nWorkers, int nMaxWorkers )
+{
+	return ( nWorkers < nMaxWorkers && nWorkers * 2 > nMaxWorkers ) ? nMaxWorkers : nWorkers * 2;
+}
+
+
+//--------------------------------------------------------------------------------------
+static HRESULT RunModelBenches( const BenchSettings& settings, BenchModel* pModel, bool bPack,
+								CGrowableArray< BenchResult >* pResults )
+{
+	HRESULT hr;
+	char strName[BENCH_MAX_NAME];
+
+	const StudioGeometryCounts& counts = pModel->counts;
+	printf( "%s: %d vertices, %d triangles, %d subsets at LOD 0\n", pModel->strName, counts.numVertices,
+			counts.numIndices / 3, counts.numSubsets );
+	V_RETURN( ReportPalettes( pModel ) );
+
+	int nFileBytes = pModel->nFileBytes[FILE_MDL] + pModel->nFileBytes[FILE_VVD] + pModel->nFileBytes[FILE_VTX];
+	int nFillBytes = counts.numVertices * ( sizeof( Vector ) * 2 + sizeof( Vector2D ) + sizeof( mstudioboneweight_t ) +
+											sizeof( Vector4D ) + sizeof( int ) ) +
+					 counts.numIndices * sizeof( unsigned short ) + counts.numIndices / 3 * sizeof( DWORD );
+	int nTangentBytes = counts.numVertices * sizeof( Vector4D );
+
+	StringCchPrintfA( strName, BENCH_MAX_NAME, "%s/load", pModel->strName );
+	V_RETURN( RunBench( settings, strName, BenchLoad, pModel, nFileBytes, pResults ) );
+	StringCchPrintfA( strName, BENCH_MAX_NAME, "%s/vvd_fixup", pModel->strName );
+	V_RETURN( RunBench( settings, strName, BenchVvdFixup, pModel, pModel->nFileBytes[FILE_VVD], pResults ) );
+	StringCchPrintfA( strName, BENCH_MAX_NAME, "%s/vtx_count", pModel->strName );
+	V_RETURN( RunBench( settings, strName, BenchVtxCount, pModel, 0, pResults ) );
+
+	int nMaxWorkers = Studio_GetNumWorkers();
+	for( int nWorkers=1; nWorkers <= nMaxWorkers; nWorkers = NextWorkerCount( nWorkers, nMaxWorkers ) )
+	{
+		pModel->nWorkers = nWorkers;
+		StringCchPrintfA( strName, BENCH_MAX_NAME, "%s/vtx_fill_w%d", pModel->strName, nWorkers );
+		V_RETURN( RunBench( settings, strName, BenchVtxFill, pModel, nFillBytes, pResults ) );
+	}
+	for( int nWorkers=1; nWorkers <= nMaxWorkers; nWorkers = NextWorkerCount( nWorkers, nMaxWorkers ) )
+	{
+		pModel->nWorkers = nWorkers;
+		StringCchPrintfA( strName, BENCH_MAX_NAME, "%s/tangents_w%d", pModel->strName, nWorkers );
+		V_RETURN( RunBench( settings, strName, BenchTangents, pModel, nTangentBytes, pResults ) );
+	}
+
+	if( bPack )
+	{
+		// Packed as the loader packs, with the tangents it would have generated
+		if( pModel->GetVvd()->tangentDataStart == 0 )
+			V_RETURN( Studio_GenerateTangents( pModel->streams.GetView(), pModel->pIndices, counts.numIndices,
+											   pModel->streams.GetTangents() ) );
+		pModel->pPacked = new StudioPackedVertex[counts.numVertices];
+		StringCchPrintfA( strName, BENCH_MAX_NAME, "%s/pack", pModel->strName );
+		V_RETURN( RunBench( settings, strName, BenchPack, pModel, counts.numVertices * sizeof( StudioPackedVertex ), pResults ) );
+
+		StudioPackStats stats;
+		pModel->packer.Pack( pModel->streams.GetView(), pModel->pPacked, &stats );
+		printf( "  packed: %d bytes to %d, %.1f%%, worst errors position %.4f normal %.4f tangent %.4f texcoord %.5f weight %.4f\n",
+				stats.nBytesIn, stats.nBytesOut, stats.nBytesIn ? 100.0 * stats.nBytesOut / stats.nBytesIn : 0.0,
+				stats.flMaxPositionError, stats.flMaxNormalError, stats.flMaxTangentError, stats.flMaxTexCoordError,
+				stats.flMaxWeightError );
+	}
+
+	return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Crowd benchmarks
+//
+// Copies of the sample model play its first sequences from phases spread over the
+// cycle, and every run is one 30 fps frame of the whole crowd. The instances stand 16
+// to a row, 4 hull radii apart, in front of the eye.
+//--------------------------------------------------------------------------------------
+#define BENCH_CROWD_SEQUENCES	4			// sequences the crowd shares
+#define BENCH_CROWD_FRAME_TIME	( 1.0f / 30.0f )
+#define BENCH_CROWD_ROW			16
+
+struct BenchCrowd
+{
+	const studiohdr_t*  pStudioHdr;
+	CStudioFrameCache   frameCache;
+	CStudioPoseCache    poseCache;
+	CStudioAnimScheduler scheduler;
+	CStudioProceduralBones procedural;
+	int                 nInstances;
+	int                 numSequences;
+	int                 iFrame;
+	float               flCycleRate[BENCH_CROWD_SEQUENCES];    // cycles per frame
+	float               poseParameter[MAXSTUDIOPOSEPARAM];
+	float*              pflMetric;      // LOD metric of every instance
+	Vector*             pPos;           // MAXSTUDIOBONES per instance
+	Quaternion*         pQ;
+	matrix3x4_t*        pBoneToWorld;   // MAXSTUDIOBONES per instance
+	const Vector**      ppPos;          // the batch for BuildMatrices
+	const Quaternion**  ppQ;
+	matrix3x4_t**       ppBoneToWorld;
+	int                 nFrames;        // of the scheduler's counters below
+	StudioAnimLODStats  lodTotals;
+
+	BenchCrowd()
+	{
+		pStudioHdr = NULL;
+		nInstances = 0;
+		numSequences = 0;
+		iFrame = 0;
+		ZeroMemory( flCycleRate, sizeof( flCycleRate ) );
+		ZeroMemory( poseParameter, sizeof( poseParameter ) );
+		pflMetric = NULL;
+		pPos = NULL;
+		pQ = NULL;
+		pBoneToWorld = NULL;
+		ppPos = NULL;
+		ppQ = NULL;
+		ppBoneToWorld = NULL;
+		nFrames = 0;
+		ZeroMemory( &lodTotals, sizeof( lodTotals ) );
+	}
+
+	~BenchCrowd()
+	{
+		SAFE_DELETE_ARRAY( pflMetric );
+		SAFE_DELETE_ARRAY( pPos );
+		SAFE_DELETE_ARRAY( pQ );
+		SAFE_DELETE_ARRAY( pBoneToWorld );
+		SAFE_DELETE_ARRAY( ppPos );
+		SAFE_DELETE_ARRAY( ppQ );
+		SAFE_DELETE_ARRAY( ppBoneToWorld );
+	}
+
+	int GetSequence( int iInstance ) const { return iInstance % numSequences; }
+
+	float GetCycle( int iInstance ) const
+	{
+		float flCycle = iInstance * 0.618034f + iFrame * flCycleRate[GetSequence( iInstance )];
+		return flCycle - floorf( flCycle );
+	}
+
+private:
+	BenchCrowd( const BenchCrowd& );
+	BenchCrowd& operator=( const BenchCrowd& );
+};
+
+
+//--------------------------------------------------------------------------------------
+static HRESULT BenchCrowdPose( void* pContext )
+{
+	BenchCrowd* pCrowd = (BenchCrowd*)pContext;
+	for( int i=0; i < pCrowd->nInstances; i++ )
+	{
+		pCrowd->frameCache.CalcPose( pCrowd->GetSequence( i ), pCrowd->GetCycle( i ), pCrowd->poseParameter,
+									 &pCrowd->pPos[i * MAXSTUDIOBONES], &pCrowd->pQ[i * MAXSTUDIOBONES] );
+	}
+	pCrowd->iFrame++;
+	return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Bone-to-world transforms from the poses the last crowd/pose run left
+//--------------------------------------------------------------------------------------
+static HRESULT BenchCrowdMatrices( void* pContext )
+{
+	BenchCrowd* pCrowd = (BenchCrowd*)pContext;
+	pCrowd->procedural.BuildMatrices( pCrowd->nInstances, pCrowd->ppPos, pCrowd->ppQ, pCrowd->ppBoneToWorld );
+	return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+static HRESULT BenchCrowdPoseCache( void* pContext )
+{
+	BenchCrowd* pCrowd = (BenchCrowd*)pContext;
+	pCrowd->poseCache.BeginFrame();
+	for( int i=0; i < pCrowd->nInstances; i++ )
+	{
+		const Vector* pPos;
+		const Quaternion* pQ;
+		pCrowd->poseCache.GetPose( pCrowd->pStudioHdr, &pCrowd->frameCache, pCrowd->GetSequence( i ), pCrowd->GetCycle( i ),
+								   pCrowd->poseParameter, BONE_USED_BY_ANYTHING, &pCrowd->pPos[i * MAXSTUDIOBONES],
+								   &pCrowd->pQ[i * MAXSTUDIOBONES], &pPos, &pQ );
+	}
+	pCrowd->iFrame++;
+	return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+static HRESULT BenchCrowdAnimLOD( void* pContext )
+{
+	BenchCrowd* pCrowd = (BenchCrowd*)pContext;
+	pCrowd->scheduler.BeginFrame();
+	for( int i=0; i < pCrowd->nInstances; i++ )
+	{
+		int iSequence = pCrowd->GetSequence( i );
+		pCrowd->scheduler.Animate( i, pCrowd->pStudioHdr, &pCrowd->frameCache, iSequence, pCrowd->GetCycle( i ),
+								   pCrowd->flCycleRate[iSequence], pCrowd->poseParameter, pCrowd->pflMetric[i],
+								   &pCrowd->pPos[i * MAXSTUDIOBONES], &pCrowd->pQ[i * MAXSTUDIOBONES] );
+	}
+	pCrowd->iFrame++;
+
+	const StudioAnimLODStats& stats = pCrowd->scheduler.GetStats();
+	pCrowd->lodTotals.nInstances += stats.nInstances;
+	pCrowd->lodTotals.nEvaluations += stats.nEvaluations;
+	pCrowd->lodTotals.nInterpolated += stats.nInterpolated;
+	pCrowd->lodTotals.nBonesEvaluated += stats.nBonesEvaluated;
+	pCrowd->nFrames++;
+	return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+static HRESULT RunCrowdBenches( const BenchSettings& settings, const studiohdr_t* pStudioHdr, int nInstances,
+								CGrowableArray< BenchResult >* pResults )
+{
+	HRESULT hr;
+
+	BenchCrowd* pCrowd = new BenchCrowd;
+	pCrowd->pStudioHdr = pStudioHdr;
+	pCrowd->nInstances = nInstances;
+	pCrowd->numSequences = pStudioHdr->GetNumSeq();
+	if( pCrowd->numSequences > BENCH_CROWD_SEQUENCES )
+		pCrowd->numSequences = BENCH_CROWD_SEQUENCES;
+	for( int i=0; i < pCrowd->numSequences; i++ )
+	{
+		int iAnim[4];
+		float flWeight[4];
+		Studio_SeqAnims( pStudioHdr, pStudioHdr->pSeqdesc( i ), i, pCrowd->poseParameter, iAnim, flWeight );
+		const mstudioanimdesc_t& animdesc = pStudioHdr->pAnimdesc( iAnim[0] );
+		if( animdesc.numframes > 1 )
+			pCrowd->flCycleRate[i] = animdesc.fps * BENCH_CROWD_FRAME_TIME / ( animdesc.numframes - 1 );
+	}
+	pCrowd->pPos = new Vector[nInstances * MAXSTUDIOBONES];
+	pCrowd->pQ = new Quaternion[nInstances * MAXSTUDIOBONES];
+	pCrowd->pBoneToWorld = new matrix3x4_t[nInstances * MAXSTUDIOBONES];
+	pCrowd->ppPos = new const Vector*[nInstances];
+	pCrowd->ppQ = new const Quaternion*[nInstances];
+	pCrowd->ppBoneToWorld = new matrix3x4_t*[nInstances];
+	for( int i=0; i < nInstances; i++ )
+	{
+		pCrowd->ppPos[i] = &pCrowd->pPos[i * MAXSTUDIOBONES];
+		pCrowd->ppQ[i] = &pCrowd->pQ[i * MAXSTUDIOBONES];
+		pCrowd->ppBoneToWorld[i] = &pCrowd->pBoneToWorld[i * MAXSTUDIOBONES];
+	}
+	printf( "crowd: %d instances playing %d sequences\n", nInstances, pCrowd->numSequences );
+
+	// The metric is in hull radii, so is the grid
+	Vector vExtent = pStudioHdr->hull_max - pStudioHdr->hull_min;
+	float flSpacing = 4.0f * __max( 0.5f * D3DXVec3Length( &vExtent ), 1.0f );
+	Vector vEye( 0, 0, 0 );
+	pCrowd->pflMetric = new float[nInstances];
+	for( int i=0; i < nInstances; i++ )
+	{
+		Vector vOrigin( ( i % BENCH_CROWD_ROW - BENCH_CROWD_ROW / 2 ) * flSpacing, 0, ( i / BENCH_CROWD_ROW + 1 ) * flSpacing );
+		pCrowd->pflMetric[i] = Studio_ComputeLODMetric( pStudioHdr, vOrigin, vEye );
+	}
+
+	hr = pCrowd->frameCache.Init( pStudioHdr );
+	if( SUCCEEDED( hr ) )
+		hr = pCrowd->procedural.Init( pStudioHdr );
+	if( SUCCEEDED( hr ) )
+		hr = pCrowd->poseCache.Init( nInstances, 1.0f / 64.0f, 1.0f / 64.0f );
+	if( SUCCEEDED( hr ) )
+		hr = pCrowd->scheduler.Init( nInstances );
+	if( SUCCEEDED( hr ) )
+		hr = RunBench( settings, "crowd/pose", BenchCrowdPose, pCrowd, 0, pResults );
+	if( SUCCEEDED( hr ) )
+		hr = RunBench( settings, "crowd/matrices", BenchCrowdMatrices, pCrowd, 0, pResults );
+	if( SUCCEEDED( hr ) )
+		printf( "  procedural bones: %d of %d\n", pCrowd->procedural.GetNumProcedural(), pStudioHdr->numbones );
+	if( SUCCEEDED( hr ) )
+		hr = RunBench( settings, "crowd/pose_cache", BenchCrowdPoseCache, pCrowd, 0, pResults );
+	if( SUCCEEDED( hr ) )
+	{
+		const StudioPoseCacheStats& stats = pCrowd->poseCache.GetStats();
+		printf( "  pose cache: %.1f%% hits, %d of %d evaluations saved, %d overflows\n", 100.0f * pCrowd->poseCache.GetHitRate(),
+				stats.nHits, stats.nLookups, stats.nOverflows );
+	}
+	if( SUCCEEDED( hr ) )
+		hr = RunBench( settings, "crowd/anim_lod", BenchCrowdAnimLOD, pCrowd, 0, pResults );
+	if( SUCCEEDED( hr ) )
+	{
+		int nLevelInstances[ANIMLOD_MAX_LEVELS] = { 0 };
+		for( int i=0; i < nInstances; i++ )
+			nLevelInstances[pCrowd->scheduler.SelectLevel( pCrowd->pflMetric[i] )]++;
+		printf( "  animation LOD: instances per level" );
+		for( int i=0; i < ANIMLOD_MAX_LEVELS && nLevelInstances[i]; i++ )
+			printf( " %d", nLevelInstances[i] );
+
+		int nFullRateBones = 0;
+		for( int i=0; i < pStudioHdr->numbones; i++ )
+		{
+			if( pStudioHdr->pBone( i )->flags & Studio_BoneMaskForLOD( 0 ) )
+				nFullRateBones += nInstances;
+		}
+		const StudioAnimLODStats& totals = pCrowd->lodTotals;
+		float flFrames = (float)__max( pCrowd->nFrames, 1 );
+		printf( ", %.0f bones evaluated a frame against %d at full rate, %.1f evaluations and %.1f blends a frame\n",
+				totals.nBonesEvaluated / flFrames, nFullRateBones, totals.nEvaluations / flFrames,
+				totals.nInterpolated / flFrames );
+	}
+
+	SAFE_DELETE( pCrowd );
+	return hr;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Material benchmarks
+//--------------------------------------------------------------------------------------
+struct BenchMaterial
+{
+	char  strVmt[MAX_PATH];         // without the extension, as GetMaterialFromVMT takes it
+	char* pVtf;
+	int   nVtfBytes;
+	char* pMips;                    // every level copied out by vtf_mips
+	int   nMipBytes;
+	CMeshLoader loader;
+	DWORD nSink;                    // sum of the mem_required runs, so they are kept
+};
+
+
+//--------------------------------------------------------------------------------------
+static HRESULT BenchVmtParse( void* pContext )
+{
+	BenchMaterial* pMaterial = (BenchMaterial*)pContext;
+	ShaderInfo shaderInfo;
+	return pMaterial->loader.GetMaterialFromVMT( pMaterial->strVmt, &shaderInfo );
+}
+
+
+//--------------------------------------------------------------------------------------
+static HRESULT BenchVtfMips( void* pContext )
+{
+	BenchMaterial* pMaterial = (BenchMaterial*)pContext;
+	const VTFFileHeader_t* pVtf = (const VTFFileHeader_t*)pMaterial->pVtf;
+
+	// Smallest level first, like CreateTextureFromVTF
+	int offset = 0;
+	for( int i=pVtf->numMipLevels-1; i >= 0; i-- )
+	{
+		int nBytes;
+		const unsigned char* pSrc = GetVTFMipLevel( pVtf, pMaterial->nVtfBytes, i, &nBytes );
+		if( pSrc == NULL || offset + nBytes > pMaterial->nMipBytes )
+			return E_FAIL;
+		memcpy( pMaterial->pMips + offset, pSrc, nBytes );
+		offset += nBytes;
+	}
+	return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+static HRESULT BenchMemRequired( void* pContext )
+{
+	static const ImageFormat s_Formats[] = { IMAGE_FORMAT_DXT1, IMAGE_FORMAT_DXT5, IMAGE_FORMAT_BGRA8888,
+											 IMAGE_FORMAT_BGR888, IMAGE_FORMAT_RGBA16161616F };
+	BenchMaterial* pMaterial = (BenchMaterial*)pContext;
+
+	DWORD nSum = 0;
+	for( int i=0; i < (int)( sizeof( s_Formats ) / sizeof( s_Formats[0] ) ); i++ )
+	{
+		for( int size=1; size <= 4096; size *= 2 )
+		{
+			nSum += GetMemRequired( size, size, s_Formats[i], false );
+			nSum += GetMemRequired( size, size, s_Formats[i], true );
+		}
+	}
+	pMaterial->nSink += nSum;
+	return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+static HRESULT RunMaterialBenches( const BenchSettings& settings, const char* strBaseName, CGrowableArray< BenchResult >* pResults )
+{
+	HRESULT hr;
+
+	BenchMaterial* pMaterial = new BenchMaterial;
+	StringCchCopyA( pMaterial->strVmt, MAX_PATH, strBaseName );
+	pMaterial->pVtf = NULL;
+	pMaterial->pMips = NULL;
+	pMaterial->nSink = 0;
+	printf( "%s\n", strBaseName );
+
+	char strFileName[MAX_PATH];
+	StringCchPrintfA( strFileName, MAX_PATH, "%s.vmt", strBaseName );
+	int nVmtBytes = 0;
+	char* pVmt = NULL;
+	hr = ReadFileImage( strFileName, &pVmt, &nVmtBytes );
+	SAFE_DELETE_ARRAY( pVmt );
+	if( SUCCEEDED( hr ) )
+		hr = RunBench( settings, "vmt_parse", BenchVmtParse, pMaterial, nVmtBytes, pResults );
+	else
+		printf( "  Could not read %s\n", strFileName );
+
+	StringCchPrintfA( strFileName, MAX_PATH, "%s.vtf", strBaseName );
+	if( SUCCEEDED( hr ) && SUCCEEDED( ReadFileImage( strFileName, &pMaterial->pVtf, &pMaterial->nVtfBytes ) ) )
+	{
+		const VTFFileHeader_t* pVtf = (const VTFFileHeader_t*)pMaterial->pVtf;
+		pMaterial->nMipBytes = GetMemRequired( pVtf->width, pVtf->height, pVtf->imageFormat, true );
+		pMaterial->pMips = new char[pMaterial->nMipBytes];
+		hr = RunBench( settings, "vtf_mips", BenchVtfMips, pMaterial, pMaterial->nMipBytes, pResults );
+	}
+	else if( SUCCEEDED( hr ) )
+		printf( "  Could not read %s\n", strFileName );
+
+	if( SUCCEEDED( hr ) )
+		hr = RunBench( settings, "mem_required", BenchMemRequired, pMaterial, 0, pResults );
+
+	SAFE_DELETE_ARRAY( pMaterial->pVtf );
+	SAFE_DELETE_ARRAY( pMaterial->pMips );
+	SAFE_DELETE( pMaterial );
+	return hr;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Results
+//--------------------------------------------------------------------------------------
+static HRESULT WriteResults( const char* strFileName, CGrowableArray< BenchResult >& results )
+{
+	FILE* pFile = fopen( strFileName, "w" );
+	if( pFile == NULL )
+		return E_FAIL;
+
+	// One result per line, which is all ReadBaseline needs to parse
+	fprintf( pFile, "{\n  \"alloc_counter\": \"%s\",\n  \"workers\": %d,\n  \"results\": [\n", g_strAllocCounter,
+			 Studio_GetNumWorkers() );
+	for( int i=0; i < results.GetSize(); i++ )
+	{
+		const BenchResult& result = results[i];
+		fprintf( pFile, "    { \"name\": \"%s\", \"iterations\": %d, \"median_us\": %.3f, \"p99_us\": %.3f, "
+				 "\"mb_per_s\": %.3f, \"allocs_per_op\": %.2f }%s\n", result.strName, result.nIterations,
+				 result.flMedianUs, result.flP99Us, result.flMBps, result.flAllocsPerOp,
+				 i + 1 < results.GetSize() ? "," : "" );
+	}
+	fprintf( pFile, "  ]\n}\n" );
+	fclose( pFile );
+	return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+static HRESULT ReadBaseline( const char* strFileName, CGrowableArray< BenchResult >* pBaseline, char* strAllocCounter )
+{
+	HRESULT hr = S_OK;
+
+	FILE* pFile = fopen( strFileName, "r" );
+	if( pFile == NULL )
+		return E_FAIL;
+
+	strAllocCounter[0] = 0;
+	char strLine[512];
+	while( fgets( strLine, sizeof( strLine ), pFile ) )
+	{
+		if( 1 == sscanf( strLine, " \"alloc_counter\": \"%63[^\"]\"", strAllocCounter ) )
+			continue;
+
+		BenchResult result;
+		ZeroMemory( &result, sizeof( result ) );
+		if( 6 == sscanf( strLine, " { \"name\": \"%63[^\"]\", \"iterations\": %d, \"median_us\": %lf, \"p99_us\": %lf, "
+						 "\"mb_per_s\": %lf, \"allocs_per_op\": %lf", result.strName, &result.nIterations,
+						 &result.flMedianUs, &result.flP99Us, &result.flMBps, &result.flAllocsPerOp ) )
+		{
+			hr = pBaseline->Add( result );
+			if( FAILED( hr ) )
+				break;
+		}
+	}
+	fclose( pFile );
+	return hr;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Returns the number of regressions: a median more than flThreshold percent slower, or
+// a different number of allocations per run. The counts are exact, so fewer
+// allocations fail too, until the baseline is written again. Benchmarks missing on
+// either side are listed but not counted.
+//--------------------------------------------------------------------------------------
+static int CompareResults( CGrowableArray< BenchResult >& results, CGrowableArray< BenchResult >& baseline, double flThreshold )
+{
+	int nRegressions = 0;
+	printf( "\n  %-28s %10s %10s %8s %8s\n", "compared to baseline", "median us", "base us", "change", "allocs" );
+	for( int i=0; i < results.GetSize(); i++ )
+	{
+		const BenchResult& result = results[i];
+		const BenchResult* pBase = NULL;
+		for( int j=0; j < baseline.GetSize() && pBase == NULL; j++ )
+		{
+			if( 0 == strcmp( baseline[j].strName, result.strName ) )
+				pBase = &baseline.GetData()[j];
+		}
+		if( pBase == NULL )
+		{
+			printf( "  %-28s %10.1f %10s\n", result.strName, result.flMedianUs, "new" );
+			continue;
+		}
+
+		double flChange = pBase->flMedianUs > 0 ? 100.0 * ( result.flMedianUs - pBase->flMedianUs ) / pBase->flMedianUs : 0;
+		bool bSlower = flChange > flThreshold;
+		double flAllocChange = result.flAllocsPerOp - pBase->flAllocsPerOp;
+		bool bAllocsChanged = flAllocChange > 0.5 || flAllocChange < -0.5;
+		printf( "  %-28s %10.1f %10.1f %+7.1f%% %+8.1f%s\n", result.strName, result.flMedianUs, pBase->flMedianUs, flChange,
+				flAllocChange, bSlower ? "  REGRESSION" : ( bAllocsChanged ? "  ALLOCS CHANGED" : "" ) );
+		if( bSlower || bAllocsChanged )
+			nRegressions++;
+	}
+	for( int j=0; j < baseline.GetSize(); j++ )
+	{
+		bool bFound = false;
+		for( int i=0; i < results.GetSize() && !bFound; i++ )
+			bFound = 0 == strcmp( baseline[j].strName, results[i].strName );
+		if( !bFound )
+			printf( "  %-28s %10s %10.1f\n", baseline[j].strName, "missing", baseline[j].flMedianUs );
+	}
+	return nRegressions;
+}
+
+
+//--------------------------------------------------------------------------------------
+static void PrintUsage()
+{
+	printf( "StudioBench [-model path] [-material path] [-nosynth] [-crowd n] [-pack] [-iterations n] [-time ms]\n" );
+	printf( "            [-json file] [-baseline file] [-threshold pct]\n" );
+}
+
+
+//--------------------------------------------------------------------------------------
+int main( int argc, char* argv[] )
+{
+	const char* strModel = "Models\\Combine_Soldier";
+	const char* strMaterial = "Models\\Combine_Soldier\\combinesoldiersheet";
+	const char* strJson = NULL;
+	const char* strBaseline = NULL;
+	bool bSynth = true;
+	bool bPack = false;
+	int nCrowd = 256;
+	double flThreshold = 10.0;
+	BenchSettings settings;
+	settings.nMinIterations = 10;
+	settings.nMinTimeMs = 250;
+
+	for( int i=1; i < argc; i++ )
+	{
+		bool bValue = i + 1 < argc;
+		if( bValue && 0 == strcmp( argv[i], "-model" ) )
+			strModel = argv[++i];
+		else if( bValue && 0 == strcmp( argv[i], "-material" ) )
+			strMaterial = argv[++i];
+		else if( bValue && 0 == strcmp( argv[i], "-crowd" ) )
+			nCrowd = atoi( argv[++i] );
+		else if( bValue && 0 == strcmp( argv[i], "-iterations" ) )
+			settings.nMinIterations = atoi( argv[++i] );
+		else if( bValue && 0 == strcmp( argv[i], "-time" ) )
+			settings.nMinTimeMs = atoi( argv[++i] );
+		else if( bValue && 0 == strcmp( argv[i], "-json" ) )
+			strJson = argv[++i];
+		else if( bValue && 0 == strcmp( argv[i], "-baseline" ) )
+			strBaseline = argv[++i];
+		else if( bValue && 0 == strcmp( argv[i], "-threshold" ) )
+			flThreshold = atof( argv[++i] );
+		else if( 0 == strcmp( argv[i], "-nosynth" ) )
+			bSynth = false;
+		else if( 0 == strcmp( argv[i], "-pack" ) )
+			bPack = true;
+		else
+		{
+			PrintUsage();
+			return 1;
+		}
+	}
+	if( settings.nMinIterations < 1 )
+		settings.nMinIterations = 1;
+
+	if( !HookAllocations() )
+	{
+		printf( "Could not hook the CRT heap functions, allocations are not counted\n" );
+		g_strAllocCounter = "none";
+	}
+
+	CGrowableArray< BenchResult > results;
+	printf( "  %-28s %10s %10s %10s %8s %8s\n", "", "median us", "p99 us", "MB/s", "allocs", "runs" );
+
+	BenchModel* pModel = new BenchModel;
+	StringCchCopyA( pModel->strName, BENCH_MAX_NAME, "sample" );
+	HRESULT hr = LoadModel( strModel, pModel );
+	if( SUCCEEDED( hr ) )
+		hr = RunModelBenches( settings, pModel, bPack, &results );
+	if( SUCCEEDED( hr ) && nCrowd > 0 && pModel->GetStudioHdr()->GetNumSeq() > 0 )
+		hr = RunCrowdBenches( settings, pModel->GetStudioHdr(), nCrowd, &results );
+	SAFE_DELETE( pModel );
+
+	// 10k, 100k and 1m vertices in all, spread over as many body parts as keep each one
+	// within 16 bit indices. The loader decodes the first, so load and vvd_fixup see the
+	// whole model and the fill and tangent benchmarks one body part.
+	if( SUCCEEDED( hr ) && bSynth )
+	{
+		static const char* s_strNames[] = { "synth10k", "synth100k", "synth1m" };
+		static const int s_numVertices[] = { 10000, 100000, 1000000 };
+		for( int i=0; i < 3 && SUCCEEDED( hr ); i++ )
+		{
+			StudioSynthParams params;
+			Studio_DefaultSynthParams( &params );
+			params.numBodyParts = ( s_numVertices[i] + BENCH_MAX_BODYPART_VERTICES - 1 ) / BENCH_MAX_BODYPART_VERTICES;
+			int numPerBodyPart = s_numVertices[i] / params.numBodyParts;
+			params.numMeshes = ( numPerBodyPart + params.numVertices - 1 ) / params.numVertices;
+			params.numVertices = ( numPerBodyPart + params.numMeshes - 1 ) / params.numMeshes;
+
+			pModel = new BenchModel;
+			StringCchCopyA( pModel->strName, BENCH_MAX_NAME, s_strNames[i] );
+			hr = SynthesizeModel( params, pModel );
+			if( SUCCEEDED( hr ) )
+				hr = RunModelBenches( settings, pModel, bPack, &results );
+			SAFE_DELETE( pModel );
+		}
+	}
+
+	if( SUCCEEDED( hr ) )
+		hr = RunMaterialBenches( settings, strMaterial, &results );
+	if( FAILED( hr ) )
+	{
+		printf( "Benchmark failed with 0x%08x\n", hr );
+		return 1;
+	}
+
+	if( strJson && FAILED( WriteResults( strJson, results ) ) )
+	{
+		printf( "Could not write %s\n", strJson );
+		return 1;
+	}
+
+	if( strBaseline )
+	{
+		CGrowableArray< BenchResult > baseline;
+		char strBaseCounter[BENCH_MAX_NAME];
+		if( FAILED( ReadBaseline( strBaseline, &baseline, strBaseCounter ) ) )
+		{
+			printf( "Could not read %s\n", strBaseline );
+			return 1;
+		}
+		// Allocations counted another way cannot be compared
+		if( 0 != strcmp( strBaseCounter, g_strAllocCounter ) )
+		{
+			printf( "Baseline counts allocations with \"%s\", this run with \"%s\"\n", strBaseCounter, g_strAllocCounter );
+			return 2;
+		}
+		int nRegressions = CompareResults( results, baseline, flThreshold );
+		printf( "%d regressions\n", nRegressions );
+		if( nRegressions > 0 )
+			return 2;
+	}
+
+	return 0;
+}
@@ -0,0 +1,112 @@
+//--------------------------------------------------------------------------------------
+// File: StudioBounds.cpp
+//
+// Animated model bounds from per-bone boxes.
+//
+//--------------------------------------------------------------------------------------
+#include "DXUT.h"
+#include "StudioBounds.h"
+
+
+//--------------------------------------------------------------------------------------
+CStudioBounds::CStudioBounds()
+{
+}
+
+
+//--------------------------------------------------------------------------------------
+CStudioBounds::~CStudioBounds()
+{
+	Destroy();
+}
+
+
+//--------------------------------------------------------------------------------------
+void CStudioBounds::Destroy()
+{
+	m_BoneBounds.RemoveAll();
+	m_UsedBones.RemoveAll();
+}
+
+
+//--------------------------------------------------------------------------------------
+// A vertex goes into the box of every bone with a non-zero weight on it. A blended
+// vertex is a weighted average of its per-bone positions, so it always lies inside the
+// union of those boxes.
+//--------------------------------------------------------------------------------------
+HRESULT CStudioBounds::Init( const studiohdr_t* pStudioHdr, const mstudiovertex_t* pVertices, int numVertices )
+{
+	HRESULT hr;
+
+	Destroy();
+
+	V_RETURN( m_BoneBounds.SetSize( pStudioHdr->numbones ) );
+	for( int i=0; i < pStudioHdr->numbones; i++ )
+	{
+		StudioBoneBounds bounds;
+		bounds.vMin = Vector( FLT_MAX, FLT_MAX, FLT_MAX );
+		bounds.vMax = Vector( -FLT_MAX, -FLT_MAX, -FLT_MAX );
+		bounds.numVertices = 0;
+		m_BoneBounds.Add( bounds );
+	}
+
+	StudioBoneBounds* pBounds = m_BoneBounds.GetData();
+	for( int i=0; i < numVertices; i++ )
+	{
+		const mstudioboneweight_t& weights = pVertices[i].m_BoneWeights;
+		for( int j=0; j < weights.numbones; j++ )
+		{
+			int iBone = weights.bone[j];
+			if( weights.weight[j] <= 0.0f || iBone < 0 || iBone >= pStudioHdr->numbones )
+				continue;
+
+			Vector vBoneSpace;
+			VectorTransform( pVertices[i].m_vecPosition, pStudioHdr->pBone( iBone )->poseToBone, vBoneSpace );
+			D3DXVec3Minimize( &pBounds[iBone].vMin, &pBounds[iBone].vMin, &vBoneSpace );
+			D3DXVec3Maximize( &pBounds[iBone].vMax, &pBounds[iBone].vMax, &vBoneSpace );
+			pBounds[iBone].numVertices++;
+		}
+	}
+
+	for( int i=0; i < pStudioHdr->numbones; i++ )
+	{
+		if( pBounds[i].numVertices )
+			m_UsedBones.Add( i );
+	}
+
+	return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+bool CStudioBounds::ComputeBounds( const matrix3x4_t* pBoneToWorld, Vector* pMin, Vector* pMax ) const
+{
+	if( m_UsedBones.GetSize() == 0 )
+		return false;
+
+	*pMin = Vector( FLT_MAX, FLT_MAX, FLT_MAX );
+	*pMax = Vector( -FLT_MAX, -FLT_MAX, -FLT_MAX );
+
+	for( int i=0; i < m_UsedBones.GetSize(); i++ )
+	{
+		int iBone = m_UsedBones[i];
+		const StudioBoneBounds& bounds = m_BoneBounds[iBone];
+		const matrix3x4_t& matrix = pBoneToWorld[iBone];
+
+		// Transform the center, and take the extents through the absolute rotation
+		Vector vCenter = ( bounds.vMin + bounds.vMax ) * 0.5f;
+		Vector vExtent = ( bounds.vMax - bounds.vMin ) * 0.5f;
+		Vector vWorldCenter, vWorldExtent;
+		VectorTransform( vCenter, matrix, vWorldCenter );
+		vWorldExtent.x = fabsf( matrix[0][0] ) * vExtent.x + fabsf( matrix[0][1] ) * vExtent.y + fabsf( matrix[0][2] ) * vExtent.z;
+		vWorldExtent.y = fabsf( matrix[1][0] ) * vExtent.x + fabsf( matrix[1][1] ) * vExtent.y + fabsf( matrix[1][2] ) * vExtent.z;
+		vWorldExtent.z = fabsf( matrix[2][0] ) * vExtent.x + fabsf( matrix[2][1] ) * vExtent.y + fabsf( matrix[2][2] ) * vExtent.z;
+
+		Vector vMin = vWorldCenter - vWorldExtent;
+		Vector vMax = vWorldCenter + vWorldExtent;
+		D3DXVec3Minimize( pMin, pMin, &vMin );
+		D3DXVec3Maximize( pMax, pMax, &vMax );
+	}
+
+	return true;
+}
@@ -0,0 +1,37 @@
+//--------------------------------------------------------------------------------------
+// File: StudioBounds.h
+//
+// Animated model bounds from per-bone boxes. Each bone keeps the box of the vertices it
+// influences in its own space, so posed bounds cost one box transform per bone instead
+// of skinning every vertex.
+//
+//--------------------------------------------------------------------------------------
+#pragma once
+#include "BoneSetup.h"
+
+struct StudioBoneBounds
+{
+	Vector vMin;                // in bone space
+	Vector vMax;
+	int    numVertices;         // vertices weighted to the bone, 0 if the box is unused
+};
+
+class CStudioBounds
+{
+public:
+	CStudioBounds();
+	~CStudioBounds();
+
+	HRESULT Init( const studiohdr_t* pStudioHdr, const mstudiovertex_t* pVertices, int numVertices );
+	void    Destroy();
+
+	// Model space bounds of the posed model, conservative for blended vertices
+	bool    ComputeBounds( const matrix3x4_t* pBoneToWorld, Vector* pMin, Vector* pMax ) const;
+
+	int     GetNumBones() const { return m_BoneBounds.GetSize(); }
+	const StudioBoneBounds& GetBoneBounds( int iBone ) const { return m_BoneBounds.GetAt( iBone ); }
+
+private:
+	CGrowableArray< StudioBoneBounds > m_BoneBounds;
+	CGrowableArray< int >              m_UsedBones;     // bones with a valid box
+};
@@ -0,0 +1,693 @@
+//--------------------------------------------------------------------------------------
+// File: StudioCatalog.cpp
+//
+// Header-only scan of .mdl files into a summary index.
+//
+//--------------------------------------------------------------------------------------
+#include "DXUT.h"
+#include "StudioCatalog.h"
+#include "StudioThreads.h"
+#include <stdio.h>
+
+struct StudioCatalogFileHeader
+{
+	int id;                     // CATALOG_FILE_ID
+	int version;                // CATALOG_VERSION
+	int numEntries;
+	int numTextures;
+	int nStringBytes;
+};
+
+
+//--------------------------------------------------------------------------------------
+CStudioStringPool::CStudioStringPool()
+{
+	m_pData = NULL;
+	m_nSize = 0;
+	m_nCapacity = 0;
+}
+
+
+//--------------------------------------------------------------------------------------
+CStudioStringPool::~CStudioStringPool()
+{
+	RemoveAll();
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT CStudioStringPool::Resize( int nBytes )
+{
+	if( nBytes > m_nCapacity )
+	{
+		int nCapacity = m_nCapacity ? m_nCapacity : 4096;
+		while( nCapacity < nBytes )
+			nCapacity *= 2;
+		char* pData = (char*)realloc( m_pData, nCapacity );
+		if( pData == NULL )
+			return E_OUTOFMEMORY;
+		m_pData = pData;
+		m_nCapacity = nCapacity;
+	}
+	m_nSize = nBytes;
+	return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT CStudioStringPool::Add( const char* str, int nLength, int* pOffset )
+{
+	HRESULT hr;
+
+	int offset = m_nSize;
+	V_RETURN( Resize( m_nSize + nLength + 1 ) );
+	memcpy( m_pData + offset, str, nLength );
+	m_pData[offset + nLength] = 0;
+	*pOffset = offset;
+	return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+void CStudioStringPool::RemoveAll()
+{
+	free( m_pData );
+	m_pData = NULL;
+	m_nSize = 0;
+	m_nCapacity = 0;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Scan workers
+//--------------------------------------------------------------------------------------
+struct CatalogWorker
+{
+	BYTE                   head[CATALOG_HEAD_BYTES];
+	int                    nHeadBytes;
+	CGrowableArray< BYTE > span;        // last read past the head
+	CGrowableArray< int >  stringOffsets; // file offsets of the strings of the file at hand
+	CStudioStringPool      strings;
+	CGrowableArray< int >  textures;
+	int                    numReads;
+	LONGLONG               nBytesRead;
+};
+
+struct CatalogScanContext
+{
+	const CStudioStringPool* pPaths;
+	StudioCatalogEntry* pEntries;
+	int*                pEntryWorker;
+	int                 numFiles;
+	CatalogWorker*      pWorkers;
+	volatile LONG       nNextFile;
+};
+
+
+//--------------------------------------------------------------------------------------
+// Returns bytes [offset, offset + nBytes) of the file, from the head when they lie in it
+//--------------------------------------------------------------------------------------
+static const BYTE* ReadRange( HANDLE hFile, int offset, int nBytes, CatalogWorker* pWorker )
+{
+	if( offset + nBytes <= pWorker->nHeadBytes )
+		return pWorker->head + offset;
+
+	// The span only ever grows, so a worker stops allocating after its first few files
+	if( pWorker->span.GetSize() < nBytes )
+	{
+		pWorker->span.RemoveAll();
+		if( FAILED( pWorker->span.SetSize( nBytes ) ) )
+			return NULL;
+		for( int i=0; i < nBytes; i++ )
+			pWorker->span.Add( 0 );
+	}
+
+	OVERLAPPED overlapped;
+	ZeroMemory( &overlapped, sizeof( overlapped ) );
+	overlapped.Offset = offset;
+	DWORD nRead = 0;
+	if( !ReadFile( hFile, pWorker->span.GetData(), nBytes, &nRead, &overlapped ) || (int)nRead != nBytes )
+		return NULL;
+	pWorker->numReads++;
+	pWorker->nBytesRead += nBytes;
+	return pWorker->span.GetData();
+}
+
+
+//--------------------------------------------------------------------------------------
+static bool InFile( int offset, int nBytes, int nFileBytes )
+{
+	return offset >= 0 && nBytes >= 0 && offset <= nFileBytes && nBytes <= nFileBytes - offset;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Appends the file offsets of the texture names, then of the cd texture paths
+//--------------------------------------------------------------------------------------
+static HRESULT ReadTextureTables( HANDLE hFile, int nFileBytes, const studiohdr_t* pHdr, CatalogWorker* pWorker )
+{
+	HRESULT hr;
+
+	// Counts from a corrupt header could overflow the table sizes, none can exceed the file
+	if( pHdr->numtextures < 0 || pHdr->numtextures > nFileBytes / (int)sizeof( mstudiotexture_t ) ||
+		pHdr->numcdtextures < 0 || pHdr->numcdtextures > nFileBytes / (int)sizeof( int ) )
+		return E_FAIL;
+	int nTextureBytes = pHdr->numtextures * sizeof( mstudiotexture_t );
+	int nCdBytes = pHdr->numcdtextures * sizeof( int );
+	if( !InFile( pHdr->textureindex, nTextureBytes, nFileBytes ) || !InFile( pHdr->cdtextureindex, nCdBytes, nFileBytes ) )
+		return E_FAIL;
+
+	// Studiomdl writes the two tables close together, one read usually takes both
+	int iFirst = pHdr->textureindex < pHdr->cdtextureindex ? pHdr->textureindex : pHdr->cdtextureindex;
+	int iEnd = pHdr->textureindex + nTextureBytes;
+	if( iEnd < pHdr->cdtextureindex + nCdBytes )
+		iEnd = pHdr->cdtextureindex + nCdBytes;
+	bool bTogether = iEnd - iFirst <= CATALOG_MAX_SPAN;
+
+	const BYTE* pData = NULL;
+	if( bTogether && nTextureBytes + nCdBytes > 0 )
+	{
+		pData = ReadRange( hFile, iFirst, iEnd - iFirst, pWorker );
+		if( pData == NULL )
+			return E_FAIL;
+	}
+
+	if( nTextureBytes > 0 )
+	{
+		const BYTE* pTextures = bTogether ? pData + ( pHdr->textureindex - iFirst ) : ReadRange( hFile, pHdr->textureindex, nTextureBytes, pWorker );
+		if( pTextures == NULL )
+			return E_FAIL;
+		for( int i=0; i < pHdr->numtextures; i++ )
+		{
+			const mstudiotexture_t* pTexture = (const mstudiotexture_t*)pTextures + i;
+			LONGLONG offset = (LONGLONG)pHdr->textureindex + i * sizeof( mstudiotexture_t ) + pTexture->sznameindex;
+			V_RETURN( pWorker->stringOffsets.Add( offset > 0 && offset < nFileBytes ? (int)offset : -1 ) );
+		}
+	}
+
+	if( nCdBytes > 0 )
+	{
+		const BYTE* pCdTextures = bTogether ? pData + ( pHdr->cdtextureindex - iFirst ) : ReadRange( hFile, pHdr->cdtextureindex, nCdBytes, pWorker );
+		if( pCdTextures == NULL )
+			return E_FAIL;
+		for( int i=0; i < pHdr->numcdtextures; i++ )
+			V_RETURN( pWorker->stringOffsets.Add( ( (const int*)pCdTextures )[i] ) );
+	}
+
+	return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Copies the strings at pWorker->stringOffsets into the worker's pool, offsets outside
+// the file give -1
+//--------------------------------------------------------------------------------------
+static HRESULT ReadStrings( HANDLE hFile, int nFileBytes, CatalogWorker* pWorker, int* pOffsets )
+{
+	HRESULT hr;
+
+	int numStrings = pWorker->stringOffsets.GetSize();
+	int iFirst = nFileBytes;
+	int iLast = 0;
+	for( int i=0; i < numStrings; i++ )
+	{
+		int offset = pWorker->stringOffsets[i];
+		if( offset <= 0 || offset >= nFileBytes )
+			continue;
+		iFirst = offset < iFirst ? offset : iFirst;
+		iLast = offset > iLast ? offset : iLast;
+	}
+	if( iFirst > iLast )
+	{
+		for( int i=0; i < numStrings; i++ )
+			pOffsets[i] = -1;
+		return S_OK;
+	}
+
+	// The string table sits at the end of the file, normally one read covers all of it
+	int iEnd = iLast + CATALOG_MAX_STRING < nFileBytes ? iLast + CATALOG_MAX_STRING : nFileBytes;
+	bool bTogether = iEnd - iFirst <= CATALOG_MAX_SPAN;
+	const BYTE* pData = NULL;
+	if( bTogether )
+	{
+		pData = ReadRange( hFile, iFirst, iEnd - iFirst, pWorker );
+		if( pData == NULL )
+			return E_FAIL;
+	}
+
+	for( int i=0; i < numStrings; i++ )
+	{
+		int offset = pWorker->stringOffsets[i];
+		pOffsets[i] = -1;
+		if( offset <= 0 || offset >= nFileBytes )
+			continue;
+
+		int nMax = offset + CATALOG_MAX_STRING < nFileBytes ? CATALOG_MAX_STRING : nFileBytes - offset;
+		const char* str = bTogether ? (const char*)pData + ( offset - iFirst ) : (const char*)ReadRange( hFile, offset, nMax, pWorker );
+		if( str == NULL )
+			return E_FAIL;
+		int nLength = 0;
+		while( nLength < nMax && str[nLength] )
+			nLength++;
+		V_RETURN( pWorker->strings.Add( str, nLength, &pOffsets[i] ) );
+	}
+
+	return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Leaves only the path and the outcome, every summary field of an earlier scan is cleared
+//--------------------------------------------------------------------------------------
+static void ResetEntry( StudioCatalogEntry* pEntry, HRESULT hrScan, int nFileBytes )
+{
+	int iPath = pEntry->iPath;
+	ZeroMemory( pEntry, sizeof( StudioCatalogEntry ) );
+	pEntry->iPath = iPath;
+	pEntry->iName = -1;
+	pEntry->iSurfaceProp = -1;
+	pEntry->iFirstTexture = -1;
+	pEntry->hrScan = hrScan;
+	pEntry->fileBytes = nFileBytes;
+}
+
+
+//--------------------------------------------------------------------------------------
+static HRESULT ScanFile( HANDLE hFile, StudioCatalogEntry* pEntry, CatalogWorker* pWorker )
+{
+	HRESULT hr;
+
+	int nFileBytes = (int)GetFileSize( hFile, NULL );
+	pEntry->fileBytes = nFileBytes;
+
+	// The header, and with small models most of the file
+	pWorker->nHeadBytes = 0;
+	int nHeadBytes = nFileBytes < CATALOG_HEAD_BYTES ? nFileBytes : CATALOG_HEAD_BYTES;
+	if( nHeadBytes < (int)sizeof( studiohdr_t ) )
+		return E_FAIL;
+	OVERLAPPED overlapped;
+	ZeroMemory( &overlapped, sizeof( overlapped ) );
+	DWORD nRead = 0;
+	if( !ReadFile( hFile, pWorker->head, nHeadBytes, &nRead, &overlapped ) || (int)nRead != nHeadBytes )
+		return E_FAIL;
+	pWorker->nHeadBytes = nHeadBytes;
+	pWorker->numReads++;
+	pWorker->nBytesRead += nHeadBytes;
+
+	const studiohdr_t* pHdr = (const studiohdr_t*)pWorker->head;
+	if( pHdr->id != IDSTUDIOHEADER || pHdr->version != STUDIO_VERSION )
+		return E_FAIL;
+	if( pHdr->numtextures < 0 || pHdr->numcdtextures < 0 )
+		return E_FAIL;
+
+	pEntry->version = pHdr->version;
+	pEntry->checksum = pHdr->checksum;
+	pEntry->flags = pHdr->flags;
+	pEntry->numBones = pHdr->numbones;
+	pEntry->numSequences = pHdr->numlocalseq;
+	pEntry->numAnimations = pHdr->numlocalanim;
+	pEntry->numBodyParts = pHdr->numbodyparts;
+	pEntry->numSkinFamilies = pHdr->numskinfamilies;
+	pEntry->numAttachments = pHdr->numlocalattachments;
+	pEntry->numFlexDesc = pHdr->numflexdesc;
+	pEntry->numIncludeModels = pHdr->numincludemodels;
+	pEntry->mass = pHdr->mass;
+	pEntry->contents = pHdr->contents;
+	pEntry->hullMin = pHdr->hull_min;
+	pEntry->hullMax = pHdr->hull_max;
+	pEntry->viewMin = pHdr->view_bbmin;
+	pEntry->viewMax = pHdr->view_bbmax;
+
+	int nNameLength = 0;
+	while( nNameLength < (int)sizeof( pHdr->name ) && pHdr->name[nNameLength] )
+		nNameLength++;
+	V_RETURN( pWorker->strings.Add( pHdr->name, nNameLength, &pEntry->iName ) );
+
+	// Texture names, cd paths and the surface property are gathered and read together
+	pWorker->stringOffsets.RemoveAll();
+	V_RETURN( ReadTextureTables( hFile, nFileBytes, pHdr, pWorker ) );
+	V_RETURN( pWorker->stringOffsets.Add( pHdr->surfacepropindex ) );
+
+	int numStrings = pWorker->stringOffsets.GetSize();
+	pEntry->numTextures = pHdr->numtextures;
+	pEntry->numCdTextures = pHdr->numcdtextures;
+	pEntry->iFirstTexture = pWorker->textures.GetSize();
+	for( int i=0; i < numStrings; i++ )
+		V_RETURN( pWorker->textures.Add( -1 ) );
+	V_RETURN( ReadStrings( hFile, nFileBytes, pWorker, pWorker->textures.GetData() + pEntry->iFirstTexture ) );
+
+	// The surface property rode along as the last string
+	pEntry->iSurfaceProp = pWorker->textures[pEntry->iFirstTexture + numStrings - 1];
+	pWorker->textures.Remove( pEntry->iFirstTexture + numStrings - 1 );
+	return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+static void ScanTask( int iTask, int nTasks, void* pContext )
+{
+	CatalogScanContext* pScan = (CatalogScanContext*)pContext;
+	CatalogWorker* pWorker = &pScan->pWorkers[iTask];
+
+	for( ;; )
+	{
+		int iFile = InterlockedIncrement( &pScan->nNextFile ) - 1;
+		if( iFile >= pScan->numFiles )
+			break;
+
+		StudioCatalogEntry* pEntry = &pScan->pEntries[iFile];
+		pScan->pEntryWorker[iFile] = iTask;
+
+		HANDLE hFile = CreateFileA( pScan->pPaths->GetString( pEntry->iPath ), GENERIC_READ, FILE_SHARE_READ, NULL,
+									OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL );
+		if( hFile == INVALID_HANDLE_VALUE )
+		{
+			ResetEntry( pEntry, E_FAIL, 0 );
+			continue;
+		}
+		HRESULT hrScan = ScanFile( hFile, pEntry, pWorker );
+		CloseHandle( hFile );
+
+		// A failed file keeps only its path, whatever strings it left in the pool go unused
+		if( FAILED( hrScan ) )
+			ResetEntry( pEntry, hrScan, pEntry->fileBytes );
+		else
+			pEntry->hrScan = hrScan;
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+// CStudioCatalog
+//--------------------------------------------------------------------------------------
+CStudioCatalog::CStudioCatalog()
+{
+	ZeroMemory( &m_Stats, sizeof( m_Stats ) );
+}
+
+
+//--------------------------------------------------------------------------------------
+CStudioCatalog::~CStudioCatalog()
+{
+	Destroy();
+}
+
+
+//--------------------------------------------------------------------------------------
+void CStudioCatalog::Destroy()
+{
+	m_Entries.RemoveAll();
+	m_Textures.RemoveAll();
+	m_Strings.RemoveAll();
+	m_Paths.RemoveAll();
+	ZeroMemory( &m_Stats, sizeof( m_Stats ) );
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT CStudioCatalog::AddFile( const char* strFileName )
+{
+	HRESULT hr;
+
+	StudioCatalogEntry entry;
+	ZeroMemory( &entry, sizeof( entry ) );
+	V_RETURN( m_Paths.Add( strFileName, (int)strlen( strFileName ), &entry.iPath ) );
+	ResetEntry( &entry, E_PENDING, 0 );
+	return m_Entries.Add( entry );
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT CStudioCatalog::AddDirectory( const char* strDirectory )
+{
+	HRESULT hr = S_OK;
+
+	char strSearch[MAX_PATH];
+	StringCchCopyA( strSearch, MAX_PATH, strDirectory );
+	StringCchCatA( strSearch, MAX_PATH, "\\*" );
+
+	WIN32_FIND_DATAA findData;
+	HANDLE hFind = FindFirstFileA( strSearch, &findData );
+	if( hFind == INVALID_HANDLE_VALUE )
+		return S_OK;
+
+	do
+	{
+		if( 0 == strcmp( findData.cFileName, "." ) || 0 == strcmp( findData.cFileName, ".." ) )
+			continue;
+
+		char strPath[MAX_PATH];
+		StringCchCopyA( strPath, MAX_PATH, strDirectory );
+		StringCchCatA( strPath, MAX_PATH, "\\" );
+		StringCchCatA( strPath, MAX_PATH, findData.cFileName );
+
+		int nLength = (int)strlen( findData.cFileName );
+		if( findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY )
+			hr = AddDirectory( strPath );
+		else if( nLength > 4 && 0 == _stricmp( findData.cFileName + nLength - 4, ".mdl" ) )
+			hr = AddFile( strPath );
+	}
+	while( SUCCEEDED( hr ) && FindNextFileA( hFind, &findData ) );
+
+	FindClose( hFind );
+	return hr;
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT CStudioCatalog::Scan( int nWorkers )
+{
+	HRESULT hr = S_OK;
+
+	LARGE_INTEGER frequency, start, end;
+	QueryPerformanceFrequency( &frequency );
+	QueryPerformanceCounter( &start );
+
+	int numFiles = m_Entries.GetSize();
+	if( nWorkers <= 0 )
+		nWorkers = Studio_GetNumWorkers();
+	if( nWorkers > STUDIO_MAX_WORKERS )
+		nWorkers = STUDIO_MAX_WORKERS;
+	if( nWorkers > numFiles )
+		nWorkers = numFiles > 0 ? numFiles : 1;
+
+	// Strings of an earlier scan are dropped, the paths keep their offsets
+	m_Textures.RemoveAll();
+	V_RETURN( m_Strings.Resize( m_Paths.GetSize() ) );
+	if( m_Paths.GetSize() > 0 )
+		memcpy( m_Strings.GetData(), m_Paths.GetData(), m_Paths.GetSize() );
+
+	CatalogWorker* pWorkers = new CatalogWorker[nWorkers];
+	int* pEntryWorker = new int[numFiles > 0 ? numFiles : 1];
+	for( int i=0; i < nWorkers; i++ )
+	{
+		pWorkers[i].nHeadBytes = 0;
+		pWorkers[i].numReads = 0;
+		pWorkers[i].nBytesRead = 0;
+	}
+
+	CatalogScanContext scan;
+	scan.pPaths = &m_Paths;
+	scan.pEntries = m_Entries.GetData();
+	scan.pEntryWorker = pEntryWorker;
+	scan.numFiles = numFiles;
+	scan.pWorkers = pWorkers;
+	scan.nNextFile = 0;
+	Studio_RunTasks( nWorkers, ScanTask, &scan );
+
+	// Append the worker pools and move every offset from its worker's pool into ours
+	int stringBase[STUDIO_MAX_WORKERS];
+	int textureBase[STUDIO_MAX_WORKERS];
+	ZeroMemory( &m_Stats, sizeof( m_Stats ) );
+	for( int i=0; i < nWorkers && SUCCEEDED( hr ); i++ )
+	{
+		CatalogWorker* pWorker = &pWorkers[i];
+		stringBase[i] = m_Strings.GetSize();
+		textureBase[i] = m_Textures.GetSize();
+		hr = m_Strings.Resize( stringBase[i] + pWorker->strings.GetSize() );
+		if( SUCCEEDED( hr ) && pWorker->strings.GetSize() > 0 )
+			memcpy( m_Strings.GetData() + stringBase[i], pWorker->strings.GetData(), pWorker->strings.GetSize() );
+		for( int j=0; j < pWorker->textures.GetSize() && SUCCEEDED( hr ); j++ )
+		{
+			int offset = pWorker->textures[j];
+			hr = m_Textures.Add( offset >= 0 ? offset + stringBase[i] : -1 );
+		}
+		m_Stats.numReads += pWorker->numReads;
+		m_Stats.nBytesRead += pWorker->nBytesRead;
+	}
+
+	for( int i=0; i < numFiles && SUCCEEDED( hr ); i++ )
+	{
+		StudioCatalogEntry& entry = m_Entries[i];
+		int iWorker = pEntryWorker[i];
+		if( entry.iName >= 0 )
+			entry.iName += stringBase[iWorker];
+		if( entry.iSurfaceProp >= 0 )
+			entry.iSurfaceProp += stringBase[iWorker];
+		if( entry.iFirstTexture >= 0 )
+			entry.iFirstTexture += textureBase[iWorker];
+		if( FAILED( entry.hrScan ) )
+			m_Stats.numFailed++;
+	}
+
+	SAFE_DELETE_ARRAY( pWorkers );
+	SAFE_DELETE_ARRAY( pEntryWorker );
+
+	QueryPerformanceCounter( &end );
+	m_Stats.numFiles = numFiles;
+	m_Stats.nWorkers = nWorkers;
+	m_Stats.flSeconds = (double)( end.QuadPart - start.QuadPart ) / (double)frequency.QuadPart;
+	return hr;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Header, entries, texture string offsets, string pool
+//--------------------------------------------------------------------------------------
+HRESULT CStudioCatalog::WriteIndex( const char* strFileName )
+{
+	FILE* pFile = fopen( strFileName, "wb" );
+	if( pFile == NULL )
+		return E_FAIL;
+
+	StudioCatalogFileHeader header;
+	header.id = CATALOG_FILE_ID;
+	header.version = CATALOG_VERSION;
+	header.numEntries = m_Entries.GetSize();
+	header.numTextures = m_Textures.GetSize();
+	header.nStringBytes = m_Strings.GetSize();
+
+	bool bWritten = 1 == fwrite( &header, sizeof( header ), 1, pFile );
+	if( bWritten && header.numEntries > 0 )
+		bWritten = 1 == fwrite( m_Entries.GetData(), header.numEntries * sizeof( StudioCatalogEntry ), 1, pFile );
+	if( bWritten && header.numTextures > 0 )
+		bWritten = 1 == fwrite( m_Textures.GetData(), header.numTextures * sizeof( int ), 1, pFile );
+	if( bWritten && header.nStringBytes > 0 )
+		bWritten = 1 == fwrite( m_Strings.GetData(), header.nStringBytes, 1, pFile );
+	fclose( pFile );
+	return bWritten ? S_OK : E_FAIL;
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT CStudioCatalog::ReadIndex( const char* strFileName )
+{
+	HRESULT hr;
+
+	Destroy();
+
+	FILE* pFile = fopen( strFileName, "rb" );
+	if( pFile == NULL )
+		return E_FAIL;
+
+	StudioCatalogFileHeader header;
+	hr = 1 == fread( &header, sizeof( header ), 1, pFile ) ? S_OK : E_FAIL;
+	if( SUCCEEDED( hr ) && ( header.id != CATALOG_FILE_ID || header.version != CATALOG_VERSION ||
+							 header.numEntries < 0 || header.numTextures < 0 || header.nStringBytes < 0 ) )
+		hr = E_FAIL;
+
+	StudioCatalogEntry entry;
+	for( int i=0; i < header.numEntries && SUCCEEDED( hr ); i++ )
+	{
+		hr = 1 == fread( &entry, sizeof( entry ), 1, pFile ) ? S_OK : E_FAIL;
+		if( SUCCEEDED( hr ) )
+			hr = m_Entries.Add( entry );
+	}
+	int offset;
+	for( int i=0; i < header.numTextures && SUCCEEDED( hr ); i++ )
+	{
+		hr = 1 == fread( &offset, sizeof( offset ), 1, pFile ) ? S_OK : E_FAIL;
+		if( SUCCEEDED( hr ) )
+			hr = m_Textures.Add( offset );
+	}
+	if( SUCCEEDED( hr ) )
+		hr = m_Strings.Resize( header.nStringBytes );
+	if( SUCCEEDED( hr ) && header.nStringBytes > 0 )
+		hr = 1 == fread( m_Strings.GetData(), header.nStringBytes, 1, pFile ) ? S_OK : E_FAIL;
+	fclose( pFile );
+
+	// Offsets pointing past the pool would make the accessors read anywhere
+	for( int i=0; i < m_Entries.GetSize() && SUCCEEDED( hr ); i++ )
+	{
+		const StudioCatalogEntry& e = m_Entries[i];
+		if( e.iPath >= header.nStringBytes || e.iName >= header.nStringBytes || e.iSurfaceProp >= header.nStringBytes ||
+			e.iFirstTexture < -1 || e.numTextures < 0 || e.numCdTextures < 0 ||
+			( e.iFirstTexture == -1 && e.numTextures + e.numCdTextures > 0 ) ||
+			e.iFirstTexture + e.numTextures + e.numCdTextures > header.numTextures )
+			hr = E_FAIL;
+	}
+	for( int i=0; i < m_Textures.GetSize() && SUCCEEDED( hr ); i++ )
+	{
+		if( m_Textures[i] >= header.nStringBytes )
+			hr = E_FAIL;
+	}
+	if( SUCCEEDED( hr ) && header.nStringBytes > 0 && m_Strings.GetData()[header.nStringBytes - 1] != 0 )
+		hr = E_FAIL;
+
+	if( FAILED( hr ) )
+		Destroy();
+	return hr;
+}
+
+
+//--------------------------------------------------------------------------------------
+static void WriteCSVString( FILE* pFile, const char* str )
+{
+	fputc( '"', pFile );
+	for( ; *str; str++ )
+	{
+		if( *str == '"' )
+			fputc( '"', pFile );
+		fputc( *str, pFile );
+	}
+	fputc( '"', pFile );
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT CStudioCatalog::WriteCSV( const char* strFileName )
+{
+	FILE* pFile = fopen( strFileName, "w" );
+	if( pFile == NULL )
+		return E_FAIL;
+
+	fprintf( pFile, "path,status,name,checksum,bytes,flags,bones,sequences,animations,bodyparts,skins,attachments,"
+			 "flexes,includes,mass,contents,hull_min,hull_max,view_min,view_max,surfaceprop,textures,cdtextures\n" );
+	for( int i=0; i < m_Entries.GetSize(); i++ )
+	{
+		const StudioCatalogEntry& entry = m_Entries[i];
+		WriteCSVString( pFile, GetString( entry.iPath ) );
+		fprintf( pFile, ",%s,", SUCCEEDED( entry.hrScan ) ? "ok" : "failed" );
+		WriteCSVString( pFile, GetString( entry.iName ) );
+		fprintf( pFile, ",%d,%d,0x%x,%d,%d,%d,%d,%d,%d,%d,%d,%g,0x%x", entry.checksum, entry.fileBytes, entry.flags,
+				 entry.numBones, entry.numSequences, entry.numAnimations, entry.numBodyParts, entry.numSkinFamilies,
+				 entry.numAttachments, entry.numFlexDesc, entry.numIncludeModels, entry.mass, entry.contents );
+		const Vector* pVectors[] = { &entry.hullMin, &entry.hullMax, &entry.viewMin, &entry.viewMax };
+		for( int j=0; j < 4; j++ )
+			fprintf( pFile, ",%g %g %g", pVectors[j]->x, pVectors[j]->y, pVectors[j]->z );
+		fputc( ',', pFile );
+		WriteCSVString( pFile, GetString( entry.iSurfaceProp ) );
+
+		// Texture names and cd paths each joined with semicolons
+		char strList[4096];
+		for( int iList=0; iList < 2; iList++ )
+		{
+			int iFirst = iList == 0 ? 0 : entry.numTextures;
+			int iEnd = iList == 0 ? entry.numTextures : entry.numTextures + entry.numCdTextures;
+			strList[0] = 0;
+			for( int j=iFirst; j < iEnd; j++ )
+			{
+				if( j > iFirst )
+					StringCchCatA( strList, sizeof( strList ), ";" );
+				StringCchCatA( strList, sizeof( strList ), GetTexture( entry, j ) );
+			}
+			fputc( ',', pFile );
+			WriteCSVString( pFile, strList );
+		}
+		fputc( '\n', pFile );
+	}
+
+	bool bWritten = !ferror( pFile );
+	fclose( pFile );
+	return bWritten ? S_OK : E_FAIL;
+}
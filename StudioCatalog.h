@@ -0,0 +1,124 @@
+//--------------------------------------------------------------------------------------
+// File: StudioCatalog.h
+//
+// Summary index of a model library, built from the .mdl headers alone. Per file the
+// scan reads the first CATALOG_HEAD_BYTES, which hold studiohdr_t, then the texture
+// and cd texture tables and then the strings they point to, each in one positional
+// read unless the pieces lie far apart. Nothing past the header is parsed, so a
+// library of 100k models scans in the time a handful of full loads take.
+//
+// Files are handed out to the workers one at a time. Every worker keeps its own
+// string pool and read buffers, the pools are merged in file order afterwards.
+//
+// The index is written as a compact binary file that ReadIndex loads back, or as CSV
+// with one row per file.
+//
+//--------------------------------------------------------------------------------------
+#pragma once
+#include "studio.h"
+
+#define CATALOG_FILE_ID		(('T'<<24)+('A'<<16)+('C'<<8)+'S')	// little-endian "SCAT"
+#define CATALOG_VERSION		1
+
+#define CATALOG_HEAD_BYTES	4096	// first read of every file
+#define CATALOG_MAX_SPAN	65536	// tables or strings further apart are read one by one
+#define CATALOG_MAX_STRING	256		// longest name kept, longer ones are cut
+
+// Growing block of zero terminated strings addressed by offset
+class CStudioStringPool
+{
+public:
+	CStudioStringPool();
+	~CStudioStringPool();
+
+	// Copies nLength characters and a terminator, the offset of the copy goes to pOffset
+	HRESULT Add( const char* str, int nLength, int* pOffset );
+	HRESULT Resize( int nBytes );
+	void    RemoveAll();
+
+	const char* GetString( int offset ) const { return offset >= 0 ? m_pData + offset : ""; }
+	char*   GetData() { return m_pData; }
+	int     GetSize() const { return m_nSize; }
+
+private:
+	char* m_pData;
+	int   m_nSize;
+	int   m_nCapacity;
+
+	CStudioStringPool( const CStudioStringPool& );
+	CStudioStringPool& operator=( const CStudioStringPool& );
+};
+
+// One scanned file. String offsets are -1 when the file has no such string. A file
+// that failed keeps its path, hrScan and size, with the other offsets -1 and counts 0.
+struct StudioCatalogEntry
+{
+	int     iPath;              // string offsets
+	int     iName;
+	int     iSurfaceProp;
+	int     iFirstTexture;      // into the texture list, the texture names then the cd paths
+	int     numTextures;
+	int     numCdTextures;
+	HRESULT hrScan;             // S_OK, or why the file is not in the summary
+	int     fileBytes;
+	int     version;
+	int     checksum;
+	int     flags;              // STUDIOHDR_FLAGS_*
+	int     numBones;
+	int     numSequences;
+	int     numAnimations;
+	int     numBodyParts;
+	int     numSkinFamilies;
+	int     numAttachments;
+	int     numFlexDesc;
+	int     numIncludeModels;
+	float   mass;
+	int     contents;
+	Vector  hullMin;
+	Vector  hullMax;
+	Vector  viewMin;
+	Vector  viewMax;
+};
+
+struct StudioCatalogStats
+{
+	int      numFiles;
+	int      numFailed;
+	int      numReads;
+	LONGLONG nBytesRead;
+	int      nWorkers;
+	double   flSeconds;
+};
+
+class CStudioCatalog
+{
+public:
+	CStudioCatalog();
+	~CStudioCatalog();
+
+	// Files to scan, a directory adds every .mdl below it
+	HRESULT AddFile( const char* strFileName );
+	HRESULT AddDirectory( const char* strDirectory );
+
+	// Reads the summary of every file added, replacing the results of an earlier scan.
+	// nWorkers of 0 picks one per processor.
+	HRESULT Scan( int nWorkers = 0 );
+	void    Destroy();
+
+	int     GetNumEntries() const { return m_Entries.GetSize(); }
+	const StudioCatalogEntry& GetEntry( int iEntry ) const { return m_Entries[iEntry]; }
+	const char* GetString( int offset ) const { return m_Strings.GetString( offset ); }
+	const char* GetTexture( const StudioCatalogEntry& entry, int i ) const { return m_Strings.GetString( m_Textures[entry.iFirstTexture + i] ); }
+	const StudioCatalogStats& GetStats() const { return m_Stats; }
+
+	HRESULT WriteIndex( const char* strFileName );
+	HRESULT ReadIndex( const char* strFileName );
+	HRESULT WriteCSV( const char* strFileName );
+
+private:
+	CGrowableArray< StudioCatalogEntry > m_Entries;
+	CGrowableArray< int > m_Textures;   // string offsets
+	CStudioStringPool m_Strings;        // the paths first, then the strings of the scan
+	CStudioStringPool m_Paths;          // the paths alone, kept for the next scan
+	StudioCatalogStats m_Stats;
+};
@@ -0,0 +1,187 @@
+//--------------------------------------------------------------------------------------
+// File: StudioEvents.cpp
+//
+// Cycle-sorted animation event index for studio models.
+//
+//--------------------------------------------------------------------------------------
+#include "DXUT.h"
+#include "StudioEvents.h"
+
+
+//--------------------------------------------------------------------------------------
+HRESULT CStudioEventIndex::Init( const studiohdr_t* pStudioHdr )
+{
+	HRESULT hr;
+
+	Destroy();
+
+	int numSeq = pStudioHdr->GetNumSeq();
+	int nTotal = 0;
+	for( int i=0; i < numSeq; i++ )
+		nTotal += pStudioHdr->pSeqdesc( i ).numevents;
+
+	V_RETURN( m_Sequences.SetSize( numSeq ) );
+	V_RETURN( m_Events.SetSize( nTotal ) );
+
+	for( int i=0; i < numSeq; i++ )
+	{
+		mstudioseqdesc_t& seqdesc = pStudioHdr->pSeqdesc( i );
+
+		StudioSequenceEvents seq;
+		seq.iFirst = m_Events.GetSize();
+		seq.nCount = seqdesc.numevents;
+		seq.bLooping = ( seqdesc.flags & STUDIO_LOOPING ) != 0;
+		V_RETURN( m_Sequences.Add( seq ) );
+
+		// Sequences carry a handful of events, insertion sort keeps equal cycles in file order
+		for( int j=0; j < seqdesc.numevents; j++ )
+		{
+			StudioEventEntry entry;
+			entry.flCycle = seqdesc.pEvent( j )->cycle;
+			entry.iEvent = j;
+			V_RETURN( m_Events.Add( entry ) );
+
+			int k = m_Events.GetSize() - 1;
+			while( k > seq.iFirst && m_Events[k - 1].flCycle > entry.flCycle )
+			{
+				m_Events[k] = m_Events[k - 1];
+				k--;
+			}
+			m_Events[k] = entry;
+		}
+	}
+
+	return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+void CStudioEventIndex::Destroy()
+{
+	m_Events.RemoveAll();
+	m_Sequences.RemoveAll();
+}
+
+
+//--------------------------------------------------------------------------------------
+int CStudioEventIndex::GetNumEvents( int iSequence ) const
+{
+	if( iSequence < 0 || iSequence >= m_Sequences.GetSize() )
+		return 0;
+	return m_Sequences[iSequence].nCount;
+}
+
+
+//--------------------------------------------------------------------------------------
+const StudioEventEntry* CStudioEventIndex::GetSortedEvents( int iSequence ) const
+{
+	if( GetNumEvents( iSequence ) == 0 )
+		return NULL;
+	return &m_Events[m_Sequences[iSequence].iFirst];
+}
+
+
+//--------------------------------------------------------------------------------------
+// First entry with a cycle >= flCycle
+//--------------------------------------------------------------------------------------
+int CStudioEventIndex::LowerBound( const StudioSequenceEvents& seq, float flCycle ) const
+{
+	int iLow = seq.iFirst;
+	int iHigh = seq.iFirst + seq.nCount;
+	while( iLow < iHigh )
+	{
+		int iMid = ( iLow + iHigh ) / 2;
+		if( m_Events[iMid].flCycle < flCycle )
+			iLow = iMid + 1;
+		else
+			iHigh = iMid;
+	}
+	return iLow;
+}
+
+
+//--------------------------------------------------------------------------------------
+// First entry with a cycle > flCycle
+//--------------------------------------------------------------------------------------
+int CStudioEventIndex::UpperBound( const StudioSequenceEvents& seq, float flCycle ) const
+{
+	int iLow = seq.iFirst;
+	int iHigh = seq.iFirst + seq.nCount;
+	while( iLow < iHigh )
+	{
+		int iMid = ( iLow + iHigh ) / 2;
+		if( m_Events[iMid].flCycle <= flCycle )
+			iLow = iMid + 1;
+		else
+			iHigh = iMid;
+	}
+	return iLow;
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT CStudioEventIndex::AddHits( const StudioSequenceEvents& seq, int iBegin, int iEnd, int iSequence, int iQuery,
+									CGrowableArray< StudioEventHit >& hits ) const
+{
+	HRESULT hr;
+
+	for( int i=iBegin; i < iEnd; i++ )
+	{
+		StudioEventHit hit;
+		hit.iQuery = iQuery;
+		hit.iSequence = iSequence;
+		hit.iEvent = m_Events[i].iEvent;
+		hit.flCycle = m_Events[i].flCycle;
+		V_RETURN( hits.Add( hit ) );
+	}
+
+	return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT CStudioEventIndex::GetEventsCrossed( int iSequence, float flPrevCycle, float flCycle, int iQuery,
+											 CGrowableArray< StudioEventHit >& hits ) const
+{
+	HRESULT hr;
+
+	if( iSequence < 0 || iSequence >= m_Sequences.GetSize() )
+		return E_INVALIDARG;
+
+	const StudioSequenceEvents& seq = m_Sequences[iSequence];
+	if( seq.nCount == 0 || flPrevCycle == flCycle )
+		return S_OK;
+
+	int iEnd = seq.iFirst + seq.nCount;
+	if( flCycle < flPrevCycle )
+	{
+		if( seq.bLooping )
+		{
+			// Wrapped: rest of the last loop, then the start of this one
+			V_RETURN( AddHits( seq, LowerBound( seq, flPrevCycle ), iEnd, iSequence, iQuery, hits ) );
+		}
+		return AddHits( seq, seq.iFirst, LowerBound( seq, flCycle ), iSequence, iQuery, hits );
+	}
+
+	// Reaching the end fires the events placed on it, there is no next tick for them
+	int iLast = ( flCycle >= 1.0f ) ? UpperBound( seq, flCycle ) : LowerBound( seq, flCycle );
+	return AddHits( seq, LowerBound( seq, flPrevCycle ), iLast, iSequence, iQuery, hits );
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT CStudioEventIndex::GetEventsCrossed( const StudioEventQuery* pQueries, int nQueries,
+											 CGrowableArray< StudioEventHit >& hits ) const
+{
+	HRESULT hr;
+
+	for( int i=0; i < nQueries; i++ )
+	{
+		const StudioEventQuery& query = pQueries[i];
+		if( GetNumEvents( query.iSequence ) == 0 )
+			continue;
+		V_RETURN( GetEventsCrossed( query.iSequence, query.flPrevCycle, query.flCycle, i, hits ) );
+	}
+
+	return S_OK;
+}
@@ -0,0 +1,68 @@
+//--------------------------------------------------------------------------------------
+// File: StudioEvents.h
+//
+// Animation events of every sequence, sorted by cycle. Finding the events crossed
+// between two cycles is a binary search into the sequence's slice instead of a scan
+// over all of its events. Built once per model and shared by every instance.
+//
+//--------------------------------------------------------------------------------------
+#pragma once
+#include "studio.h"
+
+struct StudioEventEntry
+{
+	float       flCycle;
+	int         iEvent;         // index for mstudioseqdesc_t::pEvent
+};
+
+struct StudioSequenceEvents
+{
+	int         iFirst;         // first entry in the sorted list
+	int         nCount;
+	bool        bLooping;
+};
+
+// One instance's advance over the last tick
+struct StudioEventQuery
+{
+	int         iSequence;
+	float       flPrevCycle;
+	float       flCycle;
+};
+
+struct StudioEventHit
+{
+	int         iQuery;         // index of the query that crossed the event
+	int         iSequence;
+	int         iEvent;
+	float       flCycle;
+};
+
+class CStudioEventIndex
+{
+public:
+	HRESULT Init( const studiohdr_t* pStudioHdr );
+	void    Destroy();
+
+	int     GetNumEvents( int iSequence ) const;
+	const StudioEventEntry* GetSortedEvents( int iSequence ) const;
+
+	// Appends the events of one sequence crossed going from flPrevCycle to flCycle.
+	// Events at flPrevCycle fire, events at flCycle fire on the next tick, except at the
+	// end of the sequence. A looping sequence whose cycle went backwards has wrapped
+	// and gets the tail and the head; a non-looping one was restarted and gets the head.
+	HRESULT GetEventsCrossed( int iSequence, float flPrevCycle, float flCycle, int iQuery,
+							  CGrowableArray< StudioEventHit >& hits ) const;
+	// Same for many instances at once, hits come out in query order
+	HRESULT GetEventsCrossed( const StudioEventQuery* pQueries, int nQueries,
+							  CGrowableArray< StudioEventHit >& hits ) const;
+
+private:
+	int     LowerBound( const StudioSequenceEvents& seq, float flCycle ) const;
+	int     UpperBound( const StudioSequenceEvents& seq, float flCycle ) const;
+	HRESULT AddHits( const StudioSequenceEvents& seq, int iBegin, int iEnd, int iSequence, int iQuery,
+					 CGrowableArray< StudioEventHit >& hits ) const;
+
+	CGrowableArray< StudioEventEntry >      m_Events;       // grouped by sequence, sorted by cycle
+	CGrowableArray< StudioSequenceEvents >  m_Sequences;
+};
@@ -0,0 +1,114 @@
+//--------------------------------------------------------------------------------------
+// File: StudioFlexStream.cpp
+//
+// Dynamic vertex stream for flexed strip groups.
+//
+//--------------------------------------------------------------------------------------
+#include "DXUT.h"
+#include "StudioFlexStream.h"
+
+using namespace OptimizedModel;
+
+
+//--------------------------------------------------------------------------------------
+CStudioFlexStream::CStudioFlexStream()
+{
+	m_numMeshVertices = 0;
+	m_nStride = 0;
+	ZeroMemory( &m_Stats, sizeof( m_Stats ) );
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT CStudioFlexStream::Init( const studiohdr_t* pStudioHdr, const FileHeader_t* pVtxHdr, int iLod,
+								 const StudioVertexView& vertices, int nVertexSize )
+{
+	HRESULT hr;
+
+	Destroy();
+
+	m_nStride = nVertexSize;
+
+	const ModelLODHeader_t* pLod = pVtxHdr->pBodyPart( 0 )->pModel( 0 )->pLOD( iLod );
+	const mstudiomodel_t* pStudioModel = pStudioHdr->pBodypart( 0 )->pModel( 0 );
+
+	int iSubset = 0;
+	int iIndexBase = 0;
+	for( int k=0; k < pStudioModel->nummeshes; k++ )
+	{
+		const MeshHeader_t* pMesh = pLod->pMesh( k );
+		for( int j=0; j < pMesh->numStripGroups; j++ )
+		{
+			const StripGroupHeader_t* pGroup = pMesh->pStripGroup( j );
+			if( pGroup->flags & ( STRIPGROUP_IS_FLEXED | STRIPGROUP_IS_DELTA_FLEXED ) )
+			{
+				StudioFlexRange range;
+				range.iSubset = iSubset;
+				range.iFirstVertex = m_numMeshVertices;
+				range.numVertices = pGroup->numVerts;
+				range.iFirstDynamic = m_Rest.GetSize();
+				range.iFirstIndex = iIndexBase;
+				range.numIndices = pGroup->numIndices / 3 * 3;
+				V_RETURN( m_Ranges.Add( range ) );
+
+				for( int v=0; v < pGroup->numVerts; v++ )
+				{
+					StudioFlexVertex vertex;
+					vertex.vecPosition = vertices.Position( m_numMeshVertices + v );
+					vertex.vecNormal = vertices.Normal( m_numMeshVertices + v );
+					V_RETURN( m_Rest.Add( vertex ) );
+				}
+			}
+
+			m_numMeshVertices += pGroup->numVerts;
+			iIndexBase += pGroup->numIndices / 3 * 3;
+			iSubset++;
+		}
+	}
+
+	V_RETURN( m_Dynamic.SetSize( m_Rest.GetSize() ) );
+	for( int i=0; i < m_Rest.GetSize(); i++ )
+		V_RETURN( m_Dynamic.Add( m_Rest[i] ) );
+
+	return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+void CStudioFlexStream::Destroy()
+{
+	m_Ranges.RemoveAll();
+	m_Rest.RemoveAll();
+	m_Dynamic.RemoveAll();
+	m_numMeshVertices = 0;
+	m_nStride = 0;
+	ZeroMemory( &m_Stats, sizeof( m_Stats ) );
+}
+
+
+//--------------------------------------------------------------------------------------
+void CStudioFlexStream::ResetToRest()
+{
+	if( m_Rest.GetSize() )
+		memcpy( m_Dynamic.GetData(), m_Rest.GetData(), GetDynamicBytes() );
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT CStudioFlexStream::Upload( IDirect3DVertexBuffer9* pVB )
+{
+	HRESULT hr;
+
+	if( m_Dynamic.GetSize() == 0 )
+		return S_OK;
+
+	// The whole stream is rewritten, so the old contents can be discarded
+	void* pData;
+	V_RETURN( pVB->Lock( 0, GetDynamicBytes(), &pData, D3DLOCK_DISCARD ) );
+	memcpy( pData, m_Dynamic.GetData(), GetDynamicBytes() );
+	pVB->Unlock();
+
+	m_Stats.nUploads++;
+	m_Stats.nBytesWritten += GetDynamicBytes();
+	return S_OK;
+}
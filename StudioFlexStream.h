@@ -0,0 +1,77 @@
+//--------------------------------------------------------------------------------------
+// File: StudioFlexStream.h
+//
+// Static/dynamic split of the vertex data. The mesh vertex buffer stays immutable, and
+// the positions and normals of the flexed strip groups are mirrored into a small
+// dynamic stream, so flexing a face rewrites only those vertices each frame.
+//
+// A flexed subset is drawn with the flex declaration, the mesh vertex buffer on stream
+// 0 at offset iFirstVertex * sizeof(vertex), the dynamic buffer on stream 1 at offset
+// iFirstDynamic * sizeof(StudioFlexVertex) and a base vertex index of -iFirstVertex.
+//
+//--------------------------------------------------------------------------------------
+#pragma once
+#include "optimize.h"
+#include "StudioSoAMesh.h"
+
+struct StudioFlexVertex
+{
+	Vector vecPosition;
+	Vector vecNormal;
+};
+
+// One flexed strip group, its vertices are contiguous in the mesh and in the stream
+struct StudioFlexRange
+{
+	int iSubset;
+	int iFirstVertex;       // into the mesh vertex buffer
+	int numVertices;
+	int iFirstDynamic;      // into the dynamic stream
+	int iFirstIndex;        // into the mesh index buffer
+	int numIndices;
+};
+
+struct StudioFlexStreamStats
+{
+	int nUploads;           // dynamic buffer updates since BeginFrame
+	int nBytesWritten;      // bytes rewritten since BeginFrame
+};
+
+class CStudioFlexStream
+{
+public:
+	CStudioFlexStream();
+
+	// vertices are the mesh vertices in loader order, nVertexSize the size of one
+	// vertex in the mesh vertex buffer
+	HRESULT Init( const studiohdr_t* pStudioHdr, const OptimizedModel::FileHeader_t* pVtxHdr, int iLod,
+				  const StudioVertexView& vertices, int nVertexSize );
+	void    Destroy();
+
+	int     GetNumRanges() const { return m_Ranges.GetSize(); }
+	const StudioFlexRange& GetRange( int i ) const { return m_Ranges.GetAt( i ); }
+	int     GetNumVertices() const { return m_Rest.GetSize(); }
+
+	// Flexes write into the dynamic vertices, which start out as the rest pose
+	const StudioFlexVertex* GetRestVertices() const { return m_Rest.GetData(); }
+	StudioFlexVertex* GetDynamicVertices() { return m_Dynamic.GetData(); }
+	void    ResetToRest();
+
+	// Copies the dynamic vertices into a D3DUSAGE_DYNAMIC buffer of GetDynamicBytes()
+	HRESULT Upload( IDirect3DVertexBuffer9* pVB );
+
+	void    BeginFrame() { ZeroMemory( &m_Stats, sizeof( m_Stats ) ); }
+	const StudioFlexStreamStats& GetStats() const { return m_Stats; }
+
+	// Bytes one update rewrites, against rewriting the whole mesh vertex buffer
+	int     GetDynamicBytes() const { return m_Rest.GetSize() * sizeof( StudioFlexVertex ); }
+	int     GetStaticBytes() const { return m_numMeshVertices * m_nStride; }
+
+private:
+	CGrowableArray< StudioFlexRange >  m_Ranges;
+	CGrowableArray< StudioFlexVertex > m_Rest;
+	CGrowableArray< StudioFlexVertex > m_Dynamic;
+	int m_numMeshVertices;
+	int m_nStride;
+	StudioFlexStreamStats m_Stats;
+};
@@ -0,0 +1,249 @@
+//--------------------------------------------------------------------------------------
+// File: StudioFrameCache.cpp
+//
+// Pre-decoded animation frames for studio models.
+//
+//--------------------------------------------------------------------------------------
+#include "DXUT.h"
+#include "StudioFrameCache.h"
+
+
+//--------------------------------------------------------------------------------------
+CStudioFrameCache::CStudioFrameCache()
+{
+	m_pStudioHdr = NULL;
+	m_nBones = 0;
+	ZeroMemory( &m_Stats, sizeof( m_Stats ) );
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT CStudioFrameCache::Init( const studiohdr_t* pStudioHdr )
+{
+	HRESULT hr;
+
+	Destroy();
+
+	m_pStudioHdr = pStudioHdr;
+	m_nBones = pStudioHdr->numbones;
+
+	V_RETURN( m_ZeroPos.SetSize( pStudioHdr->numlocalanim * m_nBones ) );
+	V_RETURN( m_ZeroQ.SetSize( pStudioHdr->numlocalanim * m_nBones ) );
+	V_RETURN( m_KeyframeFirst.SetSize( pStudioHdr->numlocalanim ) );
+	for( int i=0; i < pStudioHdr->numlocalanim; i++ )
+	{
+		V_RETURN( DecodeFrame( i, 0, m_ZeroPos, m_ZeroQ ) );
+		m_KeyframeFirst.Add( -1 );
+	}
+
+	return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+void CStudioFrameCache::Destroy()
+{
+	m_pStudioHdr = NULL;
+	m_nBones = 0;
+	m_ZeroPos.RemoveAll();
+	m_ZeroQ.RemoveAll();
+	m_KeyframeFirst.RemoveAll();
+	m_KeyPos.RemoveAll();
+	m_KeyQ.RemoveAll();
+	ResetStats();
+}
+
+
+//--------------------------------------------------------------------------------------
+// Appends one frame of every bone, unused bones included
+//--------------------------------------------------------------------------------------
+HRESULT CStudioFrameCache::DecodeFrame( int iAnim, int iFrame, CGrowableArray< Vector >& pos, CGrowableArray< Quaternion >& q )
+{
+	HRESULT hr;
+
+	if( iAnim < 0 || iAnim >= m_pStudioHdr->numlocalanim )
+		return E_INVALIDARG;
+
+	const mstudioanimdesc_t& animdesc = m_pStudioHdr->pAnimdesc( iAnim );
+	float flCycle = ( animdesc.numframes > 1 ) ? (float)iFrame / ( animdesc.numframes - 1 ) : 0.0f;
+
+	int iFirst = pos.GetSize();
+	for( int i=0; i < m_nBones; i++ )
+	{
+		V_RETURN( pos.Add( m_pStudioHdr->pBone( i )->pos ) );
+		V_RETURN( q.Add( m_pStudioHdr->pBone( i )->quat ) );
+	}
+	Studio_CalcAnimation( m_pStudioHdr, iAnim, flCycle, &pos[iFirst], &q[iFirst], ~0 );
+
+	return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT CStudioFrameCache::CacheSequence( int iSequence )
+{
+	HRESULT hr;
+
+	if( m_pStudioHdr == NULL || iSequence < 0 || iSequence >= m_pStudioHdr->GetNumSeq() )
+		return E_INVALIDARG;
+
+	const mstudioseqdesc_t& seqdesc = m_pStudioHdr->pSeqdesc( iSequence );
+	for( int y=0; y < seqdesc.groupsize[1]; y++ )
+	{
+		for( int x=0; x < seqdesc.groupsize[0]; x++ )
+		{
+			int iAnim = m_pStudioHdr->iRelativeAnim( iSequence, seqdesc.anim( x, y ) );
+			if( iAnim < 0 || iAnim >= m_KeyframeFirst.GetSize() || m_KeyframeFirst[iAnim] != -1 )
+				continue;
+
+			int iFirst = m_KeyPos.GetSize();
+			int numframes = m_pStudioHdr->pAnimdesc( iAnim ).numframes;
+			V_RETURN( m_KeyPos.SetSize( iFirst + numframes * m_nBones ) );
+			V_RETURN( m_KeyQ.SetSize( iFirst + numframes * m_nBones ) );
+			for( int f=0; f < numframes; f++ )
+			{
+				V_RETURN( DecodeFrame( iAnim, f, m_KeyPos, m_KeyQ ) );
+			}
+			m_KeyframeFirst[iAnim] = iFirst;
+		}
+	}
+
+	return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+bool CStudioFrameCache::IsSequenceCached( int iSequence ) const
+{
+	if( m_pStudioHdr == NULL || iSequence < 0 || iSequence >= m_pStudioHdr->GetNumSeq() )
+		return false;
+
+	const mstudioseqdesc_t& seqdesc = m_pStudioHdr->pSeqdesc( iSequence );
+	for( int y=0; y < seqdesc.groupsize[1]; y++ )
+	{
+		for( int x=0; x < seqdesc.groupsize[0]; x++ )
+		{
+			int iAnim = m_pStudioHdr->iRelativeAnim( iSequence, seqdesc.anim( x, y ) );
+			if( iAnim < 0 || iAnim >= m_KeyframeFirst.GetSize() || m_KeyframeFirst[iAnim] == -1 )
+				return false;
+		}
+	}
+	return true;
+}
+
+
+//--------------------------------------------------------------------------------------
+void CStudioFrameCache::CalcAnimation( int iAnim, float flCycle, Vector pos[], Quaternion q[], int boneMask ) const
+{
+	// No such animation, the bones are left in the bind pose
+	if( iAnim < 0 || iAnim >= m_pStudioHdr->numlocalanim || iAnim >= m_KeyframeFirst.GetSize() )
+	{
+		for( int i=0; i < m_nBones; i++ )
+		{
+			if( m_pStudioHdr->pBone( i )->flags & boneMask )
+			{
+				pos[i] = m_pStudioHdr->pBone( i )->pos;
+				q[i] = m_pStudioHdr->pBone( i )->quat;
+			}
+		}
+		return;
+	}
+
+	const mstudioanimdesc_t& animdesc = m_pStudioHdr->pAnimdesc( iAnim );
+
+	float fFrame = flCycle * ( animdesc.numframes - 1 );
+	int iFrame = (int)fFrame;
+	float s = fFrame - iFrame;
+
+	if( iFrame < 0 || iFrame >= animdesc.numframes )
+	{
+		m_Stats.nDecodes++;
+		Studio_CalcAnimation( m_pStudioHdr, iAnim, flCycle, pos, q, boneMask );
+		return;
+	}
+
+	if( iFrame == 0 && s <= 0.001f )
+	{
+		m_Stats.nZeroFrameHits++;
+		const Vector* pZeroPos = &m_ZeroPos[iAnim * m_nBones];
+		const Quaternion* pZeroQ = &m_ZeroQ[iAnim * m_nBones];
+		for( int i=0; i < m_nBones; i++ )
+		{
+			if( m_pStudioHdr->pBone( i )->flags & boneMask )
+			{
+				pos[i] = pZeroPos[i];
+				q[i] = pZeroQ[i];
+			}
+		}
+		return;
+	}
+
+	int iFirst = m_KeyframeFirst[iAnim];
+	if( iFirst == -1 )
+	{
+		m_Stats.nDecodes++;
+		Studio_CalcAnimation( m_pStudioHdr, iAnim, flCycle, pos, q, boneMask );
+		return;
+	}
+
+	m_Stats.nKeyframeHits++;
+	int iNext = ( iFrame + 1 < animdesc.numframes ) ? iFrame + 1 : iFrame;
+	const Vector* pPos1 = &m_KeyPos[iFirst + iFrame * m_nBones];
+	const Vector* pPos2 = &m_KeyPos[iFirst + iNext * m_nBones];
+	const Quaternion* pQ1 = &m_KeyQ[iFirst + iFrame * m_nBones];
+	const Quaternion* pQ2 = &m_KeyQ[iFirst + iNext * m_nBones];
+	for( int i=0; i < m_nBones; i++ )
+	{
+		if( !( m_pStudioHdr->pBone( i )->flags & boneMask ) )
+			continue;
+
+		if( s > 0.001f )
+		{
+			pos[i] = pPos1[i] * ( 1.0f - s ) + pPos2[i] * s;
+			QuaternionBlend( pQ1[i], pQ2[i], s, q[i] );
+		}
+		else
+		{
+			pos[i] = pPos1[i];
+			q[i] = pQ1[i];
+		}
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+void CStudioFrameCache::CalcPose( int iSequence, float flCycle, const float poseParameter[],
+								  Vector pos[], Quaternion q[], int boneMask ) const
+{
+	int iAnim[4];
+	float flWeight[4];
+	Studio_SeqAnims( m_pStudioHdr, m_pStudioHdr->pSeqdesc( iSequence ), iSequence, poseParameter, iAnim, flWeight );
+
+	int nPoses = 0;
+	for( int i=0; i < 4; i++ )
+	{
+		if( flWeight[i] > 0.001f )
+		{
+			iAnim[nPoses] = iAnim[i];
+			flWeight[nPoses] = flWeight[i];
+			nPoses++;
+		}
+	}
+	if( nPoses <= 1 )
+	{
+		CalcAnimation( iAnim[0], flCycle, pos, q, boneMask );
+		return;
+	}
+
+	Vector blendPos[4][MAXSTUDIOBONES];
+	Quaternion blendQ[4][MAXSTUDIOBONES];
+	const Vector* ppPos[4];
+	const Quaternion* ppQ[4];
+	for( int i=0; i < nPoses; i++ )
+	{
+		CalcAnimation( iAnim[i], flCycle, blendPos[i], blendQ[i], boneMask );
+		ppPos[i] = blendPos[i];
+		ppQ[i] = blendQ[i];
+	}
+	Studio_BlendPoses( m_pStudioHdr, nPoses, ppPos, ppQ, flWeight, pos, q, boneMask );
+}
@@ -0,0 +1,55 @@
+//--------------------------------------------------------------------------------------
+// File: StudioFrameCache.h
+//
+// Pre-decoded animation frames. Frame 0 of every animation is decoded once at load, so
+// cycle 0, which is what most instances play on the frame they spawn, never touches
+// the run-length encoded streams. Sequences played often can additionally have all of
+// their frames decoded, after which any cycle is a blend of two stored frames.
+//
+// studiohdr_t::pZeroframeCache is not read: version 44 files leave it empty and its
+// layout is not described in studio.h, so the cache is built from the animations.
+//
+//--------------------------------------------------------------------------------------
+#pragma once
+#include "BoneSetup.h"
+
+struct StudioFrameCacheStats
+{
+	int nZeroFrameHits;     // animations served from frame 0
+	int nKeyframeHits;      // animations served from a cached sequence
+	int nDecodes;           // animations decoded from the streams
+};
+
+class CStudioFrameCache
+{
+public:
+	CStudioFrameCache();
+
+	HRESULT Init( const studiohdr_t* pStudioHdr );
+	void    Destroy();
+
+	// Decodes every frame of the animations the sequence blends between
+	HRESULT CacheSequence( int iSequence );
+	bool    IsSequenceCached( int iSequence ) const;
+
+	// Same results as Studio_CalcAnimation and Studio_CalcPose, served from the cache
+	// whenever possible
+	void    CalcAnimation( int iAnim, float flCycle, Vector pos[], Quaternion q[], int boneMask = BONE_USED_BY_ANYTHING ) const;
+	void    CalcPose( int iSequence, float flCycle, const float poseParameter[],
+					  Vector pos[], Quaternion q[], int boneMask = BONE_USED_BY_ANYTHING ) const;
+
+	const StudioFrameCacheStats& GetStats() const { return m_Stats; }
+	void    ResetStats() { ZeroMemory( &m_Stats, sizeof( m_Stats ) ); }
+
+private:
+	HRESULT DecodeFrame( int iAnim, int iFrame, CGrowableArray< Vector >& pos, CGrowableArray< Quaternion >& q );
+
+	const studiohdr_t*              m_pStudioHdr;
+	int                             m_nBones;
+	CGrowableArray< Vector >        m_ZeroPos;          // numbones per animation
+	CGrowableArray< Quaternion >    m_ZeroQ;
+	CGrowableArray< int >           m_KeyframeFirst;    // per animation, first entry in m_KeyPos or -1
+	CGrowableArray< Vector >        m_KeyPos;           // numbones per frame
+	CGrowableArray< Quaternion >    m_KeyQ;
+	mutable StudioFrameCacheStats   m_Stats;
+};
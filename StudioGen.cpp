@@ -0,0 +1,112 @@
+//--------------------------------------------------------------------------------------
+// File: StudioGen.cpp
+//
+// Console tool that writes synthetic .mdl/.vvd/.dx90.vtx triples, see StudioSynth.h.
+//
+// StudioGen [options] <output base name>
+//   -bodyparts n     body parts, one model each (1)
+//   -meshes n        meshes per model (1)
+//   -stripgroups n   strip groups per mesh (1)
+//   -vertices n      LOD 0 vertices per mesh, at most 32767 (10000)
+//   -total n         LOD 0 vertices of the whole model, adds meshes as needed
+//   -lods n          LODs, each halving the grid (4)
+//   -bones n         bones (16)
+//   -materials n     materials (1)
+//   -nofixups        store the .vvd in mesh order
+//   -notangents      leave out the tangent block
+//   -checksum n      checksum shared by the three files
+//
+// Example, the three sizes the loader benchmarks use:
+//   StudioGen -total 10000 synth10k
+//   StudioGen -total 100000 synth100k
+//   StudioGen -bodyparts 4 -total 1000000 synth1m
+//
+//--------------------------------------------------------------------------------------
+#define DXUT_AUTOLIB
+#include "DXUT.h"
+#include "StudioSynth.h"
+#include <stdio.h>
+
+
+//--------------------------------------------------------------------------------------
+static void PrintUsage()
+{
+	printf( "StudioGen [-bodyparts n] [-meshes n] [-stripgroups n] [-vertices n] [-total n] [-lods n]\n" );
+	printf( "          [-bones n] [-materials n] [-nofixups] [-notangents] [-checksum n] <output base name>\n" );
+}
+
+
+//--------------------------------------------------------------------------------------
+int main( int argc, char* argv[] )
+{
+	StudioSynthParams params;
+	Studio_DefaultSynthParams( &params );
+	int numTotal = 0;
+	const char* strBaseName = NULL;
+
+	for( int i=1; i < argc; i++ )
+	{
+		bool bValue = i + 1 < argc;
+		if( bValue && 0 == strcmp( argv[i], "-bodyparts" ) )
+			params.numBodyParts = atoi( argv[++i] );
+		else if( bValue && 0 == strcmp( argv[i], "-meshes" ) )
+			params.numMeshes = atoi( argv[++i] );
+		else if( bValue && 0 == strcmp( argv[i], "-stripgroups" ) )
+			params.numStripGroups = atoi( argv[++i] );
+		else if( bValue && 0 == strcmp( argv[i], "-vertices" ) )
+			params.numVertices = atoi( argv[++i] );
+		else if( bValue && 0 == strcmp( argv[i], "-total" ) )
+			numTotal = atoi( argv[++i] );
+		else if( bValue && 0 == strcmp( argv[i], "-lods" ) )
+			params.numLODs = atoi( argv[++i] );
+		else if( bValue && 0 == strcmp( argv[i], "-bones" ) )
+			params.numBones = atoi( argv[++i] );
+		else if( bValue && 0 == strcmp( argv[i], "-materials" ) )
+			params.numMaterials = atoi( argv[++i] );
+		else if( bValue && 0 == strcmp( argv[i], "-checksum" ) )
+			params.checksum = atol( argv[++i] );
+		else if( 0 == strcmp( argv[i], "-nofixups" ) )
+			params.bFixups = false;
+		else if( 0 == strcmp( argv[i], "-notangents" ) )
+			params.bTangents = false;
+		else if( argv[i][0] != '-' && strBaseName == NULL )
+			strBaseName = argv[i];
+		else
+		{
+			PrintUsage();
+			return 1;
+		}
+	}
+	if( strBaseName == NULL )
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	// Spread a total over as many meshes as it takes
+	if( numTotal > 0 )
+	{
+		int numPerBodyPart = ( numTotal + params.numBodyParts - 1 ) / params.numBodyParts;
+		params.numMeshes = ( numPerBodyPart + params.numVertices - 1 ) / params.numVertices;
+		params.numVertices = ( numPerBodyPart + params.numMeshes - 1 ) / params.numMeshes;
+	}
+
+	StudioSynthModel model;
+	HRESULT hr = Studio_SynthesizeModel( params, &model );
+	if( FAILED( hr ) )
+	{
+		printf( "Invalid parameters, a mesh holds at most %d vertices after rounding to the LOD grid\n", SYNTH_MAX_MESH_VERTICES );
+		return 1;
+	}
+	if( FAILED( Studio_WriteSynthModel( &model, strBaseName ) ) )
+	{
+		printf( "Could not write %s\n", strBaseName );
+		return 1;
+	}
+
+	printf( "%s: %d body parts, %d meshes of %dx%d cells, %d LODs, %d bones\n", strBaseName, params.numBodyParts,
+			params.numMeshes, model.nGridX, model.nGridY, params.numLODs, params.numBones );
+	printf( "  %d vertices, %d triangles at LOD 0\n", model.numVertices, model.numTriangles );
+	printf( "  .mdl %d bytes, .vvd %d bytes, .dx90.vtx %d bytes\n", model.mdl.GetSize(), model.vvd.GetSize(), model.vtx.GetSize() );
+	return 0;
+}
@@ -0,0 +1,220 @@
+//--------------------------------------------------------------------------------------
+// File: StudioGeometry.cpp
+//
+// Two pass strip group decoding.
+//
+//--------------------------------------------------------------------------------------
+#include "DXUT.h"
+#include "StudioGeometry.h"
+#include "StudioThreads.h"
+
+using namespace OptimizedModel;
+
+// Elements a worker decodes at a time, large strip groups are split at these sizes
+#define GEOMETRY_CHUNK_VERTICES	4096
+#define GEOMETRY_CHUNK_INDICES	( 3 * 4096 )
+
+// A range of the vertices or of the indices of one strip group
+struct GeometryChunk
+{
+	const mstudiomesh_t* pStudioMesh;
+	const StripGroupHeader_t* pGroup;
+	int  iFirstVertex;      // output offsets of the strip group
+	int  iFirstIndex;
+	int  iSubset;
+	bool bIndices;
+	int  iBegin;            // range within the strip group
+	int  iEnd;
+};
+
+struct GeometryJob
+{
+	const vertexFileHeader_t* pVvdHdr;
+	const StudioGeometrySpans* pSpans;
+	const GeometryChunk* pChunks;
+	int numChunks;
+	volatile LONG nNextChunk;
+};
+
+
+//--------------------------------------------------------------------------------------
+HRESULT Studio_CountGeometry( const studiohdr_t* pStudioHdr, const FileHeader_t* pVtxHdr, int iLod,
+							  StudioGeometryCounts* pCounts )
+{
+	ZeroMemory( pCounts, sizeof( StudioGeometryCounts ) );
+
+	const ModelLODHeader_t* pLod = pVtxHdr->pBodyPart( 0 )->pModel( 0 )->pLOD( iLod );
+	const mstudiomodel_t* pStudioModel = pStudioHdr->pBodypart( 0 )->pModel( 0 );
+	for( int k=0; k < pStudioModel->nummeshes; k++ )
+	{
+		const MeshHeader_t* pMesh = pLod->pMesh( k );
+		for( int j=0; j < pMesh->numStripGroups; j++ )
+		{
+			const StripGroupHeader_t* pGroup = pMesh->pStripGroup( j );
+			pCounts->numVertices += pGroup->numVerts;
+			pCounts->numIndices += pGroup->numIndices / 3 * 3;
+			pCounts->numSubsets++;
+		}
+	}
+
+	// The indices are 16 bit, past this they would wrap onto the wrong vertices
+	if( pCounts->numVertices > GEOMETRY_MAX_VERTICES )
+		return E_INVALIDARG;
+	return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Decodes vertices [iBegin, iEnd) of one strip group
+//--------------------------------------------------------------------------------------
+static void FillVertices( const vertexFileHeader_t* pVvdHdr, const GeometryChunk& chunk, const StudioGeometrySpans& spans )
+{
+	for( int i=chunk.iBegin; i < chunk.iEnd; i++ )
+	{
+		int iSource = chunk.pStudioMesh->vertexoffset + chunk.pGroup->pVertex( i )->origMeshVertID;
+		const mstudiovertex_t* pVertex = pVvdHdr->pVertex( iSource );
+		int iVertex = chunk.iFirstVertex + i;
+		spans.pPositions[iVertex] = pVertex->m_vecPosition;
+		spans.pNormals[iVertex] = pVertex->m_vecNormal;
+		spans.pTexCoords[iVertex] = pVertex->m_vecTexCoord;
+		spans.pBoneWeights[iVertex] = pVertex->m_BoneWeights;
+		// Files without tangent data get theirs generated once the triangles are known
+		if( pVvdHdr->tangentDataStart )
+			spans.pTangents[iVertex] = *pVvdHdr->pTangent( iSource );
+		else
+			spans.pTangents[iVertex] = Vector4D( 0, 0, 0, 1 );
+		spans.pSourceVertices[iVertex] = iSource;
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+// Decodes indices [iBegin, iEnd) of one strip group, the range holds whole triangles
+//--------------------------------------------------------------------------------------
+static void FillIndices( const GeometryChunk& chunk, const StudioGeometrySpans& spans )
+{
+	for( int i=chunk.iBegin; i < chunk.iEnd; i++ )
+		spans.pIndices[chunk.iFirstIndex + i] = (unsigned short)( chunk.iFirstVertex + *chunk.pGroup->pIndex( i ) );
+	for( int i=chunk.iBegin / 3; i < chunk.iEnd / 3; i++ )
+		spans.pAttributes[chunk.iFirstIndex / 3 + i] = chunk.iSubset;
+}
+
+
+//--------------------------------------------------------------------------------------
+static void FillChunk( const vertexFileHeader_t* pVvdHdr, const GeometryChunk& chunk, const StudioGeometrySpans& spans )
+{
+	if( chunk.bIndices )
+		FillIndices( chunk, spans );
+	else
+		FillVertices( pVvdHdr, chunk, spans );
+}
+
+
+//--------------------------------------------------------------------------------------
+// Workers take the next undecoded chunk until none are left
+//--------------------------------------------------------------------------------------
+static void FillTask( int iTask, int nTasks, void* pContext )
+{
+	GeometryJob* pJob = (GeometryJob*)pContext;
+	for( ;; )
+	{
+		int iChunk = InterlockedIncrement( &pJob->nNextChunk ) - 1;
+		if( iChunk >= pJob->numChunks )
+			break;
+		FillChunk( pJob->pVvdHdr, pJob->pChunks[iChunk], *pJob->pSpans );
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT Studio_FillGeometry( const studiohdr_t* pStudioHdr, const vertexFileHeader_t* pVvdHdr,
+							 const FileHeader_t* pVtxHdr, int iLod, const StudioGeometrySpans& spans, int nWorkers )
+{
+	HRESULT hr;
+
+	const ModelLODHeader_t* pLod = pVtxHdr->pBodyPart( 0 )->pModel( 0 )->pLOD( iLod );
+	const mstudiomodel_t* pStudioModel = pStudioHdr->pBodypart( 0 )->pModel( 0 );
+
+	if( nWorkers <= 0 )
+		nWorkers = Studio_GetNumWorkers();
+
+	// Serial fill, a single pass over the strip groups in order
+	if( nWorkers == 1 )
+	{
+		GeometryChunk chunk;
+		chunk.iFirstVertex = 0;
+		chunk.iFirstIndex = 0;
+		chunk.iSubset = 0;
+		for( int k=0; k < pStudioModel->nummeshes; k++ )
+		{
+			const MeshHeader_t* pMesh = pLod->pMesh( k );
+			chunk.pStudioMesh = pStudioModel->pMesh( k );
+			for( int j=0; j < pMesh->numStripGroups; j++ )
+			{
+				chunk.pGroup = pMesh->pStripGroup( j );
+				chunk.bIndices = false;
+				chunk.iBegin = 0;
+				chunk.iEnd = chunk.pGroup->numVerts;
+				FillVertices( pVvdHdr, chunk, spans );
+				chunk.bIndices = true;
+				chunk.iEnd = chunk.pGroup->numIndices / 3 * 3;
+				FillIndices( chunk, spans );
+
+				chunk.iFirstVertex += chunk.pGroup->numVerts;
+				chunk.iFirstIndex += chunk.iEnd;
+				chunk.iSubset++;
+			}
+		}
+		return S_OK;
+	}
+
+	// Prefix sum over the headers, every strip group learns where its output starts and
+	// is cut into chunks the workers can decode independently
+	CGrowableArray< GeometryChunk > chunks;
+	GeometryChunk chunk;
+	chunk.iFirstVertex = 0;
+	chunk.iFirstIndex = 0;
+	chunk.iSubset = 0;
+	for( int k=0; k < pStudioModel->nummeshes; k++ )
+	{
+		const MeshHeader_t* pMesh = pLod->pMesh( k );
+		chunk.pStudioMesh = pStudioModel->pMesh( k );
+		for( int j=0; j < pMesh->numStripGroups; j++ )
+		{
+			chunk.pGroup = pMesh->pStripGroup( j );
+			int numVertices = chunk.pGroup->numVerts;
+			int numIndices = chunk.pGroup->numIndices / 3 * 3;
+
+			chunk.bIndices = false;
+			for( chunk.iBegin=0; chunk.iBegin < numVertices; chunk.iBegin=chunk.iEnd )
+			{
+				chunk.iEnd = chunk.iBegin + GEOMETRY_CHUNK_VERTICES;
+				if( chunk.iEnd > numVertices )
+					chunk.iEnd = numVertices;
+				V_RETURN( chunks.Add( chunk ) );
+			}
+			chunk.bIndices = true;
+			for( chunk.iBegin=0; chunk.iBegin < numIndices; chunk.iBegin=chunk.iEnd )
+			{
+				chunk.iEnd = chunk.iBegin + GEOMETRY_CHUNK_INDICES;
+				if( chunk.iEnd > numIndices )
+					chunk.iEnd = numIndices;
+				V_RETURN( chunks.Add( chunk ) );
+			}
+
+			chunk.iFirstVertex += numVertices;
+			chunk.iFirstIndex += numIndices;
+			chunk.iSubset++;
+		}
+	}
+
+	GeometryJob job;
+	job.pVvdHdr = pVvdHdr;
+	job.pSpans = &spans;
+	job.pChunks = chunks.GetData();
+	job.numChunks = chunks.GetSize();
+	job.nNextChunk = 0;
+	Studio_RunTasks( nWorkers < job.numChunks ? nWorkers : job.numChunks, FillTask, &job );
+
+	return S_OK;
+}
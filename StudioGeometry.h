@@ -0,0 +1,50 @@
+//--------------------------------------------------------------------------------------
+// File: StudioGeometry.h
+//
+// Decodes the strip groups of one .vtx LOD into mesh vertices, triangle indices and
+// per-triangle subsets. A counting pass walks only the headers and gives the exact
+// sizes, the fill pass then writes every element straight to its final place, be it
+// a locked buffer or preallocated CPU storage, so nothing grows or is copied again.
+//
+// Vertices, indices and subsets come out in strip group order, every strip group is
+// one subset and its indices are offset by the vertices of the groups before it.
+//
+// The fill can run on several workers. A prefix sum over the strip group headers gives
+// every group its output offsets up front, the groups are cut into chunks of vertices
+// and of indices, and the workers decode chunks into their disjoint ranges. The output
+// is the same bytes as a serial fill.
+//
+//--------------------------------------------------------------------------------------
+#pragma once
+#include "optimize.h"
+
+#define GEOMETRY_MAX_VERTICES	65535	// the indices are 16 bit
+
+struct StudioGeometryCounts
+{
+	int numVertices;
+	int numIndices;
+	int numSubsets;
+};
+
+// Destinations of the fill pass, sized from the counts. Vertex streams are indexed by
+// vertex, pIndices by index, pAttributes by triangle.
+struct StudioGeometrySpans
+{
+	Vector*   pPositions;
+	Vector*   pNormals;
+	Vector2D* pTexCoords;
+	mstudioboneweight_t* pBoneWeights;
+	Vector4D* pTangents;        // zero with w of 1 when the .vvd has no tangents
+	int*      pSourceVertices;  // index of each vertex in the .vvd
+	unsigned short* pIndices;
+	DWORD*    pAttributes;      // subset of each triangle
+};
+
+// Fails with E_INVALIDARG when the LOD has more vertices than 16 bit indices reach
+HRESULT Studio_CountGeometry( const studiohdr_t* pStudioHdr, const OptimizedModel::FileHeader_t* pVtxHdr, int iLod,
+							  StudioGeometryCounts* pCounts );
+// nWorkers of 1 fills on the calling thread, 0 picks one worker per processor
+HRESULT Studio_FillGeometry( const studiohdr_t* pStudioHdr, const vertexFileHeader_t* pVvdHdr,
+							 const OptimizedModel::FileHeader_t* pVtxHdr, int iLod, const StudioGeometrySpans& spans,
+							 int nWorkers = 1 );
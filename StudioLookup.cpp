@@ -0,0 +1,231 @@
+//--------------------------------------------------------------------------------------
+// File: StudioLookup.cpp
+//
+// Name lookups and attachment caching for studio models.
+//
+//--------------------------------------------------------------------------------------
+#include "DXUT.h"
+#include "StudioLookup.h"
+
+
+//--------------------------------------------------------------------------------------
+CStudioNameTable::CStudioNameTable()
+{
+	m_dwMask = 0;
+}
+
+
+//--------------------------------------------------------------------------------------
+// FNV-1a over the lower cased name
+//--------------------------------------------------------------------------------------
+DWORD CStudioNameTable::HashName( const char* pszName )
+{
+	DWORD dwHash = 2166136261U;
+	for( const char* p = pszName; *p; p++ )
+	{
+		char c = *p;
+		if( c >= 'A' && c <= 'Z' )
+			c += 'a' - 'A';
+		dwHash = ( dwHash ^ (BYTE)c ) * 16777619U;
+	}
+	return dwHash;
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT CStudioNameTable::Init( int numNames )
+{
+	HRESULT hr;
+
+	Destroy();
+
+	// Keep the load factor at or below one half
+	int nSize = 8;
+	while( nSize < numNames * 2 )
+		nSize <<= 1;
+
+	V_RETURN( m_Entries.SetSize( nSize ) );
+	StudioNameEntry empty = { NULL, 0, -1 };
+	for( int i=0; i < nSize; i++ )
+		m_Entries.Add( empty );
+	m_dwMask = nSize - 1;
+
+	return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+void CStudioNameTable::Destroy()
+{
+	m_Entries.RemoveAll();
+	m_dwMask = 0;
+}
+
+
+//--------------------------------------------------------------------------------------
+void CStudioNameTable::Insert( const char* pszName, int iIndex )
+{
+	DWORD dwHash = HashName( pszName );
+	for( DWORD i = dwHash & m_dwMask; ; i = ( i + 1 ) & m_dwMask )
+	{
+		StudioNameEntry& entry = m_Entries[i];
+		if( entry.iIndex == -1 )
+		{
+			entry.pszName = pszName;
+			entry.dwHash = dwHash;
+			entry.iIndex = iIndex;
+			return;
+		}
+		if( entry.dwHash == dwHash && _stricmp( entry.pszName, pszName ) == 0 )
+			return;
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+int CStudioNameTable::Find( const char* pszName ) const
+{
+	if( m_Entries.GetSize() == 0 || pszName == NULL )
+		return -1;
+
+	DWORD dwHash = HashName( pszName );
+	for( DWORD i = dwHash & m_dwMask; ; i = ( i + 1 ) & m_dwMask )
+	{
+		const StudioNameEntry& entry = m_Entries[i];
+		if( entry.iIndex == -1 )
+			return -1;
+		if( entry.dwHash == dwHash && _stricmp( entry.pszName, pszName ) == 0 )
+			return entry.iIndex;
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT CStudioLookup::Init( const studiohdr_t* pStudioHdr )
+{
+	HRESULT hr;
+
+	Destroy();
+
+	V_RETURN( m_Bones.Init( pStudioHdr->numbones ) );
+	for( int i=0; i < pStudioHdr->numbones; i++ )
+		m_Bones.Insert( pStudioHdr->pBone( i )->pszName(), i );
+
+	V_RETURN( m_Attachments.Init( pStudioHdr->GetNumAttachments() ) );
+	for( int i=0; i < pStudioHdr->GetNumAttachments(); i++ )
+		m_Attachments.Insert( pStudioHdr->pAttachment( i ).pszName(), i );
+
+	V_RETURN( m_Sequences.Init( pStudioHdr->GetNumSeq() ) );
+	for( int i=0; i < pStudioHdr->GetNumSeq(); i++ )
+		m_Sequences.Insert( pStudioHdr->pSeqdesc( i ).pszLabel(), i );
+
+	V_RETURN( m_PoseParameters.Init( pStudioHdr->GetNumPoseParameters() ) );
+	for( int i=0; i < pStudioHdr->GetNumPoseParameters(); i++ )
+		m_PoseParameters.Insert( pStudioHdr->pPoseParameter( i ).pszName(), i );
+
+	V_RETURN( m_FlexControllers.Init( pStudioHdr->numflexcontrollers ) );
+	for( int i=0; i < pStudioHdr->numflexcontrollers; i++ )
+		m_FlexControllers.Insert( pStudioHdr->pFlexcontroller( i )->pszName(), i );
+
+	return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+void CStudioLookup::Destroy()
+{
+	m_Bones.Destroy();
+	m_Attachments.Destroy();
+	m_Sequences.Destroy();
+	m_PoseParameters.Destroy();
+	m_FlexControllers.Destroy();
+}
+
+
+//--------------------------------------------------------------------------------------
+CAttachmentCache::CAttachmentCache()
+{
+	m_pStudioHdr = NULL;
+	m_pBoneToWorld = NULL;
+	m_dwPose = 0;
+	m_nComputed = 0;
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT CAttachmentCache::Init( const studiohdr_t* pStudioHdr )
+{
+	HRESULT hr;
+
+	Destroy();
+	m_pStudioHdr = pStudioHdr;
+
+	int numAttachments = pStudioHdr->GetNumAttachments();
+	V_RETURN( m_AttachmentToWorld.SetSize( numAttachments ) );
+	V_RETURN( m_ComputedPose.SetSize( numAttachments ) );
+	matrix3x4_t identity;
+	SetIdentityMatrix( identity );
+	for( int i=0; i < numAttachments; i++ )
+	{
+		m_AttachmentToWorld.Add( identity );
+		m_ComputedPose.Add( 0 );
+	}
+
+	return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+void CAttachmentCache::Destroy()
+{
+	m_AttachmentToWorld.RemoveAll();
+	m_ComputedPose.RemoveAll();
+	m_pStudioHdr = NULL;
+	m_pBoneToWorld = NULL;
+	m_dwPose = 0;
+	m_nComputed = 0;
+}
+
+
+//--------------------------------------------------------------------------------------
+void CAttachmentCache::SetPose( const matrix3x4_t* pBoneToWorld )
+{
+	m_pBoneToWorld = pBoneToWorld;
+	m_nComputed = 0;
+
+	// Zero marks "never computed", skip it when the counter wraps
+	if( ++m_dwPose == 0 )
+	{
+		for( int i=0; i < m_ComputedPose.GetSize(); i++ )
+			m_ComputedPose[i] = 0;
+		m_dwPose = 1;
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+const matrix3x4_t* CAttachmentCache::GetAttachmentToWorld( int iAttachment )
+{
+	if( m_pBoneToWorld == NULL || iAttachment < 0 || iAttachment >= m_AttachmentToWorld.GetSize() )
+		return NULL;
+
+	matrix3x4_t& attachmentToWorld = m_AttachmentToWorld[iAttachment];
+	if( m_ComputedPose[iAttachment] == m_dwPose )
+		return &attachmentToWorld;
+
+	const mstudioattachment_t& attachment = m_pStudioHdr->pAttachment( iAttachment );
+	ConcatTransforms( m_pBoneToWorld[m_pStudioHdr->GetAttachmentBone( iAttachment )], attachment.local, attachmentToWorld );
+
+	// World aligned attachments only follow the bone's position
+	if( attachment.flags & ATTACHMENT_FLAG_WORLD_ALIGN )
+	{
+		Vector vPosition;
+		MatrixPosition( attachmentToWorld, vPosition );
+		SetIdentityMatrix( attachmentToWorld );
+		PositionMatrix( vPosition, attachmentToWorld );
+	}
+
+	m_ComputedPose[iAttachment] = m_dwPose;
+	m_nComputed++;
+	return &attachmentToWorld;
+}
@@ -0,0 +1,83 @@
+//--------------------------------------------------------------------------------------
+// File: StudioLookup.h
+//
+// Name lookups for studio models. Bones, attachments, sequences, pose parameters and
+// flex controllers are hashed once at load so gameplay queries don't walk the tables
+// with string compares. Names compare case-insensitively, like the engine lookups.
+//
+//--------------------------------------------------------------------------------------
+#pragma once
+#include "BoneSetup.h"
+
+struct StudioNameEntry
+{
+	const char* pszName;        // points into the model data
+	DWORD       dwHash;
+	int         iIndex;         // -1 for an empty slot
+};
+
+// Open addressing hash table from names to indices
+class CStudioNameTable
+{
+public:
+	CStudioNameTable();
+
+	HRESULT Init( int numNames );
+	void    Destroy();
+
+	// The first index inserted under a name wins, as with a linear scan
+	void    Insert( const char* pszName, int iIndex );
+	int     Find( const char* pszName ) const;
+
+	static DWORD HashName( const char* pszName );
+
+private:
+	CGrowableArray< StudioNameEntry > m_Entries;
+	DWORD                             m_dwMask;
+};
+
+class CStudioLookup
+{
+public:
+	HRESULT Init( const studiohdr_t* pStudioHdr );
+	void    Destroy();
+
+	// All return -1 when the name is not found
+	int     FindBone( const char* pszName ) const { return m_Bones.Find( pszName ); }
+	int     FindAttachment( const char* pszName ) const { return m_Attachments.Find( pszName ); }
+	int     FindSequence( const char* pszName ) const { return m_Sequences.Find( pszName ); }
+	int     FindPoseParameter( const char* pszName ) const { return m_PoseParameters.Find( pszName ); }
+	int     FindFlexController( const char* pszName ) const { return m_FlexControllers.Find( pszName ); }
+
+private:
+	CStudioNameTable m_Bones;
+	CStudioNameTable m_Attachments;
+	CStudioNameTable m_Sequences;
+	CStudioNameTable m_PoseParameters;
+	CStudioNameTable m_FlexControllers;
+};
+
+// Per instance cache of attachment transforms. Each attachment is computed on its first
+// query after SetPose and reused for the rest of the pose.
+class CAttachmentCache
+{
+public:
+	CAttachmentCache();
+
+	HRESULT Init( const studiohdr_t* pStudioHdr );
+	void    Destroy();
+
+	// pBoneToWorld must stay valid until the next SetPose
+	void    SetPose( const matrix3x4_t* pBoneToWorld );
+	const matrix3x4_t* GetAttachmentToWorld( int iAttachment );
+
+	int     GetNumComputed() const { return m_nComputed; }
+
+private:
+	const studiohdr_t*              m_pStudioHdr;
+	const matrix3x4_t*              m_pBoneToWorld;
+	DWORD                           m_dwPose;           // bumped by every SetPose
+	int                             m_nComputed;        // attachments evaluated since the last SetPose
+	CGrowableArray< matrix3x4_t >   m_AttachmentToWorld;
+	CGrowableArray< DWORD >         m_ComputedPose;     // pose each transform was computed for
+};
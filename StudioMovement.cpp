@@ -0,0 +1,201 @@
+//--------------------------------------------------------------------------------------
+// File: StudioMovement.cpp
+//
+// Root motion lookups for studio model animations.
+//
+//--------------------------------------------------------------------------------------
+#include "DXUT.h"
+#include "StudioMovement.h"
+
+
+//--------------------------------------------------------------------------------------
+HRESULT CStudioMovementCache::Init( const studiohdr_t* pStudioHdr )
+{
+	HRESULT hr;
+
+	Destroy();
+
+	m_pStudioHdr = pStudioHdr;
+
+	int nBlocks = 0;
+	for( int i=0; i < pStudioHdr->numlocalanim; i++ )
+		nBlocks += pStudioHdr->pLocalAnimdesc( i )->nummovements;
+
+	V_RETURN( m_Anims.SetSize( pStudioHdr->numlocalanim ) );
+	V_RETURN( m_EndFrames.SetSize( nBlocks ) );
+	V_RETURN( m_Blocks.SetSize( nBlocks ) );
+
+	for( int i=0; i < pStudioHdr->numlocalanim; i++ )
+	{
+		const mstudioanimdesc_t* pAnim = pStudioHdr->pLocalAnimdesc( i );
+
+		StudioMovementAnim anim;
+		anim.iFirst = m_Blocks.GetSize();
+		anim.nCount = pAnim->nummovements;
+		anim.flLastFrame = (float)( pAnim->numframes - 1 );
+		anim.vLoopPos = Vector( 0, 0, 0 );
+		anim.flLoopYaw = 0.0f;
+
+		// Each block's file position and angle are already accumulated up to its end
+		float flPrevFrame = 0.0f;
+		Vector vPrevPos( 0, 0, 0 );
+		float flPrevYaw = 0.0f;
+		for( int j=0; j < pAnim->nummovements; j++ )
+		{
+			const mstudiomovement_t* pMove = pAnim->pMovement( j );
+
+			StudioMovementBlock block;
+			block.flStartFrame = flPrevFrame;
+			block.flFrameRange = pMove->endframe - flPrevFrame;
+			block.v0 = pMove->v0;
+			block.v1 = pMove->v1;
+			block.vStartPos = vPrevPos;
+			block.flStartYaw = flPrevYaw;
+			block.vVector = pMove->vector;
+			block.flEndYaw = pMove->angle;
+			V_RETURN( m_Blocks.Add( block ) );
+			V_RETURN( m_EndFrames.Add( (float)pMove->endframe ) );
+
+			flPrevFrame = (float)pMove->endframe;
+			vPrevPos = pMove->position;
+			flPrevYaw = pMove->angle;
+		}
+
+		anim.vLoopPos = vPrevPos;
+		anim.flLoopYaw = flPrevYaw;
+		V_RETURN( m_Anims.Add( anim ) );
+	}
+
+	return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+void CStudioMovementCache::Destroy()
+{
+	m_pStudioHdr = NULL;
+	m_Anims.RemoveAll();
+	m_EndFrames.RemoveAll();
+	m_Blocks.RemoveAll();
+}
+
+
+//--------------------------------------------------------------------------------------
+bool CStudioMovementCache::HasMovement( int iAnim ) const
+{
+	return iAnim >= 0 && iAnim < m_Anims.GetSize() && m_Anims[iAnim].nCount > 0;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Same integration as the engine's Studio_AnimPosition, with the block found by a
+// binary search instead of walking the blocks from the start.
+//--------------------------------------------------------------------------------------
+bool CStudioMovementCache::GetAnimPosition( int iAnim, float flCycle, Vector& vecPos, float& flYaw ) const
+{
+	vecPos = Vector( 0, 0, 0 );
+	flYaw = 0.0f;
+
+	if( !HasMovement( iAnim ) )
+		return false;
+
+	const StudioMovementAnim& anim = m_Anims[iAnim];
+
+	int iLoops = 0;
+	if( flCycle > 1.0f )
+		iLoops = (int)flCycle;
+	else if( flCycle < 0.0f )
+		iLoops = (int)flCycle - 1;
+	flCycle = flCycle - iLoops;
+
+	float flFrame = flCycle * anim.flLastFrame;
+
+	// First block ending at or after the frame
+	int iLow = anim.iFirst;
+	int iHigh = anim.iFirst + anim.nCount;
+	while( iLow < iHigh )
+	{
+		int iMid = ( iLow + iHigh ) / 2;
+		if( m_EndFrames[iMid] < flFrame )
+			iLow = iMid + 1;
+		else
+			iHigh = iMid;
+	}
+
+	if( iLow == anim.iFirst + anim.nCount )
+	{
+		// Past the last block, hold its end
+		vecPos = anim.vLoopPos;
+		flYaw = anim.flLoopYaw;
+	}
+	else
+	{
+		const StudioMovementBlock& block = m_Blocks[iLow];
+		float f = ( block.flFrameRange > 0.0f ) ? ( flFrame - block.flStartFrame ) / block.flFrameRange : 1.0f;
+		float d = block.v0 * f + 0.5f * ( block.v1 - block.v0 ) * f * f;
+		vecPos = block.vStartPos + d * block.vVector;
+		flYaw = block.flStartYaw * ( 1.0f - f ) + block.flEndYaw * f;
+	}
+
+	if( iLoops != 0 )
+	{
+		vecPos += (float)iLoops * anim.vLoopPos;
+		flYaw += iLoops * anim.flLoopYaw;
+	}
+
+	return true;
+}
+
+
+//--------------------------------------------------------------------------------------
+bool CStudioMovementCache::GetAnimMovement( int iAnim, float flCycleFrom, float flCycleTo, Vector& vecDelta, float& flYawDelta ) const
+{
+	Vector vecFrom, vecTo;
+	float flYawFrom, flYawTo;
+
+	if( !GetAnimPosition( iAnim, flCycleFrom, vecFrom, flYawFrom ) )
+	{
+		vecDelta = Vector( 0, 0, 0 );
+		flYawDelta = 0.0f;
+		return false;
+	}
+	GetAnimPosition( iAnim, flCycleTo, vecTo, flYawTo );
+
+	vecDelta = vecTo - vecFrom;
+	flYawDelta = flYawTo - flYawFrom;
+	return true;
+}
+
+
+//--------------------------------------------------------------------------------------
+bool CStudioMovementCache::GetSeqMovement( int iSequence, const float poseParameter[], float flCycleFrom, float flCycleTo,
+										   Vector& vecDelta, float& flYawDelta ) const
+{
+	vecDelta = Vector( 0, 0, 0 );
+	flYawDelta = 0.0f;
+
+	if( m_pStudioHdr == NULL || iSequence < 0 || iSequence >= m_pStudioHdr->GetNumSeq() )
+		return false;
+
+	int iAnim[4];
+	float flWeight[4];
+	Studio_SeqAnims( m_pStudioHdr, m_pStudioHdr->pSeqdesc( iSequence ), iSequence, poseParameter, iAnim, flWeight );
+
+	bool bFound = false;
+	for( int i=0; i < 4; i++ )
+	{
+		if( flWeight[i] == 0.0f )
+			continue;
+
+		Vector vecLocal;
+		float flYawLocal;
+		if( GetAnimMovement( iAnim[i], flCycleFrom, flCycleTo, vecLocal, flYawLocal ) )
+		{
+			vecDelta += flWeight[i] * vecLocal;
+			flYawDelta += flWeight[i] * flYawLocal;
+			bFound = true;
+		}
+	}
+
+	return bFound;
+}
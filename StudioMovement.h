@@ -0,0 +1,56 @@
+//--------------------------------------------------------------------------------------
+// File: StudioMovement.h
+//
+// Root motion of the animations. The piecewise movement blocks of every animation are
+// laid out with their start frame, start position and start yaw, so the motion at any
+// cycle is a binary search for the block plus the block's own integration, and the
+// motion between two cycles is the difference of two such lookups.
+//
+//--------------------------------------------------------------------------------------
+#pragma once
+#include "BoneSetup.h"
+
+struct StudioMovementBlock
+{
+	float       flStartFrame;
+	float       flFrameRange;   // endframe - start frame
+	float       v0;             // velocity at the start of the block
+	float       v1;             // velocity at the end of the block
+	Vector      vStartPos;      // accumulated position at the start of the block
+	float       flStartYaw;
+	Vector      vVector;        // direction of travel within the block
+	float       flEndYaw;
+};
+
+struct StudioMovementAnim
+{
+	int         iFirst;         // first block
+	int         nCount;
+	float       flLastFrame;    // numframes - 1
+	Vector      vLoopPos;       // movement over one full cycle
+	float       flLoopYaw;
+};
+
+class CStudioMovementCache
+{
+public:
+	HRESULT Init( const studiohdr_t* pStudioHdr );
+	void    Destroy();
+
+	bool    HasMovement( int iAnim ) const;
+
+	// Position and yaw of the root relative to the start of the animation. Cycles
+	// outside 0..1 count whole loops. Returns false if the animation has no movement.
+	bool    GetAnimPosition( int iAnim, float flCycle, Vector& vecPos, float& flYaw ) const;
+	// Movement from flCycleFrom to flCycleTo. Pass flCycleTo > 1 to wrap a looping animation.
+	bool    GetAnimMovement( int iAnim, float flCycleFrom, float flCycleTo, Vector& vecDelta, float& flYawDelta ) const;
+	// Same for a sequence, blended across its animations by the pose parameters (0..1)
+	bool    GetSeqMovement( int iSequence, const float poseParameter[], float flCycleFrom, float flCycleTo,
+							Vector& vecDelta, float& flYawDelta ) const;
+
+private:
+	const studiohdr_t*                      m_pStudioHdr;
+	CGrowableArray< StudioMovementAnim >    m_Anims;
+	CGrowableArray< float >                 m_EndFrames;    // per block, searched on its own to stay in cache
+	CGrowableArray< StudioMovementBlock >   m_Blocks;
+};
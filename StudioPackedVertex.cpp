@@ -0,0 +1,228 @@
+//--------------------------------------------------------------------------------------
+// File: StudioPackedVertex.cpp
+//
+// Packed vertex encoding and the CPU decoder.
+//
+//--------------------------------------------------------------------------------------
+#include "DXUT.h"
+#include "StudioPackedVertex.h"
+#include "mathlib.h"
+#include <float.h>
+
+D3DVERTEXELEMENT9 PACKED_VERTEX_DECL[] =
+{
+    { 0,  0, D3DDECLTYPE_SHORT4N,   D3DDECLMETHOD_DEFAULT,  D3DDECLUSAGE_POSITION,     0},
+    { 0,  8, D3DDECLTYPE_SHORT2N,   D3DDECLMETHOD_DEFAULT,  D3DDECLUSAGE_NORMAL,       0},
+    { 0, 12, D3DDECLTYPE_SHORT2N,   D3DDECLMETHOD_DEFAULT,  D3DDECLUSAGE_TANGENT,      0},
+    { 0, 16, D3DDECLTYPE_FLOAT16_2, D3DDECLMETHOD_DEFAULT,  D3DDECLUSAGE_TEXCOORD,     0},
+    { 0, 20, D3DDECLTYPE_UBYTE4N,   D3DDECLMETHOD_DEFAULT,  D3DDECLUSAGE_BLENDWEIGHT,  0},
+    { 0, 24, D3DDECLTYPE_UBYTE4,    D3DDECLMETHOD_DEFAULT,  D3DDECLUSAGE_BLENDINDICES, 0},
+	D3DDECL_END()
+};
+
+
+//--------------------------------------------------------------------------------------
+static short QuantizeSNorm( float f )
+{
+	return (short)floor( clamp( f, -1.0f, 1.0f ) * 32767.0f + 0.5f );
+}
+
+static float DequantizeSNorm( short s )
+{
+	return clamp( s / 32767.0f, -1.0f, 1.0f );
+}
+
+static float SignNotZero( float f )
+{
+	return f >= 0.0f ? 1.0f : -1.0f;
+}
+
+static void KeepMax( float& flMax, float f )
+{
+	if( f > flMax )
+		flMax = f;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Projects the unit sphere onto the octahedron and unfolds the lower half over the
+// corners of the square
+//--------------------------------------------------------------------------------------
+static void OctEncode( const Vector& v, short* pOut )
+{
+	float l1 = fabs( v.x ) + fabs( v.y ) + fabs( v.z );
+	float x = 0.0f;
+	float y = 0.0f;
+	if( l1 > 0.0f )
+	{
+		x = v.x / l1;
+		y = v.y / l1;
+		if( v.z < 0.0f )
+		{
+			float ox = x;
+			x = ( 1.0f - fabs( y ) ) * SignNotZero( ox );
+			y = ( 1.0f - fabs( ox ) ) * SignNotZero( y );
+		}
+	}
+	pOut[0] = QuantizeSNorm( x );
+	pOut[1] = QuantizeSNorm( y );
+}
+
+static Vector OctDecode( const short* pIn )
+{
+	float x = DequantizeSNorm( pIn[0] );
+	float y = DequantizeSNorm( pIn[1] );
+	float z = 1.0f - fabs( x ) - fabs( y );
+	if( z < 0.0f )
+	{
+		float ox = x;
+		x = ( 1.0f - fabs( y ) ) * SignNotZero( ox );
+		y = ( 1.0f - fabs( ox ) ) * SignNotZero( y );
+	}
+	Vector v( x, y, z );
+	D3DXVec3Normalize( &v, &v );
+	return v;
+}
+
+
+//--------------------------------------------------------------------------------------
+CStudioVertexPacker::CStudioVertexPacker()
+{
+	m_vScale = Vector( 1, 1, 1 );
+	m_vOffset = Vector( 0, 0, 0 );
+}
+
+
+//--------------------------------------------------------------------------------------
+void CStudioVertexPacker::SetBounds( const Vector& vMin, const Vector& vMax )
+{
+	m_vOffset = ( vMin + vMax ) * 0.5f;
+	m_vScale = ( vMax - vMin ) * 0.5f;
+	for( int j=0; j < 3; j++ )
+	{
+		if( m_vScale[j] <= 0.0f )
+			m_vScale[j] = 1.0f;
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+void CStudioVertexPacker::Encode( const mstudiovertex_t& vertex, const Vector4D& vecTangent, StudioPackedVertex* pOut ) const
+{
+	pOut->pos[0] = QuantizeSNorm( ( vertex.m_vecPosition.x - m_vOffset.x ) / m_vScale.x );
+	pOut->pos[1] = QuantizeSNorm( ( vertex.m_vecPosition.y - m_vOffset.y ) / m_vScale.y );
+	pOut->pos[2] = QuantizeSNorm( ( vertex.m_vecPosition.z - m_vOffset.z ) / m_vScale.z );
+	pOut->pos[3] = vecTangent.w < 0.0f ? -32767 : 32767;
+
+	OctEncode( vertex.m_vecNormal, pOut->normal );
+	OctEncode( Vector( vecTangent.x, vecTangent.y, vecTangent.z ), pOut->tangent );
+
+	pOut->texcoord[0].SetFloat( vertex.m_vecTexCoord.x );
+	pOut->texcoord[1].SetFloat( vertex.m_vecTexCoord.y );
+
+	// Round the weights of all but the last bone, which takes what is left so the bytes
+	// always add up to 255
+	const mstudioboneweight_t& weights = vertex.m_BoneWeights;
+	int numBones = weights.numbones < MAX_NUM_BONES_PER_VERT ? weights.numbones : MAX_NUM_BONES_PER_VERT;
+	int nRemaining = 255;
+	for( int i=0; i < MAX_NUM_BONES_PER_VERT; i++ )
+	{
+		pOut->weight[i] = 0;
+		pOut->bone[i] = 0;
+		if( i >= numBones )
+			continue;
+		int w = ( i == numBones - 1 ) ? nRemaining : (int)floor( clamp( weights.weight[i], 0.0f, 1.0f ) * 255.0f + 0.5f );
+		if( w > nRemaining )
+			w = nRemaining;
+		nRemaining -= w;
+		pOut->weight[i] = (BYTE)w;
+		pOut->bone[i] = (BYTE)weights.bone[i];
+	}
+	pOut->weight[3] = 0;
+	pOut->bone[3] = (BYTE)numBones;
+}
+
+
+//--------------------------------------------------------------------------------------
+void CStudioVertexPacker::Decode( const StudioPackedVertex& packed, mstudiovertex_t* pVertex, Vector4D* pTangent ) const
+{
+	pVertex->m_vecPosition.x = DequantizeSNorm( packed.pos[0] ) * m_vScale.x + m_vOffset.x;
+	pVertex->m_vecPosition.y = DequantizeSNorm( packed.pos[1] ) * m_vScale.y + m_vOffset.y;
+	pVertex->m_vecPosition.z = DequantizeSNorm( packed.pos[2] ) * m_vScale.z + m_vOffset.z;
+	pVertex->m_vecNormal = OctDecode( packed.normal );
+	pVertex->m_vecTexCoord.x = packed.texcoord[0].GetFloat();
+	pVertex->m_vecTexCoord.y = packed.texcoord[1].GetFloat();
+
+	Vector vecTangent = OctDecode( packed.tangent );
+	*pTangent = Vector4D( vecTangent.x, vecTangent.y, vecTangent.z, packed.pos[3] < 0 ? -1.0f : 1.0f );
+
+	mstudioboneweight_t& weights = pVertex->m_BoneWeights;
+	weights.numbones = packed.bone[3];
+	for( int i=0; i < MAX_NUM_BONES_PER_VERT; i++ )
+	{
+		weights.weight[i] = packed.weight[i] / 255.0f;
+		weights.bone[i] = (char)packed.bone[i];
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+void CStudioVertexPacker::Pack( const StudioVertexView& vertices, StudioPackedVertex* pOut, StudioPackStats* pStats )
+{
+	int numVertices = vertices.numVertices;
+
+	ZeroMemory( pStats, sizeof( StudioPackStats ) );
+	if( numVertices == 0 )
+		return;
+
+	Vector vMin( FLT_MAX, FLT_MAX, FLT_MAX );
+	Vector vMax( -FLT_MAX, -FLT_MAX, -FLT_MAX );
+	for( int i=0; i < numVertices; i++ )
+	{
+		const Vector& vecPosition = vertices.Position( i );
+		D3DXVec3Minimize( &vMin, &vMin, &vecPosition );
+		D3DXVec3Maximize( &vMax, &vMax, &vecPosition );
+	}
+	SetBounds( vMin, vMax );
+
+	pStats->nVertices = numVertices;
+	pStats->nBytesIn = numVertices * ( sizeof( mstudiovertex_t ) + sizeof( Vector4D ) );
+	pStats->nBytesOut = numVertices * sizeof( StudioPackedVertex );
+
+	for( int i=0; i < numVertices; i++ )
+	{
+		mstudiovertex_t vertex;
+		vertex.m_BoneWeights = vertices.BoneWeights( i );
+		vertex.m_vecPosition = vertices.Position( i );
+		vertex.m_vecNormal = vertices.Normal( i );
+		vertex.m_vecTexCoord = vertices.TexCoord( i );
+		const Vector4D& vecTangent = vertices.Tangent( i );
+		Encode( vertex, vecTangent, &pOut[i] );
+
+		mstudiovertex_t decoded;
+		Vector4D decodedTangent;
+		Decode( pOut[i], &decoded, &decodedTangent );
+
+		Vector vecNormal, vecTangentIn( vecTangent.x, vecTangent.y, vecTangent.z );
+		D3DXVec3Normalize( &vecNormal, &vertex.m_vecNormal );
+		if( D3DXVec3LengthSq( &vecTangentIn ) > 0.0f )
+			D3DXVec3Normalize( &vecTangentIn, &vecTangentIn );
+
+		Vector d = decoded.m_vecPosition - vertex.m_vecPosition;
+		KeepMax( pStats->flMaxPositionError, fabs( d.x ) );
+		KeepMax( pStats->flMaxPositionError, fabs( d.y ) );
+		KeepMax( pStats->flMaxPositionError, fabs( d.z ) );
+		d = decoded.m_vecNormal - vecNormal;
+		KeepMax( pStats->flMaxNormalError, D3DXVec3Length( &d ) );
+		// Degenerate texture mapping leaves some tangents at zero, there is no direction to keep
+		if( D3DXVec3LengthSq( &vecTangentIn ) > 0.0f )
+		{
+			d = Vector( decodedTangent.x, decodedTangent.y, decodedTangent.z ) - vecTangentIn;
+			KeepMax( pStats->flMaxTangentError, D3DXVec3Length( &d ) );
+		}
+		KeepMax( pStats->flMaxTexCoordError, fabs( decoded.m_vecTexCoord.x - vertex.m_vecTexCoord.x ) );
+		KeepMax( pStats->flMaxTexCoordError, fabs( decoded.m_vecTexCoord.y - vertex.m_vecTexCoord.y ) );
+		for( int j=0; j < vertex.m_BoneWeights.numbones && j < MAX_NUM_BONES_PER_VERT; j++ )
+			KeepMax( pStats->flMaxWeightError, fabs( decoded.m_BoneWeights.weight[j] - vertex.m_BoneWeights.weight[j] ) );
+	}
+}
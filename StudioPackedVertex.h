@@ -0,0 +1,61 @@
+//--------------------------------------------------------------------------------------
+// File: StudioPackedVertex.h
+//
+// Compact 28 byte vertex for the 64 byte mstudiovertex_t plus tangent. Positions are
+// quantized to the model box, normal and tangent are octahedron encoded, texture
+// coordinates are halfs and bone weights are bytes that sum to 255. The sign of the
+// tangent's w rides in the position's w.
+//
+// Decoding in a vertex shader:
+//   position = pos.xyz * scale + offset, tangent.w = pos.w
+//   normal   = OctDecode( normal.xy ), tangent.xyz = OctDecode( tangent.xy )
+//
+//--------------------------------------------------------------------------------------
+#pragma once
+#include "StudioSoAMesh.h"
+
+struct StudioPackedVertex
+{
+	short   pos[4];         // SHORT4N, xyz in the model box, w the tangent sign
+	short   normal[2];      // SHORT2N, octahedron encoded
+	short   tangent[2];     // SHORT2N, octahedron encoded
+	float16 texcoord[2];    // FLOAT16_2
+	BYTE    weight[4];      // UBYTE4N, weights of the used bones sum to 255
+	BYTE    bone[4];        // UBYTE4, bone[3] holds the number of bones
+};
+
+extern D3DVERTEXELEMENT9 PACKED_VERTEX_DECL[];
+
+// Worst errors of one packing run, measured by decoding what was encoded
+struct StudioPackStats
+{
+	int   nVertices;
+	int   nBytesIn;
+	int   nBytesOut;
+	float flMaxPositionError;   // model units
+	float flMaxNormalError;     // length of the difference of the unit vectors
+	float flMaxTangentError;
+	float flMaxTexCoordError;
+	float flMaxWeightError;
+};
+
+class CStudioVertexPacker
+{
+public:
+	CStudioVertexPacker();
+
+	// Box the positions are quantized to
+	void    SetBounds( const Vector& vMin, const Vector& vMax );
+	const Vector& GetScale() const { return m_vScale; }
+	const Vector& GetOffset() const { return m_vOffset; }
+
+	void    Encode( const mstudiovertex_t& vertex, const Vector4D& vecTangent, StudioPackedVertex* pOut ) const;
+	void    Decode( const StudioPackedVertex& packed, mstudiovertex_t* pVertex, Vector4D* pTangent ) const;
+
+	// Fits the bounds to the vertices and packs them, the view needs tangents
+	void    Pack( const StudioVertexView& vertices, StudioPackedVertex* pOut, StudioPackStats* pStats );
+
+private:
+	Vector m_vScale;
+	Vector m_vOffset;
+};
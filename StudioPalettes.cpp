@@ -0,0 +1,211 @@
+//--------------------------------------------------------------------------------------
+// File: StudioPalettes.cpp
+//
+// Per-strip bone palettes for hardware skinning.
+//
+//--------------------------------------------------------------------------------------
+#include "DXUT.h"
+#include "StudioPalettes.h"
+
+using namespace OptimizedModel;
+
+
+//--------------------------------------------------------------------------------------
+CStudioBonePalettes::CStudioBonePalettes()
+{
+	m_nPaletteBones = 0;
+	m_nModelBones = 0;
+	m_nFullPalettes = 0;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Hardware skinned vertices name bone slots, and the strips' bone state changes say
+// which model bone is in each slot. The slots keep their bone from one strip of a
+// group to the next, so the changes are applied cumulatively. Software skinned
+// vertices name model bones directly. A strip whose slots or weights don't resolve to
+// model bones is still drawn, with the whole skeleton as its palette and the bones of
+// its .vvd weights as blend indices.
+//--------------------------------------------------------------------------------------
+HRESULT CStudioBonePalettes::Init( const studiohdr_t* pStudioHdr, const FileHeader_t* pVtxHdr, int iLod,
+                                   const mstudiovertex_t* pVertices, const int* pVertexRemap )
+{
+	HRESULT hr;
+
+	Destroy();
+
+	m_nModelBones = pStudioHdr->numbones;
+
+	const ModelHeader_t* pModel = pVtxHdr->pBodyPart( 0 )->pModel( 0 );
+	const ModelLODHeader_t* pLod = pModel->pLOD( iLod );
+	const mstudiomodel_t* pStudioModel = pStudioHdr->pBodypart( 0 )->pModel( 0 );
+
+	int iSubset = 0;
+	int iVertexBase = 0;
+	int iIndexBase = 0;
+	for( int k=0; k < pStudioModel->nummeshes; k++ )
+	{
+		const MeshHeader_t* pMesh = pLod->pMesh( k );
+		for( int j=0; j < pMesh->numStripGroups; j++ )
+		{
+			const StripGroupHeader_t* pGroup = pMesh->pStripGroup( j );
+			bool bHardwareSkinned = ( pGroup->flags & STRIPGROUP_IS_HWSKINNED ) != 0;
+
+			for( int v=0; v < pGroup->numVerts; v++ )
+				V_RETURN( m_BoneIndices.Add( 0 ) );
+
+			int slotBone[MAXSTUDIOBONES];
+			for( int i=0; i < MAXSTUDIOBONES; i++ )
+				slotBone[i] = bHardwareSkinned ? -1 : i;
+
+			for( int s=0; s < pGroup->numStrips; s++ )
+			{
+				const StripHeader_t* pStrip = pGroup->pStrip( s );
+				bool bFullPalette = false;
+				if( bHardwareSkinned )
+				{
+					// A slot loaded with a bone the model doesn't have stays unresolved
+					for( int c=0; c < pStrip->numBoneStateChanges; c++ )
+					{
+						const BoneStateChangeHeader_t* pChange = pStrip->pBoneStateChange( c );
+						if( pChange->hardwareID < 0 || pChange->hardwareID >= MAXSTUDIOBONES )
+						{
+							bFullPalette = true;
+							continue;
+						}
+						if( pChange->newBoneID < 0 || pChange->newBoneID >= m_nModelBones )
+						{
+							slotBone[pChange->hardwareID] = -1;
+							bFullPalette = true;
+							continue;
+						}
+						slotBone[pChange->hardwareID] = pChange->newBoneID;
+					}
+				}
+
+				// Palette order follows the slots, so it is stable from strip to strip
+				int slotPalette[MAXSTUDIOBONES];
+				for( int i=0; i < MAXSTUDIOBONES; i++ )
+					slotPalette[i] = -1;
+				for( int v=pStrip->vertOffset; v < pStrip->vertOffset + pStrip->numVerts && !bFullPalette; v++ )
+				{
+					const Vertex_t* pVertex = pGroup->pVertex( v );
+					for( int b=0; b < pVertex->numBones; b++ )
+					{
+						int iSlot = pVertex->boneID[b];
+						if( iSlot < 0 || iSlot >= MAXSTUDIOBONES || slotBone[iSlot] < 0 || slotBone[iSlot] >= m_nModelBones ||
+							pVertex->boneWeightIndex[b] >= MAX_NUM_BONES_PER_VERT )
+						{
+							bFullPalette = true;
+							break;
+						}
+						slotPalette[iSlot] = 0;
+					}
+				}
+
+				StudioStripPalette palette;
+				palette.iSubset = iSubset;
+				palette.iFirstIndex = iIndexBase + pStrip->indexOffset;
+				palette.numIndices = pStrip->numIndices;
+				palette.iFirstVertex = iVertexBase + pStrip->vertOffset;
+				palette.numVertices = pStrip->numVerts;
+				palette.iFirstBone = m_PaletteBones.GetSize();
+				palette.numBones = 0;
+				palette.bHardwareSkinned = bHardwareSkinned && !bFullPalette;
+
+				if( bFullPalette )
+				{
+					for( int i=0; i < m_nModelBones; i++ )
+						V_RETURN( m_PaletteBones.Add( (BYTE)i ) );
+					palette.numBones = m_nModelBones;
+					m_nPaletteBones += palette.numBones;
+					m_nFullPalettes++;
+					V_RETURN( m_Palettes.Add( palette ) );
+
+					for( int v=palette.iFirstVertex; v < palette.iFirstVertex + palette.numVertices; v++ )
+					{
+						const mstudioboneweight_t& weights = pVertices[pVertexRemap[v]].m_BoneWeights;
+						DWORD dwIndices = 0;
+						for( int b=0; b < weights.numbones && b < MAX_NUM_BONES_PER_VERT; b++ )
+						{
+							if( weights.bone[b] >= 0 && weights.bone[b] < m_nModelBones )
+								dwIndices |= (DWORD)weights.bone[b] << ( 8 * b );
+						}
+						m_BoneIndices[v] = dwIndices;
+					}
+					continue;
+				}
+
+				for( int i=0; i < MAXSTUDIOBONES; i++ )
+				{
+					if( slotPalette[i] < 0 )
+						continue;
+					slotPalette[i] = palette.numBones++;
+					V_RETURN( m_PaletteBones.Add( (BYTE)slotBone[i] ) );
+				}
+				m_nPaletteBones += palette.numBones;
+				V_RETURN( m_Palettes.Add( palette ) );
+
+				// Blend index i goes with .vvd weight i, the .vtx vertex tells which of its
+				// bones feeds which weight
+				for( int v=pStrip->vertOffset; v < pStrip->vertOffset + pStrip->numVerts; v++ )
+				{
+					const Vertex_t* pVertex = pGroup->pVertex( v );
+					DWORD dwIndices = 0;
+					for( int b=0; b < pVertex->numBones; b++ )
+						dwIndices |= (DWORD)slotPalette[pVertex->boneID[b]] << ( 8 * pVertex->boneWeightIndex[b] );
+					m_BoneIndices[iVertexBase + v] = dwIndices;
+				}
+			}
+
+			iVertexBase += pGroup->numVerts;
+			iIndexBase += pGroup->numIndices;
+			iSubset++;
+		}
+	}
+
+	return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+void CStudioBonePalettes::Destroy()
+{
+	m_Palettes.RemoveAll();
+	m_PaletteBones.RemoveAll();
+	m_BoneIndices.RemoveAll();
+	m_nPaletteBones = 0;
+	m_nModelBones = 0;
+	m_nFullPalettes = 0;
+}
+
+
+//--------------------------------------------------------------------------------------
+void CStudioBonePalettes::BuildPaletteMatrices( const StudioStripPalette& palette, const matrix3x4_t* pSkinning, matrix3x4_t* pOut ) const
+{
+	for( int i=0; i < palette.numBones; i++ )
+		pOut[i] = pSkinning[m_PaletteBones[palette.iFirstBone + i]];
+}
+
+
+//--------------------------------------------------------------------------------------
+bool CStudioBonePalettes::Validate( const mstudiovertex_t* pVertices, const int* pVertexRemap ) const
+{
+	for( int p=0; p < m_Palettes.GetSize(); p++ )
+	{
+		const StudioStripPalette& palette = m_Palettes[p];
+		for( int v=palette.iFirstVertex; v < palette.iFirstVertex + palette.numVertices; v++ )
+		{
+			const mstudioboneweight_t& weights = pVertices[pVertexRemap[v]].m_BoneWeights;
+			DWORD dwIndices = m_BoneIndices[v];
+			for( int b=0; b < weights.numbones; b++ )
+			{
+				int iSlot = ( dwIndices >> ( 8 * b ) ) & 0xFF;
+				if( iSlot >= palette.numBones || m_PaletteBones[palette.iFirstBone + iSlot] != weights.bone[b] )
+					return false;
+			}
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,68 @@
+//--------------------------------------------------------------------------------------
+// File: StudioPalettes.h
+//
+// Hardware bone palettes built from the .vtx strips. Each strip gets the list of model
+// bones its vertices reference, and every vertex gets its blend indices remapped into
+// that list, so a draw only uploads the matrices of the bones it actually uses.
+//
+//--------------------------------------------------------------------------------------
+#pragma once
+#include "optimize.h"
+#include "BoneSetup.h"
+
+struct StudioStripPalette
+{
+	int  iSubset;           // strip group the strip came from
+	int  iFirstIndex;       // into the loader's index buffer
+	int  numIndices;
+	int  iFirstVertex;      // into the loader's vertex buffer
+	int  numVertices;
+	int  iFirstBone;        // into the palette bone list
+	int  numBones;
+	bool bHardwareSkinned;  // STRIPGROUP_IS_HWSKINNED, vertex bones are hardware slots.
+	                        // Cleared when the strip falls back to the full skeleton.
+};
+
+class CStudioBonePalettes
+{
+public:
+	CStudioBonePalettes();
+
+	// Walks the strips of the first model in the same order the loader builds its
+	// vertex and index buffers. pVertexRemap maps loader vertices to .vvd vertices, the
+	// strips that fall back to the full skeleton take their blend indices from there.
+	HRESULT Init( const studiohdr_t* pStudioHdr, const OptimizedModel::FileHeader_t* pVtxHdr, int iLod,
+	              const mstudiovertex_t* pVertices, const int* pVertexRemap );
+	void    Destroy();
+
+	int     GetNumPalettes() const { return m_Palettes.GetSize(); }
+	const StudioStripPalette& GetPalette( int i ) const { return m_Palettes.GetAt( i ); }
+	int     GetPaletteBone( const StudioStripPalette& palette, int i ) const { return m_PaletteBones.GetAt( palette.iFirstBone + i ); }
+	// Strips whose .vtx bones didn't resolve and use every model bone
+	int     GetNumFullPalettes() const { return m_nFullPalettes; }
+
+	// Blend indices of every loader vertex, one palette slot per byte in the order of
+	// the .vvd bone weights, ready for a D3DDECLTYPE_UBYTE4 stream
+	const DWORD* GetBoneIndices() const { return m_BoneIndices.GetData(); }
+	int     GetNumVertices() const { return m_BoneIndices.GetSize(); }
+
+	// Gathers the matrices one draw needs, pOut holds palette.numBones entries
+	void    BuildPaletteMatrices( const StudioStripPalette& palette, const matrix3x4_t* pSkinning, matrix3x4_t* pOut ) const;
+
+	// Checks that every remapped blend index resolves to the bone of the .vvd weight it
+	// stands for. pVertexRemap maps loader vertices to .vvd vertices.
+	bool    Validate( const mstudiovertex_t* pVertices, const int* pVertexRemap ) const;
+
+	// Matrix bytes sent when every strip is drawn once, with the palettes and with the
+	// whole skeleton per draw
+	int     GetUploadBytes() const { return m_nPaletteBones * sizeof( matrix3x4_t ); }
+	int     GetFullUploadBytes() const { return m_Palettes.GetSize() * m_nModelBones * sizeof( matrix3x4_t ); }
+
+private:
+	CGrowableArray< StudioStripPalette > m_Palettes;
+	CGrowableArray< BYTE >  m_PaletteBones;   // model bone of every palette slot
+	CGrowableArray< DWORD > m_BoneIndices;    // packed palette slots per loader vertex
+	int m_nPaletteBones;
+	int m_nModelBones;
+	int m_nFullPalettes;
+};
@@ -0,0 +1,187 @@
+//--------------------------------------------------------------------------------------
+// File: StudioPoseCache.cpp
+//
+// Shared per-frame pose cache for crowds of studio models.
+//
+//--------------------------------------------------------------------------------------
+#include "DXUT.h"
+#include "StudioPoseCache.h"
+
+
+//--------------------------------------------------------------------------------------
+CStudioPoseCache::CStudioPoseCache()
+{
+	m_dwMask = 0;
+	m_pPos = NULL;
+	m_pQ = NULL;
+	m_nMaxEntries = 0;
+	m_nEntries = 0;
+	m_flCycleStep = 1.0f / 64.0f;
+	m_flPoseStep = 1.0f / 64.0f;
+	ZeroMemory( &m_Stats, sizeof( m_Stats ) );
+}
+
+
+//--------------------------------------------------------------------------------------
+CStudioPoseCache::~CStudioPoseCache()
+{
+	Destroy();
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT CStudioPoseCache::Init( int nMaxEntries, float flCycleStep, float flPoseStep )
+{
+	HRESULT hr;
+
+	Destroy();
+
+	int nTableSize = 8;
+	while( nTableSize < nMaxEntries * 2 )
+		nTableSize <<= 1;
+
+	V_RETURN( m_Table.SetSize( nTableSize ) );
+	Entry empty;
+	ZeroMemory( &empty, sizeof( empty ) );
+	empty.iSlot = -1;
+	for( int i=0; i < nTableSize; i++ )
+		m_Table.Add( empty );
+	m_dwMask = nTableSize - 1;
+
+	m_pPos = new Vector[nMaxEntries * MAXSTUDIOBONES];
+	m_pQ = new Quaternion[nMaxEntries * MAXSTUDIOBONES];
+	if( m_pPos == NULL || m_pQ == NULL )
+	{
+		Destroy();
+		return E_OUTOFMEMORY;
+	}
+
+	m_nMaxEntries = nMaxEntries;
+	SetTolerance( flCycleStep, flPoseStep );
+	return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+void CStudioPoseCache::Destroy()
+{
+	m_Table.RemoveAll();
+	SAFE_DELETE_ARRAY( m_pPos );
+	SAFE_DELETE_ARRAY( m_pQ );
+	m_dwMask = 0;
+	m_nMaxEntries = 0;
+	m_nEntries = 0;
+	ResetStats();
+}
+
+
+//--------------------------------------------------------------------------------------
+// Changing the steps changes the keys, so the current frame's entries are dropped
+//--------------------------------------------------------------------------------------
+void CStudioPoseCache::SetTolerance( float flCycleStep, float flPoseStep )
+{
+	m_flCycleStep = ( flCycleStep > 0.0f ) ? flCycleStep : 1.0f / 64.0f;
+	m_flPoseStep = ( flPoseStep > 0.0f ) ? flPoseStep : 1.0f / 64.0f;
+	BeginFrame();
+}
+
+
+//--------------------------------------------------------------------------------------
+void CStudioPoseCache::BeginFrame()
+{
+	if( m_nEntries == 0 )
+		return;
+
+	for( int i=0; i < m_Table.GetSize(); i++ )
+		m_Table[i].iSlot = -1;
+	m_nEntries = 0;
+}
+
+
+//--------------------------------------------------------------------------------------
+DWORD CStudioPoseCache::HashKey( const StudioPoseKey& key )
+{
+	const BYTE* p = (const BYTE*)&key;
+	DWORD dwHash = 2166136261U;
+	for( int i=0; i < sizeof( key ); i++ )
+		dwHash = ( dwHash ^ p[i] ) * 16777619U;
+	return dwHash;
+}
+
+
+//--------------------------------------------------------------------------------------
+void CStudioPoseCache::GetPose( const studiohdr_t* pStudioHdr, const CStudioFrameCache* pFrameCache, int iSequence,
+								float flCycle, const float poseParameter[], int boneMask,
+								Vector* pScratchPos, Quaternion* pScratchQ,
+								const Vector** ppPos, const Quaternion** ppQ )
+{
+	m_Stats.nLookups++;
+
+	const mstudioseqdesc_t& seqdesc = pStudioHdr->pSeqdesc( iSequence );
+
+	StudioPoseKey key;
+	ZeroMemory( &key, sizeof( key ) );
+	key.pStudioHdr = pStudioHdr;
+	key.iSequence = iSequence;
+	key.iCycle = (int)floorf( flCycle / m_flCycleStep + 0.5f );
+	key.boneMask = boneMask;
+
+	// Only the sequence's blend parameters affect its pose, the rest are left out of the key
+	float flPose[MAXSTUDIOPOSEPARAM];
+	int numPose = pStudioHdr->GetNumPoseParameters();
+	if( numPose > MAXSTUDIOPOSEPARAM )
+		numPose = MAXSTUDIOPOSEPARAM;
+	for( int i=0; i < numPose; i++ )
+		flPose[i] = poseParameter[i];
+	for( int i=0; i < 2; i++ )
+	{
+		int iPose = pStudioHdr->GetSharedPoseParameter( iSequence, seqdesc.paramindex[i] );
+		if( iPose < 0 || iPose >= numPose )
+			continue;
+		key.iPose[i] = (int)floorf( poseParameter[iPose] / m_flPoseStep + 0.5f );
+		flPose[iPose] = key.iPose[i] * m_flPoseStep;
+	}
+
+	DWORD dwHash = HashKey( key );
+	DWORD i = dwHash & m_dwMask;
+	if( m_nMaxEntries > 0 )
+	{
+		for( ; m_Table[i].iSlot != -1; i = ( i + 1 ) & m_dwMask )
+		{
+			const Entry& entry = m_Table[i];
+			if( entry.dwHash == dwHash && memcmp( &entry.key, &key, sizeof( key ) ) == 0 )
+			{
+				m_Stats.nHits++;
+				*ppPos = &m_pPos[entry.iSlot * MAXSTUDIOBONES];
+				*ppQ = &m_pQ[entry.iSlot * MAXSTUDIOBONES];
+				return;
+			}
+		}
+	}
+
+	// Miss, evaluate at the rounded cycle
+	Vector* pPos = pScratchPos;
+	Quaternion* pQ = pScratchQ;
+	if( m_nEntries < m_nMaxEntries )
+	{
+		Entry& entry = m_Table[i];
+		entry.key = key;
+		entry.dwHash = dwHash;
+		entry.iSlot = m_nEntries++;
+		pPos = &m_pPos[entry.iSlot * MAXSTUDIOBONES];
+		pQ = &m_pQ[entry.iSlot * MAXSTUDIOBONES];
+	}
+	else
+	{
+		m_Stats.nOverflows++;
+	}
+
+	float flKeyCycle = key.iCycle * m_flCycleStep;
+	if( pFrameCache )
+		pFrameCache->CalcPose( iSequence, flKeyCycle, flPose, pPos, pQ, boneMask );
+	else
+		Studio_CalcPose( pStudioHdr, iSequence, flKeyCycle, flPose, pPos, pQ, boneMask );
+
+	*ppPos = pPos;
+	*ppQ = pQ;
+}
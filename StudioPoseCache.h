@@ -0,0 +1,78 @@
+//--------------------------------------------------------------------------------------
+// File: StudioPoseCache.h
+//
+// Per-frame cache of evaluated local poses shared by every instance on screen. The key
+// is the model, the sequence, the cycle and the sequence's two blend pose parameters,
+// the last three rounded to a configurable step. Instances landing on the same key
+// within a frame reuse one evaluation instead of decoding the animation again, and all
+// of them get the pose of the rounded cycle so they stay identical.
+//
+// Entries live until the next BeginFrame. The cache is not thread safe.
+//
+//--------------------------------------------------------------------------------------
+#pragma once
+#include "StudioFrameCache.h"
+
+struct StudioPoseKey
+{
+	const studiohdr_t*  pStudioHdr;
+	int                 iSequence;
+	int                 iCycle;         // cycle / cycle step, rounded
+	int                 iPose[2];       // blend pose parameters / pose step, rounded
+	int                 boneMask;
+};
+
+struct StudioPoseCacheStats
+{
+	int nLookups;
+	int nHits;
+	int nOverflows;     // misses that found the cache full and were evaluated uncached
+};
+
+class CStudioPoseCache
+{
+public:
+	CStudioPoseCache();
+	~CStudioPoseCache();
+
+	// flCycleStep and flPoseStep are the rounding steps, in cycles and in normalized
+	// pose parameter units
+	HRESULT Init( int nMaxEntries, float flCycleStep, float flPoseStep );
+	void    Destroy();
+
+	void    SetTolerance( float flCycleStep, float flPoseStep );
+	void    BeginFrame();
+
+	// Local pose for the instance, valid until the next BeginFrame. pFrameCache may be
+	// NULL to decode straight from the animation. If the cache is full the pose is
+	// evaluated into pScratchPos/pScratchQ, which then become the result.
+	void    GetPose( const studiohdr_t* pStudioHdr, const CStudioFrameCache* pFrameCache, int iSequence,
+					 float flCycle, const float poseParameter[], int boneMask,
+					 Vector* pScratchPos, Quaternion* pScratchQ,
+					 const Vector** ppPos, const Quaternion** ppQ );
+
+	int     GetNumEntries() const { return m_nEntries; }
+	const StudioPoseCacheStats& GetStats() const { return m_Stats; }
+	float   GetHitRate() const { return m_Stats.nLookups ? (float)m_Stats.nHits / m_Stats.nLookups : 0.0f; }
+	void    ResetStats() { ZeroMemory( &m_Stats, sizeof( m_Stats ) ); }
+
+private:
+	struct Entry
+	{
+		StudioPoseKey   key;
+		DWORD           dwHash;
+		int             iSlot;      // -1 for an empty table entry
+	};
+
+	static DWORD HashKey( const StudioPoseKey& key );
+
+	CGrowableArray< Entry >         m_Table;        // open addressing, twice the entries
+	DWORD                           m_dwMask;
+	Vector*                         m_pPos;         // MAXSTUDIOBONES per slot
+	Quaternion*                     m_pQ;
+	int                             m_nMaxEntries;
+	int                             m_nEntries;
+	float                           m_flCycleStep;
+	float                           m_flPoseStep;
+	StudioPoseCacheStats            m_Stats;
+};
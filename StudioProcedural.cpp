@@ -0,0 +1,462 @@
+//--------------------------------------------------------------------------------------
+// File: StudioProcedural.cpp
+//
+// Procedural bone evaluation for studio models.
+//
+//--------------------------------------------------------------------------------------
+#include "DXUT.h"
+#include "StudioProcedural.h"
+#include <xmmintrin.h>
+
+#define BONE_STATE_NONE		0
+#define BONE_STATE_VISITING	1
+#define BONE_STATE_DONE		2
+
+
+//--------------------------------------------------------------------------------------
+HRESULT CStudioProceduralBones::Init( const studiohdr_t* pStudioHdr )
+{
+	HRESULT hr;
+
+	Destroy();
+
+	m_pStudioHdr = pStudioHdr;
+
+	CGrowableArray< int > state;
+	V_RETURN( state.SetSize( pStudioHdr->numbones ) );
+	for( int i=0; i < pStudioHdr->numbones; i++ )
+		state.Add( BONE_STATE_NONE );
+
+	V_RETURN( m_Steps.SetSize( pStudioHdr->numbones ) );
+	for( int i=0; i < pStudioHdr->numbones; i++ )
+	{
+		V_RETURN( AddStep( i, state ) );
+	}
+
+	return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+void CStudioProceduralBones::Destroy()
+{
+	m_pStudioHdr = NULL;
+	m_Steps.RemoveAll();
+	m_nProcedural = 0;
+	m_TriggerX.RemoveAll();
+	m_TriggerY.RemoveAll();
+	m_TriggerZ.RemoveAll();
+	m_TriggerW.RemoveAll();
+	m_TriggerCosLimit.RemoveAll();
+	m_TriggerInvTolerance.RemoveAll();
+	m_TriggerQuat.RemoveAll();
+	m_TriggerPos.RemoveAll();
+}
+
+
+//--------------------------------------------------------------------------------------
+// Whether the bone or one of its parents is still being visited. Such a bone can't get
+// its step before the bone that reads it, as its parent chain leads back to the reader.
+//--------------------------------------------------------------------------------------
+bool CStudioProceduralBones::IsVisiting( int iBone, const CGrowableArray< int >& state ) const
+{
+	for( int n=0; n < m_pStudioHdr->numbones && iBone >= 0 && iBone < m_pStudioHdr->numbones; n++ )
+	{
+		if( state[iBone] == BONE_STATE_VISITING )
+			return true;
+		iBone = m_pStudioHdr->pBone( iBone )->parent;
+	}
+	return false;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Depth first: every bone the rule reads gets its step first. A rule that ends up
+// reading itself through a cycle is dropped and the bone is left to the animation.
+//--------------------------------------------------------------------------------------
+HRESULT CStudioProceduralBones::AddStep( int iBone, CGrowableArray< int >& state )
+{
+	HRESULT hr;
+
+	if( state[iBone] != BONE_STATE_NONE )
+		return S_OK;
+	state[iBone] = BONE_STATE_VISITING;
+
+	const mstudiobone_t* pBone = m_pStudioHdr->pBone( iBone );
+
+	StudioBoneStep step;
+	ZeroMemory( &step, sizeof( step ) );
+	step.iBone = iBone;
+	step.iParent = pBone->parent;
+	step.iControl = -1;
+	step.iControlParent = -1;
+	step.pProc = pBone->pProcedure();
+	if( step.pProc && step.iParent != -1 )
+		step.iProcType = pBone->proctype;
+
+	int deps[3] = { -1, -1, -1 };
+	switch( step.iProcType )
+	{
+	case STUDIO_PROC_AXISINTERP:
+		step.iControl = ( (const mstudioaxisinterpbone_t*)step.pProc )->control;
+		break;
+	case STUDIO_PROC_QUATINTERP:
+		step.iControl = ( (const mstudioquatinterpbone_t*)step.pProc )->control;
+		break;
+	case STUDIO_PROC_AIMATBONE:
+		step.iControl = ( (const mstudioaimatbone_t*)step.pProc )->aim;
+		deps[0] = step.iControl;
+		deps[1] = ( (const mstudioaimatbone_t*)step.pProc )->parent;
+		break;
+	case STUDIO_PROC_AIMATATTACH:
+		step.iControl = ( (const mstudioaimatbone_t*)step.pProc )->aim;
+		if( step.iControl < 0 || step.iControl >= m_pStudioHdr->GetNumAttachments() )
+			step.iProcType = 0;
+		else
+			deps[0] = m_pStudioHdr->GetAttachmentBone( step.iControl );
+		deps[1] = ( (const mstudioaimatbone_t*)step.pProc )->parent;
+		break;
+	default:
+		step.iProcType = 0;
+		break;
+	}
+
+	if( step.iProcType == STUDIO_PROC_AXISINTERP || step.iProcType == STUDIO_PROC_QUATINTERP )
+	{
+		deps[0] = step.iControl;
+		if( step.iControl >= 0 && step.iControl < m_pStudioHdr->numbones )
+			step.iControlParent = m_pStudioHdr->pBone( step.iControl )->parent;
+		else
+			step.iProcType = 0;
+		deps[1] = step.iControlParent;
+	}
+
+	// Aim-at reads both the aim target and the aim parent, without either one the bone
+	// keeps its animated pose
+	if( ( step.iProcType == STUDIO_PROC_AIMATBONE || step.iProcType == STUDIO_PROC_AIMATATTACH ) &&
+		( deps[0] < 0 || deps[0] >= m_pStudioHdr->numbones || deps[1] < 0 || deps[1] >= m_pStudioHdr->numbones ) )
+		step.iProcType = 0;
+
+	// A parent still being visited is a cycle in the hierarchy. Its transform isn't built
+	// yet, so the rule is dropped as below and the bone is built as a root.
+	if( step.iParent < -1 || step.iParent >= m_pStudioHdr->numbones || ( step.iParent != -1 && state[step.iParent] == BONE_STATE_VISITING ) )
+	{
+		step.iProcType = 0;
+		step.iParent = -1;
+	}
+	if( step.iParent != -1 )
+		V_RETURN( AddStep( step.iParent, state ) );
+
+	for( int i=0; i < 3 && step.iProcType; i++ )
+	{
+		if( deps[i] == -1 )
+			continue;
+		if( deps[i] < -1 || deps[i] >= m_pStudioHdr->numbones || IsVisiting( deps[i], state ) )
+		{
+			step.iProcType = 0;
+			break;
+		}
+		V_RETURN( AddStep( deps[i], state ) );
+	}
+
+	if( step.iProcType == STUDIO_PROC_QUATINTERP )
+	{
+		const mstudioquatinterpbone_t* pProc = (const mstudioquatinterpbone_t*)step.pProc;
+		step.iFirstTrigger = m_TriggerX.GetSize();
+		step.nTriggers = ( pProc->numtriggers + 3 ) & ~3;
+		for( int i=0; i < step.nTriggers; i++ )
+		{
+			// Padding never passes the limit
+			Quaternion quat( 0, 0, 0, 1 );
+			Quaternion trigger( 0, 0, 0, 0 );
+			Vector pos( 0, 0, 0 );
+			float flCosLimit = 2.0f;
+			float flInvTolerance = 0.0f;
+			if( i < pProc->numtriggers )
+			{
+				const mstudioquatinterpinfo_t* pTrigger = pProc->pTrigger( i );
+				quat = pTrigger->quat;
+				trigger = pTrigger->trigger;
+				pos = pTrigger->pos;
+				flInvTolerance = pTrigger->inv_tolerance;
+
+				// weight = 1 - 2 * acos( |dot| ) * inv_tolerance is positive below this angle
+				float flMaxAngle = ( flInvTolerance > 0.0f ) ? 0.5f / flInvTolerance : D3DX_PI;
+				flCosLimit = ( flMaxAngle >= 0.5f * D3DX_PI ) ? -1.0f : cosf( flMaxAngle );
+			}
+			V_RETURN( m_TriggerX.Add( trigger.x ) );
+			V_RETURN( m_TriggerY.Add( trigger.y ) );
+			V_RETURN( m_TriggerZ.Add( trigger.z ) );
+			V_RETURN( m_TriggerW.Add( trigger.w ) );
+			V_RETURN( m_TriggerCosLimit.Add( flCosLimit ) );
+			V_RETURN( m_TriggerInvTolerance.Add( flInvTolerance ) );
+			V_RETURN( m_TriggerQuat.Add( quat ) );
+			V_RETURN( m_TriggerPos.Add( pos ) );
+		}
+		if( pProc->numtriggers == 0 )
+			step.iProcType = 0;
+	}
+
+	if( step.iProcType )
+		m_nProcedural++;
+
+	state[iBone] = BONE_STATE_DONE;
+	return m_Steps.Add( step );
+}
+
+
+//--------------------------------------------------------------------------------------
+void CStudioProceduralBones::BuildMatrices( int nInstances, const Vector* const* ppPos, const Quaternion* const* ppQ,
+											matrix3x4_t* const* ppBoneToWorld ) const
+{
+	for( int s=0; s < m_Steps.GetSize(); s++ )
+	{
+		const StudioBoneStep& step = m_Steps[s];
+
+		for( int n=0; n < nInstances; n++ )
+		{
+			matrix3x4_t* pBoneToWorld = ppBoneToWorld[n];
+			switch( step.iProcType )
+			{
+			case STUDIO_PROC_AXISINTERP:
+				DoAxisInterpBone( step, pBoneToWorld );
+				break;
+			case STUDIO_PROC_QUATINTERP:
+				DoQuatInterpBone( step, pBoneToWorld );
+				break;
+			case STUDIO_PROC_AIMATBONE:
+			case STUDIO_PROC_AIMATATTACH:
+				DoAimAtBone( step, pBoneToWorld );
+				break;
+			default:
+				{
+					matrix3x4_t boneToParent;
+					QuaternionMatrix( ppQ[n][step.iBone], ppPos[n][step.iBone], boneToParent );
+					if( step.iParent == -1 )
+						pBoneToWorld[step.iBone] = boneToParent;
+					else
+						ConcatTransforms( pBoneToWorld[step.iParent], boneToParent, pBoneToWorld[step.iBone] );
+				}
+				break;
+			}
+		}
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+void CStudioProceduralBones::BuildMatrices( const Vector pos[], const Quaternion q[], matrix3x4_t* pBoneToWorld ) const
+{
+	BuildMatrices( 1, &pos, &q, &pBoneToWorld );
+}
+
+
+//--------------------------------------------------------------------------------------
+// Three-way blend of the poses for the control bone's local axis direction
+//--------------------------------------------------------------------------------------
+void CStudioProceduralBones::DoAxisInterpBone( const StudioBoneStep& step, matrix3x4_t* pBoneToWorld ) const
+{
+	const mstudioaxisinterpbone_t* pProc = (const mstudioaxisinterpbone_t*)step.pProc;
+	const matrix3x4_t& controlToWorld = pBoneToWorld[step.iControl];
+
+	Vector control( controlToWorld[0][pProc->axis], controlToWorld[1][pProc->axis], controlToWorld[2][pProc->axis] );
+	if( step.iControlParent != -1 )
+		VectorIRotate( control, pBoneToWorld[step.iControlParent], control );
+
+	// Pick the side of each axis the control points to
+	float a1 = control.x;
+	float a2 = control.y;
+	float a3 = control.z;
+	int i1 = 0;
+	int i2 = 2;
+	int i3 = 4;
+	if( a1 < 0.0f ) { a1 = -a1; i1 = 1; }
+	if( a2 < 0.0f ) { a2 = -a2; i2 = 3; }
+	if( a3 < 0.0f ) { a3 = -a3; i3 = 5; }
+
+	Vector p;
+	Quaternion v;
+	if( a1 + a2 > 0.0f )
+	{
+		float t = 1.0f / ( a1 + a2 + a3 );
+		Quaternion tmp;
+		QuaternionSlerp( pProc->quat[i2], pProc->quat[i1], a1 / ( a1 + a2 ), tmp );
+		QuaternionSlerp( tmp, pProc->quat[i3], a3 * t, v );
+		p = pProc->pos[i1] * ( a1 * t ) + pProc->pos[i2] * ( a2 * t ) + pProc->pos[i3] * ( a3 * t );
+	}
+	else
+	{
+		v = pProc->quat[i3];
+		QuaternionNormalize( v );
+		p = pProc->pos[i3];
+	}
+
+	matrix3x4_t boneToParent;
+	QuaternionMatrix( v, p, boneToParent );
+	ConcatTransforms( pBoneToWorld[step.iParent], boneToParent, pBoneToWorld[step.iBone] );
+}
+
+
+//--------------------------------------------------------------------------------------
+// Weighted blend of the trigger poses close to the control bone's local rotation. Four
+// triggers are tested per SSE pass, acos is only taken for those within tolerance.
+//--------------------------------------------------------------------------------------
+void CStudioProceduralBones::DoQuatInterpBone( const StudioBoneStep& step, matrix3x4_t* pBoneToWorld ) const
+{
+	// Control bone rotation relative to its parent
+	matrix3x4_t controlToParent;
+	const matrix3x4_t& controlToWorld = pBoneToWorld[step.iControl];
+	if( step.iControlParent != -1 )
+	{
+		const matrix3x4_t& parentToWorld = pBoneToWorld[step.iControlParent];
+		for( int i=0; i < 3; i++ )
+		{
+			for( int j=0; j < 3; j++ )
+			{
+				controlToParent[i][j] = parentToWorld[0][i] * controlToWorld[0][j] +
+										parentToWorld[1][i] * controlToWorld[1][j] +
+										parentToWorld[2][i] * controlToWorld[2][j];
+			}
+		}
+	}
+	else
+	{
+		controlToParent = controlToWorld;
+	}
+
+	Quaternion src;
+	MatrixQuaternion( controlToParent, src );
+
+	const __m128 srcX = _mm_set1_ps( src.x );
+	const __m128 srcY = _mm_set1_ps( src.y );
+	const __m128 srcZ = _mm_set1_ps( src.z );
+	const __m128 srcW = _mm_set1_ps( src.w );
+
+	__m128 quat = _mm_setzero_ps();
+	Vector pos( 0, 0, 0 );
+	float flScale = 0.0f;
+	float flWeight[4];
+	float flDot[4];
+
+	// Unnormalized sums, the quaternion is normalized at the end and the position
+	// divided by the total weight
+	for( int t=step.iFirstTrigger; t < step.iFirstTrigger + step.nTriggers; t += 4 )
+	{
+		__m128 dot = _mm_add_ps( _mm_add_ps( _mm_mul_ps( _mm_loadu_ps( &m_TriggerX[t] ), srcX ),
+											 _mm_mul_ps( _mm_loadu_ps( &m_TriggerY[t] ), srcY ) ),
+								 _mm_add_ps( _mm_mul_ps( _mm_loadu_ps( &m_TriggerZ[t] ), srcZ ),
+											 _mm_mul_ps( _mm_loadu_ps( &m_TriggerW[t] ), srcW ) ) );
+		__m128 absDot = _mm_max_ps( dot, _mm_sub_ps( _mm_setzero_ps(), dot ) );
+		int mask = _mm_movemask_ps( _mm_cmpgt_ps( absDot, _mm_loadu_ps( &m_TriggerCosLimit[t] ) ) );
+		if( mask == 0 )
+			continue;
+
+		_mm_storeu_ps( flDot, dot );
+		for( int i=0; i < 4; i++ )
+		{
+			flWeight[i] = 0.0f;
+			if( !( mask & ( 1 << i ) ) )
+				continue;
+
+			float flAbsDot = fabsf( flDot[i] );
+			if( flAbsDot > 1.0f )
+				flAbsDot = 1.0f;
+			float w = 1.0f - 2.0f * acosf( flAbsDot ) * m_TriggerInvTolerance[t + i];
+			if( w <= 0.0f )
+				continue;
+
+			// Only the trigger test ignores the sign, the pose quaternions are summed as stored
+			flWeight[i] = w;
+			flScale += w;
+			pos += w * m_TriggerPos[t + i];
+		}
+
+		for( int i=0; i < 4; i++ )
+		{
+			if( flWeight[i] != 0.0f )
+				quat = _mm_add_ps( quat, _mm_mul_ps( _mm_set1_ps( flWeight[i] ), _mm_loadu_ps( (const float*)&m_TriggerQuat[t + i] ) ) );
+		}
+	}
+
+	Quaternion q;
+	matrix3x4_t boneToParent;
+	if( flScale <= 0.001f )
+	{
+		q = m_TriggerQuat[step.iFirstTrigger];
+		pos = m_TriggerPos[step.iFirstTrigger];
+	}
+	else
+	{
+		_mm_storeu_ps( (float*)&q, quat );
+		QuaternionNormalize( q );
+		pos *= 1.0f / flScale;
+	}
+
+	QuaternionMatrix( q, pos, boneToParent );
+	ConcatTransforms( pBoneToWorld[step.iParent], boneToParent, pBoneToWorld[step.iBone] );
+}
+
+
+//--------------------------------------------------------------------------------------
+// Points the bone's aim vector at a bone or attachment and rolls it so its up vector
+// stays in the plane of the parent's up vector
+//--------------------------------------------------------------------------------------
+void CStudioProceduralBones::DoAimAtBone( const StudioBoneStep& step, matrix3x4_t* pBoneToWorld ) const
+{
+	const mstudioaimatbone_t* pProc = (const mstudioaimatbone_t*)step.pProc;
+
+	Vector aimWorldPosition;
+	if( step.iProcType == STUDIO_PROC_AIMATBONE )
+	{
+		MatrixPosition( pBoneToWorld[step.iControl], aimWorldPosition );
+	}
+	else
+	{
+		const mstudioattachment_t& attachment = m_pStudioHdr->pAttachment( step.iControl );
+		Vector local( attachment.local[0][3], attachment.local[1][3], attachment.local[2][3] );
+		VectorTransform( local, pBoneToWorld[m_pStudioHdr->GetAttachmentBone( step.iControl )], aimWorldPosition );
+	}
+
+	const matrix3x4_t& parentToWorld = pBoneToWorld[pProc->parent];
+
+	Vector bonePosition;
+	VectorTransform( pProc->basepos, parentToWorld, bonePosition );
+
+	Vector aimVector = aimWorldPosition - bonePosition;
+	D3DXVec3Normalize( &aimVector, &aimVector );
+
+	Vector axis;
+	D3DXVec3Cross( &axis, &pProc->aimvector, &aimVector );
+	D3DXVec3Normalize( &axis, &axis );
+	float flDot = D3DXVec3Dot( &pProc->aimvector, &aimVector );
+	Quaternion aimRotation;
+	AxisAngleQuaternion( axis, acosf( clamp( flDot, -1.0f, 1.0f ) ), aimRotation );
+
+	Quaternion boneRotation = aimRotation;
+	if( 1.0f - fabsf( D3DXVec3Dot( &pProc->upvector, &pProc->aimvector ) ) > FLT_EPSILON )
+	{
+		matrix3x4_t aimRotationMatrix;
+		QuaternionMatrix( aimRotation, Vector( 0, 0, 0 ), aimRotationMatrix );
+
+		// Both up vectors projected onto the plane perpendicular to the aim
+		Vector up;
+		VectorRotate( pProc->upvector, aimRotationMatrix, up );
+		up -= D3DXVec3Dot( &aimVector, &up ) * aimVector;
+		D3DXVec3Normalize( &up, &up );
+
+		Vector parentUp;
+		VectorRotate( pProc->upvector, parentToWorld, parentUp );
+		parentUp -= D3DXVec3Dot( &aimVector, &parentUp ) * aimVector;
+		D3DXVec3Normalize( &parentUp, &parentUp );
+
+		D3DXVec3Cross( &axis, &up, &parentUp );
+		D3DXVec3Normalize( &axis, &axis );
+		flDot = D3DXVec3Dot( &up, &parentUp );
+		Quaternion upRotation;
+		AxisAngleQuaternion( axis, acosf( clamp( flDot, -1.0f, 1.0f ) ), upRotation );
+
+		QuaternionMult( upRotation, aimRotation, boneRotation );
+	}
+
+	QuaternionMatrix( boneRotation, bonePosition, pBoneToWorld[step.iBone] );
+}
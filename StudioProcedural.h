@@ -0,0 +1,61 @@
+//--------------------------------------------------------------------------------------
+// File: StudioProcedural.h
+//
+// Procedural helper bones (axis interpolation, quaternion interpolation and aim-at) as a
+// stage of building the bone-to-world transforms. At load time every bone gets a step
+// in an order where each bone comes after everything it reads, and the quaternion
+// triggers are copied into a table laid out for four-wide SSE tests. Evaluation then
+// runs step by step over a batch of instances, so the rule data of a bone is fetched
+// once per batch rather than once per instance.
+//
+//--------------------------------------------------------------------------------------
+#pragma once
+#include "BoneSetup.h"
+
+struct StudioBoneStep
+{
+	int         iBone;
+	int         iParent;
+	int         iProcType;      // STUDIO_PROC_*, 0 for a bone taken from the animation
+	int         iControl;       // interp: control bone, aim-at: aim bone or attachment
+	int         iControlParent; // interp: parent of the control bone
+	int         iFirstTrigger;  // quat interp: first entry in the trigger table
+	int         nTriggers;      // rounded up to a multiple of four
+	const void* pProc;          // rule as stored in the .mdl
+};
+
+class CStudioProceduralBones
+{
+public:
+	HRESULT Init( const studiohdr_t* pStudioHdr );
+	void    Destroy();
+
+	int     GetNumProcedural() const { return m_nProcedural; }
+
+	// Bone-to-world transforms of nInstances skeletons from their parent-relative
+	// positions and rotations, with the procedural bones evaluated
+	void    BuildMatrices( int nInstances, const Vector* const* ppPos, const Quaternion* const* ppQ,
+						   matrix3x4_t* const* ppBoneToWorld ) const;
+	void    BuildMatrices( const Vector pos[], const Quaternion q[], matrix3x4_t* pBoneToWorld ) const;
+
+private:
+	void    DoAxisInterpBone( const StudioBoneStep& step, matrix3x4_t* pBoneToWorld ) const;
+	void    DoQuatInterpBone( const StudioBoneStep& step, matrix3x4_t* pBoneToWorld ) const;
+	void    DoAimAtBone( const StudioBoneStep& step, matrix3x4_t* pBoneToWorld ) const;
+	bool    IsVisiting( int iBone, const CGrowableArray< int >& state ) const;
+	HRESULT AddStep( int iBone, CGrowableArray< int >& state );
+
+	const studiohdr_t*                  m_pStudioHdr;
+	CGrowableArray< StudioBoneStep >    m_Steps;        // dependency order
+	int                                 m_nProcedural;
+
+	// Quat interp triggers, structure of arrays padded to groups of four
+	CGrowableArray< float >             m_TriggerX;
+	CGrowableArray< float >             m_TriggerY;
+	CGrowableArray< float >             m_TriggerZ;
+	CGrowableArray< float >             m_TriggerW;
+	CGrowableArray< float >             m_TriggerCosLimit;  // |dot| at or below this gives no weight
+	CGrowableArray< float >             m_TriggerInvTolerance;
+	CGrowableArray< Quaternion >        m_TriggerQuat;
+	CGrowableArray< Vector >            m_TriggerPos;
+};
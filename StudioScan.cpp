@@ -0,0 +1,155 @@
+//--------------------------------------------------------------------------------------
+// File: StudioScan.cpp
+//
+// Console tool that builds a catalog of a model library from the .mdl headers, see
+// StudioCatalog.h.
+//
+// StudioScan [options] <.mdl file or directory> ...
+//   -list file       also scan the paths in a text file, one per line
+//   -workers n       workers, 0 for one per processor (0)
+//   -index file      write the binary index
+//   -csv file        write the CSV index
+//   -bench n         scan n more times on 1, 2, 4 .. workers and report files per second
+//
+// The first scan runs against whatever the OS file cache holds, the bench scans after
+// it mostly see a warm cache.
+//
+//--------------------------------------------------------------------------------------
+#define DXUT_AUTOLIB
+#include "DXUT.h"
+#include "StudioCatalog.h"
+#include "StudioThreads.h"
+#include <stdio.h>
+
+
+//--------------------------------------------------------------------------------------
+static void PrintUsage()
+{
+	printf( "StudioScan [-list file] [-workers n] [-index file] [-csv file] [-bench n] <.mdl file or directory> ...\n" );
+}
+
+
+//--------------------------------------------------------------------------------------
+static void PrintStats( const char* strLabel, const StudioCatalogStats& stats )
+{
+	double flFiles = stats.numFiles > 0 ? (double)stats.numFiles : 1.0;
+	printf( "%-12s %8d files %6d failed %3d workers %9.3f s %10.0f files/s %5.2f reads/file %8.0f bytes/file\n", strLabel,
+			stats.numFiles, stats.numFailed, stats.nWorkers, stats.flSeconds,
+			stats.flSeconds > 0 ? stats.numFiles / stats.flSeconds : 0, stats.numReads / flFiles,
+			(double)stats.nBytesRead / flFiles );
+}
+
+
+//--------------------------------------------------------------------------------------
+static HRESULT AddList( CStudioCatalog* pCatalog, const char* strFileName )
+{
+	HRESULT hr = S_OK;
+
+	FILE* pFile = fopen( strFileName, "r" );
+	if( pFile == NULL )
+		return E_FAIL;
+
+	char strLine[MAX_PATH];
+	while( SUCCEEDED( hr ) && fgets( strLine, MAX_PATH, pFile ) )
+	{
+		int nLength = (int)strlen( strLine );
+		while( nLength > 0 && ( strLine[nLength - 1] == '\n' || strLine[nLength - 1] == '\r' ) )
+			strLine[--nLength] = 0;
+		if( nLength > 0 )
+			hr = pCatalog->AddFile( strLine );
+	}
+	fclose( pFile );
+	return hr;
+}
+
+
+//--------------------------------------------------------------------------------------
+int main( int argc, char* argv[] )
+{
+	CStudioCatalog catalog;
+	const char* strIndex = NULL;
+	const char* strCSV = NULL;
+	int nWorkers = 0;
+	int numBenchScans = 0;
+	HRESULT hr = S_OK;
+
+	for( int i=1; i < argc && SUCCEEDED( hr ); i++ )
+	{
+		bool bValue = i + 1 < argc;
+		if( bValue && 0 == strcmp( argv[i], "-list" ) )
+		{
+			hr = AddList( &catalog, argv[++i] );
+			if( FAILED( hr ) )
+				printf( "Could not read %s\n", argv[i] );
+		}
+		else if( bValue && 0 == strcmp( argv[i], "-workers" ) )
+			nWorkers = atoi( argv[++i] );
+		else if( bValue && 0 == strcmp( argv[i], "-index" ) )
+			strIndex = argv[++i];
+		else if( bValue && 0 == strcmp( argv[i], "-csv" ) )
+			strCSV = argv[++i];
+		else if( bValue && 0 == strcmp( argv[i], "-bench" ) )
+			numBenchScans = atoi( argv[++i] );
+		else if( argv[i][0] != '-' )
+		{
+			int nLength = (int)strlen( argv[i] );
+			if( nLength > 4 && 0 == _stricmp( argv[i] + nLength - 4, ".mdl" ) )
+				hr = catalog.AddFile( argv[i] );
+			else
+				hr = catalog.AddDirectory( argv[i] );
+		}
+		else
+		{
+			PrintUsage();
+			return 1;
+		}
+	}
+	if( FAILED( hr ) )
+		return 1;
+	if( catalog.GetNumEntries() == 0 )
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	if( FAILED( catalog.Scan( nWorkers ) ) )
+	{
+		printf( "Scan failed\n" );
+		return 1;
+	}
+	PrintStats( "scan", catalog.GetStats() );
+
+	if( strIndex && FAILED( catalog.WriteIndex( strIndex ) ) )
+	{
+		printf( "Could not write %s\n", strIndex );
+		return 1;
+	}
+	if( strCSV && FAILED( catalog.WriteCSV( strCSV ) ) )
+	{
+		printf( "Could not write %s\n", strCSV );
+		return 1;
+	}
+
+	// Best of n scans at every worker count
+	int nMaxWorkers = Studio_GetNumWorkers();
+	for( int nBenchWorkers=1; numBenchScans > 0 && nBenchWorkers <= nMaxWorkers; )
+	{
+		StudioCatalogStats best;
+		ZeroMemory( &best, sizeof( best ) );
+		for( int i=0; i < numBenchScans; i++ )
+		{
+			if( FAILED( catalog.Scan( nBenchWorkers ) ) )
+			{
+				printf( "Scan failed\n" );
+				return 1;
+			}
+			if( i == 0 || catalog.GetStats().flSeconds < best.flSeconds )
+				best = catalog.GetStats();
+		}
+		PrintStats( "bench", best );
+
+		nBenchWorkers = ( nBenchWorkers < nMaxWorkers && nBenchWorkers * 2 > nMaxWorkers ) ? nMaxWorkers : nBenchWorkers * 2;
+	}
+
+	return 0;
+}
@@ -0,0 +1,185 @@
+//--------------------------------------------------------------------------------------
+// File: StudioShadowLOD.cpp
+//
+// Position-only shadow and depth stream.
+//
+//--------------------------------------------------------------------------------------
+#include "DXUT.h"
+#include "StudioShadowLOD.h"
+#include "mathlib.h"
+
+using namespace OptimizedModel;
+
+D3DVERTEXELEMENT9 SHADOW_VERTEX_DECL[] =
+{
+    { 0,  0, D3DDECLTYPE_FLOAT3, D3DDECLMETHOD_DEFAULT,  D3DDECLUSAGE_POSITION, 0},
+	D3DDECL_END()
+};
+
+D3DVERTEXELEMENT9 SHADOW_VERTEX16_DECL[] =
+{
+    { 0,  0, D3DDECLTYPE_SHORT4N, D3DDECLMETHOD_DEFAULT,  D3DDECLUSAGE_POSITION, 0},
+	D3DDECL_END()
+};
+
+
+//--------------------------------------------------------------------------------------
+CStudioShadowStream::CStudioShadowStream()
+{
+	m_vScale = Vector( 1, 1, 1 );
+	m_vOffset = Vector( 0, 0, 0 );
+	m_iLod = 0;
+	m_bShadowLOD = false;
+	m_bQuantize = false;
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT CStudioShadowStream::Init( const studiohdr_t* pStudioHdr, const FileHeader_t* pVtxHdr,
+								   const vertexFileHeader_t* pVvdHdr, bool bQuantize )
+{
+	HRESULT hr;
+
+	Destroy();
+
+	const ModelHeader_t* pModel = pVtxHdr->pBodyPart( 0 )->pModel( 0 );
+	const mstudiomodel_t* pStudioModel = pStudioHdr->pBodypart( 0 )->pModel( 0 );
+	m_iLod = pModel->numLODs - 1;
+	m_bShadowLOD = ( pStudioHdr->flags & STUDIOHDR_FLAGS_HASSHADOWLOD ) != 0;
+	m_bQuantize = bQuantize;
+
+	// Stream vertex of every .vvd vertex, -1 until a strip group uses it
+	CGrowableArray< int > streamVertex;
+	int numVvdVertices = pVvdHdr->numLODVertexes[0];
+	V_RETURN( streamVertex.SetSize( numVvdVertices ) );
+	for( int i=0; i < numVvdVertices; i++ )
+		streamVertex.Add( -1 );
+
+	const ModelLODHeader_t* pLod = pModel->pLOD( m_iLod );
+	for( int k=0; k < pStudioModel->nummeshes; k++ )
+	{
+		const MeshHeader_t* pMesh = pLod->pMesh( k );
+		const mstudiomesh_t* pStudioMesh = pStudioModel->pMesh( k );
+		for( int j=0; j < pMesh->numStripGroups; j++ )
+		{
+			const StripGroupHeader_t* pGroup = pMesh->pStripGroup( j );
+			for( int i=0; i < pGroup->numIndices; i++ )
+			{
+				int iVvd = pStudioMesh->vertexoffset + pGroup->pVertex( *pGroup->pIndex( i ) )->origMeshVertID;
+				if( iVvd < 0 || iVvd >= numVvdVertices )
+					return E_FAIL;
+				if( streamVertex[iVvd] < 0 )
+				{
+					if( m_VertexRemap.GetSize() > 0xFFFF )
+						return E_FAIL;
+					streamVertex[iVvd] = m_VertexRemap.GetSize();
+					V_RETURN( m_VertexRemap.Add( iVvd ) );
+					V_RETURN( m_Positions.Add( pVvdHdr->pVertex( iVvd )->m_vecPosition ) );
+				}
+				V_RETURN( m_Indices.Add( (WORD)streamVertex[iVvd] ) );
+			}
+		}
+	}
+
+	return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+void CStudioShadowStream::Destroy()
+{
+	m_VertexRemap.RemoveAll();
+	m_Positions.RemoveAll();
+	m_Indices.RemoveAll();
+	m_vScale = Vector( 1, 1, 1 );
+	m_vOffset = Vector( 0, 0, 0 );
+	m_iLod = 0;
+	m_bShadowLOD = false;
+	m_bQuantize = false;
+}
+
+
+//--------------------------------------------------------------------------------------
+const D3DVERTEXELEMENT9* CStudioShadowStream::GetDecl() const
+{
+	return m_bQuantize ? SHADOW_VERTEX16_DECL : SHADOW_VERTEX_DECL;
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT CStudioShadowStream::CreateBuffers( IDirect3DDevice9* pd3dDevice, IDirect3DVertexBuffer9** ppVB, IDirect3DIndexBuffer9** ppIB )
+{
+	HRESULT hr;
+
+	*ppVB = NULL;
+	*ppIB = NULL;
+	if( m_Indices.GetSize() == 0 )
+		return S_OK;
+
+	V_RETURN( pd3dDevice->CreateVertexBuffer( GetNumVertices() * GetVertexSize(), D3DUSAGE_WRITEONLY, 0, D3DPOOL_MANAGED, ppVB, NULL ) );
+	V_RETURN( pd3dDevice->CreateIndexBuffer( GetNumIndices() * sizeof( WORD ), D3DUSAGE_WRITEONLY, D3DFMT_INDEX16, D3DPOOL_MANAGED, ppIB, NULL ) );
+
+	void* pData;
+	V_RETURN( (*ppIB)->Lock( 0, 0, &pData, 0 ) );
+	memcpy( pData, m_Indices.GetData(), GetNumIndices() * sizeof( WORD ) );
+	(*ppIB)->Unlock();
+
+	return UpdatePositions( *ppVB, m_Positions.GetData() );
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT CStudioShadowStream::UpdatePositions( IDirect3DVertexBuffer9* pVB, const Vector* pPositions )
+{
+	HRESULT hr;
+
+	void* pData;
+	V_RETURN( pVB->Lock( 0, 0, &pData, 0 ) );
+	EncodePositions( pPositions, pData );
+	pVB->Unlock();
+
+	return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+void CStudioShadowStream::EncodePositions( const Vector* pPositions, void* pOut )
+{
+	int numVertices = GetNumVertices();
+	if( numVertices == 0 )
+		return;
+	if( !m_bQuantize )
+	{
+		memcpy( pOut, pPositions, numVertices * sizeof( Vector ) );
+		return;
+	}
+
+	Vector vMin = pPositions[0];
+	Vector vMax = pPositions[0];
+	for( int i=1; i < numVertices; i++ )
+	{
+		for( int j=0; j < 3; j++ )
+		{
+			if( pPositions[i][j] < vMin[j] ) vMin[j] = pPositions[i][j];
+			if( pPositions[i][j] > vMax[j] ) vMax[j] = pPositions[i][j];
+		}
+	}
+
+	// [-1,1] covers the box, a flat axis keeps a non-zero scale
+	m_vOffset = ( vMin + vMax ) * 0.5f;
+	m_vScale = ( vMax - vMin ) * 0.5f;
+	for( int j=0; j < 3; j++ )
+	{
+		if( m_vScale[j] <= 0.0f )
+			m_vScale[j] = 1.0f;
+	}
+
+	StudioShadowVertex16* pVertex = (StudioShadowVertex16*)pOut;
+	for( int i=0; i < numVertices; i++ )
+	{
+		pVertex[i].x = (short)floor( clamp( ( pPositions[i].x - m_vOffset.x ) / m_vScale.x, -1.0f, 1.0f ) * 32767.0f + 0.5f );
+		pVertex[i].y = (short)floor( clamp( ( pPositions[i].y - m_vOffset.y ) / m_vScale.y, -1.0f, 1.0f ) * 32767.0f + 0.5f );
+		pVertex[i].z = (short)floor( clamp( ( pPositions[i].z - m_vOffset.z ) / m_vScale.z, -1.0f, 1.0f ) * 32767.0f + 0.5f );
+		pVertex[i].w = 32767;
+	}
+}
@@ -0,0 +1,64 @@
+//--------------------------------------------------------------------------------------
+// File: StudioShadowLOD.h
+//
+// Position-only vertex stream for shadow and depth passes. It is built from the
+// dedicated shadow LOD when the model has one (STUDIOHDR_FLAGS_HASSHADOWLOD, always the
+// last LOD), otherwise from the coarsest LOD. All subsets are merged into a single draw
+// and vertices shared between strip groups are stored once.
+//
+// Quantized positions are SHORT4N relative to the stream bounds, the vertex shader
+// rebuilds them as position * GetDequantizeScale() + GetDequantizeOffset().
+//
+//--------------------------------------------------------------------------------------
+#pragma once
+#include "optimize.h"
+
+struct StudioShadowVertex16
+{
+	short x, y, z, w;
+};
+
+class CStudioShadowStream
+{
+public:
+	CStudioShadowStream();
+
+	HRESULT Init( const studiohdr_t* pStudioHdr, const OptimizedModel::FileHeader_t* pVtxHdr,
+				  const vertexFileHeader_t* pVvdHdr, bool bQuantize );
+	void    Destroy();
+
+	int     GetLOD() const { return m_iLod; }
+	bool    IsShadowLOD() const { return m_bShadowLOD; }
+	bool    IsQuantized() const { return m_bQuantize; }
+
+	int     GetNumVertices() const { return m_VertexRemap.GetSize(); }
+	int     GetNumIndices() const { return m_Indices.GetSize(); }
+	int     GetVertexSize() const { return m_bQuantize ? sizeof( StudioShadowVertex16 ) : sizeof( Vector ); }
+	const D3DVERTEXELEMENT9* GetDecl() const;
+
+	// .vvd vertex of every stream vertex, to skin the stream on the CPU
+	const int* GetVertexRemap() const { return m_VertexRemap.GetData(); }
+	const WORD* GetIndices() const { return m_Indices.GetData(); }
+
+	const Vector& GetDequantizeScale() const { return m_vScale; }
+	const Vector& GetDequantizeOffset() const { return m_vOffset; }
+
+	// Managed buffers holding the stream, released by the caller
+	HRESULT CreateBuffers( IDirect3DDevice9* pd3dDevice, IDirect3DVertexBuffer9** ppVB, IDirect3DIndexBuffer9** ppIB );
+
+	// Rewrites a vertex buffer from CPU skinned positions, one per stream vertex. A
+	// quantized stream refits its bounds to the new positions.
+	HRESULT UpdatePositions( IDirect3DVertexBuffer9* pVB, const Vector* pPositions );
+
+private:
+	void    EncodePositions( const Vector* pPositions, void* pOut );
+
+	CGrowableArray< int >    m_VertexRemap;
+	CGrowableArray< Vector > m_Positions;      // rest positions
+	CGrowableArray< WORD >   m_Indices;
+	Vector m_vScale;
+	Vector m_vOffset;
+	int    m_iLod;
+	bool   m_bShadowLOD;
+	bool   m_bQuantize;
+};
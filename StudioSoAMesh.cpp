@@ -0,0 +1,174 @@
+//--------------------------------------------------------------------------------------
+// File: StudioSoAMesh.cpp
+//
+// Structure-of-arrays vertex streams.
+//
+//--------------------------------------------------------------------------------------
+#include "DXUT.h"
+#include "StudioSoAMesh.h"
+#include <malloc.h>
+
+
+//--------------------------------------------------------------------------------------
+static HRESULT GrowStream( void** ppStream, int nElementSize, int numUsed, int nCapacity )
+{
+	void* pNew = _aligned_malloc( nCapacity * nElementSize, SOA_STREAM_ALIGNMENT );
+	if( pNew == NULL )
+		return E_OUTOFMEMORY;
+	if( *ppStream )
+	{
+		memcpy( pNew, *ppStream, numUsed * nElementSize );
+		_aligned_free( *ppStream );
+	}
+	*ppStream = pNew;
+	return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+StudioVertexView Studio_InterleavedView( const mstudiovertex_t* pVertices, const Vector4D* pTangents, int stride, int numVertices )
+{
+	StudioVertexView view;
+	view.pPosition = &pVertices->m_vecPosition;
+	view.pNormal = &pVertices->m_vecNormal;
+	view.pTexCoord = &pVertices->m_vecTexCoord;
+	view.pBoneWeights = &pVertices->m_BoneWeights;
+	view.pTangent = pTangents;
+	view.nPositionStride = stride;
+	view.nNormalStride = stride;
+	view.nTexCoordStride = stride;
+	view.nBoneWeightStride = stride;
+	view.nTangentStride = stride;
+	view.numVertices = numVertices;
+	return view;
+}
+
+
+//--------------------------------------------------------------------------------------
+CStudioSoAMesh::CStudioSoAMesh()
+{
+	m_pPositions = NULL;
+	m_pNormals = NULL;
+	m_pTexCoords = NULL;
+	m_pBoneWeights = NULL;
+	m_pTangents = NULL;
+	m_pSourceVertices = NULL;
+	m_numVertices = 0;
+	m_nCapacity = 0;
+	m_nGrows = 0;
+}
+
+
+//--------------------------------------------------------------------------------------
+CStudioSoAMesh::~CStudioSoAMesh()
+{
+	RemoveAll();
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT CStudioSoAMesh::Reserve( int numVertices )
+{
+	HRESULT hr;
+
+	if( numVertices <= m_nCapacity )
+		return S_OK;
+
+	V_RETURN( GrowStream( (void**)&m_pPositions, sizeof( Vector ), m_numVertices, numVertices ) );
+	V_RETURN( GrowStream( (void**)&m_pNormals, sizeof( Vector ), m_numVertices, numVertices ) );
+	V_RETURN( GrowStream( (void**)&m_pTexCoords, sizeof( Vector2D ), m_numVertices, numVertices ) );
+	V_RETURN( GrowStream( (void**)&m_pBoneWeights, sizeof( mstudioboneweight_t ), m_numVertices, numVertices ) );
+	V_RETURN( GrowStream( (void**)&m_pTangents, sizeof( Vector4D ), m_numVertices, numVertices ) );
+	V_RETURN( GrowStream( (void**)&m_pSourceVertices, sizeof( int ), m_numVertices, numVertices ) );
+	m_nCapacity = numVertices;
+	m_nGrows++;
+
+	return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT CStudioSoAMesh::Resize( int numVertices )
+{
+	HRESULT hr;
+
+	V_RETURN( Reserve( numVertices ) );
+	m_numVertices = numVertices;
+
+	return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT CStudioSoAMesh::Add( const mstudiovertex_t& vertex, const Vector4D& vecTangent, int iSourceVertex )
+{
+	HRESULT hr;
+
+	if( m_numVertices == m_nCapacity )
+		V_RETURN( Reserve( m_nCapacity ? m_nCapacity * 2 : 1024 ) );
+
+	m_pPositions[m_numVertices] = vertex.m_vecPosition;
+	m_pNormals[m_numVertices] = vertex.m_vecNormal;
+	m_pTexCoords[m_numVertices] = vertex.m_vecTexCoord;
+	m_pBoneWeights[m_numVertices] = vertex.m_BoneWeights;
+	m_pTangents[m_numVertices] = vecTangent;
+	m_pSourceVertices[m_numVertices] = iSourceVertex;
+	m_numVertices++;
+
+	return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+void CStudioSoAMesh::RemoveAll()
+{
+	if( m_pPositions ) _aligned_free( m_pPositions );
+	if( m_pNormals ) _aligned_free( m_pNormals );
+	if( m_pTexCoords ) _aligned_free( m_pTexCoords );
+	if( m_pBoneWeights ) _aligned_free( m_pBoneWeights );
+	if( m_pTangents ) _aligned_free( m_pTangents );
+	if( m_pSourceVertices ) _aligned_free( m_pSourceVertices );
+	m_pPositions = NULL;
+	m_pNormals = NULL;
+	m_pTexCoords = NULL;
+	m_pBoneWeights = NULL;
+	m_pTangents = NULL;
+	m_pSourceVertices = NULL;
+	m_numVertices = 0;
+	m_nCapacity = 0;
+	m_nGrows = 0;
+}
+
+
+//--------------------------------------------------------------------------------------
+StudioVertexView CStudioSoAMesh::GetView() const
+{
+	StudioVertexView view;
+	view.pPosition = m_pPositions;
+	view.pNormal = m_pNormals;
+	view.pTexCoord = m_pTexCoords;
+	view.pBoneWeights = m_pBoneWeights;
+	view.pTangent = m_pTangents;
+	view.nPositionStride = sizeof( Vector );
+	view.nNormalStride = sizeof( Vector );
+	view.nTexCoordStride = sizeof( Vector2D );
+	view.nBoneWeightStride = sizeof( mstudioboneweight_t );
+	view.nTangentStride = sizeof( Vector4D );
+	view.numVertices = m_numVertices;
+	return view;
+}
+
+
+//--------------------------------------------------------------------------------------
+void CStudioSoAMesh::Interleave( mstudiovertex_t* pVertices, Vector4D* pTangents, int stride ) const
+{
+	for( int i=0; i < m_numVertices; i++ )
+	{
+		mstudiovertex_t* pVertex = (mstudiovertex_t*)( (BYTE*)pVertices + i * stride );
+		pVertex->m_BoneWeights = m_pBoneWeights[i];
+		pVertex->m_vecPosition = m_pPositions[i];
+		pVertex->m_vecNormal = m_pNormals[i];
+		pVertex->m_vecTexCoord = m_pTexCoords[i];
+		*(Vector4D*)( (BYTE*)pTangents + i * stride ) = m_pTangents[i];
+	}
+}
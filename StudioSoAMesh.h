@@ -0,0 +1,88 @@
+//--------------------------------------------------------------------------------------
+// File: StudioSoAMesh.h
+//
+// Structure-of-arrays vertex storage for CPU side processing. Positions, normals,
+// texture coordinates, bone weights, tangents and .vvd indices each live in their own 32 byte
+// aligned stream, so a pass over one attribute does not drag the others through the
+// cache. Vertices are interleaved only when a vertex buffer is filled.
+//
+// StudioVertexView describes either layout with a pointer and a stride per attribute,
+// so code written against the view runs on the streams and on interleaved vertices
+// without copying either.
+//
+//--------------------------------------------------------------------------------------
+#pragma once
+#include "studio.h"
+
+#define SOA_STREAM_ALIGNMENT	32
+
+struct StudioVertexView
+{
+	const Vector*   pPosition;
+	const Vector*   pNormal;
+	const Vector2D* pTexCoord;
+	const mstudioboneweight_t* pBoneWeights;
+	const Vector4D* pTangent;   // may be NULL
+	int nPositionStride;
+	int nNormalStride;
+	int nTexCoordStride;
+	int nBoneWeightStride;
+	int nTangentStride;
+	int numVertices;
+
+	const Vector& Position( int i ) const { return *(const Vector*)( (const BYTE*)pPosition + i * nPositionStride ); }
+	const Vector& Normal( int i ) const { return *(const Vector*)( (const BYTE*)pNormal + i * nNormalStride ); }
+	const Vector2D& TexCoord( int i ) const { return *(const Vector2D*)( (const BYTE*)pTexCoord + i * nTexCoordStride ); }
+	const mstudioboneweight_t& BoneWeights( int i ) const { return *(const mstudioboneweight_t*)( (const BYTE*)pBoneWeights + i * nBoneWeightStride ); }
+	const Vector4D& Tangent( int i ) const { return *(const Vector4D*)( (const BYTE*)pTangent + i * nTangentStride ); }
+};
+
+// View over interleaved vertices, the tangent of vertex i is at pTangents + i * stride
+StudioVertexView Studio_InterleavedView( const mstudiovertex_t* pVertices, const Vector4D* pTangents, int stride, int numVertices );
+
+class CStudioSoAMesh
+{
+public:
+	CStudioSoAMesh();
+	~CStudioSoAMesh();
+
+	HRESULT Reserve( int numVertices );
+	// Sizes the streams to exactly numVertices, leaving the new vertices for the caller
+	// to write through the stream pointers
+	HRESULT Resize( int numVertices );
+	HRESULT Add( const mstudiovertex_t& vertex, const Vector4D& vecTangent, int iSourceVertex );
+	void    RemoveAll();
+
+	int     GetNumVertices() const { return m_numVertices; }
+	StudioVertexView GetView() const;
+
+	Vector*   GetPositions() { return m_pPositions; }
+	Vector*   GetNormals() { return m_pNormals; }
+	Vector2D* GetTexCoords() { return m_pTexCoords; }
+	mstudioboneweight_t* GetBoneWeights() { return m_pBoneWeights; }
+	Vector4D* GetTangents() { return m_pTangents; }
+	int*      GetSourceVertices() { return m_pSourceVertices; }   // index of each vertex in the .vvd
+
+	// Reserve calls that grew the streams since the last RemoveAll. Each one reallocates
+	// all six streams, other storage of the caller is not counted.
+	int     GetNumGrows() const { return m_nGrows; }
+
+	// Writes vertex i to pVertices + i * stride and its tangent to pTangents + i * stride,
+	// typically straight into a locked vertex buffer
+	void    Interleave( mstudiovertex_t* pVertices, Vector4D* pTangents, int stride ) const;
+
+private:
+	Vector*   m_pPositions;
+	Vector*   m_pNormals;
+	Vector2D* m_pTexCoords;
+	mstudioboneweight_t* m_pBoneWeights;
+	Vector4D* m_pTangents;
+	int*      m_pSourceVertices;
+	int m_numVertices;
+	int m_nCapacity;
+	int m_nGrows;
+
+	// The streams are owned, no copies
+	CStudioSoAMesh( const CStudioSoAMesh& );
+	CStudioSoAMesh& operator=( const CStudioSoAMesh& );
+};
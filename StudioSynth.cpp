@@ -0,0 +1,666 @@
+//--------------------------------------------------------------------------------------
+// File: StudioSynth.cpp
+//
+// Synthetic model files.
+//
+//--------------------------------------------------------------------------------------
+#include "DXUT.h"
+#include "StudioSynth.h"
+#include <fstream>
+
+using namespace std;
+using namespace OptimizedModel;
+
+#define SYNTH_SPACING       4.0f    // model units between grid points
+#define SYNTH_MESH_GAP      16.0f   // between neighbouring meshes along z
+#define SYNTH_AMPLITUDE     6.0f    // height of the rolling surface
+#define SYNTH_FREQUENCY     0.05f
+
+
+//--------------------------------------------------------------------------------------
+CStudioSynthFile::CStudioSynthFile()
+{
+	m_pData = NULL;
+	m_nSize = 0;
+	m_nCapacity = 0;
+}
+
+
+//--------------------------------------------------------------------------------------
+CStudioSynthFile::~CStudioSynthFile()
+{
+	Reset();
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT CStudioSynthFile::Alloc( int nBytes, int* pOffset, int nAlign )
+{
+	int offset = ( m_nSize + nAlign - 1 ) / nAlign * nAlign;
+	int nNewSize = offset + nBytes;
+	if( nNewSize > m_nCapacity )
+	{
+		int nCapacity = m_nCapacity ? m_nCapacity : 4096;
+		while( nCapacity < nNewSize )
+			nCapacity *= 2;
+		BYTE* pNew = (BYTE*)realloc( m_pData, nCapacity );
+		if( pNew == NULL )
+			return E_OUTOFMEMORY;
+		m_pData = pNew;
+		m_nCapacity = nCapacity;
+	}
+
+	ZeroMemory( m_pData + m_nSize, nNewSize - m_nSize );
+	m_nSize = nNewSize;
+	*pOffset = offset;
+	return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT CStudioSynthFile::AllocString( const char* str, int* pOffset )
+{
+	HRESULT hr;
+
+	int nLength = (int)strlen( str ) + 1;
+	V_RETURN( Alloc( nLength, pOffset, 1 ) );
+	memcpy( m_pData + *pOffset, str, nLength );
+	return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+void CStudioSynthFile::Reset()
+{
+	if( m_pData )
+		free( m_pData );
+	m_pData = NULL;
+	m_nSize = 0;
+	m_nCapacity = 0;
+}
+
+
+//--------------------------------------------------------------------------------------
+void Studio_DefaultSynthParams( StudioSynthParams* pParams )
+{
+	pParams->numBodyParts = 1;
+	pParams->numMeshes = 1;
+	pParams->numStripGroups = 1;
+	pParams->numVertices = 10000;
+	pParams->numLODs = 4;
+	pParams->numBones = 16;
+	pParams->numMaterials = 1;
+	pParams->bFixups = true;
+	pParams->bTangents = true;
+	pParams->checksum = 0x5EED;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Grid shared by every mesh. Points are numbered in mesh order: those kept by the
+// coarsest LOD first, those only LOD 0 draws last, so LOD n uses a prefix.
+//--------------------------------------------------------------------------------------
+struct SynthGrid
+{
+	int nCellsX;
+	int nCellsY;
+	int numLODs;
+	int numVertices;                        // per mesh
+	int numBlockVertices[MAX_NUM_LODS];     // points whose coarsest LOD is n
+	int iBlockStart[MAX_NUM_LODS];          // first mesh vertex of block n
+	CGrowableArray< int > pointLod;         // coarsest LOD that keeps each point
+	CGrowableArray< int > pointToVertex;    // mesh vertex of each point
+
+	int Point( int r, int c ) const { return r * ( nCellsX + 1 ) + c; }
+	int LODVertices( int iLod ) const { return iBlockStart[iLod] + numBlockVertices[iLod]; }
+};
+
+
+//--------------------------------------------------------------------------------------
+static int RoundUp( int n, int nMultiple )
+{
+	return ( n + nMultiple - 1 ) / nMultiple * nMultiple;
+}
+
+
+//--------------------------------------------------------------------------------------
+static HRESULT BuildGrid( const StudioSynthParams& params, SynthGrid* pGrid )
+{
+	HRESULT hr;
+
+	// Every LOD halves the grid, and every strip group band must survive the halving
+	int nUnit = 1 << ( params.numLODs - 1 );
+	int nSide = (int)sqrtf( (float)params.numVertices ) - 1;
+	pGrid->nCellsX = RoundUp( nSide > 1 ? nSide : 1, nUnit );
+	int nRows = params.numVertices / ( pGrid->nCellsX + 1 ) - 1;
+	pGrid->nCellsY = RoundUp( nRows > 1 ? nRows : 1, nUnit * params.numStripGroups );
+	pGrid->numLODs = params.numLODs;
+	pGrid->numVertices = ( pGrid->nCellsX + 1 ) * ( pGrid->nCellsY + 1 );
+	if( pGrid->numVertices > SYNTH_MAX_MESH_VERTICES )
+		return E_INVALIDARG;
+
+	V_RETURN( pGrid->pointLod.SetSize( pGrid->numVertices ) );
+	V_RETURN( pGrid->pointToVertex.SetSize( pGrid->numVertices ) );
+	ZeroMemory( pGrid->numBlockVertices, sizeof( pGrid->numBlockVertices ) );
+	for( int r=0; r <= pGrid->nCellsY; r++ )
+	{
+		for( int c=0; c <= pGrid->nCellsX; c++ )
+		{
+			int iLod = 0;
+			while( iLod + 1 < params.numLODs && r % ( 2 << iLod ) == 0 && c % ( 2 << iLod ) == 0 )
+				iLod++;
+			pGrid->pointLod.Add( iLod );
+			pGrid->pointToVertex.Add( 0 );
+			pGrid->numBlockVertices[iLod]++;
+		}
+	}
+
+	int iVertex = 0;
+	for( int iLod=params.numLODs - 1; iLod >= 0; iLod-- )
+	{
+		pGrid->iBlockStart[iLod] = iVertex;
+		for( int i=0; i < pGrid->numVertices; i++ )
+		{
+			if( pGrid->pointLod[i] == iLod )
+				pGrid->pointToVertex[i] = iVertex++;
+		}
+	}
+
+	return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Vertex of one grid point, on the height field of the mesh at zOffset
+//--------------------------------------------------------------------------------------
+static void MakeVertex( const StudioSynthParams& params, const SynthGrid& grid, int r, int c, float zOffset,
+						mstudiovertex_t* pVertex, Vector4D* pTangent )
+{
+	float x = c * SYNTH_SPACING;
+	float z = zOffset + r * SYNTH_SPACING;
+	float sx = sinf( x * SYNTH_FREQUENCY ), cx = cosf( x * SYNTH_FREQUENCY );
+	float sz = sinf( z * SYNTH_FREQUENCY ), cz = cosf( z * SYNTH_FREQUENCY );
+	float dydx = SYNTH_AMPLITUDE * SYNTH_FREQUENCY * cx * cz;
+	float dydz = -SYNTH_AMPLITUDE * SYNTH_FREQUENCY * sx * sz;
+
+	pVertex->m_vecPosition = Vector( x, SYNTH_AMPLITUDE * sx * cz, z );
+	Vector vNormal( -dydx, 1.0f, -dydz );
+	pVertex->m_vecNormal = vNormal / D3DXVec3Length( &vNormal );
+	pVertex->m_vecTexCoord = Vector2D( (float)c / grid.nCellsX, (float)r / grid.nCellsY );
+
+	// Texture u runs along x, v along z
+	Vector vTangent( 1.0f, dydx, 0.0f );
+	vTangent -= pVertex->m_vecNormal * D3DXVec3Dot( &pVertex->m_vecNormal, &vTangent );
+	vTangent *= 1.0f / D3DXVec3Length( &vTangent );
+	Vector vBinormal;
+	D3DXVec3Cross( &vBinormal, &pVertex->m_vecNormal, &vTangent );
+	*pTangent = Vector4D( vTangent.x, vTangent.y, vTangent.z, vBinormal.z < 0.0f ? -1.0f : 1.0f );
+
+	// Bones are spread evenly along x, blend the two around the vertex
+	mstudioboneweight_t& weights = pVertex->m_BoneWeights;
+	float flBone = ( params.numBones - 1 ) * (float)c / grid.nCellsX;
+	int iBone = (int)flBone;
+	if( iBone > params.numBones - 2 )
+		iBone = params.numBones - 2;
+	float flBlend = flBone - iBone;
+	if( params.numBones == 1 || flBlend < 1e-4f )
+	{
+		weights.weight[0] = 1.0f;
+		weights.bone[0] = (char)( iBone > 0 ? iBone : 0 );
+		weights.numbones = 1;
+	}
+	else
+	{
+		weights.weight[0] = 1.0f - flBlend;
+		weights.weight[1] = flBlend;
+		weights.bone[0] = (char)iBone;
+		weights.bone[1] = (char)( iBone + 1 );
+		weights.numbones = 2;
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+// Vertex data, LOD sorted with a fixup table when asked for
+//--------------------------------------------------------------------------------------
+static HRESULT WriteVvd( const StudioSynthParams& params, const SynthGrid& grid, StudioSynthModel* pModel )
+{
+	HRESULT hr;
+	CStudioSynthFile& file = pModel->vvd;
+
+	int numMeshes = params.numBodyParts * params.numMeshes;
+	int numVertices = numMeshes * grid.numVertices;
+	int numFixups = 0;
+	if( params.bFixups )
+	{
+		for( int iLod=0; iLod < params.numLODs; iLod++ )
+			numFixups += grid.numBlockVertices[iLod] ? numMeshes : 0;
+	}
+
+	int iHeader, iFixups, iVertices, iTangents = 0;
+	V_RETURN( file.Alloc( sizeof( vertexFileHeader_t ), &iHeader ) );
+	V_RETURN( file.Alloc( numFixups * sizeof( vertexFileFixup_t ), &iFixups ) );
+	V_RETURN( file.Alloc( numVertices * sizeof( mstudiovertex_t ), &iVertices, 16 ) );
+	if( params.bTangents )
+		V_RETURN( file.Alloc( numVertices * sizeof( Vector4D ), &iTangents, 16 ) );
+
+	vertexFileHeader_t* pHeader = file.Ptr< vertexFileHeader_t >( iHeader );
+	pHeader->id = MODEL_VERTEX_FILE_ID;
+	pHeader->version = MODEL_VERTEX_FILE_VERSION;
+	pHeader->checksum = params.checksum;
+	pHeader->numLODs = params.numLODs;
+	for( int iLod=0; iLod < params.numLODs; iLod++ )
+		pHeader->numLODVertexes[iLod] = numMeshes * grid.LODVertices( iLod );
+	pHeader->numFixups = numFixups;
+	pHeader->fixupTableStart = iFixups;
+	pHeader->vertexDataStart = iVertices;
+	pHeader->tangentDataStart = iTangents;
+
+	// Sorted, the vertices kept by the coarsest LOD come first for all meshes, and the
+	// fixups restore mesh order block by block
+	vertexFileFixup_t* pFixup = file.Ptr< vertexFileFixup_t >( iFixups );
+	for( int iMesh=0; iMesh < numMeshes && params.bFixups; iMesh++ )
+	{
+		for( int iLod=params.numLODs - 1; iLod >= 0; iLod-- )
+		{
+			if( grid.numBlockVertices[iLod] == 0 )
+				continue;
+			pFixup->lod = iLod;
+			pFixup->sourceVertexID = numMeshes * grid.iBlockStart[iLod] + iMesh * grid.numBlockVertices[iLod];
+			pFixup->numVertexes = grid.numBlockVertices[iLod];
+			pFixup++;
+		}
+	}
+
+	for( int iMesh=0; iMesh < numMeshes; iMesh++ )
+	{
+		float zOffset = iMesh * ( grid.nCellsY * SYNTH_SPACING + SYNTH_MESH_GAP );
+		for( int r=0; r <= grid.nCellsY; r++ )
+		{
+			for( int c=0; c <= grid.nCellsX; c++ )
+			{
+				int iPoint = grid.Point( r, c );
+				int iLod = grid.pointLod[iPoint];
+				int iVertex = grid.pointToVertex[iPoint];
+				int iStored = iMesh * grid.numVertices + iVertex;
+				if( params.bFixups )
+					iStored = numMeshes * grid.iBlockStart[iLod] + iMesh * grid.numBlockVertices[iLod] + iVertex - grid.iBlockStart[iLod];
+
+				Vector4D vecTangent;
+				MakeVertex( params, grid, r, c, zOffset, file.Ptr< mstudiovertex_t >( iVertices ) + iStored, &vecTangent );
+				if( params.bTangents )
+					file.Ptr< Vector4D >( iTangents )[iStored] = vecTangent;
+			}
+		}
+	}
+
+	pModel->numVertices = numVertices;
+	return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+// One strip group: the band of rows at LOD iLod as a triangle list, in a single strip
+// whose bone state changes map every used bone to the hardware slot of its index
+//--------------------------------------------------------------------------------------
+static HRESULT WriteStripGroup( const StudioSynthParams& params, const SynthGrid& grid, CStudioSynthFile& file,
+								int iGroup, int iLod, int iGroupHeader, int* pnTriangles )
+{
+	HRESULT hr;
+
+	int nStep = 1 << iLod;
+	int nBandRows = grid.nCellsY / params.numStripGroups;
+	int nColumns = grid.nCellsX / nStep + 1;
+	int nRows = nBandRows / nStep + 1;
+	int numVerts = nColumns * nRows;
+	int numIndices = ( nColumns - 1 ) * ( nRows - 1 ) * 6;
+
+	bool bUsed[MAXSTUDIOBONES] = { false };
+	int numBones = 0;
+	int iStrip, iVerts, iIndices, iChanges;
+	V_RETURN( file.Alloc( sizeof( StripHeader_t ), &iStrip ) );
+	V_RETURN( file.Alloc( numVerts * sizeof( Vertex_t ), &iVerts ) );
+	V_RETURN( file.Alloc( numIndices * sizeof( unsigned short ), &iIndices ) );
+
+	for( int r=0; r < nRows; r++ )
+	{
+		for( int c=0; c < nColumns; c++ )
+		{
+			int iPoint = grid.Point( iGroup * nBandRows + r * nStep, c * nStep );
+			mstudiovertex_t vertex;
+			Vector4D vecTangent;
+			ZeroMemory( &vertex, sizeof( vertex ) );
+			MakeVertex( params, grid, iGroup * nBandRows + r * nStep, c * nStep, 0.0f, &vertex, &vecTangent );
+
+			Vertex_t* pVertex = file.Ptr< Vertex_t >( iVerts ) + r * nColumns + c;
+			pVertex->numBones = vertex.m_BoneWeights.numbones;
+			pVertex->origMeshVertID = (short)grid.pointToVertex[iPoint];
+			for( int j=0; j < MAX_NUM_BONES_PER_VERT; j++ )
+			{
+				pVertex->boneWeightIndex[j] = (unsigned char)j;
+				pVertex->boneID[j] = j < vertex.m_BoneWeights.numbones ? vertex.m_BoneWeights.bone[j] : 0;
+				if( j < vertex.m_BoneWeights.numbones && !bUsed[vertex.m_BoneWeights.bone[j]] )
+				{
+					bUsed[vertex.m_BoneWeights.bone[j]] = true;
+					numBones++;
+				}
+			}
+		}
+	}
+
+	unsigned short* pIndex = file.Ptr< unsigned short >( iIndices );
+	for( int r=0; r < nRows - 1; r++ )
+	{
+		for( int c=0; c < nColumns - 1; c++ )
+		{
+			unsigned short i0 = (unsigned short)( r * nColumns + c );
+			unsigned short i1 = (unsigned short)( i0 + 1 );
+			unsigned short i2 = (unsigned short)( i0 + nColumns );
+			unsigned short i3 = (unsigned short)( i2 + 1 );
+			*pIndex++ = i0; *pIndex++ = i2; *pIndex++ = i1;
+			*pIndex++ = i1; *pIndex++ = i2; *pIndex++ = i3;
+		}
+	}
+
+	V_RETURN( file.Alloc( numBones * sizeof( BoneStateChangeHeader_t ), &iChanges ) );
+	BoneStateChangeHeader_t* pChange = file.Ptr< BoneStateChangeHeader_t >( iChanges );
+	for( int i=0; i < params.numBones; i++ )
+	{
+		if( !bUsed[i] )
+			continue;
+		pChange->hardwareID = i;
+		pChange->newBoneID = i;
+		pChange++;
+	}
+
+	StripHeader_t* pStrip = file.Ptr< StripHeader_t >( iStrip );
+	pStrip->numIndices = numIndices;
+	pStrip->indexOffset = 0;
+	pStrip->numVerts = numVerts;
+	pStrip->vertOffset = 0;
+	pStrip->numBones = (short)numBones;
+	pStrip->flags = STRIP_IS_TRILIST;
+	pStrip->numBoneStateChanges = numBones;
+	pStrip->boneStateChangeOffset = iChanges - iStrip;
+
+	StripGroupHeader_t* pGroup = file.Ptr< StripGroupHeader_t >( iGroupHeader );
+	pGroup->numVerts = numVerts;
+	pGroup->vertOffset = iVerts - iGroupHeader;
+	pGroup->numIndices = numIndices;
+	pGroup->indexOffset = iIndices - iGroupHeader;
+	pGroup->numStrips = 1;
+	pGroup->stripOffset = iStrip - iGroupHeader;
+	pGroup->flags = STRIPGROUP_IS_HWSKINNED;
+
+	*pnTriangles = numIndices / 3;
+	return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Strip groups of every LOD of every mesh
+//--------------------------------------------------------------------------------------
+static HRESULT WriteVtx( const StudioSynthParams& params, const SynthGrid& grid, StudioSynthModel* pModel )
+{
+	HRESULT hr;
+	CStudioSynthFile& file = pModel->vtx;
+
+	int iHeader, iBodyParts, iReplacements;
+	V_RETURN( file.Alloc( sizeof( FileHeader_t ), &iHeader ) );
+	V_RETURN( file.Alloc( params.numBodyParts * sizeof( BodyPartHeader_t ), &iBodyParts ) );
+	// The lists stay empty, no LOD replaces any material
+	V_RETURN( file.Alloc( params.numLODs * sizeof( MaterialReplacementListHeader_t ), &iReplacements ) );
+
+	FileHeader_t* pHeader = file.Ptr< FileHeader_t >( iHeader );
+	pHeader->version = OPTIMIZED_MODEL_FILE_VERSION;
+	pHeader->vertCacheSize = 24;
+	pHeader->maxBonesPerStrip = (unsigned short)params.numBones;
+	pHeader->maxBonesPerTri = MAX_NUM_BONES_PER_TRI;
+	pHeader->maxBonesPerVert = MAX_NUM_BONES_PER_VERT;
+	pHeader->checkSum = params.checksum;
+	pHeader->numLODs = params.numLODs;
+	pHeader->materialReplacementListOffset = iReplacements;
+	pHeader->numBodyParts = params.numBodyParts;
+	pHeader->bodyPartOffset = iBodyParts;
+
+	pModel->numTriangles = 0;
+	for( int b=0; b < params.numBodyParts; b++ )
+	{
+		int iBodyPart = iBodyParts + b * sizeof( BodyPartHeader_t );
+		int iModel, iLods;
+		V_RETURN( file.Alloc( sizeof( ModelHeader_t ), &iModel ) );
+		V_RETURN( file.Alloc( params.numLODs * sizeof( ModelLODHeader_t ), &iLods ) );
+		file.Ptr< BodyPartHeader_t >( iBodyPart )->numModels = 1;
+		file.Ptr< BodyPartHeader_t >( iBodyPart )->modelOffset = iModel - iBodyPart;
+		file.Ptr< ModelHeader_t >( iModel )->numLODs = params.numLODs;
+		file.Ptr< ModelHeader_t >( iModel )->lodOffset = iLods - iModel;
+
+		for( int iLod=0; iLod < params.numLODs; iLod++ )
+		{
+			int iLodHeader = iLods + iLod * sizeof( ModelLODHeader_t );
+			int iMeshes;
+			V_RETURN( file.Alloc( params.numMeshes * sizeof( MeshHeader_t ), &iMeshes ) );
+			ModelLODHeader_t* pLod = file.Ptr< ModelLODHeader_t >( iLodHeader );
+			pLod->numMeshes = params.numMeshes;
+			pLod->meshOffset = iMeshes - iLodHeader;
+			pLod->switchPoint = iLod * 20.0f;
+
+			for( int k=0; k < params.numMeshes; k++ )
+			{
+				int iMesh = iMeshes + k * sizeof( MeshHeader_t );
+				int iGroups;
+				V_RETURN( file.Alloc( params.numStripGroups * sizeof( StripGroupHeader_t ), &iGroups ) );
+				file.Ptr< MeshHeader_t >( iMesh )->numStripGroups = params.numStripGroups;
+				file.Ptr< MeshHeader_t >( iMesh )->stripGroupHeaderOffset = iGroups - iMesh;
+
+				for( int j=0; j < params.numStripGroups; j++ )
+				{
+					int nTriangles;
+					V_RETURN( WriteStripGroup( params, grid, file, j, iLod, iGroups + j * sizeof( StripGroupHeader_t ), &nTriangles ) );
+					if( iLod == 0 )
+						pModel->numTriangles += nTriangles;
+				}
+			}
+		}
+	}
+
+	return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Header, bone chain, materials, body parts, models and meshes
+//--------------------------------------------------------------------------------------
+static HRESULT WriteMdl( const StudioSynthParams& params, const SynthGrid& grid, StudioSynthModel* pModel )
+{
+	HRESULT hr;
+	CStudioSynthFile& file = pModel->mdl;
+	char str[MAX_PATH];
+
+	int iHeader, iBones, iTextures, iCdTextures, iSkins, iBodyParts, iBoneTable;
+	V_RETURN( file.Alloc( sizeof( studiohdr_t ), &iHeader ) );
+	V_RETURN( file.Alloc( params.numBones * sizeof( mstudiobone_t ), &iBones ) );
+	V_RETURN( file.Alloc( params.numMaterials * sizeof( mstudiotexture_t ), &iTextures ) );
+	V_RETURN( file.Alloc( sizeof( int ), &iCdTextures ) );
+	V_RETURN( file.Alloc( params.numMaterials * sizeof( short ), &iSkins ) );
+	V_RETURN( file.Alloc( params.numBodyParts * sizeof( mstudiobodyparts_t ), &iBodyParts ) );
+	V_RETURN( file.Alloc( params.numBones, &iBoneTable, 1 ) );
+
+	// Bones chain along x over the width of the grid, bone 0 at the origin
+	float flWidth = grid.nCellsX * SYNTH_SPACING;
+	float flLink = params.numBones > 1 ? flWidth / ( params.numBones - 1 ) : 0.0f;
+	int iEmpty;
+	V_RETURN( file.AllocString( "", &iEmpty ) );
+	for( int i=0; i < params.numBones; i++ )
+	{
+		int iBone = iBones + i * sizeof( mstudiobone_t );
+		int iName;
+		StringCchPrintfA( str, MAX_PATH, "bone%03d", i );
+		V_RETURN( file.AllocString( str, &iName ) );
+
+		mstudiobone_t* pBone = file.Ptr< mstudiobone_t >( iBone );
+		pBone->sznameindex = iName - iBone;
+		pBone->parent = i - 1;
+		for( int j=0; j < 6; j++ )
+			pBone->bonecontroller[j] = -1;
+		pBone->pos = Vector( i ? flLink : 0.0f, 0, 0 );
+		pBone->quat = Quaternion( 0, 0, 0, 1 );
+		pBone->rot = RadianEuler( 0, 0, 0 );
+		pBone->posscale = Vector( 1.0f / 32, 1.0f / 32, 1.0f / 32 );
+		pBone->rotscale = Vector( 1.0f / 4096, 1.0f / 4096, 1.0f / 4096 );
+		for( int r=0; r < 3; r++ )
+			pBone->poseToBone.m_flMatVal[r][r] = 1.0f;
+		pBone->poseToBone.m_flMatVal[0][3] = -i * flLink;
+		pBone->qAlignment = Quaternion( 0, 0, 0, 1 );
+		pBone->flags = BONE_USED_BY_ANYTHING;
+		pBone->surfacepropidx = iEmpty - iBone;
+
+		// Names sort in bone order
+		file.Ptr< BYTE >( iBoneTable )[i] = (BYTE)i;
+	}
+
+	for( int i=0; i < params.numMaterials; i++ )
+	{
+		int iTexture = iTextures + i * sizeof( mstudiotexture_t );
+		int iName;
+		StringCchPrintfA( str, MAX_PATH, "synth%d", i );
+		V_RETURN( file.AllocString( str, &iName ) );
+		file.Ptr< mstudiotexture_t >( iTexture )->sznameindex = iName - iTexture;
+		file.Ptr< short >( iSkins )[i] = (short)i;
+	}
+	int iCdTexture;
+	V_RETURN( file.AllocString( "models\\synth\\", &iCdTexture ) );
+	*file.Ptr< int >( iCdTextures ) = iCdTexture;
+
+	int numMeshes = params.numBodyParts * params.numMeshes;
+	float flMeshDepth = grid.nCellsY * SYNTH_SPACING;
+	Vector vMin( 0, -SYNTH_AMPLITUDE, 0 );
+	Vector vMax( flWidth, SYNTH_AMPLITUDE, numMeshes * ( flMeshDepth + SYNTH_MESH_GAP ) - SYNTH_MESH_GAP );
+	Vector vExtent = vMax - vMin;
+
+	for( int b=0; b < params.numBodyParts; b++ )
+	{
+		int iBodyPart = iBodyParts + b * sizeof( mstudiobodyparts_t );
+		int iName, iModel, iMeshes;
+		StringCchPrintfA( str, MAX_PATH, "body%d", b );
+		V_RETURN( file.AllocString( str, &iName ) );
+		V_RETURN( file.Alloc( sizeof( mstudiomodel_t ), &iModel ) );
+		V_RETURN( file.Alloc( params.numMeshes * sizeof( mstudiomesh_t ), &iMeshes ) );
+
+		mstudiobodyparts_t* pBodyPart = file.Ptr< mstudiobodyparts_t >( iBodyPart );
+		pBodyPart->sznameindex = iName - iBodyPart;
+		pBodyPart->nummodels = 1;
+		pBodyPart->base = 1;
+		pBodyPart->modelindex = iModel - iBodyPart;
+
+		// Models follow each other in the vertex data
+		int iFirstVertex = b * params.numMeshes * grid.numVertices;
+		mstudiomodel_t* pStudioModel = file.Ptr< mstudiomodel_t >( iModel );
+		StringCchPrintfA( pStudioModel->name, sizeof( pStudioModel->name ), "body%d.smd", b );
+		pStudioModel->boundingradius = D3DXVec3Length( &vExtent ) * 0.5f;
+		pStudioModel->nummeshes = params.numMeshes;
+		pStudioModel->meshindex = iMeshes - iModel;
+		pStudioModel->numvertices = params.numMeshes * grid.numVertices;
+		pStudioModel->vertexindex = iFirstVertex * sizeof( mstudiovertex_t );
+		pStudioModel->tangentsindex = iFirstVertex * sizeof( Vector4D );
+
+		for( int k=0; k < params.numMeshes; k++ )
+		{
+			int iMesh = iMeshes + k * sizeof( mstudiomesh_t );
+			mstudiomesh_t* pMesh = file.Ptr< mstudiomesh_t >( iMesh );
+			pMesh->material = ( b * params.numMeshes + k ) % params.numMaterials;
+			pMesh->modelindex = iModel - iMesh;
+			pMesh->numvertices = grid.numVertices;
+			pMesh->vertexoffset = k * grid.numVertices;
+			pMesh->meshid = k;
+			float zCenter = ( b * params.numMeshes + k ) * ( flMeshDepth + SYNTH_MESH_GAP ) + flMeshDepth * 0.5f;
+			pMesh->center = Vector( flWidth * 0.5f, 0, zCenter );
+			for( int iLod=0; iLod < params.numLODs; iLod++ )
+				pMesh->vertexdata.numLODVertexes[iLod] = grid.LODVertices( iLod );
+		}
+	}
+
+	studiohdr_t* pHeader = file.Ptr< studiohdr_t >( iHeader );
+	pHeader->id = IDSTUDIOHEADER;
+	pHeader->version = STUDIO_VERSION;
+	pHeader->checksum = params.checksum;
+	StringCchCopyA( pHeader->name, sizeof( pHeader->name ), "synth/synth.mdl" );
+	pHeader->length = file.GetSize();
+	pHeader->eyeposition = Vector( 0, 0, 0 );
+	pHeader->illumposition = ( vMin + vMax ) * 0.5f;
+	pHeader->hull_min = vMin;
+	pHeader->hull_max = vMax;
+	pHeader->view_bbmin = vMin;
+	pHeader->view_bbmax = vMax;
+	pHeader->numbones = params.numBones;
+	pHeader->boneindex = iBones;
+	pHeader->numtextures = params.numMaterials;
+	pHeader->textureindex = iTextures;
+	pHeader->numcdtextures = 1;
+	pHeader->cdtextureindex = iCdTextures;
+	pHeader->numskinref = params.numMaterials;
+	pHeader->numskinfamilies = 1;
+	pHeader->skinindex = iSkins;
+	pHeader->numbodyparts = params.numBodyParts;
+	pHeader->bodypartindex = iBodyParts;
+	pHeader->surfacepropindex = iEmpty;
+	pHeader->mass = 1.0f;
+	pHeader->bonetablebynameindex = iBoneTable;
+
+	return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT Studio_SynthesizeModel( const StudioSynthParams& params, StudioSynthModel* pModel )
+{
+	HRESULT hr;
+
+	if( params.numBodyParts < 1 || params.numMeshes < 1 || params.numStripGroups < 1 || params.numVertices < 4 ||
+		params.numLODs < 1 || params.numLODs > MAX_NUM_LODS || params.numBones < 1 || params.numBones > MAXSTUDIOBONES ||
+		params.numMaterials < 1 )
+		return E_INVALIDARG;
+
+	pModel->mdl.Reset();
+	pModel->vvd.Reset();
+	pModel->vtx.Reset();
+
+	SynthGrid grid;
+	V_RETURN( BuildGrid( params, &grid ) );
+	pModel->nGridX = grid.nCellsX;
+	pModel->nGridY = grid.nCellsY;
+
+	V_RETURN( WriteMdl( params, grid, pModel ) );
+	V_RETURN( WriteVvd( params, grid, pModel ) );
+	V_RETURN( WriteVtx( params, grid, pModel ) );
+
+	return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+static HRESULT WriteFile( CStudioSynthFile& file, const char* strBaseName, const char* strExtension )
+{
+	char strPath[MAX_PATH];
+	StringCchCopyA( strPath, MAX_PATH, strBaseName );
+	StringCchCatA( strPath, MAX_PATH, strExtension );
+
+	ofstream out( strPath, ios::binary );
+	if( !out )
+		return E_FAIL;
+	out.write( (const char*)file.GetData(), file.GetSize() );
+	return out ? S_OK : E_FAIL;
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT Studio_WriteSynthModel( StudioSynthModel* pModel, const char* strBaseName )
+{
+	HRESULT hr;
+
+	V_RETURN( WriteFile( pModel->mdl, strBaseName, ".mdl" ) );
+	V_RETURN( WriteFile( pModel->vvd, strBaseName, ".vvd" ) );
+	V_RETURN( WriteFile( pModel->vtx, strBaseName, ".dx90.vtx" ) );
+
+	return S_OK;
+}
@@ -0,0 +1,78 @@
+//--------------------------------------------------------------------------------------
+// File: StudioSynth.h
+//
+// Synthetic .mdl, .vvd and .dx90.vtx triples of any size, for measuring the loader on
+// models far larger than the sample. Every mesh is a rolling height field gridded so
+// that LOD n keeps every 2^n-th row and column, cut into bands of rows that become its
+// strip groups. Bones form a chain along x and each vertex blends the two nearest.
+// The files carry matching checksums and load like studiomdl output, but hold no
+// sequences, so the model stays in its bind pose.
+//
+// The .vvd can be stored LOD sorted with a fixup table, the layout studiomdl writes
+// for models with LODs, so loading it runs Studio_LoadVertexes.
+//
+// Limits of the formats: Vertex_t::origMeshVertID is a short, so a mesh holds at most
+// 32767 vertices, and larger models take more meshes or body parts. The loader itself
+// draws with 16 bit indices and only uses the first body part.
+//
+//--------------------------------------------------------------------------------------
+#pragma once
+#include "optimize.h"
+
+#define SYNTH_MAX_MESH_VERTICES	32767
+
+struct StudioSynthParams
+{
+	int  numBodyParts;      // one model each
+	int  numMeshes;         // per model
+	int  numStripGroups;    // per mesh, bands of grid rows
+	int  numVertices;       // per mesh at LOD 0, rounded to the LOD grid
+	int  numLODs;           // 1..MAX_NUM_LODS
+	int  numBones;          // 1..MAXSTUDIOBONES
+	int  numMaterials;      // meshes cycle through them
+	bool bFixups;           // LOD sorted .vvd with a fixup table
+	bool bTangents;         // write the tangent block
+	long checksum;          // shared by the three files
+};
+
+// One file image, grown as structures are placed and filled through their offsets
+class CStudioSynthFile
+{
+public:
+	CStudioSynthFile();
+	~CStudioSynthFile();
+
+	// Appends nBytes of zeroes at an nAlign boundary
+	HRESULT Alloc( int nBytes, int* pOffset, int nAlign = 4 );
+	HRESULT AllocString( const char* str, int* pOffset );
+	void    Reset();
+
+	template< class T > T* Ptr( int offset ) { return (T*)( m_pData + offset ); }
+	BYTE*   GetData() { return m_pData; }
+	int     GetSize() const { return m_nSize; }
+
+private:
+	BYTE* m_pData;
+	int   m_nSize;
+	int   m_nCapacity;
+
+	CStudioSynthFile( const CStudioSynthFile& );
+	CStudioSynthFile& operator=( const CStudioSynthFile& );
+};
+
+struct StudioSynthModel
+{
+	CStudioSynthFile mdl;
+	CStudioSynthFile vvd;
+	CStudioSynthFile vtx;
+	int numVertices;        // LOD 0 vertices of all meshes
+	int numTriangles;       // LOD 0 triangles of all strip groups
+	int nGridX;             // grid cells of every mesh
+	int nGridY;
+};
+
+void    Studio_DefaultSynthParams( StudioSynthParams* pParams );
+HRESULT Studio_SynthesizeModel( const StudioSynthParams& params, StudioSynthModel* pModel );
+
+// Writes strBaseName.mdl, .vvd and .dx90.vtx, the names CMeshLoader::Create expects
+HRESULT Studio_WriteSynthModel( StudioSynthModel* pModel, const char* strBaseName );
@@ -0,0 +1,185 @@
+//--------------------------------------------------------------------------------------
+// File: StudioTangents.cpp
+//
+// Parallel tangent frame generation.
+//
+//--------------------------------------------------------------------------------------
+#include "DXUT.h"
+#include "StudioTangents.h"
+#include "StudioThreads.h"
+#include "mathlib.h"
+
+// Smallest mesh that is worth spreading over several threads
+#define TANGENT_MIN_TRIANGLES_PER_WORKER	1024
+
+struct TangentJob
+{
+	StudioVertexView vertices;
+	const unsigned short* pIndices;
+	int numTriangles;
+	Vector4D* pTangents;
+	Vector* pTan[STUDIO_MAX_WORKERS];       // per worker sums of the tangent directions
+	Vector* pBitan[STUDIO_MAX_WORKERS];     // and of the bitangent directions
+	int nWorkers;
+};
+
+
+//--------------------------------------------------------------------------------------
+// Component of v perpendicular to the unit vector n
+//--------------------------------------------------------------------------------------
+static inline Vector Orthogonalize( const Vector& v, const Vector& n )
+{
+	return v - n * D3DXVec3Dot( &n, &v );
+}
+
+
+//--------------------------------------------------------------------------------------
+static inline float NormalizeInPlace( Vector& v )
+{
+	float flLength = D3DXVec3Length( &v );
+	if( flLength > 1e-20f )
+		v *= 1.0f / flLength;
+	return flLength;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Adds the contributions of one range of triangles to this worker's arrays
+//--------------------------------------------------------------------------------------
+static void AccumulateTask( int iTask, int nTasks, void* pContext )
+{
+	TangentJob* pJob = (TangentJob*)pContext;
+	const StudioVertexView& vertices = pJob->vertices;
+	Vector* pTan = pJob->pTan[iTask];
+	Vector* pBitan = pJob->pBitan[iTask];
+
+	ZeroMemory( pTan, vertices.numVertices * sizeof( Vector ) );
+	ZeroMemory( pBitan, vertices.numVertices * sizeof( Vector ) );
+
+	int iFirst = pJob->numTriangles * iTask / nTasks;
+	int iLast = pJob->numTriangles * ( iTask + 1 ) / nTasks;
+	for( int t=iFirst; t < iLast; t++ )
+	{
+		const unsigned short* pTri = pJob->pIndices + t * 3;
+		if( pTri[0] >= vertices.numVertices || pTri[1] >= vertices.numVertices || pTri[2] >= vertices.numVertices )
+			continue;
+
+		const Vector& p0 = vertices.Position( pTri[0] );
+		const Vector2D& uv0 = vertices.TexCoord( pTri[0] );
+		Vector e1 = vertices.Position( pTri[1] ) - p0;
+		Vector e2 = vertices.Position( pTri[2] ) - p0;
+		Vector2D d1 = vertices.TexCoord( pTri[1] ) - uv0;
+		Vector2D d2 = vertices.TexCoord( pTri[2] ) - uv0;
+
+		// Triangles without a texture mapping have no texture space to contribute
+		float flDet = d1.x * d2.y - d2.x * d1.y;
+		if( fabsf( flDet ) < 1e-12f )
+			continue;
+
+		// Texture space directions of the triangle, scaled so that the orientation
+		// carries the sign of the mapping
+		float flSign = flDet < 0.0f ? -1.0f : 1.0f;
+		Vector vTan = ( e1 * d2.y - e2 * d1.y ) * flSign;
+		Vector vBitan = ( e2 * d1.x - e1 * d2.x ) * flSign;
+
+		for( int c=0; c < 3; c++ )
+		{
+			int v = pTri[c];
+			const Vector& p = vertices.Position( v );
+			Vector a = vertices.Position( pTri[( c + 1 ) % 3] ) - p;
+			Vector b = vertices.Position( pTri[( c + 2 ) % 3] ) - p;
+			if( NormalizeInPlace( a ) == 0.0f || NormalizeInPlace( b ) == 0.0f )
+				continue;
+			float flAngle = acosf( clamp( D3DXVec3Dot( &a, &b ), -1.0f, 1.0f ) );
+
+			const Vector& n = vertices.Normal( v );
+			Vector t = Orthogonalize( vTan, n );
+			Vector s = Orthogonalize( vBitan, n );
+			NormalizeInPlace( t );
+			NormalizeInPlace( s );
+			pTan[v] += t * flAngle;
+			pBitan[v] += s * flAngle;
+		}
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+// Sums the worker arrays for one range of vertices and writes the final frames
+//--------------------------------------------------------------------------------------
+static void MergeTask( int iTask, int nTasks, void* pContext )
+{
+	TangentJob* pJob = (TangentJob*)pContext;
+	const StudioVertexView& vertices = pJob->vertices;
+
+	int iFirst = vertices.numVertices * iTask / nTasks;
+	int iLast = vertices.numVertices * ( iTask + 1 ) / nTasks;
+	for( int v=iFirst; v < iLast; v++ )
+	{
+		Vector vTan = pJob->pTan[0][v];
+		Vector vBitan = pJob->pBitan[0][v];
+		for( int w=1; w < pJob->nWorkers; w++ )
+		{
+			vTan += pJob->pTan[w][v];
+			vBitan += pJob->pBitan[w][v];
+		}
+
+		const Vector& n = vertices.Normal( v );
+		Vector t = Orthogonalize( vTan, n );
+		if( NormalizeInPlace( t ) < 1e-6f )
+		{
+			// No usable contributions, any direction in the normal's plane will do
+			Vector vAxis = fabsf( n.x ) < 0.9f ? Vector( 1, 0, 0 ) : Vector( 0, 1, 0 );
+			t = Orthogonalize( vAxis, n );
+			NormalizeInPlace( t );
+		}
+
+		Vector vCross;
+		D3DXVec3Cross( &vCross, &n, &t );
+		float flSign = D3DXVec3Dot( &vCross, &vBitan ) < 0.0f ? -1.0f : 1.0f;
+		pJob->pTangents[v] = Vector4D( t.x, t.y, t.z, flSign );
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT Studio_GenerateTangents( const StudioVertexView& vertices, const unsigned short* pIndices, int numIndices,
+								 Vector4D* pTangents, int nWorkers )
+{
+	if( vertices.numVertices == 0 )
+		return S_OK;
+
+	TangentJob job;
+	job.vertices = vertices;
+	job.pIndices = pIndices;
+	job.numTriangles = numIndices / 3;
+	job.pTangents = pTangents;
+
+	if( nWorkers <= 0 )
+		nWorkers = Studio_GetNumWorkers();
+	int nUseful = job.numTriangles / TANGENT_MIN_TRIANGLES_PER_WORKER;
+	if( nWorkers > nUseful )
+		nWorkers = nUseful;
+	if( nWorkers < 1 )
+		nWorkers = 1;
+	if( nWorkers > STUDIO_MAX_WORKERS )
+		nWorkers = STUDIO_MAX_WORKERS;
+	job.nWorkers = nWorkers;
+
+	// One block holds every worker's arrays
+	int numVertices = vertices.numVertices;
+	Vector* pSums = new Vector[numVertices * 2 * nWorkers];
+	if( pSums == NULL )
+		return E_OUTOFMEMORY;
+	for( int w=0; w < nWorkers; w++ )
+	{
+		job.pTan[w] = pSums + numVertices * 2 * w;
+		job.pBitan[w] = job.pTan[w] + numVertices;
+	}
+
+	Studio_RunTasks( nWorkers, AccumulateTask, &job );
+	Studio_RunTasks( nWorkers, MergeTask, &job );
+
+	delete[] pSums;
+	return S_OK;
+}
@@ -0,0 +1,20 @@
+//--------------------------------------------------------------------------------------
+// File: StudioTangents.h
+//
+// Per-vertex tangent frames for models whose VVD has no tangent data. Follows the
+// MikkTSpace weighting: every triangle corner contributes its texture space direction
+// projected onto the vertex normal and weighted by the corner angle, and the sums are
+// orthogonalized against the normal. Vertices are not split, the loader's vertices are
+// already unique per strip group.
+//
+// Triangles are divided among worker threads that each accumulate into their own
+// arrays, a second pass merges them per vertex range, so no atomics are needed.
+//
+//--------------------------------------------------------------------------------------
+#pragma once
+#include "StudioSoAMesh.h"
+
+// Writes one tangent per vertex of the view, w is the sign for binormal = cross(n, t) * w.
+// nWorkers of 0 picks one per processor.
+HRESULT Studio_GenerateTangents( const StudioVertexView& vertices, const unsigned short* pIndices, int numIndices,
+								 Vector4D* pTangents, int nWorkers = 0 );
@@ -0,0 +1,72 @@
+//--------------------------------------------------------------------------------------
+// File: StudioThreads.cpp
+//
+// Fork-join helper built on _beginthreadex.
+//
+//--------------------------------------------------------------------------------------
+#include "DXUT.h"
+#include "StudioThreads.h"
+#include <process.h>
+
+struct StudioTaskArgs
+{
+	StudioTaskFn pfnTask;
+	void* pContext;
+	int   iTask;
+	int   nTasks;
+};
+
+
+//--------------------------------------------------------------------------------------
+static unsigned WINAPI StudioTaskThread( void* pArgs )
+{
+	StudioTaskArgs* pTask = (StudioTaskArgs*)pArgs;
+	pTask->pfnTask( pTask->iTask, pTask->nTasks, pTask->pContext );
+	return 0;
+}
+
+
+//--------------------------------------------------------------------------------------
+int Studio_GetNumWorkers()
+{
+	SYSTEM_INFO info;
+	GetSystemInfo( &info );
+	int nWorkers = (int)info.dwNumberOfProcessors;
+	if( nWorkers < 1 )
+		nWorkers = 1;
+	if( nWorkers > STUDIO_MAX_WORKERS )
+		nWorkers = STUDIO_MAX_WORKERS;
+	return nWorkers;
+}
+
+
+//--------------------------------------------------------------------------------------
+void Studio_RunTasks( int nTasks, StudioTaskFn pfnTask, void* pContext )
+{
+	if( nTasks > STUDIO_MAX_WORKERS )
+		nTasks = STUDIO_MAX_WORKERS;
+
+	StudioTaskArgs args[STUDIO_MAX_WORKERS];
+	HANDLE hThreads[STUDIO_MAX_WORKERS];
+	int nThreads = 0;
+	for( int i=1; i < nTasks; i++ )
+	{
+		args[i].pfnTask = pfnTask;
+		args[i].pContext = pContext;
+		args[i].iTask = i;
+		args[i].nTasks = nTasks;
+		HANDLE hThread = (HANDLE)_beginthreadex( NULL, 0, StudioTaskThread, &args[i], 0, NULL );
+		if( hThread )
+			hThreads[nThreads++] = hThread;
+		else
+			pfnTask( i, nTasks, pContext );
+	}
+
+	if( nTasks > 0 )
+		pfnTask( 0, nTasks, pContext );
+
+	if( nThreads )
+		WaitForMultipleObjects( nThreads, hThreads, TRUE, INFINITE );
+	for( int i=0; i < nThreads; i++ )
+		CloseHandle( hThreads[i] );
+}
@@ -0,0 +1,20 @@
+//--------------------------------------------------------------------------------------
+// File: StudioThreads.h
+//
+// Minimal fork-join helper for the load time passes that split their work into a fixed
+// number of independent tasks.
+//
+//--------------------------------------------------------------------------------------
+#pragma once
+
+#define STUDIO_MAX_WORKERS	16
+
+typedef void (*StudioTaskFn)( int iTask, int nTasks, void* pContext );
+
+// Processor count, clamped to 1..STUDIO_MAX_WORKERS
+int     Studio_GetNumWorkers();
+
+// Runs pfnTask once for every task index, each on its own thread with the calling
+// thread taking task 0, and returns when all of them are done. nTasks is clamped to
+// STUDIO_MAX_WORKERS. Tasks that fail to get a thread run on the calling thread.
+void    Studio_RunTasks( int nTasks, StudioTaskFn pfnTask, void* pContext );
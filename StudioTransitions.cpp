@@ -0,0 +1,214 @@
+//--------------------------------------------------------------------------------------
+// File: StudioTransitions.cpp
+//
+// Sequence transition routing for studio models.
+//
+//--------------------------------------------------------------------------------------
+#include "DXUT.h"
+#include "StudioTransitions.h"
+
+
+//--------------------------------------------------------------------------------------
+// Breadth-first search from every node over the sequence edges. The first edge taken
+// out of the source is carried along, which gives the next hop for every reachable
+// goal. Edges are visited in sequence order, forward before reverse, so ties go to
+// the lowest sequence index.
+//--------------------------------------------------------------------------------------
+HRESULT CStudioTransitionGraph::Init( const studiohdr_t* pStudioHdr )
+{
+	HRESULT hr;
+
+	Destroy();
+
+	// Routing is optional, a graph too large to tabulate just isn't routed
+	m_pStudioHdr = pStudioHdr;
+	m_nNodes = pStudioHdr->numlocalnodes;
+	if( m_nNodes <= 0 || m_nNodes > TRANSITION_MAX_NODES )
+	{
+		m_nNodes = 0;
+		return S_OK;
+	}
+
+	int numSeq = pStudioHdr->GetNumSeq();
+
+	// Edges grouped by source node
+	CGrowableArray< int > edgeStart;
+	CGrowableArray< Edge > edges;
+	V_RETURN( edgeStart.SetSize( m_nNodes + 1 ) );
+	for( int i=0; i <= m_nNodes; i++ )
+		edgeStart.Add( 0 );
+
+	for( int pass=0; pass < 2; pass++ )
+	{
+		for( int i=0; i < numSeq; i++ )
+		{
+			const mstudioseqdesc_t& seqdesc = pStudioHdr->pSeqdesc( i );
+			int iEntry = seqdesc.localentrynode - 1;
+			int iExit = seqdesc.localexitnode - 1;
+			if( iEntry < 0 || iExit < 0 || iEntry >= m_nNodes || iExit >= m_nNodes || iEntry == iExit )
+				continue;
+
+			if( pass == 0 )
+			{
+				edgeStart[iEntry + 1]++;
+				if( seqdesc.nodeflags )
+					edgeStart[iExit + 1]++;
+				continue;
+			}
+
+			Edge edge;
+			edge.iTo = iExit;
+			edge.dwSequence = (DWORD)i;
+			edges[edgeStart[iEntry]++] = edge;
+			if( seqdesc.nodeflags )
+			{
+				edge.iTo = iEntry;
+				edge.dwSequence = (DWORD)i | TRANSITION_REVERSE;
+				edges[edgeStart[iExit]++] = edge;
+			}
+		}
+
+		if( pass == 0 )
+		{
+			for( int i=0; i < m_nNodes; i++ )
+				edgeStart[i + 1] += edgeStart[i];
+
+			Edge empty = { 0, 0 };
+			V_RETURN( edges.SetSize( edgeStart[m_nNodes] ) );
+			for( int i=0; i < edgeStart[m_nNodes]; i++ )
+				edges.Add( empty );
+		}
+	}
+
+	// The fill pass moved every start to the next node's start, shift them back
+	for( int i=m_nNodes; i > 0; i-- )
+		edgeStart[i] = edgeStart[i - 1];
+	edgeStart[0] = 0;
+
+	int nPairs = m_nNodes * m_nNodes;
+	V_RETURN( m_NextSequence.SetSize( nPairs ) );
+	V_RETURN( m_Hops.SetSize( nPairs ) );
+	V_RETURN( m_NextNode.SetSize( nPairs ) );
+	for( int i=0; i < nPairs; i++ )
+	{
+		m_NextSequence.Add( TRANSITION_NONE );
+		m_Hops.Add( TRANSITION_UNREACHABLE );
+		m_NextNode.Add( 0 );
+	}
+
+	CGrowableArray< int > queue;
+	V_RETURN( queue.SetSize( m_nNodes ) );
+	for( int i=0; i < m_nNodes; i++ )
+		queue.Add( 0 );
+
+	for( int iSource=0; iSource < m_nNodes; iSource++ )
+	{
+		DWORD* pNext = &m_NextSequence[iSource * m_nNodes];
+		WORD* pHops = &m_Hops[iSource * m_nNodes];
+		WORD* pNode = &m_NextNode[iSource * m_nNodes];
+
+		pHops[iSource] = 0;
+		int iHead = 0;
+		int iTail = 0;
+		queue[iTail++] = iSource;
+		while( iHead < iTail )
+		{
+			int iNode = queue[iHead++];
+			for( int e=edgeStart[iNode]; e < edgeStart[iNode + 1]; e++ )
+			{
+				int iTo = edges[e].iTo;
+				if( pHops[iTo] != TRANSITION_UNREACHABLE )
+					continue;
+
+				pHops[iTo] = (WORD)( pHops[iNode] + 1 );
+				if( iNode == iSource )
+				{
+					pNext[iTo] = edges[e].dwSequence;
+					pNode[iTo] = (WORD)iTo;
+				}
+				else
+				{
+					pNext[iTo] = pNext[iNode];
+					pNode[iTo] = pNode[iNode];
+				}
+				queue[iTail++] = iTo;
+			}
+		}
+	}
+
+	return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+void CStudioTransitionGraph::Destroy()
+{
+	m_pStudioHdr = NULL;
+	m_nNodes = 0;
+	m_NextSequence.RemoveAll();
+	m_Hops.RemoveAll();
+	m_NextNode.RemoveAll();
+}
+
+
+//--------------------------------------------------------------------------------------
+int CStudioTransitionGraph::PairIndex( int iFromNode, int iGoalNode ) const
+{
+	if( iFromNode < 1 || iFromNode > m_nNodes || iGoalNode < 1 || iGoalNode > m_nNodes )
+		return -1;
+	return ( iFromNode - 1 ) * m_nNodes + ( iGoalNode - 1 );
+}
+
+
+//--------------------------------------------------------------------------------------
+int CStudioTransitionGraph::GetNextSequence( int iFromNode, int iGoalNode, bool* pbReverse ) const
+{
+	int iPair = PairIndex( iFromNode, iGoalNode );
+	if( iPair < 0 || m_NextSequence[iPair] == TRANSITION_NONE )
+		return -1;
+
+	DWORD dwNext = m_NextSequence[iPair];
+	if( pbReverse )
+		*pbReverse = ( dwNext & TRANSITION_REVERSE ) != 0;
+	return (int)( dwNext & TRANSITION_SEQUENCE );
+}
+
+
+//--------------------------------------------------------------------------------------
+int CStudioTransitionGraph::GetNextNode( int iFromNode, int iGoalNode ) const
+{
+	int iPair = PairIndex( iFromNode, iGoalNode );
+	if( iPair < 0 || m_NextSequence[iPair] == TRANSITION_NONE )
+		return 0;
+	return m_NextNode[iPair] + 1;
+}
+
+
+//--------------------------------------------------------------------------------------
+int CStudioTransitionGraph::GetNumHops( int iFromNode, int iGoalNode ) const
+{
+	int iPair = PairIndex( iFromNode, iGoalNode );
+	if( iPair < 0 || m_Hops[iPair] == TRANSITION_UNREACHABLE )
+		return -1;
+	return m_Hops[iPair];
+}
+
+
+//--------------------------------------------------------------------------------------
+int CStudioTransitionGraph::FindTransitionSequence( int iCurSequence, int iGoalSequence, bool* pbReverse ) const
+{
+	if( pbReverse )
+		*pbReverse = false;
+
+	if( m_nNodes == 0 || iCurSequence < 0 || iCurSequence >= m_pStudioHdr->GetNumSeq() )
+		return iGoalSequence;
+	if( iGoalSequence < 0 || iGoalSequence >= m_pStudioHdr->GetNumSeq() )
+		return iGoalSequence;
+
+	int iEndNode = m_pStudioHdr->ExitNode( iCurSequence );
+	int iGoalNode = m_pStudioHdr->EntryNode( iGoalSequence );
+	if( iEndNode == 0 || iGoalNode == 0 || iEndNode == iGoalNode )
+		return iGoalSequence;
+
+	return GetNextSequence( iEndNode, iGoalNode, pbReverse );
+}
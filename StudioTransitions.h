@@ -0,0 +1,58 @@
+//--------------------------------------------------------------------------------------
+// File: StudioTransitions.h
+//
+// All-pairs routing over the sequence transition graph. Nodes are the entry and exit
+// nodes of the sequences, each sequence that moves between two nodes is an edge, and
+// a sequence with node flags may also be played backwards. The next sequence for
+// every node pair is found at load time, so routing an instance to a goal node is a
+// single table read. Graphs past TRANSITION_MAX_NODES keep no tables, and every
+// transition then goes straight to the goal sequence.
+//
+//--------------------------------------------------------------------------------------
+#pragma once
+#include "studio.h"
+
+#define TRANSITION_NONE			0xFFFFFFFF	// no route, or already at the goal
+#define TRANSITION_REVERSE		0x80000000	// play the sequence backwards
+#define TRANSITION_SEQUENCE		0x7FFFFFFF	// sequence index bits
+#define TRANSITION_UNREACHABLE	0xFFFF		// hop count of a pair without a route
+#define TRANSITION_MAX_NODES	1024		// the tables grow with the square of the nodes
+
+class CStudioTransitionGraph
+{
+public:
+	HRESULT Init( const studiohdr_t* pStudioHdr );
+	void    Destroy();
+
+	// Nodes are numbered from 1 as in the file, 0 means no node. 0 nodes also when the
+	// graph was too large to route.
+	int     GetNumNodes() const { return m_nNodes; }
+
+	// Sequence to play at iFromNode to get one step closer to iGoalNode, or -1 if the
+	// goal cannot be reached. *pbReverse is set if it has to be played backwards.
+	int     GetNextSequence( int iFromNode, int iGoalNode, bool* pbReverse = NULL ) const;
+	// Node the next sequence ends at, or 0
+	int     GetNextNode( int iFromNode, int iGoalNode ) const;
+	// Number of sequences on the shortest route, -1 if unreachable
+	int     GetNumHops( int iFromNode, int iGoalNode ) const;
+
+	// Sequence to play after iCurSequence on the way to iGoalSequence. Returns the goal
+	// itself when no transition is needed, as the engine does, and -1 if it can't be
+	// reached.
+	int     FindTransitionSequence( int iCurSequence, int iGoalSequence, bool* pbReverse = NULL ) const;
+
+private:
+	struct Edge
+	{
+		int  iTo;
+		DWORD dwSequence;   // with TRANSITION_REVERSE
+	};
+
+	int     PairIndex( int iFromNode, int iGoalNode ) const;
+
+	const studiohdr_t*      m_pStudioHdr;
+	int                     m_nNodes;
+	CGrowableArray< DWORD > m_NextSequence;     // m_nNodes squared, from-major
+	CGrowableArray< WORD >  m_Hops;             // m_nNodes squared
+	CGrowableArray< WORD >  m_NextNode;         // m_nNodes squared, 0-based node of the hop
+};
@@ -0,0 +1,291 @@
+//--------------------------------------------------------------------------------------
+// File: mathlib.h
+//
+// Bone transform helpers working on matrix3x4_t and Quaternion, following the naming
+// of the Source SDK mathlib so code ported from it reads the same.
+//
+//--------------------------------------------------------------------------------------
+#pragma once
+#include "vector.h"
+
+//--------------------------------------------------------------------------------------
+inline float clamp( float val, float minVal, float maxVal )
+{
+	if( val < minVal )
+		return minVal;
+	if( val > maxVal )
+		return maxVal;
+	return val;
+}
+
+//--------------------------------------------------------------------------------------
+inline void SetIdentityMatrix( matrix3x4_t& matrix )
+{
+	memset( matrix.m_flMatVal, 0, sizeof(matrix.m_flMatVal) );
+	matrix[0][0] = 1.0f;
+	matrix[1][1] = 1.0f;
+	matrix[2][2] = 1.0f;
+}
+
+//--------------------------------------------------------------------------------------
+inline void MatrixPosition( const matrix3x4_t& matrix, Vector& position )
+{
+	position.x = matrix[0][3];
+	position.y = matrix[1][3];
+	position.z = matrix[2][3];
+}
+
+//--------------------------------------------------------------------------------------
+inline void PositionMatrix( const Vector& position, matrix3x4_t& matrix )
+{
+	matrix[0][3] = position.x;
+	matrix[1][3] = position.y;
+	matrix[2][3] = position.z;
+}
+
+//--------------------------------------------------------------------------------------
+inline void QuaternionMatrix( const Quaternion& q, const Vector& pos, matrix3x4_t& matrix )
+{
+	matrix[0][0] = 1.0f - 2.0f * q.y * q.y - 2.0f * q.z * q.z;
+	matrix[1][0] = 2.0f * q.x * q.y + 2.0f * q.w * q.z;
+	matrix[2][0] = 2.0f * q.x * q.z - 2.0f * q.w * q.y;
+
+	matrix[0][1] = 2.0f * q.x * q.y - 2.0f * q.w * q.z;
+	matrix[1][1] = 1.0f - 2.0f * q.x * q.x - 2.0f * q.z * q.z;
+	matrix[2][1] = 2.0f * q.y * q.z + 2.0f * q.w * q.x;
+
+	matrix[0][2] = 2.0f * q.x * q.z + 2.0f * q.w * q.y;
+	matrix[1][2] = 2.0f * q.y * q.z - 2.0f * q.w * q.x;
+	matrix[2][2] = 1.0f - 2.0f * q.x * q.x - 2.0f * q.y * q.y;
+
+	PositionMatrix( pos, matrix );
+}
+
+//--------------------------------------------------------------------------------------
+// out = in1 * in2, safe when out aliases either input
+//--------------------------------------------------------------------------------------
+inline void ConcatTransforms( const matrix3x4_t& in1, const matrix3x4_t& in2, matrix3x4_t& out )
+{
+	matrix3x4_t tmp;
+	for( int i=0; i < 3; i++ )
+	{
+		tmp[i][0] = in1[i][0] * in2[0][0] + in1[i][1] * in2[1][0] + in1[i][2] * in2[2][0];
+		tmp[i][1] = in1[i][0] * in2[0][1] + in1[i][1] * in2[1][1] + in1[i][2] * in2[2][1];
+		tmp[i][2] = in1[i][0] * in2[0][2] + in1[i][1] * in2[1][2] + in1[i][2] * in2[2][2];
+		tmp[i][3] = in1[i][0] * in2[0][3] + in1[i][1] * in2[1][3] + in1[i][2] * in2[2][3] + in1[i][3];
+	}
+	out = tmp;
+}
+
+//--------------------------------------------------------------------------------------
+inline void VectorTransform( const Vector& in1, const matrix3x4_t& in2, Vector& out )
+{
+	float x = in1.x * in2[0][0] + in1.y * in2[0][1] + in1.z * in2[0][2] + in2[0][3];
+	float y = in1.x * in2[1][0] + in1.y * in2[1][1] + in1.z * in2[1][2] + in2[1][3];
+	float z = in1.x * in2[2][0] + in1.y * in2[2][1] + in1.z * in2[2][2] + in2[2][3];
+	out.x = x;
+	out.y = y;
+	out.z = z;
+}
+
+//--------------------------------------------------------------------------------------
+inline void VectorRotate( const Vector& in1, const matrix3x4_t& in2, Vector& out )
+{
+	float x = in1.x * in2[0][0] + in1.y * in2[0][1] + in1.z * in2[0][2];
+	float y = in1.x * in2[1][0] + in1.y * in2[1][1] + in1.z * in2[1][2];
+	float z = in1.x * in2[2][0] + in1.y * in2[2][1] + in1.z * in2[2][2];
+	out.x = x;
+	out.y = y;
+	out.z = z;
+}
+
+//--------------------------------------------------------------------------------------
+// in1 rotated by the transpose of in2, i.e. from world back into the bone's frame
+//--------------------------------------------------------------------------------------
+inline void VectorIRotate( const Vector& in1, const matrix3x4_t& in2, Vector& out )
+{
+	float x = in1.x * in2[0][0] + in1.y * in2[1][0] + in1.z * in2[2][0];
+	float y = in1.x * in2[0][1] + in1.y * in2[1][1] + in1.z * in2[2][1];
+	float z = in1.x * in2[0][2] + in1.y * in2[1][2] + in1.z * in2[2][2];
+	out.x = x;
+	out.y = y;
+	out.z = z;
+}
+
+//--------------------------------------------------------------------------------------
+inline float QuaternionDotProduct( const Quaternion& p, const Quaternion& q )
+{
+	return p.x * q.x + p.y * q.y + p.z * q.z + p.w * q.w;
+}
+
+//--------------------------------------------------------------------------------------
+// q flipped if needed so it lies in the same hemisphere as p
+//--------------------------------------------------------------------------------------
+inline void QuaternionAlign( const Quaternion& p, const Quaternion& q, Quaternion& qt )
+{
+	if( QuaternionDotProduct( p, q ) < 0.0f )
+		qt = Quaternion( -q.x, -q.y, -q.z, -q.w );
+	else
+		qt = q;
+}
+
+//--------------------------------------------------------------------------------------
+inline float QuaternionNormalize( Quaternion& q )
+{
+	float radius = sqrtf( QuaternionDotProduct( q, q ) );
+	if( radius )
+	{
+		float iradius = 1.0f / radius;
+		q.x *= iradius;
+		q.y *= iradius;
+		q.z *= iradius;
+		q.w *= iradius;
+	}
+	return radius;
+}
+
+//--------------------------------------------------------------------------------------
+inline void QuaternionSlerpNoAlign( const Quaternion& p, const Quaternion& q, float t, Quaternion& qt )
+{
+	float sclp, sclq;
+	float cosom = QuaternionDotProduct( p, q );
+
+	if( cosom > -0.9999f )
+	{
+		if( cosom < 0.9999f )
+		{
+			float omega = acosf( cosom );
+			float sinom = sinf( omega );
+			sclp = sinf( ( 1.0f - t ) * omega ) / sinom;
+			sclq = sinf( t * omega ) / sinom;
+		}
+		else
+		{
+			// Close enough for a straight line
+			sclp = 1.0f - t;
+			sclq = t;
+		}
+		qt.x = sclp * p.x + sclq * q.x;
+		qt.y = sclp * p.y + sclq * q.y;
+		qt.z = sclp * p.z + sclq * q.z;
+		qt.w = sclp * p.w + sclq * q.w;
+	}
+	else
+	{
+		// Opposite, go through a perpendicular quaternion
+		qt.x = -q.y;
+		qt.y = q.x;
+		qt.z = -q.w;
+		qt.w = q.z;
+		sclp = sinf( ( 1.0f - t ) * ( 0.5f * D3DX_PI ) );
+		sclq = sinf( t * ( 0.5f * D3DX_PI ) );
+		qt.x = sclp * p.x + sclq * qt.x;
+		qt.y = sclp * p.y + sclq * qt.y;
+		qt.z = sclp * p.z + sclq * qt.z;
+	}
+}
+
+//--------------------------------------------------------------------------------------
+inline void QuaternionSlerp( const Quaternion& p, const Quaternion& q, float t, Quaternion& qt )
+{
+	Quaternion q2;
+	QuaternionAlign( p, q, q2 );
+	QuaternionSlerpNoAlign( p, q2, t, qt );
+}
+
+//--------------------------------------------------------------------------------------
+// qt = p * q, rotation q applied first
+//--------------------------------------------------------------------------------------
+inline void QuaternionMult( const Quaternion& p, const Quaternion& q, Quaternion& qt )
+{
+	Quaternion q2;
+	QuaternionAlign( p, q, q2 );
+	float x =  p.x * q2.w + p.y * q2.z - p.z * q2.y + p.w * q2.x;
+	float y = -p.x * q2.z + p.y * q2.w + p.z * q2.x + p.w * q2.y;
+	float z =  p.x * q2.y - p.y * q2.x + p.z * q2.w + p.w * q2.z;
+	float w = -p.x * q2.x - p.y * q2.y - p.z * q2.z + p.w * q2.w;
+	qt = Quaternion( x, y, z, w );
+}
+
+//--------------------------------------------------------------------------------------
+// Angle in radians
+//--------------------------------------------------------------------------------------
+inline void AxisAngleQuaternion( const Vector& axis, float angle, Quaternion& q )
+{
+	float sa = sinf( angle * 0.5f );
+	float ca = cosf( angle * 0.5f );
+	q = Quaternion( axis.x * sa, axis.y * sa, axis.z * sa, ca );
+}
+
+//--------------------------------------------------------------------------------------
+// Rotation part of the matrix as a quaternion, inverse of QuaternionMatrix
+//--------------------------------------------------------------------------------------
+inline void MatrixQuaternion( const matrix3x4_t& matrix, Quaternion& q )
+{
+	float trace = matrix[0][0] + matrix[1][1] + matrix[2][2];
+	if( trace >= 0.0f )
+	{
+		float s = 0.5f / sqrtf( trace + 1.0f );
+		q.x = ( matrix[2][1] - matrix[1][2] ) * s;
+		q.y = ( matrix[0][2] - matrix[2][0] ) * s;
+		q.z = ( matrix[1][0] - matrix[0][1] ) * s;
+		q.w = 0.25f / s;
+	}
+	else if( matrix[0][0] > matrix[1][1] && matrix[0][0] > matrix[2][2] )
+	{
+		float s = 2.0f * sqrtf( 1.0f + matrix[0][0] - matrix[1][1] - matrix[2][2] );
+		q.x = 0.25f * s;
+		q.y = ( matrix[0][1] + matrix[1][0] ) / s;
+		q.z = ( matrix[0][2] + matrix[2][0] ) / s;
+		q.w = ( matrix[2][1] - matrix[1][2] ) / s;
+	}
+	else if( matrix[1][1] > matrix[2][2] )
+	{
+		float s = 2.0f * sqrtf( 1.0f + matrix[1][1] - matrix[0][0] - matrix[2][2] );
+		q.x = ( matrix[0][1] + matrix[1][0] ) / s;
+		q.y = 0.25f * s;
+		q.z = ( matrix[1][2] + matrix[2][1] ) / s;
+		q.w = ( matrix[0][2] - matrix[2][0] ) / s;
+	}
+	else
+	{
+		float s = 2.0f * sqrtf( 1.0f + matrix[2][2] - matrix[0][0] - matrix[1][1] );
+		q.x = ( matrix[0][2] + matrix[2][0] ) / s;
+		q.y = ( matrix[1][2] + matrix[2][1] ) / s;
+		q.z = 0.25f * s;
+		q.w = ( matrix[1][0] - matrix[0][1] ) / s;
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// Euler angles in radians (roll about x, pitch about y, yaw about z)
+//--------------------------------------------------------------------------------------
+inline void AngleQuaternion( const RadianEuler& angles, Quaternion& outQuat )
+{
+	float sy = sinf( angles.z * 0.5f ), cy = cosf( angles.z * 0.5f );
+	float sp = sinf( angles.y * 0.5f ), cp = cosf( angles.y * 0.5f );
+	float sr = sinf( angles.x * 0.5f ), cr = cosf( angles.x * 0.5f );
+
+	float srXcp = sr * cp, crXsp = cr * sp;
+	outQuat.x = srXcp * cy - crXsp * sy;
+	outQuat.y = crXsp * cy + srXcp * sy;
+
+	float crXcp = cr * cp, srXsp = sr * sp;
+	outQuat.z = crXcp * sy - srXsp * cy;
+	outQuat.w = crXcp * cy + srXsp * sy;
+}
+
+//--------------------------------------------------------------------------------------
+// Normalized linear blend, cheaper than a slerp for the small steps between frames
+//--------------------------------------------------------------------------------------
+inline void QuaternionBlend( const Quaternion& p, const Quaternion& q, float t, Quaternion& qt )
+{
+	Quaternion q2;
+	QuaternionAlign( p, q, q2 );
+	float sclp = 1.0f - t;
+	qt.x = sclp * p.x + t * q2.x;
+	qt.y = sclp * p.y + t * q2.y;
+	qt.z = sclp * p.z + t * q2.z;
+	qt.w = sclp * p.w + t * q2.w;
+	QuaternionNormalize( qt );
+}
@@ -0,0 +1,207 @@
+//--------------------------------------------------------------------------------------
+// File: studio.cpp
+//
+// studiohdr_t accessors declared in studio.h.
+//
+// This loader does not resolve include models ($includemodel), so there is never a
+// virtual model and every accessor works on the file local data only.
+//
+//--------------------------------------------------------------------------------------
+#include "DXUT.h"
+#include "studio.h"
+
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+bool studiohdr_t::SequencesAvailable() const
+{
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+int studiohdr_t::GetNumSeq( void ) const
+{
+	return numlocalseq;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+mstudioseqdesc_t &studiohdr_t::pSeqdesc( int i ) const
+{
+	return *pLocalSeqdesc( i );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+mstudioanimdesc_t &studiohdr_t::pAnimdesc( int i ) const
+{
+	return *pLocalAnimdesc( i );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+int studiohdr_t::iRelativeAnim( int baseseq, int relanim ) const
+{
+	return relanim;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+int studiohdr_t::iRelativeSeq( int baseseq, int relseq ) const
+{
+	return relseq;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+int studiohdr_t::RemapSeqBone( int iSequence, int iLocalBone ) const
+{
+	return iLocalBone;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+int studiohdr_t::RemapAnimBone( int iAnim, int iLocalBone ) const
+{
+	return iLocalBone;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+int studiohdr_t::GetNumAttachments( void ) const
+{
+	return numlocalattachments;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+const mstudioattachment_t &studiohdr_t::pAttachment( int i ) const
+{
+	return *pLocalAttachment( i );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+int studiohdr_t::GetAttachmentBone( int i ) const
+{
+	return pAttachment( i ).localbone;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+void studiohdr_t::SetAttachmentBone( int iAttachment, int iBone )
+{
+	pLocalAttachment( iAttachment )->localbone = iBone;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+int studiohdr_t::GetNumPoseParameters( void ) const
+{
+	return numlocalposeparameters;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+const mstudioposeparamdesc_t &studiohdr_t::pPoseParameter( int i ) const
+{
+	return *pLocalPoseParameter( i );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+int studiohdr_t::GetSharedPoseParameter( int iSequence, int iLocalPose ) const
+{
+	return iLocalPose;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+int studiohdr_t::GetSequenceActivity( int iSequence )
+{
+	return pSeqdesc( iSequence ).activity;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+void studiohdr_t::SetSequenceActivity( int iSequence, int iActivity )
+{
+	pSeqdesc( iSequence ).activity = iActivity;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+int studiohdr_t::GetActivityListVersion( void ) const
+{
+	return activitylistversion;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+void studiohdr_t::SetActivityListVersion( int version ) const
+{
+	activitylistversion = version;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: transition node the sequence starts at, 0 if it has none
+//-----------------------------------------------------------------------------
+int studiohdr_t::EntryNode( int iSequence ) const
+{
+	return pSeqdesc( iSequence ).localentrynode;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: transition node the sequence ends at, 0 if it has none
+//-----------------------------------------------------------------------------
+int studiohdr_t::ExitNode( int iSequence ) const
+{
+	return pSeqdesc( iSequence ).localexitnode;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: nodes are numbered from 1
+//-----------------------------------------------------------------------------
+char *studiohdr_t::pszNodeName( int iNode ) const
+{
+	return pszLocalNodeName( iNode - 1 );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: next node on the way from iFrom to iTo, nodes are numbered from 1
+//-----------------------------------------------------------------------------
+int studiohdr_t::GetTransition( int iFrom, int iTo ) const
+{
+	return *pLocalTransition( (iFrom-1)*numlocalnodes + (iTo - 1) );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: animation data stored in the .mdl itself. Data in external .ani
+//			blocks is not loaded, those animations return NULL.
+//-----------------------------------------------------------------------------
+mstudioanim_t *mstudioanimdesc_t::pAnim( void ) const
+{
+	if (animblock == 0)
+		return (mstudioanim_t *)(((byte *)this) + animindex);
+	return NULL;
+}
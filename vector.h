@@ -16,19 +16,29 @@
 typedef float vec_t;
 struct Quaternion48
 {
+	inline operator Quaternion () const
+	{
+		Quaternion tmp;
+		tmp.x = ((int)x - 32768) * (1 / 32768.0f);
+		tmp.y = ((int)y - 32768) * (1 / 32768.0f);
+		tmp.z = ((int)z - 16384) * (1 / 16384.0f);
+		float ww = 1 - tmp.x * tmp.x - tmp.y * tmp.y - tmp.z * tmp.z;
+		tmp.w = ( ww > 0 ) ? sqrtf( ww ) : 0;
+		if (wneg)
+			tmp.w = -tmp.w;
+		return tmp;
+	}
+
 	unsigned short x:16;
 	unsigned short y:16;
 	unsigned short z:15;
 	unsigned short wneg:1;
 };
-class Vector48
-{
-	unsigned short x:16;
-	unsigned short y:16;
-	unsigned short z:16;
-};
 struct matrix3x4_t
 {
+	float *operator[]( int i )				{ Assert(( i >= 0 ) && ( i < 3 )); return m_flMatVal[i]; }
+	const float *operator[]( int i ) const	{ Assert(( i >= 0 ) && ( i < 3 )); return m_flMatVal[i]; }
+
 	float m_flMatVal[3][4];
 };
 
@@ -238,6 +248,19 @@ protected:
 
 	float16bits m_storage;
 };
+
+class Vector48
+{
+public:
+	inline operator Vector () const
+	{
+		return Vector( x.GetFloat(), y.GetFloat(), z.GetFloat() );
+	}
+
+	float16 x;
+	float16 y;
+	float16 z;
+};
 //class Vector4D					
 //{
 //public: